@@ -0,0 +1,504 @@
+/** \file       AsyncDatReader.cpp
+ *  \brief      Contains the definition of the asynchronous .dat entry reader.
+ *  \author     agent
+ */
+
+/**
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of Gw2Browser.
+ *
+ * Gw2Browser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stdafx.h"
+
+#include <algorithm>
+
+#ifdef GW2B_HAVE_LIBURING
+#include <cerrno>
+#include <liburing.h>
+#endif
+
+#include "DatFile.h"
+
+#include "AsyncDatReader.h"
+
+namespace gw2b {
+
+    /** A read going through io_uring. */
+    struct AsyncDatReader::Request {
+        uint            entryNum;
+        uint64          offset;         // position of the raw data in the .dat
+        uint            size;           // size of the raw data
+        uint            done;           // bytes read so far
+        Array<byte>     input;
+        ReadCallback    callback;
+        Priority        priority;
+    };
+
+    struct AsyncDatReader::Ring {
+#ifdef GW2B_HAVE_LIBURING
+        io_uring        ring;
+        std::mutex      submitMutex;    // the submission queue has a single producer
+        std::thread     reaper;
+#endif
+    };
+
+    namespace {
+
+        /** Amount of raw data readEntries hands to a worker at a time. */
+        const uint64 BatchChunkSize = 16 * 1024 * 1024;
+
+        /** How many jobs of more urgent classes may be taken while a job of each
+        *   class waits, before it gets a turn anyway. */
+        const uint FairnessLimits[AsyncDatReader::RP_Count] = { 0, 4, 16, 16 };
+
+        /** Reader whose worker the current thread is, if any. */
+        thread_local const AsyncDatReader* t_workerOf = nullptr;
+
+    }; // anon namespace
+
+    AsyncDatReader::AsyncDatReader( const DatFile& p_datFile, uint p_numThreads, uint p_maxPending )
+        : m_datFile( p_datFile )
+        , m_maxPending( wxMax( p_maxPending, 1u ) )
+        , m_numBackgroundBusy( 0 )
+        , m_stopping( false ) {
+        if ( !p_numThreads ) {
+            p_numThreads = wxMax( std::thread::hardware_concurrency( ), 1u );
+        }
+        m_numWorkers = p_numThreads;
+        for ( uint i = 0; i < RP_Count; i++ ) {
+            m_numPending[i] = 0;
+            m_numPassedOver[i] = 0;
+        }
+
+#ifdef GW2B_HAVE_LIBURING
+        // Every pending read fits the ring at once, so it never runs out of entries
+        m_ring.reset( new Ring );
+        if ( ::io_uring_queue_init( m_maxPending * RP_Count, &m_ring->ring, 0 ) == 0 ) {
+            m_ring->reaper = std::thread( &AsyncDatReader::reaperLoop, this );
+        } else {
+            wxLogMessage( wxT( "io_uring is not available, reading through worker threads." ) );
+            m_ring.reset( );
+        }
+#endif
+
+        for ( uint i = 0; i < p_numThreads; i++ ) {
+            m_workers.emplace_back( &AsyncDatReader::workerLoop, this );
+        }
+    }
+
+    AsyncDatReader::~AsyncDatReader( ) {
+        this->wait( );
+
+#ifdef GW2B_HAVE_LIBURING
+        if ( m_ring ) {
+            // A completion without a request tells the reaper to stop
+            {
+                std::lock_guard<std::mutex> lock( m_ring->submitMutex );
+                auto sqe = ::io_uring_get_sqe( &m_ring->ring );
+                ::io_uring_prep_nop( sqe );
+                ::io_uring_sqe_set_data( sqe, nullptr );
+                ::io_uring_submit( &m_ring->ring );
+            }
+            m_ring->reaper.join( );
+            ::io_uring_queue_exit( &m_ring->ring );
+        }
+#endif
+
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_stopping = true;
+        }
+        m_jobAdded.notify_all( );
+        for ( auto& worker : m_workers ) {
+            worker.join( );
+        }
+    }
+
+    AsyncDatReader::Backend AsyncDatReader::backend( ) const {
+        // Reads from a mapped .dat are plain memory copies, io_uring gains nothing there
+        return ( m_ring && m_datFile.readBackend( ) == DatFile::RB_File ) ? AB_IoUring : AB_ThreadPool;
+    }
+
+    void AsyncDatReader::readEntry( uint p_entryNum, ReadCallback p_callback, Priority p_priority ) {
+        this->beginRequest( p_priority );
+
+        if ( this->backend( ) == AB_IoUring && !m_datFile.cache( ).contains( p_entryNum ) ) {
+            std::unique_ptr<Request> request( new Request );
+            request->entryNum = p_entryNum;
+            request->done = 0;
+            request->callback = p_callback;
+            request->priority = p_priority;
+            if ( m_datFile.entryLocation( p_entryNum, request->offset, request->size ) ) {
+                request->input.SetSize( request->size );
+                if ( this->submitRead( request ) ) {
+                    return;
+                }
+            }
+        }
+
+        this->post( [this, p_entryNum, p_callback, p_priority] ( bool p_isCancelled ) {
+            p_callback( p_entryNum, p_isCancelled ? Array<byte>( ) : m_datFile.readEntry( p_entryNum ) );
+            this->endRequest( p_priority );
+        }, p_priority );
+    }
+
+    void AsyncDatReader::readFile( uint p_fileNum, ReadCallback p_callback, Priority p_priority ) {
+        this->readEntry( p_fileNum + m_datFile.mftFileOffset( ), p_callback, p_priority );
+    }
+
+    std::future<Array<byte>> AsyncDatReader::readEntry( uint p_entryNum, Priority p_priority ) {
+        auto promise = std::make_shared<std::promise<Array<byte>>>( );
+        auto future = promise->get_future( );
+        this->readEntry( p_entryNum, [promise] ( uint, Array<byte> p_data ) {
+            promise->set_value( std::move( p_data ) );
+        }, p_priority );
+        return future;
+    }
+
+    std::future<Array<byte>> AsyncDatReader::readFile( uint p_fileNum, Priority p_priority ) {
+        return this->readEntry( p_fileNum + m_datFile.mftFileOffset( ), p_priority );
+    }
+
+    void AsyncDatReader::peekEntry( uint p_entryNum, uint p_peekSize, ReadCallback p_callback, Priority p_priority ) {
+        // Peeks read little and decide how much to read as they go, so they
+        // always go through DatFile
+        this->beginRequest( p_priority );
+        this->post( [this, p_entryNum, p_peekSize, p_callback, p_priority] ( bool p_isCancelled ) {
+            p_callback( p_entryNum, p_isCancelled ? Array<byte>( ) : m_datFile.peekEntry( p_entryNum, p_peekSize ) );
+            this->endRequest( p_priority );
+        }, p_priority );
+    }
+
+    void AsyncDatReader::peekFile( uint p_fileNum, uint p_peekSize, ReadCallback p_callback, Priority p_priority ) {
+        this->peekEntry( p_fileNum + m_datFile.mftFileOffset( ), p_peekSize, p_callback, p_priority );
+    }
+
+    std::future<Array<byte>> AsyncDatReader::peekEntry( uint p_entryNum, uint p_peekSize, Priority p_priority ) {
+        auto promise = std::make_shared<std::promise<Array<byte>>>( );
+        auto future = promise->get_future( );
+        this->peekEntry( p_entryNum, p_peekSize, [promise] ( uint, Array<byte> p_data ) {
+            promise->set_value( std::move( p_data ) );
+        }, p_priority );
+        return future;
+    }
+
+    std::future<Array<byte>> AsyncDatReader::peekFile( uint p_fileNum, uint p_peekSize, Priority p_priority ) {
+        return this->peekEntry( p_fileNum + m_datFile.mftFileOffset( ), p_peekSize, p_priority );
+    }
+
+    void AsyncDatReader::streamEntry( uint p_entryNum, StreamCallback p_callback, StreamDoneCallback p_done, Priority p_priority ) {
+        // Streams inflate as they read, so they always go through DatFile
+        this->beginRequest( p_priority );
+        this->post( [this, p_entryNum, p_callback, p_done, p_priority] ( bool p_isCancelled ) {
+            p_done( !p_isCancelled && m_datFile.streamEntry( p_entryNum, p_callback ) );
+            this->endRequest( p_priority );
+        }, p_priority );
+    }
+
+    void AsyncDatReader::streamFile( uint p_fileNum, StreamCallback p_callback, StreamDoneCallback p_done, Priority p_priority ) {
+        this->streamEntry( p_fileNum + m_datFile.mftFileOffset( ), p_callback, p_done, p_priority );
+    }
+
+    bool AsyncDatReader::prefetchFile( uint p_fileNum ) {
+        if ( !this->tryBeginRequest( RP_Prefetch ) ) {
+            return false;
+        }
+        // Reading through DatFile leaves the entry in its cache
+        uint entryNum = p_fileNum + m_datFile.mftFileOffset( );
+        this->post( [this, entryNum] ( bool p_isCancelled ) {
+            if ( !p_isCancelled ) {
+                m_datFile.readEntry( entryNum );
+            }
+            this->endRequest( RP_Prefetch );
+        }, RP_Prefetch );
+        return true;
+    }
+
+    void AsyncDatReader::readEntries( const uint* p_entries, size_t p_count, BatchCallback p_callback, Priority p_priority ) {
+        struct Request {
+            uint64  offset;
+            uint    size;
+            size_t  index;
+        };
+
+        // Sort here as well, so every chunk covers a stretch of the .dat and
+        // the chunks are handed out in .dat order. Entries that can not be
+        // located go last, DatFile deals with them.
+        std::vector<Request> requests( p_count );
+        for ( size_t i = 0; i < p_count; i++ ) {
+            requests[i].index = i;
+            if ( !m_datFile.entryLocation( p_entries[i], requests[i].offset, requests[i].size ) ) {
+                requests[i].offset = std::numeric_limits<uint64>::max( );
+                requests[i].size = 0;
+            }
+        }
+        std::stable_sort( requests.begin( ), requests.end( ), [] ( const Request& p_a, const Request& p_b ) {
+            return p_a.offset < p_b.offset;
+        } );
+
+        for ( size_t first = 0; first < requests.size( ); ) {
+            uint64 chunkSize = 0;
+            size_t last = first;
+            while ( last < requests.size( ) && ( last == first || chunkSize + requests[last].size <= BatchChunkSize ) ) {
+                chunkSize += requests[last].size;
+                last++;
+            }
+
+            auto entries = std::make_shared<std::vector<uint>>( );
+            auto indices = std::make_shared<std::vector<size_t>>( );
+            for ( size_t i = first; i < last; i++ ) {
+                entries->push_back( p_entries[requests[i].index] );
+                indices->push_back( requests[i].index );
+            }
+
+            this->beginRequest( p_priority );
+            this->post( [this, entries, indices, p_callback, p_priority] ( bool p_isCancelled ) {
+                if ( p_isCancelled ) {
+                    for ( size_t i = 0; i < indices->size( ) && p_callback( ( *indices )[i], Array<byte>( ) ); i++ ) {
+                    }
+                    this->endRequest( p_priority );
+                    return;
+                }
+                m_datFile.readEntries( entries->data( ), entries->size( ), [&] ( size_t p_index, Array<byte> p_data ) {
+                    return p_callback( ( *indices )[p_index], std::move( p_data ) );
+                } );
+                this->endRequest( p_priority );
+            }, p_priority );
+            first = last;
+        }
+    }
+
+    void AsyncDatReader::readFiles( const uint* p_files, size_t p_count, BatchCallback p_callback, Priority p_priority ) {
+        std::vector<uint> entries( p_files, p_files + p_count );
+        for ( auto& entry : entries ) {
+            entry += m_datFile.mftFileOffset( );
+        }
+        this->readEntries( entries.data( ), entries.size( ), p_callback, p_priority );
+    }
+
+    uint AsyncDatReader::numPending( ) const {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        uint numPending = 0;
+        for ( uint i = 0; i < RP_Count; i++ ) {
+            numPending += m_numPending[i];
+        }
+        return numPending;
+    }
+
+    uint AsyncDatReader::numPending( Priority p_priority ) const {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_numPending[p_priority];
+    }
+
+    void AsyncDatReader::cancel( Priority p_priority ) {
+        std::deque<Job> jobs;
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            jobs.swap( m_jobs[p_priority] );
+            m_numPassedOver[p_priority] = 0;
+        }
+        for ( auto& job : jobs ) {
+            job( true );
+        }
+    }
+
+    void AsyncDatReader::wait( ) {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        m_requestDone.wait( lock, [this] ( ) {
+            return std::all_of( m_numPending, m_numPending + RP_Count, [] ( uint p_count ) { return p_count == 0; } );
+        } );
+    }
+
+    void AsyncDatReader::beginRequest( Priority p_priority ) {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        // Callbacks requesting more reads would deadlock if they had to wait
+        // for a worker to free up, so they are let through. Every class has a
+        // limit of its own, so a full export never holds up a preview here.
+        if ( t_workerOf != this ) {
+            m_requestDone.wait( lock, [this, p_priority] ( ) { return m_numPending[p_priority] < m_maxPending; } );
+        }
+        m_numPending[p_priority]++;
+    }
+
+    bool AsyncDatReader::tryBeginRequest( Priority p_priority ) {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if ( m_numPending[p_priority] >= m_maxPending ) {
+            return false;
+        }
+        m_numPending[p_priority]++;
+        return true;
+    }
+
+    void AsyncDatReader::endRequest( Priority p_priority ) {
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_numPending[p_priority]--;
+        }
+        m_requestDone.notify_all( );
+    }
+
+    void AsyncDatReader::post( Job p_job, Priority p_priority ) {
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_jobs[p_priority].push_back( std::move( p_job ) );
+        }
+        m_jobAdded.notify_one( );
+    }
+
+    bool AsyncDatReader::pickJob( Priority& po_priority ) {
+        // The last free worker is kept for previews and prefetches, as
+        // background jobs can take long to decode
+        bool backgroundAllowed = m_numWorkers < 2 || m_numBackgroundBusy + 1 < m_numWorkers;
+
+        int picked = -1;
+        for ( int i = 0; i < RP_Count; i++ ) {
+            if ( m_jobs[i].empty( ) || ( i >= RP_Scan && !backgroundAllowed ) ) {
+                continue;
+            }
+            // Take the most urgent job, unless a less urgent one waited long enough
+            if ( picked < 0 || m_numPassedOver[i] >= FairnessLimits[i] ) {
+                picked = i;
+                if ( m_numPassedOver[i] >= FairnessLimits[i] && i > 0 ) {
+                    break;
+                }
+            }
+        }
+        if ( picked < 0 ) {
+            return false;
+        }
+
+        for ( int i = 0; i < RP_Count; i++ ) {
+            if ( i == picked || m_jobs[i].empty( ) ) {
+                m_numPassedOver[i] = 0;
+            } else if ( i > picked ) {
+                m_numPassedOver[i]++;
+            }
+        }
+        po_priority = static_cast<Priority>( picked );
+        return true;
+    }
+
+    void AsyncDatReader::workerLoop( ) {
+        t_workerOf = this;
+
+        for ( ;; ) {
+            Job job;
+            Priority priority;
+            {
+                std::unique_lock<std::mutex> lock( m_mutex );
+                bool picked = false;
+                m_jobAdded.wait( lock, [this, &picked, &priority] ( ) {
+                    picked = this->pickJob( priority );
+                    return picked || ( m_stopping && std::all_of( m_jobs, m_jobs + RP_Count, [] ( const std::deque<Job>& p_jobs ) {
+                        return p_jobs.empty( );
+                    } ) );
+                } );
+                if ( !picked ) {
+                    return;
+                }
+                job = std::move( m_jobs[priority].front( ) );
+                m_jobs[priority].pop_front( );
+                if ( priority >= RP_Scan ) {
+                    m_numBackgroundBusy++;
+                }
+            }
+            job( false );
+
+            // A background job held back for lack of workers may go now
+            if ( priority >= RP_Scan ) {
+                {
+                    std::lock_guard<std::mutex> lock( m_mutex );
+                    m_numBackgroundBusy--;
+                }
+                m_jobAdded.notify_all( );
+            }
+        }
+    }
+
+    bool AsyncDatReader::submitRead( std::unique_ptr<Request>& p_request ) {
+#ifdef GW2B_HAVE_LIBURING
+        std::lock_guard<std::mutex> lock( m_ring->submitMutex );
+
+        auto sqe = ::io_uring_get_sqe( &m_ring->ring );
+        if ( !sqe ) {
+            return false;
+        }
+
+        auto& request = *p_request;
+        ::io_uring_prep_read( sqe, m_datFile.fileDescriptor( ), request.input.GetPointer( ) + request.done,
+            request.size - request.done, request.offset + request.done );
+        ::io_uring_sqe_set_data( sqe, p_request.release( ) );
+
+        // The entry is queued now, so it has to be submitted one way or another
+        int result;
+        while ( ( result = ::io_uring_submit( &m_ring->ring ) ) == -EINTR || result == -EAGAIN || result == -EBUSY ) {
+            std::this_thread::yield( );
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void AsyncDatReader::reaperLoop( ) {
+#ifdef GW2B_HAVE_LIBURING
+        for ( ;; ) {
+            io_uring_cqe* cqe;
+            int result = ::io_uring_wait_cqe( &m_ring->ring, &cqe );
+            if ( result == -EINTR ) {
+                continue;
+            }
+            if ( result < 0 ) {
+                wxLogMessage( wxT( "Waiting on io_uring failed: %d" ), result );
+                return;
+            }
+
+            std::unique_ptr<Request> request( static_cast<Request*>( ::io_uring_cqe_get_data( cqe ) ) );
+            int bytesRead = cqe->res;
+            ::io_uring_cqe_seen( &m_ring->ring, cqe );
+
+            if ( !request ) {
+                return;
+            }
+
+            // Short reads carry on where they left off
+            if ( bytesRead > 0 ) {
+                request->done += bytesRead;
+                if ( request->done < request->size && this->submitRead( request ) ) {
+                    continue;
+                }
+            }
+
+            // Decode on a worker. If io_uring failed, the worker reads it again
+            // through DatFile.
+            std::shared_ptr<Request> shared( std::move( request ) );
+            this->post( [this, shared] ( bool p_isCancelled ) {
+                auto& request = *shared;
+                if ( p_isCancelled ) {
+                    request.callback( request.entryNum, Array<byte>( ) );
+                } else if ( request.done == request.size ) {
+                    request.callback( request.entryNum, m_datFile.decodeEntry( request.entryNum, request.input.GetPointer( ), request.size ) );
+                } else {
+                    request.callback( request.entryNum, m_datFile.readEntry( request.entryNum ) );
+                }
+                this->endRequest( request.priority );
+            }, shared->priority );
+        }
+#endif
+    }
+
+}; // namespace gw2b
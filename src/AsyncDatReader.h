@@ -0,0 +1,252 @@
+/** \file       AsyncDatReader.h
+ *  \brief      Contains the declaration of the asynchronous .dat entry reader.
+ *  \author     agent
+ */
+
+/**
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of Gw2Browser.
+ *
+ * Gw2Browser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifndef ASYNCDATREADER_H_INCLUDED
+#define ASYNCDATREADER_H_INCLUDED
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace gw2b {
+    class DatFile;
+
+    /** Reads entries of a DatFile in the background, with many reads in flight
+    *   at once. When built with liburing, the raw entry data is read through
+    *   io_uring and decoded on a pool of worker threads. Otherwise, or when the
+    *   .dat is memory mapped, the workers read the entries themselves.
+    *   Every read has a priority class, with a queue of its own. Workers take
+    *   the most urgent job first, but a class passed over more often than its
+    *   fairness limit gets the next turn. Scan and export jobs are never given
+    *   the last free worker, and every class has its own limit of pending
+    *   reads, so previews do not wait behind background work. Reads still
+    *   queued can be cancelled once nobody waits for them anymore, and
+    *   prefetches are dropped rather than waited on, so the UI thread never
+    *   blocks on a full class.
+    *   The DatFile must stay open while reads are pending. Reads can be
+    *   requested from any thread. */
+    class AsyncDatReader {
+    public:
+        /** Called once a read completed, on one of the worker threads, or on
+        *   the thread that cancelled it. UI code should hand the data over to
+        *   the main thread, e.g. with CallAfter.
+        *  \param[in]  p_entryNum   MFT entry number that was read.
+        *  \param[in]  p_data       Data of the entry, empty if the read failed. */
+        typedef std::function<void( uint p_entryNum, Array<byte> p_data )> ReadCallback;
+        /** Called once an entry of a batch was read, on one of the worker threads.
+        *  \param[in]  p_index  Position of the entry in the list given to readEntries.
+        *  \param[in]  p_data   Data of the entry, empty if the read failed.
+        *  \return bool    true to carry on, false to skip the rest of the
+        *                  stretch this entry was read with. */
+        typedef std::function<bool( size_t p_index, Array<byte> p_data )> BatchCallback;
+        /** Called with each part of a streamed entry, in order, on one of the
+        *   worker threads.
+        *  \param[in]  p_data   Part of the entry.
+        *  \param[in]  p_size   Size of the part.
+        *  \return bool    true to carry on reading, false to stop. */
+        typedef std::function<bool( const byte* p_data, uint p_size )> StreamCallback;
+        /** Called once a streamed read ended, on one of the worker threads, or
+        *   on the thread that cancelled it.
+        *  \param[in]  p_isComplete true if all of the entry was streamed, false
+        *                           if reading failed, the stream callback
+        *                           stopped it or it was cancelled. */
+        typedef std::function<void( bool p_isComplete )> StreamDoneCallback;
+
+        /** Priority classes of reads, most urgent first. */
+        enum Priority {
+            RP_Preview,     /**< Entries the user is waiting on, such as the one clicked. */
+            RP_Prefetch,    /**< Entries the user is likely to want next. */
+            RP_Scan,        /**< Reads of a scan or reindex of the .dat. */
+            RP_Export,      /**< Bulk reads, such as exports. */
+            RP_Count,
+        };
+
+        /** Ways of getting the entry data out of the .dat file. */
+        enum Backend {
+            AB_ThreadPool,  /**< Workers read the entries through DatFile. */
+            AB_IoUring,     /**< io_uring reads the raw data, workers decode it. */
+        };
+    private:
+        struct Request;
+        struct Ring;
+        /** A queued read. Called with true if it was cancelled, it then only
+        *   completes the request, with empty data. */
+        typedef std::function<void( bool p_isCancelled )>  Job;
+    private:
+        const DatFile&              m_datFile;
+        std::vector<std::thread>    m_workers;
+        uint                        m_numWorkers;
+        std::deque<Job>             m_jobs[RP_Count];
+        mutable std::mutex          m_mutex;
+        std::condition_variable     m_jobAdded;
+        std::condition_variable     m_requestDone;
+        uint                        m_maxPending;
+        uint                        m_numPending[RP_Count];
+        uint                        m_numPassedOver[RP_Count];
+        uint                        m_numBackgroundBusy;
+        bool                        m_stopping;
+        std::unique_ptr<Ring>       m_ring;
+    public:
+        /** Constructor. Starts the worker threads.
+        *  \param[in]  p_datFile        .dat file to read entries from.
+        *  \param[in]  p_numThreads     Amount of worker threads, 0 for one per
+        *                               hardware thread.
+        *  \param[in]  p_maxPending     Maximum amount of reads of each priority class
+        *                               pending at once. Requesting more blocks until
+        *                               one of the same class completes. */
+        AsyncDatReader( const DatFile& p_datFile, uint p_numThreads = 0, uint p_maxPending = 64 );
+        /** Destructor. Waits for the pending reads, then stops the workers. */
+        ~AsyncDatReader( );
+
+        /** Gets the backend used for reads requested now.
+        *  \return Backend  Backend in use. */
+        Backend backend( ) const;
+
+        /** Reads the given MFT entry in the background.
+        *  \param[in]  p_entryNum   MFT entry number to read.
+        *  \param[in]  p_callback   Called with the data once read.
+        *  \param[in]  p_priority   Priority class of the read. */
+        void readEntry( uint p_entryNum, ReadCallback p_callback, Priority p_priority = RP_Preview );
+        /** Reads the given MFT file entry in the background.
+        *  \param[in]  p_fileNum    MFT file entry number to read.
+        *  \param[in]  p_callback   Called with the data once read.
+        *  \param[in]  p_priority   Priority class of the read. */
+        void readFile( uint p_fileNum, ReadCallback p_callback, Priority p_priority = RP_Preview );
+        /** Reads the given MFT entry in the background.
+        *  \param[in]  p_entryNum   MFT entry number to read.
+        *  \param[in]  p_priority   Priority class of the read.
+        *  \return std::future<Array<byte>>    Data of the entry, once read. */
+        std::future<Array<byte>> readEntry( uint p_entryNum, Priority p_priority = RP_Preview );
+        /** Reads the given MFT file entry in the background.
+        *  \param[in]  p_fileNum    MFT file entry number to read.
+        *  \param[in]  p_priority   Priority class of the read.
+        *  \return std::future<Array<byte>>    Data of the file, once read. */
+        std::future<Array<byte>> readFile( uint p_fileNum, Priority p_priority = RP_Preview );
+        /** Peeks at the start of the given MFT entry in the background.
+        *  \param[in]  p_entryNum   MFT entry number to peek at.
+        *  \param[in]  p_peekSize   Amount of bytes to peek at.
+        *  \param[in]  p_callback   Called with the data once read.
+        *  \param[in]  p_priority   Priority class of the read. */
+        void peekEntry( uint p_entryNum, uint p_peekSize, ReadCallback p_callback, Priority p_priority = RP_Preview );
+        /** Peeks at the start of the given MFT file entry in the background.
+        *  \param[in]  p_fileNum    MFT file entry number to peek at.
+        *  \param[in]  p_peekSize   Amount of bytes to peek at.
+        *  \param[in]  p_callback   Called with the data once read.
+        *  \param[in]  p_priority   Priority class of the read. */
+        void peekFile( uint p_fileNum, uint p_peekSize, ReadCallback p_callback, Priority p_priority = RP_Preview );
+        /** Peeks at the start of the given MFT entry in the background.
+        *  \param[in]  p_entryNum   MFT entry number to peek at.
+        *  \param[in]  p_peekSize   Amount of bytes to peek at.
+        *  \param[in]  p_priority   Priority class of the read.
+        *  \return std::future<Array<byte>>    Start of the entry, once read. */
+        std::future<Array<byte>> peekEntry( uint p_entryNum, uint p_peekSize, Priority p_priority = RP_Preview );
+        /** Peeks at the start of the given MFT file entry in the background.
+        *  \param[in]  p_fileNum    MFT file entry number to peek at.
+        *  \param[in]  p_peekSize   Amount of bytes to peek at.
+        *  \param[in]  p_priority   Priority class of the read.
+        *  \return std::future<Array<byte>>    Start of the file, once read. */
+        std::future<Array<byte>> peekFile( uint p_fileNum, uint p_peekSize, Priority p_priority = RP_Preview );
+
+        /** Reads the given MFT entry a part at a time in the background, with
+        *   DatFile::streamEntry. Memory use stays the same whatever the size
+        *   of the entry, and the entry cache is bypassed, so it suits reading
+        *   many entries only once, such as hashing them.
+        *  \param[in]  p_entryNum   MFT entry number to read.
+        *  \param[in]  p_callback   Called with each part of the entry.
+        *  \param[in]  p_done       Called once the read ended.
+        *  \param[in]  p_priority   Priority class of the read. */
+        void streamEntry( uint p_entryNum, StreamCallback p_callback, StreamDoneCallback p_done, Priority p_priority = RP_Export );
+        /** Reads the given MFT file entry a part at a time in the background,
+        *   like streamEntry.
+        *  \param[in]  p_fileNum    MFT file entry number to read.
+        *  \param[in]  p_callback   Called with each part of the file.
+        *  \param[in]  p_done       Called once the read ended.
+        *  \param[in]  p_priority   Priority class of the read. */
+        void streamFile( uint p_fileNum, StreamCallback p_callback, StreamDoneCallback p_done, Priority p_priority = RP_Export );
+
+        /** Reads the given MFT file entry into the cache of the DatFile, as a
+        *   prefetch. Never blocks: when the prefetch class is full, the read
+        *   is dropped.
+        *  \param[in]  p_fileNum    MFT file entry number to read.
+        *  \return bool    true if the read was queued, false if dropped. */
+        bool prefetchFile( uint p_fileNum );
+
+        /** Reads the given MFT entries in the background, in the order they are
+        *   stored in the .dat. The entries are split into stretches of the .dat
+        *   that the workers read with DatFile::readEntries, in .dat order.
+        *  \param[in]  p_entries    MFT entry numbers to read. Copied, so it does
+        *                           not need to outlive the call.
+        *  \param[in]  p_count      Amount of entry numbers in p_entries.
+        *  \param[in]  p_callback   Called with each entry once read.
+        *  \param[in]  p_priority   Priority class of the reads. */
+        void readEntries( const uint* p_entries, size_t p_count, BatchCallback p_callback, Priority p_priority = RP_Export );
+        /** Reads the given MFT file entries in the background, in .dat order.
+        *  \param[in]  p_files      MFT file entry numbers to read.
+        *  \param[in]  p_count      Amount of file entry numbers in p_files.
+        *  \param[in]  p_callback   Called with each file once read.
+        *  \param[in]  p_priority   Priority class of the reads. */
+        void readFiles( const uint* p_files, size_t p_count, BatchCallback p_callback, Priority p_priority = RP_Export );
+
+        /** Gets the amount of reads requested but not completed yet.
+        *  \return uint    Amount of pending reads. */
+        uint numPending( ) const;
+        /** Gets the amount of reads of the given priority class requested but
+        *   not completed yet.
+        *  \param[in]  p_priority   Priority class to count.
+        *  \return uint    Amount of pending reads. */
+        uint numPending( Priority p_priority ) const;
+        /** Cancels the reads of the given priority class that no worker took
+        *   yet, such as previews of entries the user moved on from. Their
+        *   callbacks are called on this thread, with empty data. Reads being
+        *   done by a worker or io_uring already still complete.
+        *  \param[in]  p_priority   Priority class to cancel the queued reads of. */
+        void cancel( Priority p_priority );
+        /** Blocks until all pending reads completed. */
+        void wait( );
+
+    private:
+        AsyncDatReader( const AsyncDatReader& );
+        AsyncDatReader& operator=( const AsyncDatReader& );
+
+        void beginRequest( Priority p_priority );
+        bool tryBeginRequest( Priority p_priority );
+        void endRequest( Priority p_priority );
+        void post( Job p_job, Priority p_priority );
+        bool pickJob( Priority& po_priority );
+        void workerLoop( );
+        bool submitRead( std::unique_ptr<Request>& p_request );
+        void reaperLoop( );
+
+    }; // class AsyncDatReader
+
+}; // namespace gw2b
+
+#endif // ASYNCDATREADER_H_INCLUDED
@@ -40,6 +40,7 @@
 #include "PreviewPanel.h"
 #include "PreviewGLCanvas.h"
 
+#include "Tasks/HashDatTask.h"
 #include "Tasks/ReadIndexTask.h"
 #include "Tasks/ScanDatTask.h"
 #include "Tasks/WriteIndexTask.h"
@@ -48,18 +49,40 @@
 
 namespace gw2b {
 
+    namespace {
+
+        /** How often the UI commits and shows the progress of the current task, in milliseconds. */
+        const int TaskPollInterval = 50;
+        /** Amount of entries after the viewed one that are read into the cache,
+        *   as the user often steps through a category entry by entry. */
+        const uint NumPrefetchedEntries = 2;
+
+    }; // anon namespace
+
     BrowserWindow::BrowserWindow( const wxString& p_title, const wxSize p_size )
         : wxFrame( nullptr, wxID_ANY, p_title, wxDefaultPosition, p_size )
+        , m_asyncReader( m_datFile )
+        , m_viewRequest( 0 )
         , m_index( std::make_shared<DatIndex>( ) )
         , m_progress( nullptr )
         , m_currentTask( nullptr )
+        , m_taskStopping( false )
+        , m_taskFinished( false )
+        , m_taskTimer( nullptr )
         , m_catTree( nullptr )
         , m_previewPanel( nullptr )
         , m_previewGLCanvas( nullptr ) {
         // Initializes all available image handlers
         wxInitAllImageHandlers( );
+        // Keep recently viewed entries around, browsing tends to revisit them
+        m_datFile.setCacheBudget( 256 * 1024 * 1024 );
+        // Previews jump all over the .dat, readahead would only waste I/O
+        m_datFile.setIoPolicy( DatFile::IP_Random );
         // Notify wxAUI which frame to use
         m_uiManager.SetManagedWindow( this );
+        // Tasks run in the background, the UI only polls them
+        m_taskTimer = new wxTimer( this );
+        this->Bind( wxEVT_TIMER, &BrowserWindow::onTaskTimerEvt, this, m_taskTimer->GetId( ) );
 
         auto menuBar = new wxMenuBar;
 
@@ -207,7 +230,8 @@ namespace gw2b {
     //============================================================================/
 
     BrowserWindow::~BrowserWindow( ) {
-        deletePointer( m_currentTask );
+        this->abortTask( );
+        deletePointer( m_taskTimer );
         deletePointer( m_logTarget );
         // Deinitialize the frame manager
         m_uiManager.UnInit( );
@@ -221,9 +245,7 @@ namespace gw2b {
         // Already have a task running?
         if ( m_currentTask ) {
             if ( m_currentTask->canAbort( ) ) {
-                m_currentTask->abort( );
-                deletePointer( m_currentTask );
-                this->Unbind( wxEVT_IDLE, &BrowserWindow::onPerformTaskEvt, this );
+                this->abortTask( );
                 m_progress->hideProgressBar( );
             } else {
                 deletePointer( p_task );
@@ -238,7 +260,16 @@ namespace gw2b {
             return false;
         }
 
-        this->Bind( wxEVT_IDLE, &BrowserWindow::onPerformTaskEvt, this );
+        m_taskStopping = false;
+        m_taskFinished = false;
+        m_taskThread = std::thread( [this, p_task] ( ) {
+            while ( !m_taskStopping && !p_task->isDone( ) ) {
+                p_task->perform( );
+            }
+            m_taskFinished = true;
+        } );
+
+        m_taskTimer->Start( TaskPollInterval );
         m_progress->setMaxValue( m_currentTask->maxProgress( ) );
         m_progress->showProgressBar( );
         return true;
@@ -246,7 +277,42 @@ namespace gw2b {
 
     //============================================================================/
 
+    void BrowserWindow::abortTask( ) {
+        if ( !m_currentTask ) {
+            return;
+        }
+
+        m_taskTimer->Stop( );
+        // Tasks that cannot be aborted are left to finish
+        if ( m_currentTask->canAbort( ) ) {
+            m_taskStopping = true;
+            m_currentTask->abort( );
+        }
+        if ( m_taskThread.joinable( ) ) {
+            m_taskThread.join( );
+        }
+        deletePointer( m_currentTask );
+    }
+
+    //============================================================================/
+
     void BrowserWindow::openFile( const wxString& p_path ) {
+        // The current task reads the open .dat and the index on its own thread,
+        // so it has to be gone before either changes
+        if ( m_currentTask ) {
+            if ( !m_currentTask->canAbort( ) ) {
+                auto path = p_path;
+                m_currentTask->addOnCompleteHandler( [this, path] ( ) { this->openFile( path ); } );
+                return;
+            }
+            this->abortTask( );
+            m_progress->hideProgressBar( );
+        }
+
+        // Reads still in flight use the old file, and their entries are going away
+        m_asyncReader.wait( );
+        m_viewRequest++;
+
         // Try to open the file
         if ( !m_datFile.open( p_path ) ) {
             wxMessageBox( wxString::Format( wxT( "Failed to open file: %s" ), p_path ),
@@ -257,9 +323,8 @@ namespace gw2b {
         m_datPath = p_path;
 
         // Open the index file
-        uint64 datTimeStamp = wxFileModificationTime( p_path );
         auto indexFile = this->findDatIndex( );
-        auto readIndexTask = new ReadIndexTask( m_index, indexFile.GetFullPath( ), datTimeStamp );
+        auto readIndexTask = new ReadIndexTask( m_index, indexFile.GetFullPath( ) );
 
         // Start reading the index
         readIndexTask->addOnCompleteHandler( [this] ( ) { this->onReadIndexComplete( ); } );
@@ -281,17 +346,55 @@ namespace gw2b {
     //============================================================================/
 
     void BrowserWindow::viewEntry( const DatIndexEntry& p_entry ) {
+        // Read in the background so the UI does not block on big entries. Only
+        // the most recently requested entry gets shown, so reads for the ones
+        // before it that did not start yet are dropped. That also keeps the
+        // preview class from filling up, which would block this thread.
+        auto request = ++m_viewRequest;
+        auto entry = &p_entry;
+        m_asyncReader.cancel( AsyncDatReader::RP_Preview );
+        m_asyncReader.cancel( AsyncDatReader::RP_Prefetch );
+        m_asyncReader.readFile( p_entry.mftEntry( ), [this, request, entry] ( uint, Array<byte> p_data ) {
+            // Array is not safe to share between threads, pass it on as a whole
+            auto data = std::make_shared<Array<byte>>( std::move( p_data ) );
+            this->CallAfter( [this, request, entry, data] ( ) {
+                if ( request == m_viewRequest ) {
+                    this->showEntry( *entry, *data );
+                }
+            } );
+        } );
+
+        // Reading ahead only pays off if the entries are kept
+        auto category = p_entry.category( );
+        if ( !m_datFile.cache( ).isEnabled( ) || !category ) {
+            return;
+        }
+        for ( uint i = 0; i < category->numEntries( ); i++ ) {
+            if ( category->entry( i ) != &p_entry ) {
+                continue;
+            }
+            auto end = wxMin( i + 1 + NumPrefetchedEntries, category->numEntries( ) );
+            for ( uint j = i + 1; j < end; j++ ) {
+                m_asyncReader.prefetchFile( category->entry( j )->mftEntry( ) );
+            }
+            break;
+        }
+    }
+
+    //============================================================================/
+
+    void BrowserWindow::showEntry( const DatIndexEntry& p_entry, const Array<byte>& p_entryData ) {
         switch ( p_entry.fileType( ) ) {
         //case ANFT_MapParam:
         case ANFT_Model:
-            if ( m_previewGLCanvas->previewFile( m_datFile, p_entry ) ) {
+            if ( m_previewGLCanvas->previewFile( m_datFile, p_entry, p_entryData ) ) {
                 m_previewPanel->destroyViewer( );
                 m_uiManager.GetPane( wxT( "panel_content" ) ).Hide( );
                 m_uiManager.GetPane( wxT( "gl_content" ) ).Show( );
             }
             break;
         default:
-            if ( m_previewPanel->previewFile( m_datFile, p_entry ) ) {
+            if ( m_previewPanel->previewFile( m_datFile, p_entry, p_entryData ) ) {
                 // Clear the OpenGL canvas to reduce memory usage
                 m_previewGLCanvas->clear( );
                 m_uiManager.GetPane( wxT( "gl_content" ) ).Hide( );
@@ -327,8 +430,22 @@ namespace gw2b {
 
     //============================================================================/
 
+    wxFileName BrowserWindow::findDatJournal( ) {
+        auto journalFile = this->findDatIndex( );
+        journalFile.SetExt( wxT( "jnl" ) );
+        return journalFile;
+    }
+
+    //============================================================================/
+
     void BrowserWindow::indexDat( ) {
-        auto scanTask = new ScanDatTask( m_index, m_datFile );
+        // Bringing the index up to date may drop entries reads are pending for
+        m_viewRequest++;
+        auto journalFile = this->findDatJournal( );
+        if ( !journalFile.DirExists( ) ) {
+            journalFile.Mkdir( 511, wxPATH_MKDIR_FULL );
+        }
+        auto scanTask = new ScanDatTask( m_index, m_datFile, m_asyncReader, wxFileModificationTime( m_datPath ), journalFile.GetFullPath( ) );
         scanTask->addOnCompleteHandler( [this] ( ) { this->onScanTaskComplete( ); } );
         this->performTask( scanTask );
     }
@@ -336,6 +453,7 @@ namespace gw2b {
     //============================================================================/
 
     void BrowserWindow::reIndexDat( ) {
+        m_viewRequest++;
         m_index->clear( );
         m_index->setDatTimestamp( wxFileModificationTime( m_datPath ) );
         this->indexDat( );
@@ -390,9 +508,7 @@ namespace gw2b {
         // Cancel current task if possible.
         if ( m_currentTask ) {
             if ( m_currentTask->canAbort( ) ) {
-                m_currentTask->abort( );
-                deletePointer( m_currentTask );
-                this->Unbind( wxEVT_IDLE, &BrowserWindow::onPerformTaskEvt, this );
+                this->abortTask( );
             } else {
                 this->Disable( );
                 m_currentTask->addOnCompleteHandler( [this] ( ) { this->tryClose( ); } );
@@ -422,15 +538,20 @@ namespace gw2b {
 
     //============================================================================/
 
-    void BrowserWindow::onPerformTaskEvt( wxIdleEvent& p_event ) {
-        Ensure::notNull( m_currentTask );
-        m_currentTask->perform( );
+    void BrowserWindow::onTaskTimerEvt( wxTimerEvent& p_event ) {
+        // A tick may still be queued after the task was aborted
+        if ( !m_currentTask ) {
+            return;
+        }
+        m_currentTask->commit( );
 
-        if ( !m_currentTask->isDone( ) ) {
+        if ( !m_taskFinished ) {
             m_progress->update( m_currentTask->currentProgress( ), m_currentTask->text( ) );
-            p_event.RequestMore( );
         } else {
-            this->Unbind( wxEVT_IDLE, &BrowserWindow::onPerformTaskEvt, this );
+            m_taskTimer->Stop( );
+            m_taskThread.join( );
+            // Hand over whatever the last perform() did
+            m_currentTask->commit( );
             m_progress->SetStatusText( wxEmptyString );
             m_progress->hideProgressBar( );
 
@@ -504,18 +625,42 @@ namespace gw2b {
             return;
         }
 
-        // Was it complete?
-        auto isComplete = ( m_index->highestMftEntry( ) == m_datFile.numFiles( ) );
-        if ( !isComplete ) {
-            this->indexDat( );
-        }
+        // Scans only what the index is missing, or what a patch changed. Sizes
+        // of the unchanged entries are handed to the .dat file there.
+        this->indexDat( );
     }
 
     //============================================================================/
 
     void BrowserWindow::onScanTaskComplete( ) {
         auto writeTask = new WriteIndexTask( m_index, this->findDatIndex( ).GetFullPath( ) );
-        this->performTask( writeTask );
+        writeTask->addOnCompleteHandler( [this] ( ) { this->onWriteTaskCompleted( ); } );
+        // Nothing to write if the scan found no changes
+        if ( !this->performTask( writeTask ) ) {
+            this->onWriteTaskCompleted( );
+        }
+    }
+
+    //============================================================================/
+
+    void BrowserWindow::onWriteTaskCompleted( ) {
+        // The index holds everything the scan journal did now
+        auto journalPath = this->findDatJournal( ).GetFullPath( );
+        if ( !m_index->isDirty( ) && wxFile::Exists( journalPath ) ) {
+            wxRemoveFile( journalPath );
+        }
+
+        // Hash the entries in the background, so exports can skip duplicates
+        // before reading them. Does nothing once all entries have a hash.
+        auto hashTask = new HashDatTask( m_index, m_datFile, m_asyncReader );
+        hashTask->addOnCompleteHandler( [this] ( ) { this->onHashTaskCompleted( ); } );
+        this->performTask( hashTask );
+    }
+
+    //============================================================================/
+
+    void BrowserWindow::onHashTaskCompleted( ) {
+        this->performTask( new WriteIndexTask( m_index, this->findDatIndex( ).GetFullPath( ) ) );
     }
 
     //============================================================================/
@@ -548,6 +693,16 @@ namespace gw2b {
 
     //============================================================================/
 
+    void BrowserWindow::onTreeCategoryExpanded( CategoryTree& p_tree, const DatIndexCategory& p_category ) {
+        // Unclassified files the user looks at get scanned first
+        auto scanTask = dynamic_cast<ScanDatTask*>( m_currentTask );
+        if ( scanTask ) {
+            scanTask->prioritize( p_category );
+        }
+    }
+
+    //============================================================================/
+
     void BrowserWindow::onTreeCleared( CategoryTree& p_tree ) {
         // TODO
     }
@@ -560,9 +715,13 @@ namespace gw2b {
 
         if ( entries.GetSize( ) ) {
             if ( p_mode ) {
-                exporter = new Exporter( entries, m_datFile, Exporter::EM_Converted );
+                exporter = new Exporter( entries, m_datFile, m_asyncReader, Exporter::EM_Converted );
             } else {
-                exporter = new Exporter( entries, m_datFile, Exporter::EM_Raw );
+                exporter = new Exporter( entries, m_datFile, m_asyncReader, Exporter::EM_Raw );
+            }
+            // Hashes found while exporting are worth keeping in the index
+            if ( exporter->hasNewHashes( ) ) {
+                m_index->setDirty( true );
             }
             delete exporter;
         }
@@ -664,6 +823,14 @@ namespace gw2b {
             return;
         }
 
+        // Unclassified files the user looks for get scanned first
+        auto scanTask = dynamic_cast<ScanDatTask*>( m_currentTask );
+        auto itemData = static_cast<const CategoryTreeItem*>( m_catTree->GetItemData( item ) );
+        if ( scanTask && itemData && itemData->dataType( ) == CategoryTreeItem::DT_Entry ) {
+            auto entry = static_cast<const DatIndexEntry*>( itemData->data( ) );
+            scanTask->prioritize( *entry->category( ) );
+        }
+
         // Deselect all
         m_catTree->UnselectAll( );
         // Select item
@@ -28,11 +28,15 @@
 #ifndef BROWSERWINDOW_H_INCLUDED
 #define BROWSERWINDOW_H_INCLUDED
 
+#include <atomic>
+#include <thread>
+
 #include <wx/aui/aui.h>
 #include <wx/filename.h>
 #include <wx/splitter.h>
 #include <wx/aboutdlg.h>
 
+#include "AsyncDatReader.h"
 #include "CategoryTree.h"
 #include "DatFile.h"
 #include "PreviewPanel.h"
@@ -49,9 +53,15 @@ namespace gw2b {
     class BrowserWindow : public wxFrame, public ICategoryTreeListener {
         wxString                    m_datPath;
         DatFile                     m_datFile;
+        AsyncDatReader              m_asyncReader;
+        uint                        m_viewRequest;
         std::shared_ptr<DatIndex>   m_index;
         ProgressStatusBar*          m_progress;
         Task*                       m_currentTask;
+        std::thread                 m_taskThread;
+        std::atomic<bool>           m_taskStopping;
+        std::atomic<bool>           m_taskFinished;
+        wxTimer*                    m_taskTimer;
         wxAuiManager                m_uiManager;
         CategoryTree*               m_catTree;
         PreviewPanel*               m_previewPanel;
@@ -68,28 +78,41 @@ namespace gw2b {
         BrowserWindow( const wxString& p_title, const wxSize p_size = wxDefaultSize );
         /** Destructor. */
         ~BrowserWindow( );
-        /** Opens the given .dat file for browsing.
+        /** Opens the given .dat file for browsing. If the current task cannot
+        *   be aborted, the file is opened once it is done.
         *  \param[in]  p_path   Path to the .dat file to open. */
         void openFile( const wxString& p_path );
         /** Tries to close this window, but does not force it (same as calling
         *  Close(false)). */
         void tryClose( );
-        /** Opens the preview pane with the given entry's contents in it.
+        /** Opens the preview pane with the given entry's contents in it, and
+        *   reads the entries after it into the cache.
         *  \param[in]  p_entry  entry to view. */
         void viewEntry( const DatIndexEntry& p_entry );
+        /** Shows the given entry's contents, once read, in the preview pane.
+        *  \param[in]  p_entry      entry to view.
+        *  \param[in]  p_entryData  contents of the entry. */
+        void showEntry( const DatIndexEntry& p_entry, const Array<byte>& p_entryData );
         /** Check if OpenGL context can be create. */
         bool OGLAvailable( );
 
     private:
-        /** Performs the given task periodically, until it is done.
+        /** Performs the given task on a background thread, until it is done.
         *  \param[in]  p_task   Task to perform. Ownership is taken.
         *  \return bool    true if the task's init succeeded, false if not. */
         bool performTask( Task* p_task );
+        /** Aborts the current task and waits for its thread to exit. Tasks
+        *   that cannot be aborted are waited for until they are done. */
+        void abortTask( );
 
         /** Hashes the internally stored .dat file path and determines where its
         *   index file should be located.
         *   \return wxFileName containing the path to the index file. */
         wxFileName findDatIndex( );
+        /** Determines where the scan journal of the internally stored .dat
+        *   file path should be located, next to its index file.
+        *   \return wxFileName containing the path to the journal file. */
+        wxFileName findDatJournal( );
         /** Resumes indexing the loaded .dat file. */
         void indexDat( );
         /** Re-indexes the loaded .dat file. */
@@ -110,9 +133,10 @@ namespace gw2b {
         /** Executed when the a button is pressed.
         *  \param[in]  p_event  Unused event object handed to us by wxWidgets. */
         void onButtonEvt( wxCommandEvent& p_event );
-        /** Performs the currently active task repeatedly until it is complete.
-        *  \param[in]  p_event  Idle event object used to request more idle events. */
-        void onPerformTaskEvt( wxIdleEvent& p_event );
+        /** Commits the work of the currently active task and updates its
+        *   progress, until it is complete.
+        *  \param[in]  p_event  Unused event object handed to us by wxWidgets. */
+        void onTaskTimerEvt( wxTimerEvent& p_event );
         /** Executed when the user clicks <em>View -> Menu</em> in the menu.
         *  \param[in]  p_event  Unused event object handed to us by wxWidgets. */
         void onTogglePaneEvt( wxCommandEvent &p_event );
@@ -130,6 +154,11 @@ namespace gw2b {
         void onReadIndexComplete( );
         /** Raised when the .dat has finished indexing. */
         void onScanTaskComplete( );
+        /** Raised when the write task has finished, if invoked from onScanTaskComplete,
+        *   or after the scan if there was nothing to write. Starts hashing the entries. */
+        void onWriteTaskCompleted( );
+        /** Raised when the entries of the index have been hashed. */
+        void onHashTaskCompleted( );
         /** Raised when the write task has finished, if invoked from onCloseEvt. */
         void onWriteTaskCloseCompleted( );
 
@@ -141,6 +170,10 @@ namespace gw2b {
         *  \param[in]  p_tree       tree that raised the event.
         *  \param[in]  p_category   category that was clicked. */
         virtual void onTreeCategoryClicked( CategoryTree& p_tree, const DatIndexCategory& p_category ) override;
+        /** Raised when the user expands a category in the category tree.
+        *  \param[in]  p_tree       tree that raised the event.
+        *  \param[in]  p_category   category that was expanded. */
+        virtual void onTreeCategoryExpanded( CategoryTree& p_tree, const DatIndexCategory& p_category ) override;
         /** Raised when the category tree was cleared.
         *  \param[in]  p_tree   tree that was cleared. */
         virtual void onTreeCleared( CategoryTree& p_tree ) override;
@@ -182,6 +182,29 @@ namespace gw2b {
 
     //============================================================================/
 
+    wxTreeItemId CategoryTree::findCategory( const DatIndexCategory& p_category ) const {
+        auto parent = p_category.parent( ) ? this->findCategory( *p_category.parent( ) ) : this->GetRootItem( );
+        if ( !parent.IsOk( ) ) {
+            return wxTreeItemId( );
+        }
+
+        wxTreeItemIdValue cookie;
+        auto child = this->GetFirstChild( parent, cookie );
+        while ( child.IsOk( ) ) {
+            auto data = static_cast<const CategoryTreeItem*>( this->GetItemData( child ) );
+            if ( data->dataType( ) != CategoryTreeItem::DT_Category ) {
+                break;
+            }
+            if ( data->data( ) == &p_category ) {
+                return child;
+            }
+            child = this->GetNextChild( parent, cookie );
+        }
+        return wxTreeItemId( );
+    }
+
+    //============================================================================/
+
     wxTreeItemId CategoryTree::addEntry( const wxTreeItemId& p_parent, const DatIndexEntry& p_entry ) {
         if ( p_entry.name( ).IsNumber( ) ) {
             ulong number;
@@ -516,6 +539,10 @@ namespace gw2b {
             return;
         }
 
+        for ( auto const& it : m_listeners ) {
+            it->onTreeCategoryExpanded( *this, *category );
+        }
+
         // Add all contained entries
         for ( uint i = 0; i < category->numEntries( ); i++ ) {
             auto entry = category->entry( i );
@@ -649,6 +676,55 @@ namespace gw2b {
 
     //============================================================================/
 
+    void CategoryTree::removeEntryNode( const DatIndexCategory& p_category, const DatIndexEntry& p_entry ) {
+        // Only nodes that were filled in have items for their entries
+        auto node = this->findCategory( p_category );
+        if ( !node.IsOk( ) ) {
+            return;
+        }
+        auto itemData = static_cast<const CategoryTreeItem*>( this->GetItemData( node ) );
+        if ( itemData->isDirty( ) ) {
+            return;
+        }
+
+        wxTreeItemIdValue cookie;
+        auto child = this->GetFirstChild( node, cookie );
+        while ( child.IsOk( ) ) {
+            auto data = static_cast<const CategoryTreeItem*>( this->GetItemData( child ) );
+            if ( data->dataType( ) == CategoryTreeItem::DT_Entry && data->data( ) == &p_entry ) {
+                this->Delete( child );
+                return;
+            }
+            child = this->GetNextChild( node, cookie );
+        }
+    }
+
+    //============================================================================/
+
+    void CategoryTree::onIndexFileMoved( DatIndex& p_index, const DatIndexEntry& p_entry, const DatIndexCategory& p_oldCategory ) {
+        this->removeEntryNode( p_oldCategory, p_entry );
+        this->addEntry( p_entry );
+    }
+
+    //============================================================================/
+
+    void CategoryTree::onIndexFileRemoved( DatIndex& p_index, const DatIndexEntry& p_entry ) {
+        if ( p_entry.category( ) ) {
+            this->removeEntryNode( *p_entry.category( ), p_entry );
+        }
+    }
+
+    //============================================================================/
+
+    void CategoryTree::onIndexCategoryRemoved( DatIndex& p_index, const DatIndexCategory& p_category ) {
+        auto node = this->findCategory( p_category );
+        if ( node.IsOk( ) ) {
+            this->Delete( node );
+        }
+    }
+
+    //============================================================================/
+
     void CategoryTree::onIndexCleared( DatIndex& p_index ) {
         Assert( &p_index == m_index.get( ) );
         this->clearEntries( );
@@ -656,6 +732,21 @@ namespace gw2b {
 
     //============================================================================/
 
+    void CategoryTree::onIndexLoaded( DatIndex& p_index ) {
+        Assert( &p_index == m_index.get( ) );
+        this->clearEntries( );
+
+        // Nothing is expanded yet, the top-level categories are all that show
+        for ( uint i = 0; i < p_index.numCategories( ); i++ ) {
+            auto category = p_index.category( i );
+            if ( !category->parent( ) ) {
+                this->ensureHasCategory( *category );
+            }
+        }
+    }
+
+    //============================================================================/
+
     void CategoryTree::onIndexDestruction( DatIndex& p_index ) {
         Assert( &p_index == m_index.get( ) );
         m_index = nullptr;
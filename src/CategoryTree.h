@@ -126,6 +126,11 @@ namespace gw2b {
         *  \param[in]  p_category   reference to the clicked category. */
         virtual void onTreeCategoryClicked( CategoryTree& p_tree, const DatIndexCategory& p_category ) {
         }
+        /** Raised whenever a category is expanded in the category tree.
+        *  \param[in]  p_tree       category tree invoking the callback.
+        *  \param[in]  p_category   reference to the expanded category. */
+        virtual void onTreeCategoryExpanded( CategoryTree& p_tree, const DatIndexCategory& p_category ) {
+        }
         /** Raised when the category tree is being cleared.
         *  \param[in]  p_tree   category tree invoking the callback. */
         virtual void onTreeCleared( CategoryTree& p_tree ) {
@@ -191,9 +196,25 @@ namespace gw2b {
         *  \param[in]  p_index  Reference to the index that had a file added to it.
         *  \param[in]  p_entry  Reference to the newly added entry. */
         virtual void onIndexFileAdded( DatIndex& p_index, const DatIndexEntry& p_entry ) override;
+        /** Called by the .dat index when an entry is moved to another category.
+        *  \param[in]  p_index          Reference to the index containing the entry.
+        *  \param[in]  p_entry          Reference to the moved entry.
+        *  \param[in]  p_oldCategory    Category the entry was moved out of. */
+        virtual void onIndexFileMoved( DatIndex& p_index, const DatIndexEntry& p_entry, const DatIndexCategory& p_oldCategory ) override;
+        /** Called by the .dat index when a category is about to be removed.
+        *  \param[in]  p_index      Reference to the index containing the category.
+        *  \param[in]  p_category   Reference to the category being removed. */
+        virtual void onIndexCategoryRemoved( DatIndex& p_index, const DatIndexCategory& p_category ) override;
+        /** Called by the .dat index when an entry is about to be removed.
+        *  \param[in]  p_index  Reference to the index containing the entry.
+        *  \param[in]  p_entry  Reference to the entry being removed. */
+        virtual void onIndexFileRemoved( DatIndex& p_index, const DatIndexEntry& p_entry ) override;
         /** Called by the .dat index when it is cleared.
         *  \param[in]  p_index  Reference to the index being cleared. */
         virtual void onIndexCleared( DatIndex& p_index ) override;
+        /** Called by the .dat index when it took over a loaded index.
+        *  \param[in]  p_index  Reference to the loaded index. */
+        virtual void onIndexLoaded( DatIndex& p_index ) override;
         /** Called by the .dat index when it is destroyed.
         *  \param[in]  p_index  Reference to the index being destroyed. */
         virtual void onIndexDestruction( DatIndex& p_index ) override;
@@ -222,6 +243,15 @@ namespace gw2b {
         *  \param[in]  p_parent         Parent category to add the category to.
         *  \param[in]  p_displayName    Name of the category to add. */
         wxTreeItemId addCategoryEntry( const wxTreeItemId& p_parent, const wxString& p_displayName );
+        /** Finds the node of the given category, without adding it.
+        *  \param[in]  p_category   Category to find.
+        *  \return wxTreeItemId    Node of the category, invalid if not in the tree. */
+        wxTreeItemId findCategory( const DatIndexCategory& p_category ) const;
+        /** Removes the node of the given entry from the node of the given
+        *   category, if that was filled in.
+        *  \param[in]  p_category   Category the entry is shown in.
+        *  \param[in]  p_entry      Entry to remove the node of. */
+        void removeEntryNode( const DatIndexCategory& p_category, const DatIndexEntry& p_entry );
 
         /** Gets the index for the image that should represent the given entry.
         *  \param[in]  p_entry  Entry in need of an icon. */
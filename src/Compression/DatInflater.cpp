@@ -0,0 +1,300 @@
+/** \file       Compression/DatInflater.cpp
+ *  \brief      Contains the definition of the in-tree inflater of compressed .dat entries.
+ *  \author     agent
+ */
+
+/**
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of Gw2Browser.
+ *
+ * Gw2Browser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stdafx.h"
+
+#include <gw2dattools/exception/Exception.h>
+
+#include "DatInflater.h"
+#include "HuffmanDecoder.h"
+
+namespace gw2b {
+
+    namespace {
+
+        /** Code lengths of the symbols the other trees' code lengths are encoded
+        *   with, in the order they are added. Each length from 3 bits up lists
+        *   its symbols in DictionarySymbols, all others are 16 bits long. */
+        const byte DictionarySymbols[] = {
+            0x0A, 0x09, 0x08,
+            0x0C, 0x0B, 0x07, 0x00,
+            0xE0, 0x2A, 0x29, 0x06,
+            0x4A, 0x40, 0x2C, 0x2B, 0x28, 0x20, 0x05, 0x04,
+            0x49, 0x48, 0x27, 0x26, 0x25, 0x0D, 0x03,
+            0x6A, 0x69, 0x4C, 0x4B, 0x47, 0x24,
+            0xE8, 0xA0, 0x89, 0x88, 0x68, 0x67, 0x63, 0x60, 0x46, 0x23,
+            0xE9, 0xC9, 0xC0, 0xA9, 0xA8, 0x8A, 0x87, 0x80, 0x66, 0x65, 0x45, 0x44, 0x43, 0x2D, 0x02, 0x01,
+            0xE5, 0xC8, 0xAA, 0xA5, 0xA4, 0x8B, 0x85, 0x84, 0x6C, 0x6B, 0x64, 0x4D, 0x0E,
+            0xE7, 0xCA, 0xC7, 0xA7, 0xA6, 0x86, 0x83,
+            0xE6, 0xE4, 0xC4, 0x8C, 0x2E, 0x22,
+            0xEC, 0xC6, 0x6D, 0x4E,
+            0xEA, 0xCC, 0xAC, 0xAB, 0x8D, 0x11, 0x10, 0x0F,
+        };
+        const uint DictionaryCounts[] = { 3, 4, 4, 8, 7, 6, 10, 16, 13, 7, 6, 4, 8 };
+
+        /** Farthest back a copy can reach, from the largest offset code. */
+        const uint32 MaxCopyOffset = ( ( 3u << 15 ) | 0x7FFF ) + 1;
+        /** Longest copy, from the largest length code plus the largest copy
+        *   length constant. */
+        const uint32 MaxCopySize = 0xFF + 16;
+
+        HuffmanTree buildDictionaryTree( ) {
+            HuffmanTreeBuilder builder;
+            bool used[256] = { };
+
+            uint index = 0;
+            for ( uint i = 0; i < sizeof( DictionaryCounts ) / sizeof( DictionaryCounts[0] ); i++ ) {
+                for ( uint j = 0; j < DictionaryCounts[i]; j++ ) {
+                    byte symbol = DictionarySymbols[index++];
+                    builder.addSymbol( symbol, 3 + i );
+                    used[symbol] = true;
+                }
+            }
+            for ( int symbol = 0xFF; symbol >= 0; symbol-- ) {
+                if ( !used[symbol] ) {
+                    builder.addSymbol( static_cast<uint16>( symbol ), 16 );
+                }
+            }
+
+            HuffmanTree tree;
+            builder.build( tree );
+            return tree;
+        }
+
+        /** Tree the other trees' code lengths are encoded with. */
+        const HuffmanTree& dictionaryTree( ) {
+            static const HuffmanTree tree = buildDictionaryTree( );
+            return tree;
+        }
+
+        void parseHuffmanTree( HuffmanBitReader& p_reader, HuffmanTreeBuilder& p_builder, HuffmanTree& po_tree ) {
+            const auto& dictionary = dictionaryTree( );
+
+            uint numSymbols = p_reader.read( 16 );
+            if ( numSymbols > HuffmanTree::MaxSymbols ) {
+                throw exception::Exception( "Too many symbols to decode." );
+            }
+
+            p_builder.clear( );
+            int remaining = static_cast<int>( numSymbols ) - 1;
+            while ( remaining > -1 ) {
+                uint16 code = p_reader.readSymbol( dictionary );
+                uint bits = code & 0x1F;
+                uint count = ( code >> 5 ) + 1;
+
+                if ( !bits ) {
+                    remaining -= count;
+                    continue;
+                }
+                for ( ; count > 0; count-- ) {
+                    if ( remaining < 0 ) {
+                        throw exception::Exception( "Too many symbols in Huffman tree." );
+                    }
+                    p_builder.addSymbol( static_cast<uint16>( remaining-- ), bits );
+                }
+            }
+            p_builder.build( po_tree );
+        }
+
+        /** Inflates p_outputSize bytes into the given window. Once the window
+        *   holds p_flushSize bytes, they are handed to the sink and all but the
+        *   last MaxCopyOffset bytes, which back references can still reach,
+        *   are dropped. Inflating into a buffer big enough for all the output
+        *   passes p_outputSize as flush size, and needs no sink.
+        *  \return bool    false if the sink asked to stop. */
+        bool inflateData( HuffmanBitReader& p_reader, uint32 p_outputSize, byte* po_window, uint32 p_flushSize,
+            const DatInflater::OutputSink* p_sink ) {
+            HuffmanTreeBuilder builder;
+            HuffmanTree symbolTree;
+            HuffmanTree copyTree;
+
+            p_reader.need( 8 );
+            p_reader.refill( );
+            p_reader.skip( 4 );
+            uint32 copyAdd = p_reader.read( 4 ) + 1;
+
+            // Positions in the window, the end of the output moves along as
+            // the window is flushed
+            uint32 position = 0;
+            uint32 flushed = 0;
+            uint32 end = p_outputSize;
+            while ( position < end ) {
+                parseHuffmanTree( p_reader, builder, symbolTree );
+                parseHuffmanTree( p_reader, builder, copyTree );
+
+                uint32 maxCount = ( p_reader.read( 4 ) + 1 ) << 12;
+                uint32 count = 0;
+
+                while ( count < maxCount && position < end ) {
+                    if ( position >= p_flushSize ) {
+                        if ( !( *p_sink )( po_window + flushed, position - flushed ) ) {
+                            return false;
+                        }
+                        uint32 dropped = position - MaxCopyOffset;
+                        ::memmove( po_window, po_window + dropped, MaxCopyOffset );
+                        end -= dropped;
+                        position = flushed = MaxCopyOffset;
+                    }
+
+                    // Most of the data are literals, decode two at a time when possible
+                    if ( count + 2 <= maxCount && position + 2 <= end && symbolTree.isReadable( ) ) {
+                        p_reader.needCode( );
+                        if ( p_reader.readLiteralPair( symbolTree, po_window + position ) ) {
+                            position += 2;
+                            count += 2;
+                            continue;
+                        }
+                    }
+
+                    count++;
+                    uint32 code = p_reader.readSymbol( symbolTree );
+                    if ( code < 0x100 ) {
+                        po_window[position++] = static_cast<byte>( code );
+                        continue;
+                    }
+
+                    // Copy length
+                    code -= 0x100;
+                    uint32 quotient = code / 4;
+                    uint32 remainder = code % 4;
+                    uint32 copySize;
+                    if ( quotient == 0 ) {
+                        copySize = code;
+                    } else if ( quotient < 7 ) {
+                        copySize = ( 1 << ( quotient - 1 ) ) * ( 4 + remainder );
+                    } else if ( code == 28 ) {
+                        copySize = 0xFF;
+                    } else {
+                        throw exception::Exception( "Invalid value for writeSize code." );
+                    }
+                    if ( quotient > 1 && code != 28 ) {
+                        copySize |= p_reader.read( quotient - 1 );
+                    }
+                    copySize += copyAdd;
+
+                    // Copy offset
+                    code = p_reader.readSymbol( copyTree );
+                    quotient = code / 2;
+                    remainder = code % 2;
+                    uint32 copyOffset;
+                    if ( quotient == 0 ) {
+                        copyOffset = code;
+                    } else if ( quotient < 17 ) {
+                        copyOffset = ( 1 << ( quotient - 1 ) ) * ( 2 + remainder );
+                    } else {
+                        throw exception::Exception( "Invalid value for writeOffset code." );
+                    }
+                    if ( quotient > 1 ) {
+                        copyOffset |= p_reader.read( quotient - 1 );
+                    }
+                    copyOffset += 1;
+
+                    if ( copyOffset > position ) {
+                        throw exception::Exception( "Copy offset before the start of the output." );
+                    }
+
+                    uint32 size = wxMin( copySize, end - position );
+                    byte* output = po_window + position;
+                    const byte* source = output - copyOffset;
+                    if ( copyOffset >= size ) {
+                        ::memcpy( output, source, size );
+                    } else {
+                        // Overlapping copies repeat the last copyOffset bytes
+                        for ( uint32 i = 0; i < size; i++ ) {
+                            output[i] = source[i];
+                        }
+                    }
+                    position += size;
+                }
+            }
+
+            if ( p_sink && position > flushed ) {
+                return ( *p_sink )( po_window + flushed, position - flushed );
+            }
+            return true;
+        }
+
+    }; // anon namespace
+
+    void DatInflater::inflate( uint p_inputSize, const byte* p_input, uint32& po_outputSize, byte* po_output,
+        Implementation p_implementation ) {
+        if ( p_implementation == DI_Builtin ) {
+            DatInflater::inflateBuiltin( p_inputSize, p_input, po_outputSize, po_output );
+            return;
+        }
+
+        try {
+            gw2dt::compression::inflateDatFileBuffer( p_inputSize, p_input, po_outputSize, po_output );
+        } catch ( const gw2dt::exception::Exception& err ) {
+            throw exception::Exception( err.what( ) );
+        }
+    }
+
+    const char* DatInflater::implementationName( Implementation p_implementation ) {
+        switch ( p_implementation ) {
+        case DI_Builtin:
+            return "builtin";
+        case DI_Gw2DatTools:
+            return "gw2dattools";
+        default:
+            return "unknown";
+        }
+    }
+
+    void DatInflater::inflateBuiltin( uint p_inputSize, const byte* p_input, uint32& po_outputSize, byte* po_output ) {
+        if ( !p_input ) {
+            throw exception::Exception( "Input buffer is null." );
+        }
+        if ( !po_output ) {
+            throw exception::Exception( "Output buffer is null." );
+        }
+        if ( !po_outputSize ) {
+            throw exception::Exception( "Output size is zero." );
+        }
+
+        HuffmanBitReader reader( p_input, p_inputSize, true );
+
+        // Skip the header, then read the uncompressed size
+        reader.read( 32 );
+        uint32 outputSize = wxMin( reader.read( 32 ), po_outputSize );
+        po_outputSize = outputSize;
+
+        inflateData( reader, outputSize, po_output, outputSize, nullptr );
+    }
+
+    bool DatInflater::inflate( uint p_inputSize, const InputSource& p_input, const OutputSink& p_sink ) {
+        HuffmanBitReader reader( p_input, p_inputSize, StreamInputChunkSize, true );
+
+        reader.read( 32 );
+        uint32 outputSize = reader.read( 32 );
+        if ( !outputSize ) {
+            return true;
+        }
+
+        // Room for the history, a full window and the longest copy past it
+        Array<byte> window( MaxCopyOffset + StreamWindowSize + MaxCopySize );
+        return inflateData( reader, outputSize, window.GetPointer( ), MaxCopyOffset + StreamWindowSize, &p_sink );
+    }
+
+}; // namespace gw2b
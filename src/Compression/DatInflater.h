@@ -0,0 +1,110 @@
+/** \file       Compression/DatInflater.h
+ *  \brief      Contains the declaration of the in-tree inflater of compressed .dat entries.
+ *  \author     agent
+ */
+
+/**
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of Gw2Browser.
+ *
+ * Gw2Browser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#ifndef COMPRESSION_DATINFLATER_H_INCLUDED
+#define COMPRESSION_DATINFLATER_H_INCLUDED
+
+#include <functional>
+
+namespace gw2b {
+
+    /** Inflates compressed .dat entries. The format is a series of blocks,
+    *   each with its own pair of canonical Huffman trees (one for literals and
+    *   copy lengths, one for copy offsets), which are themselves encoded with
+    *   a fixed dictionary tree. Every 16384th dword of the input is a check
+    *   value and is skipped.
+    *   The in-tree implementation decodes through lookup tables that resolve
+    *   up to two literals at once. On valid data its output is the same as
+    *   gw2dattools'. It is stricter on corrupt data: it throws on Huffman
+    *   trees with too many or no symbols, on copies reaching before the start
+    *   of the output, and on a zero output size, where gw2dattools stops or
+    *   carries on quietly. It can be called from any number of threads at
+    *   once. */
+    class DatInflater {
+    public:
+        /** Implementations to inflate with. */
+        enum Implementation {
+            DI_Builtin,         /**< The table-driven inflater in this class. */
+            DI_Gw2DatTools,     /**< gw2dt::compression::inflateDatFileBuffer. */
+        };
+        /** Gets a chunk of the compressed data of a streamed inflate.
+        *  \param[in]  p_offset     Position of the chunk in the compressed data.
+        *  \param[in]  p_size       Size of the chunk.
+        *  \return byte*   The chunk, valid until the next call. nullptr if it
+        *                  could not be read. */
+        typedef std::function<const byte*( uint p_offset, uint p_size )> InputSource;
+        /** Called with each part of the output of a streamed inflate, in order.
+        *  \param[in]  p_data   Inflated data.
+        *  \param[in]  p_size   Size of the data.
+        *  \return bool    true to carry on, false to stop inflating. */
+        typedef std::function<bool( const byte* p_data, uint p_size )> OutputSink;
+
+        /** Size of the parts streamed output is handed over in, but for the last. */
+        static const uint StreamWindowSize = 1024 * 1024;
+        /** Size of the chunks streamed input is read in. */
+        static const uint StreamInputChunkSize = 256 * 1024;
+    public:
+        /** Inflates a compressed .dat entry into the given buffer. Stops once
+        *   po_outputSize bytes were written, so the start of an entry can be
+        *   inflated without decoding the rest of it.
+        *  \param[in]  p_inputSize      Size of the compressed data.
+        *  \param[in]  p_input          Compressed data, as stored in the .dat.
+        *  \param[in,out]  po_outputSize    Size of po_output. Set to the amount of
+        *                               bytes inflated, which is the smaller of it
+        *                               and the uncompressed size of the entry.
+        *  \param[out] po_output        Buffer to inflate into.
+        *  \param[in]  p_implementation Implementation to inflate with.
+        *  \throws exception::Exception if the data is corrupt or truncated. */
+        static void inflate( uint p_inputSize, const byte* p_input, uint32& po_outputSize, byte* po_output,
+            Implementation p_implementation = DI_Builtin );
+
+        /** Inflates a compressed .dat entry a window at a time, handing every
+        *   window to the sink once it is full. Memory use is the same whatever
+        *   the size of the entry. Always uses the builtin implementation, as
+        *   gw2dattools needs room for all of the output at once.
+        *  \param[in]  p_inputSize  Size of the compressed data.
+        *  \param[in]  p_input      Source of the compressed data.
+        *  \param[in]  p_sink       Called with each window of inflated data.
+        *  \return bool    true if all of the entry was inflated, false if the
+        *                  sink asked to stop.
+        *  \throws exception::Exception if the data is corrupt, truncated or
+        *          could not be read. */
+        static bool inflate( uint p_inputSize, const InputSource& p_input, const OutputSink& p_sink );
+
+        /** Gets the name of the given implementation.
+        *  \param[in]  p_implementation     Implementation to name.
+        *  \return const char*  Name of the implementation. */
+        static const char* implementationName( Implementation p_implementation );
+
+    private:
+        static void inflateBuiltin( uint p_inputSize, const byte* p_input, uint32& po_outputSize, byte* po_output );
+
+    }; // class DatInflater
+
+}; // namespace gw2b
+
+#endif // COMPRESSION_DATINFLATER_H_INCLUDED
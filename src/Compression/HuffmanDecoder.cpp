@@ -0,0 +1,120 @@
+/** \file       Compression/HuffmanDecoder.cpp
+ *  \brief      Contains the definition of the Huffman decoding shared by the inflaters.
+ *  \author     agent
+ */
+
+/**
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of Gw2Browser.
+ *
+ * Gw2Browser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stdafx.h"
+
+#include "HuffmanDecoder.h"
+
+namespace gw2b {
+
+    void HuffmanTreeBuilder::build( HuffmanTree& po_tree ) const {
+        ::memset( po_tree.codeStart, 0, sizeof( po_tree.codeStart ) );
+        po_tree.numLengths = 0;
+
+        uint64 codeSpace = 0;
+        uint32 code = 0;
+        uint16 offset = 0;
+        for ( uint bits = 0; bits < HuffmanTree::MaxCodeBits; bits++ ) {
+            if ( m_lengthHead[bits] != -1 ) {
+                for ( int16 symbol = m_lengthHead[bits]; symbol != -1; symbol = m_next[symbol] ) {
+                    po_tree.symbols[offset++] = symbol;
+                    codeSpace += uint64( 1 ) << ( 32 - bits );
+                    code--;
+                }
+                uint index = po_tree.numLengths++;
+                po_tree.codeStart[index] = ( code + 1 ) << ( 32 - bits );
+                po_tree.codeBits[index] = bits;
+                po_tree.symbolOffset[index] = offset - 1;
+            }
+            code = ( code << 1 ) + 1;
+        }
+
+        // Codes of an oversubscribed tree would overlap
+        if ( codeSpace > ( uint64( 1 ) << 32 ) ) {
+            throw exception::Exception( "Oversubscribed Huffman tree." );
+        }
+
+        ::memset( po_tree.lookup, 0, sizeof( po_tree.lookup ) );
+        if ( !po_tree.isReadable( ) ) {
+            return;
+        }
+
+        for ( uint i = 0; i < po_tree.numLengths; i++ ) {
+            uint bits = po_tree.codeBits[i];
+            if ( bits > HuffmanTree::LookupBits ) {
+                break;
+            }
+            uint32 firstCode = po_tree.codeStart[i] >> ( 32 - bits );
+            uint count = po_tree.symbolOffset[i] + 1 - ( i ? po_tree.symbolOffset[i - 1] + 1 : 0 );
+            for ( uint j = 0; j < count; j++ ) {
+                HuffmanTree::LookupEntry entry = { po_tree.symbols[po_tree.symbolOffset[i] - j], 0, static_cast<uint8>( bits ), 0, 1 };
+                uint first = ( firstCode + j ) << ( HuffmanTree::LookupBits - bits );
+                uint last = ( firstCode + j + 1 ) << ( HuffmanTree::LookupBits - bits );
+                for ( uint k = first; k < last; k++ ) {
+                    po_tree.lookup[k] = entry;
+                }
+            }
+        }
+
+        // Literals with room left for another literal resolve both at once
+        for ( uint i = 0; i < ( 1u << HuffmanTree::LookupBits ); i++ ) {
+            auto& entry = po_tree.lookup[i];
+            if ( !entry.count || entry.symbol >= 0x100 || entry.bits >= HuffmanTree::LookupBits ) {
+                continue;
+            }
+            const auto& next = po_tree.lookup[( i << entry.bits ) & ( ( 1u << HuffmanTree::LookupBits ) - 1 )];
+            if ( next.count && next.symbol < 0x100 && next.bits <= HuffmanTree::LookupBits - entry.bits ) {
+                entry.second = next.symbol;
+                entry.pairBits = entry.bits + next.bits;
+                entry.count = 2;
+            }
+        }
+    }
+
+    void HuffmanBitReader::loadChunk( ) {
+        m_chunkStart = m_position;
+        m_chunkEnd = wxMin( m_position + m_chunkWords, m_numWords );
+        m_input = ( *m_source )( m_chunkStart * 4, ( m_chunkEnd - m_chunkStart ) * 4 );
+        if ( !m_input ) {
+            throw exception::Exception( "Failed to read input." );
+        }
+    }
+
+    uint16 HuffmanBitReader::readLongSymbol( const HuffmanTree& p_tree ) {
+        uint32 window = this->peek( 32 );
+        uint index = 0;
+        while ( index < p_tree.numLengths && window < p_tree.codeStart[index] ) {
+            index++;
+        }
+        if ( index == p_tree.numLengths ) {
+            throw exception::Exception( "Invalid Huffman code." );
+        }
+
+        uint bits = p_tree.codeBits[index];
+        uint delta = ( window - p_tree.codeStart[index] ) >> ( 32 - bits );
+        this->skip( bits );
+        return p_tree.symbols[p_tree.symbolOffset[index] - delta];
+    }
+
+}; // namespace gw2b
@@ -0,0 +1,279 @@
+/** \file       Compression/HuffmanDecoder.h
+ *  \brief      Contains the declaration of the Huffman decoding shared by the inflaters.
+ *  \author     agent
+ */
+
+/**
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of Gw2Browser.
+ *
+ * Gw2Browser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#ifndef COMPRESSION_HUFFMANDECODER_H_INCLUDED
+#define COMPRESSION_HUFFMANDECODER_H_INCLUDED
+
+#include <cstring>
+#include <functional>
+
+#include "Exception.h"
+
+namespace gw2b {
+
+    /** Canonical Huffman tree, laid out the way ArenaNet's formats assign
+    *   their codes: the symbols of each code length, in the order they were
+    *   added, get consecutive codes counting down from the top of the code
+    *   space. Codes of up to LookupBits bits are resolved by a lookup table,
+    *   longer ones by comparing against the first code of each length. */
+    struct HuffmanTree {
+        /** Code lengths are stored in 5 bits. */
+        static const uint MaxCodeBits = 32;
+        /** Literals, copy lengths and the end of the table. */
+        static const uint MaxSymbols = 285;
+        /** Amount of bits the lookup table is indexed by. */
+        static const uint LookupBits = 10;
+
+        /** Lookup table entry. Resolves a code, or a literal followed by a
+        *   second literal if both fit. */
+        struct LookupEntry {
+            uint16  symbol;
+            uint16  second;
+            uint8   bits;           /**< Bits of the first symbol. */
+            uint8   pairBits;       /**< Bits of both symbols, if count is 2. */
+            uint8   count;          /**< Symbols resolved, 0 if the code is longer than LookupBits. */
+        };
+
+        /** Smallest code of each length in use, left-aligned to 32 bits. */
+        uint32      codeStart[MaxCodeBits];
+        /** Position in symbols of the first code of each length in use. */
+        uint16      symbolOffset[MaxCodeBits];
+        uint8       codeBits[MaxCodeBits];
+        uint        numLengths;
+        uint16      symbols[MaxSymbols];
+        LookupEntry lookup[1 << LookupBits];
+
+        /** Whether any code can be read from the tree. */
+        bool isReadable( ) const {
+            return codeStart[0] != 0;
+        }
+    };
+
+    /** Collects the code lengths of a tree's symbols, then builds it. */
+    class HuffmanTreeBuilder {
+        int16   m_lengthHead[HuffmanTree::MaxCodeBits];
+        int16   m_next[HuffmanTree::MaxSymbols];
+    public:
+        HuffmanTreeBuilder( ) {
+            this->clear( );
+        }
+
+        /** Forgets all symbols added. */
+        void clear( ) {
+            ::memset( m_lengthHead, 0xff, sizeof( m_lengthHead ) );
+            ::memset( m_next, 0xff, sizeof( m_next ) );
+        }
+
+        /** Adds a symbol with the given code length.
+        *  \param[in]  p_symbol     Symbol to add, below HuffmanTree::MaxSymbols.
+        *  \param[in]  p_bits       Length of its code, below HuffmanTree::MaxCodeBits. */
+        void addSymbol( uint16 p_symbol, uint p_bits ) {
+            // Each length is a list with the latest symbol first
+            m_next[p_symbol] = m_lengthHead[p_bits];
+            m_lengthHead[p_bits] = p_symbol;
+        }
+
+        /** Assigns the codes and fills the lookup table.
+        *  \param[out] po_tree  Tree to build.
+        *  \throws exception::Exception if the codes do not fit in the code space. */
+        void build( HuffmanTree& po_tree ) const;
+    };
+
+    /** Reads a stream of little-endian dwords, most significant bit first.
+    *   Past the end of the input, one more dword of zeroes can be read; going
+    *   further fails. This, and where exactly reads fail, matches the bit
+    *   reader of gw2dattools.
+    *   The input is either in memory as a whole, or handed over in chunks by
+    *   an InputSource as the reader gets to them. */
+    class HuffmanBitReader {
+    public:
+        /** Gets a chunk of the input.
+        *  \param[in]  p_offset     Position of the chunk in the input, a multiple of 4.
+        *  \param[in]  p_size       Size of the chunk.
+        *  \return byte*   The chunk, valid until the next call. nullptr if it
+        *                  could not be read. */
+        typedef std::function<const byte*( uint p_offset, uint p_size )> InputSource;
+    private:
+        /** Every 16384th dword of compressed .dat entries is a check value. */
+        static const uint CheckWordInterval = 0x4000;
+
+        const byte* m_input;
+        const InputSource* m_source;
+        uint32      m_chunkWords;
+        uint32      m_chunkStart;
+        uint32      m_chunkEnd;
+        uint32      m_numWords;
+        uint32      m_position;
+        uint64      m_buffer;
+        uint        m_bitCount;
+        uint64      m_consumed;
+        uint64      m_available;
+        bool        m_skipCheckWords;
+    public:
+        /** Constructor.
+        *  \param[in]  p_input          Input to read.
+        *  \param[in]  p_inputSize      Size of the input. Trailing bytes that do
+        *                               not make up a dword are ignored.
+        *  \param[in]  p_skipCheckWords Whether every 16384th dword is skipped. */
+        HuffmanBitReader( const byte* p_input, uint p_inputSize, bool p_skipCheckWords )
+            : m_input( p_input )
+            , m_source( nullptr )
+            , m_chunkWords( 0 )
+            , m_chunkStart( 0 )
+            , m_chunkEnd( p_inputSize / 4 )
+            , m_numWords( p_inputSize / 4 )
+            , m_position( 0 )
+            , m_buffer( 0 )
+            , m_bitCount( 0 )
+            , m_consumed( 0 )
+            , m_skipCheckWords( p_skipCheckWords ) {
+            uint32 numChecks = ( p_skipCheckWords ? m_numWords / CheckWordInterval : 0 );
+            m_available = uint64( m_numWords - numChecks ) * 32;
+        }
+        /** Constructor. Reads the input a chunk at a time.
+        *  \param[in]  p_source         Source of the input chunks. Must outlive the reader.
+        *  \param[in]  p_inputSize      Size of the whole input.
+        *  \param[in]  p_chunkSize      Size of the chunks to get, a multiple of 4.
+        *  \param[in]  p_skipCheckWords Whether every 16384th dword is skipped. */
+        HuffmanBitReader( const InputSource& p_source, uint p_inputSize, uint p_chunkSize, bool p_skipCheckWords )
+            : m_input( nullptr )
+            , m_source( &p_source )
+            , m_chunkWords( p_chunkSize / 4 )
+            , m_chunkStart( 0 )
+            , m_chunkEnd( 0 )
+            , m_numWords( p_inputSize / 4 )
+            , m_position( 0 )
+            , m_buffer( 0 )
+            , m_bitCount( 0 )
+            , m_consumed( 0 )
+            , m_skipCheckWords( p_skipCheckWords ) {
+            uint32 numChecks = ( p_skipCheckWords ? m_numWords / CheckWordInterval : 0 );
+            m_available = uint64( m_numWords - numChecks ) * 32;
+        }
+
+        /** Fails if p_bits more bits cannot be read. */
+        void need( uint p_bits ) const {
+            if ( m_consumed + p_bits > m_available + 32 ) {
+                throw exception::Exception( "Reached end of input." );
+            }
+        }
+
+        /** Fails if the next code would start past the end of the input. */
+        void needCode( ) const {
+            if ( m_consumed > m_available ) {
+                throw exception::Exception( "Reached end of input." );
+            }
+        }
+
+        /** Makes at least 33 bits available to peek at. */
+        void refill( ) {
+            while ( m_bitCount <= 32 ) {
+                m_buffer |= uint64( this->nextWord( ) ) << ( 32 - m_bitCount );
+                m_bitCount += 32;
+            }
+        }
+
+        uint32 peek( uint p_bits ) const {
+            return static_cast<uint32>( m_buffer >> ( 64 - p_bits ) );
+        }
+
+        void skip( uint p_bits ) {
+            m_buffer <<= p_bits;
+            m_bitCount -= p_bits;
+            m_consumed += p_bits;
+        }
+
+        /** Reads the given amount of bits, 1 to 32. */
+        uint32 read( uint p_bits ) {
+            this->need( p_bits );
+            this->refill( );
+            uint32 value = this->peek( p_bits );
+            this->skip( p_bits );
+            return value;
+        }
+
+        /** Reads a symbol with the given tree. */
+        uint16 readSymbol( const HuffmanTree& p_tree ) {
+            this->needCode( );
+            if ( !p_tree.isReadable( ) ) {
+                throw exception::Exception( "Trying to read code from an empty Huffman tree." );
+            }
+            this->refill( );
+
+            const auto& entry = p_tree.lookup[this->peek( HuffmanTree::LookupBits )];
+            if ( entry.count ) {
+                this->skip( entry.bits );
+                return entry.symbol;
+            }
+            return this->readLongSymbol( p_tree );
+        }
+
+        /** Reads a literal pair from the lookup table, if the next codes are one.
+        *  \return bool    true if both literals were read. */
+        bool readLiteralPair( const HuffmanTree& p_tree, byte* po_output ) {
+            this->refill( );
+            const auto& entry = p_tree.lookup[this->peek( HuffmanTree::LookupBits )];
+            if ( entry.count != 2 || m_consumed + entry.bits > m_available ) {
+                return false;
+            }
+            po_output[0] = static_cast<byte>( entry.symbol );
+            po_output[1] = static_cast<byte>( entry.second );
+            this->skip( entry.pairBits );
+            return true;
+        }
+
+        /** Gets the position of the first dword not consumed yet, where data
+        *   that follows the bit stream starts. Streams with check values do
+        *   not have such data.
+        *  \return uint32  Position, in dwords. */
+        uint32 wordPosition( ) const {
+            return static_cast<uint32>( ( m_consumed + 31 ) / 32 );
+        }
+
+    private:
+        uint32 nextWord( ) {
+            if ( m_skipCheckWords && ( m_position + 1 ) % CheckWordInterval == 0 ) {
+                m_position++;
+            }
+            uint32 word = 0;
+            if ( m_position < m_numWords ) {
+                if ( m_position >= m_chunkEnd ) {
+                    this->loadChunk( );
+                }
+                ::memcpy( &word, m_input + ( m_position - m_chunkStart ) * 4, sizeof( word ) );
+            }
+            m_position++;
+            return word;
+        }
+
+        void loadChunk( );
+        uint16 readLongSymbol( const HuffmanTree& p_tree );
+    };
+
+}; // namespace gw2b
+
+#endif // COMPRESSION_HUFFMANDECODER_H_INCLUDED
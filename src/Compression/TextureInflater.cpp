@@ -0,0 +1,502 @@
+/** \file       Compression/TextureInflater.cpp
+ *  \brief      Contains the definition of the in-tree inflater of ATEX textures.
+ *  \author     agent
+ */
+
+/**
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of Gw2Browser.
+ *
+ * Gw2Browser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stdafx.h"
+
+#include <vector>
+
+#include <gw2dattools/compression/inflateTextureFileBuffer.h>
+#include <gw2dattools/exception/Exception.h>
+
+#include "ANetStructs.h"
+#include "HuffmanDecoder.h"
+#include "TextureInflater.h"
+
+namespace gw2b {
+
+    namespace {
+
+        /** What the blocks of a format are made of. */
+        enum FormatFlags {
+            FF_Color            = 0x10,
+            FF_Alpha            = 0x20,
+            FF_DeducedAlpha     = 0x40,     /**< Alpha is part of the color, as in DXT1. */
+            FF_PlainAlpha       = 0x80,     /**< Alpha is stored apart from the color. */
+            FF_BiColor          = 0x200,    /**< Two color components, as in 3Dc. */
+        };
+
+        /** Passes the run-length coded part of the data is made of. */
+        enum CompressionFlags {
+            CF_WhiteColor       = 0x01,
+            CF_ConstantAlpha4   = 0x02,
+            CF_ConstantAlpha8   = 0x04,
+            CF_PlainColor       = 0x08,
+        };
+
+        /** What has been written to a block so far. */
+        enum BlockFlags {
+            BF_Alpha            = 0x01,
+            BF_Color            = 0x02,
+        };
+
+        /** Size of the ATEX header, up to and including the dimensions. */
+        const uint AtexHeaderSize = 12;
+
+        struct Layout {
+            uint    flags;
+            uint    numBlocks;
+            uint    bytesPerBlock;
+            uint    bytesPerComponent;
+            uint    colorOffset;        /**< Position of the color component in a block. */
+        };
+
+        bool formatFlags( uint32 p_format, uint& po_flags, uint& po_bitsPerPixel ) {
+            switch ( p_format ) {
+            case FCC_DXT1:
+                po_flags = FF_Color | FF_Alpha | FF_DeducedAlpha;
+                po_bitsPerPixel = 4;
+                return true;
+            case FCC_DXT2:
+            case FCC_DXT3:
+            case FCC_DXT4:
+            case FCC_DXT5:
+                po_flags = FF_Color | FF_Alpha | FF_PlainAlpha;
+                po_bitsPerPixel = 8;
+                return true;
+            case FCC_DXTA:
+                po_flags = FF_Alpha | FF_PlainAlpha;
+                po_bitsPerPixel = 4;
+                return true;
+            case FCC_DXTL:
+                po_flags = FF_Color;
+                po_bitsPerPixel = 8;
+                return true;
+            case FCC_DXTN:
+            case FCC_3DCX:
+                po_flags = FF_BiColor;
+                po_bitsPerPixel = 8;
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        /** Tree the run lengths are encoded with. */
+        HuffmanTree buildDictionaryTree( ) {
+            HuffmanTreeBuilder builder;
+            builder.addSymbol( 0x01, 1 );
+            builder.addSymbol( 0x12, 2 );
+            for ( uint16 symbol = 0x11; symbol >= 0x02; symbol-- ) {
+                builder.addSymbol( symbol, 6 );
+            }
+
+            HuffmanTree tree;
+            builder.build( tree );
+            return tree;
+        }
+
+        const HuffmanTree& dictionaryTree( ) {
+            static const HuffmanTree tree = buildDictionaryTree( );
+            return tree;
+        }
+
+        /** Inflates the blocks in [p_firstBlock, p_endBlock) into po_output. */
+        class TextureDecoder {
+            HuffmanBitReader    m_reader;
+            const byte*         m_input;
+            uint32              m_numWords;
+            const Layout&       m_layout;
+            std::vector<uint8>& m_blockFlags;
+            uint                m_firstBlock;
+            uint                m_endBlock;
+            byte*               m_output;
+        public:
+            TextureDecoder( const byte* p_input, uint p_inputSize, const Layout& p_layout, std::vector<uint8>& p_blockFlags,
+                uint p_firstBlock, uint p_endBlock, byte* po_output )
+                : m_reader( p_input, p_inputSize, false )
+                , m_input( p_input )
+                , m_numWords( p_inputSize / 4 )
+                , m_layout( p_layout )
+                , m_blockFlags( p_blockFlags )
+                , m_firstBlock( p_firstBlock )
+                , m_endBlock( p_endBlock )
+                , m_output( po_output ) {
+            }
+
+            void decode( ) {
+                // Skip the identifier, format and dimensions, then the size of the data
+                m_reader.read( 32 );
+                m_reader.read( 32 );
+                m_reader.read( 32 );
+                m_reader.read( 32 );
+                uint32 compressionFlags = m_reader.read( 32 );
+
+                m_blockFlags.assign( m_layout.numBlocks, 0 );
+                ::memset( m_output, 0, ( m_endBlock - m_firstBlock ) * m_layout.bytesPerBlock );
+
+                if ( compressionFlags & CF_WhiteColor ) {
+                    this->decodeWhiteColor( );
+                }
+                if ( compressionFlags & CF_ConstantAlpha4 ) {
+                    uint64 alpha = m_reader.read( 4 );
+                    alpha |= alpha << 4;
+                    alpha |= alpha << 8;
+                    alpha |= alpha << 16;
+                    alpha |= alpha << 32;
+                    this->decodeConstantAlpha( alpha );
+                }
+                if ( compressionFlags & CF_ConstantAlpha8 ) {
+                    uint64 alpha = m_reader.read( 8 );
+                    alpha |= alpha << 8;
+                    this->decodeConstantAlpha( alpha );
+                }
+                if ( compressionFlags & CF_PlainColor ) {
+                    this->decodePlainColor( );
+                }
+
+                this->copyRawBlocks( );
+            }
+
+        private:
+            /** Gets where the given block goes in the output, if it is inflated at all. */
+            byte* blockOutput( uint p_block ) const {
+                if ( p_block < m_firstBlock || p_block >= m_endBlock ) {
+                    return nullptr;
+                }
+                return m_output + ( p_block - m_firstBlock ) * m_layout.bytesPerBlock;
+            }
+
+            /** Walks the runs of a pass. Each run covers the given amount of
+            *   blocks that do not have p_doneFlag set yet, and applies to them
+            *   if its value bit is set.
+            *  \param[in]  p_readValue  Reads the value of a run, after its length.
+            *  \param[in]  p_apply      Applies a run to a block. */
+            template <typename ReadValue, typename Apply>
+            void decodeRuns( uint8 p_doneFlag, ReadValue p_readValue, Apply p_apply ) {
+                const auto& dictionary = dictionaryTree( );
+                auto flags = m_blockFlags.data( );
+                uint numBlocks = m_layout.numBlocks;
+
+                uint block = 0;
+                while ( block < numBlocks ) {
+                    uint count = m_reader.readSymbol( dictionary );
+                    bool value = p_readValue( );
+
+                    while ( count > 0 ) {
+                        if ( block >= numBlocks ) {
+                            throw exception::Exception( "Run goes past the last block." );
+                        }
+                        if ( !( flags[block] & p_doneFlag ) ) {
+                            if ( value ) {
+                                p_apply( block );
+                            }
+                            count--;
+                        }
+                        block++;
+                    }
+
+                    while ( block < numBlocks && ( flags[block] & p_doneFlag ) ) {
+                        block++;
+                    }
+                }
+            }
+
+            void decodeWhiteColor( ) {
+                const uint64 white = 0xFFFFFFFFFFFFFFFEull;
+                this->decodeRuns( BF_Color, [this] ( ) {
+                    return m_reader.read( 1 ) != 0;
+                }, [this, &white] ( uint p_block ) {
+                    auto output = this->blockOutput( p_block );
+                    if ( output ) {
+                        ::memcpy( output, &white, sizeof( white ) );
+                    }
+                    m_blockFlags[p_block] |= BF_Alpha | BF_Color;
+                } );
+            }
+
+            void decodeConstantAlpha( uint64 p_alpha ) {
+                const uint64 zero = 0;
+                uint size = wxMin( m_layout.bytesPerComponent, static_cast<uint>( sizeof( p_alpha ) ) );
+                bool isNotNull = false;
+                this->decodeRuns( BF_Alpha, [this, &isNotNull] ( ) {
+                    // The second bit only belongs to runs that apply
+                    m_reader.need( 2 );
+                    m_reader.refill( );
+                    bool value = m_reader.peek( 1 ) != 0;
+                    m_reader.skip( 1 );
+                    isNotNull = m_reader.peek( 1 ) != 0;
+                    if ( value ) {
+                        m_reader.skip( 1 );
+                    }
+                    return value;
+                }, [&] ( uint p_block ) {
+                    auto output = this->blockOutput( p_block );
+                    if ( output ) {
+                        ::memcpy( output, isNotNull ? &p_alpha : &zero, size );
+                    }
+                    m_blockFlags[p_block] |= BF_Alpha;
+                } );
+            }
+
+            void decodePlainColor( ) {
+                uint64 block = this->readPlainColorBlock( );
+                uint size = wxMin( m_layout.bytesPerComponent, static_cast<uint>( sizeof( block ) ) );
+                this->decodeRuns( BF_Color, [this] ( ) {
+                    return m_reader.read( 1 ) != 0;
+                }, [&] ( uint p_block ) {
+                    auto output = this->blockOutput( p_block );
+                    if ( output ) {
+                        ::memcpy( output + m_layout.colorOffset, &block, size );
+                    }
+                    m_blockFlags[p_block] |= BF_Color;
+                } );
+            }
+
+            /** Reads the color of the plain color pass, and builds the color
+            *   block that comes closest to it. */
+            uint64 readPlainColorBlock( ) {
+                m_reader.need( 24 );
+                int blue = m_reader.read( 8 );
+                int green = m_reader.read( 8 );
+                int red = m_reader.read( 8 );
+
+                // Closest 5:6:5 values, and how far the color is from them in twelfths
+                uint32 red5 = static_cast<uint8>( ( red - ( red >> 5 ) ) >> 3 );
+                uint32 blue5 = static_cast<uint8>( ( blue - ( blue >> 5 ) ) >> 3 );
+                uint32 green6 = static_cast<uint16>( ( green - ( green >> 6 ) ) >> 2 );
+
+                int red8 = static_cast<uint8>( ( red5 << 3 ) + ( red5 >> 2 ) );
+                int blue8 = static_cast<uint8>( ( blue5 << 3 ) + ( blue5 >> 2 ) );
+                int green8 = static_cast<uint16>( ( green6 << 2 ) + ( green6 >> 4 ) );
+
+                uint32 redError = 12 * ( red - red8 ) / ( 8 - ( ( red5 & 0x11 ) == 0x11 ? 1 : 0 ) );
+                uint32 blueError = 12 * ( blue - blue8 ) / ( 8 - ( ( blue5 & 0x11 ) == 0x11 ? 1 : 0 ) );
+                uint32 greenError = 12 * ( green - green8 ) / ( 8 - ( ( green6 & 0x1111 ) == 0x1111 ? 1 : 0 ) );
+
+                // Pick the two endpoints around each channel
+                auto endpoints = [] ( uint32 p_value, uint32 p_error, uint32& po_first, uint32& po_second ) {
+                    po_first = p_value + ( p_error < 6 ? 0 : 1 );
+                    po_second = p_value + ( p_error < 2 || ( p_error >= 6 && p_error < 10 ) ? 0 : 1 );
+                };
+                uint32 red1, red2, blue1, blue2, green1, green2;
+                endpoints( red5, redError, red1, red2 );
+                endpoints( blue5, blueError, blue1, blue2 );
+                endpoints( green6, greenError, green1, green2 );
+
+                uint32 color1 = red1 | ( ( green1 | ( blue1 << 6 ) ) << 5 );
+                uint32 color2 = red2 | ( ( green2 | ( blue2 << 6 ) ) << 5 );
+
+                // Average position between the endpoints, over the channels that differ
+                uint32 weight = 0;
+                uint32 numDiffering = 0;
+                auto addWeight = [&] ( uint32 p_first, uint32 p_second, uint32 p_value, uint32 p_error ) {
+                    if ( p_first != p_second ) {
+                        weight += ( p_first == p_value ) ? p_error : 12 - p_error;
+                        numDiffering++;
+                    }
+                };
+                addWeight( red1, red2, red5, redError );
+                addWeight( blue1, blue2, blue5, blueError );
+                addWeight( green1, green2, green6, greenError );
+                if ( numDiffering > 0 ) {
+                    weight = ( weight + ( numDiffering / 2 ) ) / numDiffering;
+                }
+
+                bool dxt1SpecialCase = ( m_layout.flags & FF_DeducedAlpha ) && ( weight == 5 || weight == 6 || numDiffering != 0 );
+                if ( numDiffering > 0 && !dxt1SpecialCase ) {
+                    if ( color2 == 0xFFFF ) {
+                        weight = 12;
+                        color1--;
+                    } else {
+                        weight = 0;
+                        color2++;
+                    }
+                }
+
+                if ( color2 >= color1 ) {
+                    std::swap( color1, color2 );
+                    weight = 12 - weight;
+                }
+
+                uint64 selected;
+                if ( dxt1SpecialCase ) {
+                    selected = 2;
+                } else if ( weight < 2 ) {
+                    selected = 0;
+                } else if ( weight < 6 ) {
+                    selected = 2;
+                } else if ( weight < 10 ) {
+                    selected = 3;
+                } else {
+                    selected = 1;
+                }
+
+                // Every pixel of the block uses the selected color
+                uint64 indices = selected | ( selected << 2 ) | ( ( selected | ( selected << 2 ) ) << 4 );
+                indices |= indices << 8;
+                indices |= indices << 16;
+                return static_cast<uint32>( color1 | ( color2 << 16 ) ) | ( indices << 32 );
+            }
+
+            uint32 word( uint32 p_position ) const {
+                uint32 value = 0;
+                if ( p_position < m_numWords ) {
+                    ::memcpy( &value, m_input + p_position * 4, sizeof( value ) );
+                }
+                return value;
+            }
+
+            /** Copies the blocks not covered by any run from the raw data that
+            *   follows the bit stream, alpha components first. Blocks left when
+            *   the data runs out stay zeroed. */
+            void copyRawBlocks( ) {
+                auto flags = m_blockFlags.data( );
+                uint numBlocks = m_layout.numBlocks;
+                uint32 position = m_reader.wordPosition( );
+
+                auto copyWords = [&] ( uint8 p_doneFlag, uint p_offset ) {
+                    for ( uint block = 0; block < numBlocks && position < m_numWords; block++ ) {
+                        if ( flags[block] & p_doneFlag ) {
+                            continue;
+                        }
+                        auto output = this->blockOutput( block );
+                        if ( output ) {
+                            uint32 value = this->word( position );
+                            ::memcpy( output + p_offset, &value, sizeof( value ) );
+                        }
+                        position++;
+                    }
+                };
+
+                if ( ( m_layout.flags & FF_Alpha ) && !( m_layout.flags & FF_DeducedAlpha ) ) {
+                    for ( uint block = 0; block < numBlocks && position < m_numWords; block++ ) {
+                        if ( flags[block] & BF_Alpha ) {
+                            continue;
+                        }
+                        auto output = this->blockOutput( block );
+                        if ( output ) {
+                            uint32 value = this->word( position );
+                            ::memcpy( output, &value, sizeof( value ) );
+                        }
+                        position++;
+                        if ( m_layout.bytesPerComponent > 4 ) {
+                            if ( output ) {
+                                uint32 value = this->word( position );
+                                ::memcpy( output + 4, &value, sizeof( value ) );
+                            }
+                            position++;
+                        }
+                    }
+                }
+
+                if ( m_layout.flags & ( FF_Color | FF_BiColor ) ) {
+                    copyWords( BF_Color, m_layout.colorOffset );
+                    if ( m_layout.bytesPerComponent > 4 ) {
+                        copyWords( BF_Color, m_layout.colorOffset + 4 );
+                    }
+                }
+            }
+        };
+
+        bool readLayout( const byte* p_input, uint p_inputSize, TextureInflater::Info& po_info, Layout& po_layout ) {
+            if ( !p_input || p_inputSize < AtexHeaderSize ) {
+                return false;
+            }
+
+            ::memcpy( &po_info.format, p_input + 4, sizeof( po_info.format ) );
+            ::memcpy( &po_info.width, p_input + 8, sizeof( po_info.width ) );
+            ::memcpy( &po_info.height, p_input + 10, sizeof( po_info.height ) );
+
+            uint bitsPerPixel;
+            if ( !formatFlags( po_info.format, po_layout.flags, bitsPerPixel ) ) {
+                return false;
+            }
+
+            po_info.blocksWide = ( po_info.width + 3 ) / 4;
+            po_info.blocksHigh = ( po_info.height + 3 ) / 4;
+            po_info.bytesPerBlock = bitsPerPixel * 4 * 4 / 8;
+            po_info.outputSize = po_info.blocksWide * po_info.blocksHigh * po_info.bytesPerBlock;
+
+            // Formats with separate alpha and color, and two-color formats, have two components
+            const uint plainFlags = FF_PlainAlpha | FF_Color | FF_Alpha;
+            bool hasTwoComponents = ( ( po_layout.flags & plainFlags ) == plainFlags ) || ( po_layout.flags & FF_BiColor );
+            po_layout.numBlocks = po_info.blocksWide * po_info.blocksHigh;
+            po_layout.bytesPerBlock = po_info.bytesPerBlock;
+            po_layout.bytesPerComponent = hasTwoComponents ? po_info.bytesPerBlock / 2 : po_info.bytesPerBlock;
+            po_layout.colorOffset = hasTwoComponents ? po_layout.bytesPerComponent : 0;
+            return true;
+        }
+
+        /** Which blocks have been written, per thread so inflating does not allocate. */
+        thread_local std::vector<uint8> t_blockFlags;
+
+    }; // anon namespace
+
+    bool TextureInflater::readInfo( const byte* p_input, uint p_inputSize, Info& po_info ) {
+        Layout layout;
+        return readLayout( p_input, p_inputSize, po_info, layout );
+    }
+
+    void TextureInflater::inflate( uint p_inputSize, const byte* p_input, uint32& po_outputSize, byte* po_output,
+        DatInflater::Implementation p_implementation ) {
+        if ( p_implementation == DatInflater::DI_Gw2DatTools ) {
+            try {
+                gw2dt::compression::inflateTextureFileBuffer( p_inputSize, p_input, po_outputSize, po_output );
+            } catch ( const gw2dt::exception::Exception& err ) {
+                throw exception::Exception( err.what( ) );
+            }
+            return;
+        }
+
+        Info info;
+        Layout layout;
+        if ( !readLayout( p_input, p_inputSize, info, layout ) ) {
+            throw exception::Exception( "Unsupported texture format." );
+        }
+        if ( !po_output || po_outputSize < info.outputSize ) {
+            throw exception::Exception( "Output buffer is too small." );
+        }
+
+        TextureDecoder decoder( p_input, p_inputSize, layout, t_blockFlags, 0, layout.numBlocks, po_output );
+        decoder.decode( );
+        po_outputSize = info.outputSize;
+    }
+
+    void TextureInflater::inflateRows( uint p_inputSize, const byte* p_input, uint p_firstRow, uint p_numRows, byte* po_output ) {
+        Info info;
+        Layout layout;
+        if ( !readLayout( p_input, p_inputSize, info, layout ) ) {
+            throw exception::Exception( "Unsupported texture format." );
+        }
+        if ( p_firstRow > info.blocksHigh || p_numRows > info.blocksHigh - p_firstRow ) {
+            throw exception::Exception( "Rows out of bounds." );
+        }
+
+        uint firstBlock = p_firstRow * info.blocksWide;
+        uint endBlock = ( p_firstRow + p_numRows ) * info.blocksWide;
+        TextureDecoder decoder( p_input, p_inputSize, layout, t_blockFlags, firstBlock, endBlock, po_output );
+        decoder.decode( );
+    }
+
+}; // namespace gw2b
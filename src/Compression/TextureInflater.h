@@ -0,0 +1,90 @@
+/** \file       Compression/TextureInflater.h
+ *  \brief      Contains the declaration of the in-tree inflater of ATEX textures.
+ *  \author     agent
+ */
+
+/**
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of Gw2Browser.
+ *
+ * Gw2Browser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#ifndef COMPRESSION_TEXTUREINFLATER_H_INCLUDED
+#define COMPRESSION_TEXTUREINFLATER_H_INCLUDED
+
+#include "DatInflater.h"
+
+namespace gw2b {
+
+    /** Inflates the first mip level of ATEX textures into their BCn (DXTn,
+    *   3Dc) blocks. Runs of blocks that are plain white, have a constant
+    *   alpha or a plain color are stored as run lengths, the other blocks
+    *   follow them as raw data. Only the first mip level is stored this way,
+    *   the rest of the file is never read.
+    *   The in-tree implementation writes straight into the caller's buffer,
+    *   can inflate only some rows of blocks, and produces the same blocks as
+    *   gw2dattools. It can be called from any number of threads at once. */
+    class TextureInflater {
+    public:
+        /** Layout of the first mip level of a texture. */
+        struct Info {
+            uint32  format;         /**< FourCC of the block format. */
+            uint16  width;          /**< Width, in pixels. */
+            uint16  height;         /**< Height, in pixels. */
+            uint    blocksWide;     /**< Width, in 4x4 blocks. */
+            uint    blocksHigh;     /**< Height, in 4x4 blocks. */
+            uint    bytesPerBlock;  /**< Size of one block. */
+            uint32  outputSize;     /**< Size of all blocks. */
+        };
+    public:
+        /** Reads the layout of the texture in the given data.
+        *  \param[in]  p_input      ATEX data.
+        *  \param[in]  p_inputSize  Size of the data.
+        *  \param[out] po_info      Layout of the texture.
+        *  \return bool    true if the data holds a texture in a supported format. */
+        static bool readInfo( const byte* p_input, uint p_inputSize, Info& po_info );
+
+        /** Inflates the first mip level of a texture.
+        *  \param[in]  p_inputSize      Size of the ATEX data.
+        *  \param[in]  p_input          ATEX data.
+        *  \param[in,out]  po_outputSize    Size of po_output, set to the amount
+        *                               of bytes inflated (Info::outputSize).
+        *  \param[out] po_output        Buffer to inflate into, at least
+        *                               Info::outputSize bytes.
+        *  \param[in]  p_implementation Implementation to inflate with.
+        *  \throws exception::Exception if the data is corrupt, or the buffer too small. */
+        static void inflate( uint p_inputSize, const byte* p_input, uint32& po_outputSize, byte* po_output,
+            DatInflater::Implementation p_implementation = DatInflater::DI_Builtin );
+        /** Inflates some rows of 4x4 blocks of the first mip level of a
+        *   texture, with the in-tree implementation. The output holds the
+        *   blocks of these rows only, laid out like in the full texture.
+        *  \param[in]  p_inputSize  Size of the ATEX data.
+        *  \param[in]  p_input      ATEX data.
+        *  \param[in]  p_firstRow   First row of blocks to inflate.
+        *  \param[in]  p_numRows    Amount of rows of blocks to inflate.
+        *  \param[out] po_output    Buffer to inflate into, at least p_numRows *
+        *                           Info::blocksWide * Info::bytesPerBlock bytes.
+        *  \throws exception::Exception if the data is corrupt, or the rows out of bounds. */
+        static void inflateRows( uint p_inputSize, const byte* p_input, uint p_firstRow, uint p_numRows, byte* po_output );
+
+    }; // class TextureInflater
+
+}; // namespace gw2b
+
+#endif // COMPRESSION_TEXTUREINFLATER_H_INCLUDED
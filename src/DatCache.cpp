@@ -0,0 +1,138 @@
+/** \file       DatCache.cpp
+ *  \brief      Contains the definition of the cache of decompressed .dat entries.
+ *  \author     agent
+ */
+
+/**
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of Gw2Browser.
+ *
+ * Gw2Browser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stdafx.h"
+
+#include "DatCache.h"
+
+namespace gw2b {
+
+    DatCache::DatCache( size_t p_budget )
+        : m_budget( p_budget )
+        , m_usedBytes( 0 )
+        , m_hits( 0 )
+        , m_misses( 0 ) {
+    }
+
+    DatCache::~DatCache( ) {
+    }
+
+    void DatCache::setBudget( size_t p_budget ) {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_budget = p_budget;
+        this->evict( p_budget );
+    }
+
+    size_t DatCache::usedBytes( ) const {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_usedBytes;
+    }
+
+    bool DatCache::contains( uint p_entryNum ) const {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_itemMap.find( p_entryNum ) != m_itemMap.end( );
+    }
+
+    uint DatCache::read( uint p_entryNum, uint p_size, byte* po_buffer ) {
+        std::lock_guard<std::mutex> lock( m_mutex );
+
+        auto it = m_itemMap.find( p_entryNum );
+        if ( it == m_itemMap.end( ) ) {
+            m_misses++;
+            return 0;
+        }
+        m_hits++;
+
+        // Move to the front of the list, as most recently used
+        m_items.splice( m_items.begin( ), m_items, it->second );
+
+        const auto& data = it->second->data;
+        uint size = wxMin( p_size, static_cast<uint>( data.GetSize( ) ) );
+        ::memcpy( po_buffer, data.GetPointer( ), size );
+        return size;
+    }
+
+    Array<byte> DatCache::read( uint p_entryNum ) {
+        std::lock_guard<std::mutex> lock( m_mutex );
+
+        auto it = m_itemMap.find( p_entryNum );
+        if ( it == m_itemMap.end( ) ) {
+            m_misses++;
+            return Array<byte>( );
+        }
+        m_hits++;
+
+        m_items.splice( m_items.begin( ), m_items, it->second );
+
+        // Array shares its data through a reference count that is not thread
+        // safe, so hand out a copy rather than a reference to the cached data
+        const auto& data = it->second->data;
+        Array<byte> output( data.GetSize( ) );
+        ::memcpy( output.GetPointer( ), data.GetPointer( ), data.GetByteSize( ) );
+        return output;
+    }
+
+    void DatCache::insert( uint p_entryNum, const byte* p_data, uint p_size ) {
+        if ( !p_size || p_size > m_budget ) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock( m_mutex );
+
+        // Another thread may have read the same entry in the meantime
+        size_t budget = m_budget;
+        if ( p_size > budget || m_itemMap.find( p_entryNum ) != m_itemMap.end( ) ) {
+            return;
+        }
+
+        this->evict( budget - p_size );
+
+        m_items.push_front( CacheItem( ) );
+        auto& item = m_items.front( );
+        item.entryNum = p_entryNum;
+        item.data.SetSize( p_size );
+        ::memcpy( item.data.GetPointer( ), p_data, p_size );
+
+        m_itemMap[p_entryNum] = m_items.begin( );
+        m_usedBytes += p_size;
+    }
+
+    void DatCache::clear( ) {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_itemMap.clear( );
+        m_items.clear( );
+        m_usedBytes = 0;
+    }
+
+    void DatCache::evict( size_t p_budget ) {
+        // Least recently used entries are at the back
+        while ( m_usedBytes > p_budget && !m_items.empty( ) ) {
+            auto& item = m_items.back( );
+            m_usedBytes -= item.data.GetSize( );
+            m_itemMap.erase( item.entryNum );
+            m_items.pop_back( );
+        }
+    }
+
+}; // namespace gw2b
@@ -0,0 +1,126 @@
+/** \file       DatCache.h
+ *  \brief      Contains the declaration of the cache of decompressed .dat entries.
+ *  \author     agent
+ */
+
+/**
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of Gw2Browser.
+ *
+ * Gw2Browser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifndef DATCACHE_H_INCLUDED
+#define DATCACHE_H_INCLUDED
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace gw2b {
+
+    /** Least recently used cache of decompressed .dat entries, bounded by the
+    *   total size of the entries it holds. Safe to use from multiple threads.
+    *   Data never leaves the cache by reference, it is always copied out. */
+    class DatCache {
+        struct CacheItem {
+            uint        entryNum;
+            Array<byte> data;
+        };
+        typedef std::list<CacheItem>                        ItemList;
+        typedef std::unordered_map<uint, ItemList::iterator> ItemMap;
+    private:
+        mutable std::mutex      m_mutex;
+        ItemList                m_items;        // most recently used first
+        ItemMap                 m_itemMap;
+        std::atomic<size_t>     m_budget;
+        size_t                  m_usedBytes;
+        std::atomic<uint64>     m_hits;
+        std::atomic<uint64>     m_misses;
+    public:
+        /** Constructor.
+        *  \param[in]  p_budget     Maximum amount of bytes to keep cached. 0
+        *                           disables the cache. */
+        DatCache( size_t p_budget = 0 );
+        /** Destructor. */
+        ~DatCache( );
+
+        /** Sets the maximum amount of bytes to keep cached, evicting entries as
+        *   needed. 0 disables the cache.
+        *  \param[in]  p_budget     New budget, in bytes. */
+        void setBudget( size_t p_budget );
+        /** Gets the maximum amount of bytes kept cached.
+        *  \return size_t  Budget, in bytes. */
+        size_t budget( ) const {
+            return m_budget;
+        }
+        /** Checks whether the cache is enabled.
+        *  \return bool    true if the budget is above 0. */
+        bool isEnabled( ) const {
+            return m_budget > 0;
+        }
+        /** Gets the amount of bytes currently cached.
+        *  \return size_t  Cached bytes. */
+        size_t usedBytes( ) const;
+
+        /** Checks whether an entry is cached, without counting as a hit or a
+        *   miss, or marking it as recently used.
+        *  \param[in]  p_entryNum   MFT entry number to look for.
+        *  \return bool    true if the entry is cached. */
+        bool contains( uint p_entryNum ) const;
+        /** Copies the start of a cached entry into the given buffer, and marks
+        *   it as recently used. Counts as a hit or a miss.
+        *  \param[in]  p_entryNum   MFT entry number to look for.
+        *  \param[in]  p_size       Maximum amount of bytes to copy.
+        *  \param[out] po_buffer    Buffer to copy to, at least p_size long.
+        *  \return uint    Amount of bytes copied, 0 if not cached. */
+        uint read( uint p_entryNum, uint p_size, byte* po_buffer );
+        /** Copies a cached entry, and marks it as recently used. Counts as a hit
+        *   or a miss.
+        *  \param[in]  p_entryNum   MFT entry number to look for.
+        *  \return Array<byte>  Copy of the entry, empty if not cached. */
+        Array<byte> read( uint p_entryNum );
+        /** Adds a copy of a fully decompressed entry to the cache, evicting
+        *   the least recently used entries to stay within budget. Entries too
+        *   big for the budget are ignored.
+        *  \param[in]  p_entryNum   MFT entry number the data belongs to.
+        *  \param[in]  p_data       Decompressed contents of the entry.
+        *  \param[in]  p_size       Size of the entry. */
+        void insert( uint p_entryNum, const byte* p_data, uint p_size );
+        /** Removes all entries from the cache. Keeps the counters. */
+        void clear( );
+
+        /** Gets the amount of lookups that found their entry.
+        *  \return uint64  Cache hits. */
+        uint64 hits( ) const {
+            return m_hits;
+        }
+        /** Gets the amount of lookups that did not find their entry.
+        *  \return uint64  Cache misses. */
+        uint64 misses( ) const {
+            return m_misses;
+        }
+
+    private:
+        void evict( size_t p_budget );
+
+    }; // class DatCache
+
+}; // namespace gw2b
+
+#endif // DATCACHE_H_INCLUDED
@@ -0,0 +1,131 @@
+/** \file       DatEntryView.cpp
+ *  \brief      Contains the definition of the view of .dat entry data.
+ *  \author     agent
+ */
+
+/**
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of Gw2Browser.
+ *
+ * Gw2Browser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stdafx.h"
+
+#include <algorithm>
+
+#include "DatEntryView.h"
+
+namespace gw2b {
+
+    DatEntryView::DatEntryView( )
+        : m_size( 0 ) {
+    }
+
+    DatEntryView::DatEntryView( const Array<byte>& p_data )
+        : m_storage( p_data )
+        , m_size( static_cast<uint>( p_data.GetSize( ) ) ) {
+        if ( m_size ) {
+            Segment segment = { m_storage.GetPointer( ), 0, m_size };
+            m_segments.push_back( segment );
+        }
+    }
+
+    void DatEntryView::setData( const byte* p_data, uint p_size, const Array<byte>& p_storage ) {
+        m_storage = p_storage;
+        m_segments.clear( );
+        m_size = p_size;
+        if ( p_size ) {
+            Segment segment = { p_data, 0, p_size };
+            m_segments.push_back( segment );
+        }
+    }
+
+    void DatEntryView::setRawEntry( const byte* p_raw, uint p_rawSize, const Array<byte>& p_storage ) {
+        m_storage = p_storage;
+        m_segments.clear( );
+        m_size = 0;
+
+        // Every full block ends in a trailer, the last partial block is kept whole
+        uint numBlocks = p_rawSize / RawBlockSize;
+        m_segments.reserve( numBlocks + 1 );
+        for ( uint i = 0; i < numBlocks; i++ ) {
+            Segment segment = { p_raw + i * RawBlockSize, m_size, RawBlockDataSize };
+            m_segments.push_back( segment );
+            m_size += RawBlockDataSize;
+        }
+
+        uint remaining = p_rawSize - numBlocks * RawBlockSize;
+        if ( remaining ) {
+            Segment segment = { p_raw + numBlocks * RawBlockSize, m_size, remaining };
+            m_segments.push_back( segment );
+            m_size += remaining;
+        }
+    }
+
+    uint DatEntryView::rawEntryDataSize( uint p_rawSize ) {
+        return p_rawSize - ( p_rawSize / RawBlockSize ) * ( RawBlockSize - RawBlockDataSize );
+    }
+
+    const DatEntryView::Segment* DatEntryView::findSegment( uint p_offset ) const {
+        if ( p_offset >= m_size ) {
+            return nullptr;
+        }
+
+        // Last segment starting at or before the offset
+        auto it = std::upper_bound( m_segments.begin( ), m_segments.end( ), p_offset, [] ( uint p_value, const Segment& p_segment ) {
+            return p_value < p_segment.offset;
+        } );
+        return &*( it - 1 );
+    }
+
+    const byte* DatEntryView::contiguousRange( uint p_offset, uint p_size ) const {
+        auto segment = this->findSegment( p_offset );
+        if ( !segment || p_size > segment->offset + segment->size - p_offset ) {
+            return nullptr;
+        }
+        return segment->data + ( p_offset - segment->offset );
+    }
+
+    uint DatEntryView::read( uint p_offset, void* po_buffer, uint p_size ) const {
+        auto segment = this->findSegment( p_offset );
+        if ( !segment ) {
+            return 0;
+        }
+
+        auto output = static_cast<byte*>( po_buffer );
+        auto end = m_segments.data( ) + m_segments.size( );
+        uint copied = 0;
+        for ( ; segment != end && copied < p_size; segment++ ) {
+            uint start = ( copied ? 0 : p_offset - segment->offset );
+            uint size = wxMin( segment->size - start, p_size - copied );
+            ::memcpy( output + copied, segment->data + start, size );
+            copied += size;
+        }
+        return copied;
+    }
+
+    Array<byte> DatEntryView::toArray( ) const {
+        // Views of whole arrays can share them
+        if ( m_segments.size( ) == 1 && m_segments[0].data == m_storage.GetPointer( ) && m_size == m_storage.GetSize( ) ) {
+            return m_storage;
+        }
+
+        Array<byte> output( m_size );
+        this->read( 0, output.GetPointer( ), m_size );
+        return output;
+    }
+
+}; // namespace gw2b
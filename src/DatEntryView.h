@@ -0,0 +1,124 @@
+/** \file       DatEntryView.h
+ *  \brief      Contains the declaration of the view of .dat entry data.
+ *  \author     agent
+ */
+
+/**
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of Gw2Browser.
+ *
+ * Gw2Browser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifndef DATENTRYVIEW_H_INCLUDED
+#define DATENTRYVIEW_H_INCLUDED
+
+#include <vector>
+
+namespace gw2b {
+
+    /** Read-only view of the contents of a .dat entry, made of one or more
+    *   segments of memory. Uncompressed entries are stored in blocks that end
+    *   in a 4-byte trailer; their views point at the data between trailers
+    *   instead of copying it into one buffer.
+    *   A view of data inside the memory mapped .dat is only valid as long as
+    *   the DatFile it came from stays open. */
+    class DatEntryView {
+    public:
+        /** Contiguous part of the viewed data. */
+        struct Segment {
+            const byte* data;
+            uint        offset;     /**< Position of the segment in the viewed data. */
+            uint        size;
+        };
+        /** Size of the blocks uncompressed entries are stored in, trailer included. */
+        static const uint RawBlockSize = 65536;
+        /** Size of the data in each block of an uncompressed entry. */
+        static const uint RawBlockDataSize = 65532;
+    private:
+        Array<byte>             m_storage;
+        std::vector<Segment>    m_segments;
+        uint                    m_size;
+    public:
+        /** Default constructor. Creates an empty view. */
+        DatEntryView( );
+        /** Constructor. Views the given data as a single segment, sharing it.
+        *  \param[in]  p_data   Data to view. */
+        explicit DatEntryView( const Array<byte>& p_data );
+
+        /** Views the given data as a single segment.
+        *  \param[in]  p_data       Data to view.
+        *  \param[in]  p_size       Size of the data.
+        *  \param[in]  p_storage    Buffer holding the data, kept alive by the view.
+        *                           Empty when the data lives elsewhere. */
+        void setData( const byte* p_data, uint p_size, const Array<byte>& p_storage = Array<byte>( ) );
+        /** Views the raw data of an uncompressed entry, skipping the block
+        *   trailers.
+        *  \param[in]  p_raw        Raw data of the entry, as stored in the .dat.
+        *  \param[in]  p_rawSize    Size of the raw data.
+        *  \param[in]  p_storage    Buffer holding the raw data, kept alive by the
+        *                           view. Empty when the data lives elsewhere,
+        *                           such as in a memory mapping. */
+        void setRawEntry( const byte* p_raw, uint p_rawSize, const Array<byte>& p_storage = Array<byte>( ) );
+        /** Gets the amount of data in a raw uncompressed entry, without the
+        *   block trailers.
+        *  \param[in]  p_rawSize    Size of the raw data.
+        *  \return uint    Size of the entry contents. */
+        static uint rawEntryDataSize( uint p_rawSize );
+
+        /** Gets the size of the viewed data.
+        *  \return uint    Size, in bytes. */
+        uint size( ) const {
+            return m_size;
+        }
+        /** Gets the amount of segments the data is made of.
+        *  \return uint    Amount of segments. */
+        uint numSegments( ) const {
+            return static_cast<uint>( m_segments.size( ) );
+        }
+        /** Gets the segment with the given index.
+        *  \param[in]  p_index  Index of the segment.
+        *  \return Segment&     The segment. */
+        const Segment& segment( uint p_index ) const {
+            return m_segments[p_index];
+        }
+        /** Gets a pointer to the given range of the viewed data, if it does not
+        *   cross a segment boundary.
+        *  \param[in]  p_offset     Start of the range.
+        *  \param[in]  p_size       Size of the range.
+        *  \return byte*   Pointer to the range, nullptr if it is split or out of bounds. */
+        const byte* contiguousRange( uint p_offset, uint p_size ) const;
+
+        /** Copies part of the viewed data to the given buffer.
+        *  \param[in]  p_offset     Position in the viewed data to copy from.
+        *  \param[out] po_buffer    Buffer to copy to.
+        *  \param[in]  p_size       Maximum amount of bytes to copy.
+        *  \return uint    Amount of bytes copied. */
+        uint read( uint p_offset, void* po_buffer, uint p_size ) const;
+        /** Gets the viewed data as one array. Shares the data of views made from
+        *   an array, copies it otherwise.
+        *  \return Array<byte>  The viewed data. */
+        Array<byte> toArray( ) const;
+
+    private:
+        const Segment* findSegment( uint p_offset ) const;
+
+    }; // class DatEntryView
+
+}; // namespace gw2b
+
+#endif // DATENTRYVIEW_H_INCLUDED
@@ -25,8 +25,18 @@
 
 #include "stdafx.h"
 
-#include <gw2dattools/exception/Exception.h>
-
+#ifdef _WIN32
+#include <io.h>
+#include <wx/msw/wrapwin.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <vector>
+
+#include "Exception.h"
 #include "FileReader.h"
 
 #include "DatFile.h"
@@ -38,14 +48,106 @@ namespace gw2b {
         uint32  fileId;
     };
 
-    DatFile::DatFile( )
-        : m_lastReadEntry( -1 ) {
+    namespace {
+
+        /** Entries up to this size are read into a buffer owned by the reading
+        *   thread, bigger ones get a buffer of their own for the call. */
+        const uint MaxThreadInputBufferSize = 16 * 1024 * 1024;
+
+        thread_local Array<byte> t_inputBuffer;
+
+        /** Amount of compressed data first read when peeking at the start of a
+        *   compressed entry. Grown by PeekChunkGrowth until the peek succeeds. */
+        const uint InitialPeekChunkSize = 4096;
+        const uint PeekChunkGrowth = 4;
+        /** Extra bytes decoded past a peek from a partial compressed stream. The
+        *   inflater only notices running out of input on the next code it reads,
+        *   so the peeked bytes are only known good once a code past them was
+        *   decoded. This is more than the longest back reference. */
+        const uint PeekSafetyMargin = 512;
+
+        /** Uncompressed entries are streamed this many blocks at a time. */
+        const uint StreamBlocksPerChunk = 16;
+
+        /** Entries this close to each other are read with a single read by
+        *   readEntries, reading the gap along with them. */
+        const uint64 MaxCoalesceGap = 64 * 1024;
+        /** Largest read readEntries merges entries into. Bigger entries are
+        *   still read in one go. */
+        const uint64 MaxCoalescedReadSize = 8 * 1024 * 1024;
+
+        /** Marks compressed entries with a size that was not read yet. */
+        const uint32 UnknownEntrySize = std::numeric_limits<uint32>::max( );
+
+        /** Marks an unused slot in the id lookup tables. Entry numbers never get
+        *   near UINT_MAX, so this can not clash with a real slot. */
+        const uint64 EmptyIdSlot = std::numeric_limits<uint64>::max( );
+
+        // The id lookup tables are open addressing hash tables, with the id in
+        // the upper half of each slot and the entry number in the lower half.
+        uint idSlotIndex( uint32 p_id, size_t p_mask ) {
+            return static_cast<uint>( ( ( p_id * 0x9e3779b97f4a7c15ull ) >> 32 ) & p_mask );
+        }
+
+        void initIdLookup( Array<uint64>& po_table, size_t p_numIds ) {
+            size_t size = 16;
+            while ( size < p_numIds * 2 ) {
+                size <<= 1;
+            }
+            po_table.SetSize( size );
+            ::memset( po_table.GetPointer( ), 0xff, po_table.GetByteSize( ) );
+        }
+
+        /** Adds the id to the table, unless it is already in there. Adding the
+        *   entries in order thus makes lookups find the lowest entry number. */
+        void addIdLookup( Array<uint64>& po_table, uint32 p_id, uint32 p_entryNum ) {
+            auto mask = po_table.GetSize( ) - 1;
+            auto slots = po_table.GetPointer( );
+            for ( auto index = idSlotIndex( p_id, mask ); ; index = ( index + 1 ) & mask ) {
+                if ( slots[index] == EmptyIdSlot ) {
+                    slots[index] = ( static_cast<uint64>( p_id ) << 32 ) | p_entryNum;
+                    return;
+                }
+                if ( static_cast<uint32>( slots[index] >> 32 ) == p_id ) {
+                    return;
+                }
+            }
+        }
+
+        uint findIdLookup( const Array<uint64>& p_table, uint32 p_id ) {
+            if ( !p_table.GetSize( ) ) {
+                return std::numeric_limits<uint>::max( );
+            }
+            auto mask = p_table.GetSize( ) - 1;
+            auto slots = p_table.GetPointer( );
+            for ( auto index = idSlotIndex( p_id, mask ); slots[index] != EmptyIdSlot; index = ( index + 1 ) & mask ) {
+                if ( static_cast<uint32>( slots[index] >> 32 ) == p_id ) {
+                    return static_cast<uint32>( slots[index] );
+                }
+            }
+            return std::numeric_limits<uint>::max( );
+        }
+
+    }; // anon namespace
+
+    DatFile::DatFile( ReadBackend p_backend )
+        : m_readBackend( p_backend )
+        , m_ioPolicy( IP_Normal )
+        , m_defaultIoPolicy( IP_Normal )
+        , m_ioPolicyUsers( )
+        , m_inflater( DatInflater::DI_Gw2DatTools )
+        , m_fileLength( 0 ) {
         ::memset( &m_datHead, 0, sizeof( m_datHead ) );
         ::memset( &m_mftHead, 0, sizeof( m_mftHead ) );
     }
 
-    DatFile::DatFile( const wxString& p_filename )
-        : m_lastReadEntry( -1 ) {
+    DatFile::DatFile( const wxString& p_filename, ReadBackend p_backend )
+        : m_readBackend( p_backend )
+        , m_ioPolicy( IP_Normal )
+        , m_defaultIoPolicy( IP_Normal )
+        , m_ioPolicyUsers( )
+        , m_inflater( DatInflater::DI_Gw2DatTools )
+        , m_fileLength( 0 ) {
         ::memset( &m_datHead, 0, sizeof( m_datHead ) );
         ::memset( &m_mftHead, 0, sizeof( m_mftHead ) );
         this->open( p_filename );
@@ -64,15 +166,17 @@ namespace gw2b {
             if ( !m_file.IsOpened( ) ) {
                 break;
             }
+            m_filename = p_filename;
 
             // Read header
-            if ( static_cast<size_t>( m_file.Length( ) ) < sizeof( m_datHead ) ) {
+            m_fileLength = m_file.Length( );
+            if ( m_fileLength < sizeof( m_datHead ) ) {
                 break;
             }
             m_file.Read( &m_datHead, sizeof( m_datHead ) );
 
             // Read MFT Header
-            if ( static_cast<uint64>( m_file.Length( ) ) < m_datHead.mftOffset + m_datHead.mftSize ) {
+            if ( m_fileLength < m_datHead.mftOffset + m_datHead.mftSize ) {
                 break;
             }
             m_file.Seek( m_datHead.mftOffset, wxFromStart );
@@ -91,7 +195,7 @@ namespace gw2b {
             m_file.Read( m_mftEntries.GetPointer( ), m_datHead.mftSize );
 
             // Read the file id entry table
-            if ( static_cast<uint64>( m_file.Length( ) ) < m_mftEntries[2].offset + m_mftEntries[2].size ) {
+            if ( m_fileLength < m_mftEntries[2].offset + m_mftEntries[2].size ) {
                 break;
             }
             if ( m_mftEntries[2].size % sizeof( ANetFileIdEntry ) ) {
@@ -128,6 +232,31 @@ namespace gw2b {
                 }
             }
 
+            // Uncompressed entries are as big as they are in the .dat, less the
+            // block trailers. The size of compressed ones is filled in as it
+            // gets known.
+            m_entrySizes.reset( new std::atomic<uint32>[m_mftEntries.GetSize( )] );
+            for ( uint i = 0; i < m_mftEntries.GetSize( ); i++ ) {
+                auto size = ( m_mftEntries[i].compressionFlag & ANCF_Compressed ) ? UnknownEntrySize : DatEntryView::rawEntryDataSize( m_mftEntries[i].size );
+                m_entrySizes[i].store( size, std::memory_order_relaxed );
+            }
+
+            // Build the id -> entry lookups. File ids fall back to the base id
+            // when an entry has no file id of its own.
+            initIdLookup( m_fileIdToEntry, m_entryToId.GetSize( ) );
+            initIdLookup( m_baseIdToEntry, m_entryToId.GetSize( ) );
+            for ( uint i = 0; i < m_entryToId.GetSize( ); i++ ) {
+                auto& entry = m_entryToId[i];
+                addIdLookup( m_fileIdToEntry, ( entry.fileId == 0 ? entry.baseId : entry.fileId ), i );
+                addIdLookup( m_baseIdToEntry, entry.baseId, i );
+            }
+
+            // Map the file if asked to, falling back to wxFile if that fails
+            if ( m_readBackend == RB_MemoryMap && !m_mappedFile.open( p_filename ) ) {
+                wxLogMessage( wxT( "Failed to map %s into memory, falling back to file reads." ), p_filename );
+            }
+            this->applyIoPolicy( );
+
             // Success!
             return true;
         }
@@ -141,9 +270,12 @@ namespace gw2b {
     }
 
     void DatFile::close( ) {
-        // Clear input buffer and lookup tables
-        m_inputBuffer.Clear( );
+        // Clear lookup tables and cached entries
+        m_cache.clear( );
         m_entryToId.Clear( );
+        m_fileIdToEntry.Clear( );
+        m_baseIdToEntry.Clear( );
+        m_entrySizes.reset( );
 
         // Clear PODs
         ::memset( &m_datHead, 0, sizeof( m_datHead ) );
@@ -151,10 +283,143 @@ namespace gw2b {
 
         // Remove MFT entries and close the file
         m_mftEntries.Clear( );
+        m_mappedFile.close( );
         m_file.Close( );
+        m_filename.Clear( );
+        m_fileLength = 0;
+    }
+
+    void DatFile::setReadBackend( ReadBackend p_backend ) {
+        m_readBackend = p_backend;
+        if ( !this->isOpen( ) ) {
+            return;
+        }
+
+        if ( p_backend == RB_MemoryMap && !m_mappedFile.isOpen( ) ) {
+            if ( !m_mappedFile.open( m_filename ) ) {
+                wxLogMessage( wxT( "Failed to map %s into memory, falling back to file reads." ), m_filename );
+            }
+        } else if ( p_backend == RB_File ) {
+            m_mappedFile.close( );
+        }
+        this->applyIoPolicy( );
+    }
+
+    void DatFile::setIoPolicy( IoPolicy p_policy ) {
+        std::lock_guard<std::mutex> lock( m_ioPolicyMutex );
+        m_defaultIoPolicy = p_policy;
+        this->updateIoPolicy( );
+    }
+
+    void DatFile::beginIoPolicy( IoPolicy p_policy ) const {
+        std::lock_guard<std::mutex> lock( m_ioPolicyMutex );
+        m_ioPolicyUsers[p_policy]++;
+        this->updateIoPolicy( );
+    }
+
+    void DatFile::endIoPolicy( IoPolicy p_policy ) const {
+        std::lock_guard<std::mutex> lock( m_ioPolicyMutex );
+        Assert( m_ioPolicyUsers[p_policy] );
+        m_ioPolicyUsers[p_policy]--;
+        this->updateIoPolicy( );
+    }
+
+    void DatFile::updateIoPolicy( ) const {
+        auto policy = m_defaultIoPolicy;
+        if ( m_ioPolicyUsers[IP_Streaming] ) {
+            policy = IP_Streaming;
+        } else if ( m_ioPolicyUsers[IP_Sequential] ) {
+            policy = IP_Sequential;
+        } else if ( m_ioPolicyUsers[IP_Random] ) {
+            policy = IP_Random;
+        }
+
+        if ( m_ioPolicy.exchange( policy, std::memory_order_relaxed ) != policy && this->isOpen( ) ) {
+            this->applyIoPolicy( );
+        }
+    }
+
+    void DatFile::applyIoPolicy( ) const {
+        auto policy = this->ioPolicy( );
+#ifndef _WIN32
+        int advice = POSIX_FADV_NORMAL;
+        if ( policy == IP_Sequential || policy == IP_Streaming ) {
+            advice = POSIX_FADV_SEQUENTIAL;
+        } else if ( policy == IP_Random ) {
+            advice = POSIX_FADV_RANDOM;
+        }
+        ::posix_fadvise( m_file.fd( ), 0, 0, advice );
+#endif
+
+        if ( policy == IP_Sequential || policy == IP_Streaming ) {
+            m_mappedFile.advise( MappedFile::MA_Sequential );
+        } else if ( policy == IP_Random ) {
+            m_mappedFile.advise( MappedFile::MA_Random );
+        } else {
+            m_mappedFile.advise( MappedFile::MA_Normal );
+        }
+    }
+
+    void DatFile::releaseEntry( uint p_entryNum ) const {
+        uint64 offset;
+        uint size;
+        if ( this->entryLocation( p_entryNum, offset, size ) ) {
+            this->releaseRange( offset, size );
+        }
     }
 
-    uint DatFile::entrySize( uint p_entryNum ) {
+    void DatFile::releaseRange( uint64 p_offset, uint64 p_size ) const {
+        if ( this->ioPolicy( ) != IP_Streaming ) {
+            return;
+        }
+
+        // Unmap the pages first, the page cache only lets go of unmapped ones
+        m_mappedFile.discard( p_offset, p_size );
+#ifndef _WIN32
+        ::posix_fadvise( m_file.fd( ), p_offset, p_size, POSIX_FADV_DONTNEED );
+#endif
+    }
+
+    bool DatFile::readAt( uint64 p_offset, void* po_buffer, size_t p_size ) const {
+        if ( p_offset + p_size > m_fileLength ) {
+            return false;
+        }
+
+        if ( m_mappedFile.isOpen( ) ) {
+            ::memcpy( po_buffer, m_mappedFile.data( ) + p_offset, p_size );
+            return true;
+        }
+
+        // Positional reads leave the file position alone, so any number of
+        // threads can read through the same handle at once
+        auto output = static_cast<byte*>( po_buffer );
+        while ( p_size ) {
+#ifdef _WIN32
+            auto handle = reinterpret_cast<HANDLE>( ::_get_osfhandle( m_file.fd( ) ) );
+            OVERLAPPED overlapped;
+            ::memset( &overlapped, 0, sizeof( overlapped ) );
+            overlapped.Offset = static_cast<DWORD>( p_offset );
+            overlapped.OffsetHigh = static_cast<DWORD>( p_offset >> 32 );
+
+            DWORD chunkSize = static_cast<DWORD>( wxMin( p_size, static_cast<size_t>( 0x40000000 ) ) );
+            DWORD bytesRead = 0;
+            if ( !::ReadFile( handle, output, chunkSize, &bytesRead, &overlapped ) || bytesRead == 0 ) {
+                return false;
+            }
+#else
+            auto bytesRead = ::pread( m_file.fd( ), output, p_size, p_offset );
+            if ( bytesRead <= 0 ) {
+                return false;
+            }
+#endif
+            output += bytesRead;
+            p_offset += bytesRead;
+            p_size -= bytesRead;
+        }
+        return true;
+    }
+
+    uint DatFile::entrySize( uint p_entryNum ) const {
         if ( !isOpen( ) ) {
             return std::numeric_limits<uint>::max( );
         }
@@ -162,41 +427,44 @@ namespace gw2b {
             return std::numeric_limits<uint>::max( );
         }
 
-        auto& entry = m_mftEntries[p_entryNum];
-
-        // If the entry is compressed we need to read the uncompressed size from the .dat
-        if ( entry.compressionFlag & ANCF_Compressed ) {
-            uint32 uncompressedSize = 0;
-            m_file.Seek( entry.offset + 4, wxFromStart );
-            m_file.Read( &uncompressedSize, sizeof( uncompressedSize ) );
-            return uncompressedSize;
+        auto size = m_entrySizes[p_entryNum].load( std::memory_order_relaxed );
+        if ( size != UnknownEntrySize ) {
+            return size;
         }
 
-        return entry.size;
+        // The entry is compressed, so we need to read the uncompressed size from the .dat
+        if ( !this->readAt( m_mftEntries[p_entryNum].offset + 4, &size, sizeof( size ) ) ) {
+            return std::numeric_limits<uint>::max( );
+        }
+        m_entrySizes[p_entryNum].store( size, std::memory_order_relaxed );
+        return size;
     }
 
-    uint DatFile::fileSize( uint p_fileNum ) {
+    uint DatFile::fileSize( uint p_fileNum ) const {
         return this->entrySize( p_fileNum + MFT_FILE_OFFSET );
     }
 
+    void DatFile::cacheFileSize( uint p_fileNum, uint p_size ) const {
+        uint entryNum = p_fileNum + MFT_FILE_OFFSET;
+        if ( !this->isOpen( ) || entryNum >= m_mftEntries.GetSize( ) || p_size == UnknownEntrySize ) {
+            return;
+        }
+        if ( m_mftEntries[entryNum].compressionFlag & ANCF_Compressed ) {
+            m_entrySizes[entryNum].store( p_size, std::memory_order_relaxed );
+        }
+    }
+
     uint DatFile::entryNumFromFileOrBaseId( uint p_Id ) const {
         if (!isOpen()) {
             return std::numeric_limits<uint>::max();
         }
 
-        for (uint i = 0; i < m_entryToId.GetSize(); i++) {
-            uint fileId = (m_entryToId[i].fileId == 0 ? m_entryToId[i].baseId : m_entryToId[i].fileId);
-            if (fileId == p_Id) {
-                return i;
-            }
-        }
-
-        for (uint i = 0; i < m_entryToId.GetSize(); i++) {
-            if (m_entryToId[i].baseId == p_Id) {
-                return i;
-            }
+        // File ids take precedence over base ids
+        auto entryNum = findIdLookup( m_fileIdToEntry, p_Id );
+        if ( entryNum == std::numeric_limits<uint>::max( ) ) {
+            entryNum = findIdLookup( m_baseIdToEntry, p_Id );
         }
-        return std::numeric_limits<uint>::max();
+        return entryNum;
     }
 
     uint DatFile::fileIdFromEntryNum( uint p_entryNum ) const {
@@ -227,92 +495,302 @@ namespace gw2b {
         return this->baseIdFromEntryNum( p_fileNum + MFT_FILE_OFFSET );
     }
 
-    uint DatFile::peekFile( uint p_fileNum, uint p_peekSize, byte* po_Buffer ) {
+    uint DatFile::peekFile( uint p_fileNum, uint p_peekSize, byte* po_Buffer ) const {
         return this->peekEntry( p_fileNum + MFT_FILE_OFFSET, p_peekSize, po_Buffer );
     }
 
-    uint DatFile::peekEntry( uint p_entryNum, uint p_peekSize, byte* po_Buffer ) {
+    uint DatFile::peekEntry( uint p_entryNum, uint p_peekSize, byte* po_Buffer ) const {
         Ensure::notNull( po_Buffer );
-        uint inputSize;
+
+        // Entries read in full before may still be cached
+        if ( m_cache.isEnabled( ) && p_peekSize ) {
+            auto cachedSize = m_cache.read( p_entryNum, p_peekSize, po_Buffer );
+            if ( cachedSize ) {
+                return cachedSize;
+            }
+        }
+
+        return this->readEntryData( p_entryNum, p_peekSize, po_Buffer );
+    }
+
+    uint DatFile::readEntryData( uint p_entryNum, uint p_peekSize, byte* po_Buffer ) const {
 
         // Return instantly if size is 0, or if the file isn't open
         if ( p_peekSize == 0 || !this->isOpen( ) ) {
             return 0;
         }
 
-        // If this was the last entry we read, there's no need to re-read it. The
-        // input buffer should already contain the full file.
-        if ( m_lastReadEntry != p_entryNum ) {
-            // Perform some checks
-            auto entryIsInRange = m_mftHead.numEntries > ( uint ) p_entryNum;
-            if ( !entryIsInRange ) {
-                return 0;
+        // Perform some checks
+        auto entryIsInRange = m_mftHead.numEntries > ( uint ) p_entryNum;
+        if ( !entryIsInRange ) {
+            return 0;
+        }
+
+        auto entryIsInUse = ( m_mftEntries[p_entryNum].entryFlags & ANMEF_InUse );
+        auto fileIsLargeEnough = m_fileLength >= m_mftEntries[p_entryNum].offset + m_mftEntries[p_entryNum].size;
+        if ( !entryIsInUse || !fileIsLargeEnough ) {
+            return 0;
+        }
+
+        uint inputSize = m_mftEntries[p_entryNum].size;
+        const byte* input;
+        Array<byte> callInputBuffer;
+
+        if ( m_mappedFile.isOpen( ) ) {
+            // The mapping holds the whole file, read straight from it. Only the
+            // pages the inflater actually touches end up being read.
+            input = m_mappedFile.data( ) + m_mftEntries[p_entryNum].offset;
+        } else {
+            // Try to get away with reading only the start of compressed entries
+            if ( m_mftEntries[p_entryNum].compressionFlag ) {
+                auto outputSize = this->peekCompressedPrefix( p_entryNum, p_peekSize, po_Buffer );
+                if ( outputSize ) {
+                    this->releaseEntry( p_entryNum );
+                    return outputSize;
+                }
             }
 
-            auto entryIsInUse = ( m_mftEntries[p_entryNum].entryFlags & ANMEF_InUse );
-            auto fileIsLargeEnough = ( uint64 ) m_file.Length( ) >= m_mftEntries[p_entryNum].offset + m_mftEntries[p_entryNum].size;
-            if ( !entryIsInUse || !fileIsLargeEnough ) {
-                return 0;
+            // Uncompressed entries need no more than what was asked for, plus
+            // the trailers of the blocks it spans
+            if ( !m_mftEntries[p_entryNum].compressionFlag ) {
+                uint64 rawPeekSize = p_peekSize + static_cast<uint64>( p_peekSize / DatEntryView::RawBlockDataSize ) * ( DatEntryView::RawBlockSize - DatEntryView::RawBlockDataSize );
+                inputSize = static_cast<uint>( wxMin( rawPeekSize, static_cast<uint64>( inputSize ) ) );
             }
+            const uint readSize = inputSize;
 
-            // Make sure we can re-use the input buffer
-            inputSize = m_mftEntries[p_entryNum].size;
-            if ( m_inputBuffer.GetSize( ) < inputSize ) {
-                m_inputBuffer.SetSize( inputSize );
+            // Never share an input buffer between threads
+            auto& inputBuffer = ( readSize <= MaxThreadInputBufferSize ) ? t_inputBuffer : callInputBuffer;
+            if ( inputBuffer.GetSize( ) < readSize ) {
+                inputBuffer.SetSize( readSize );
             }
 
             // Read the file data
-            m_file.Seek( m_mftEntries[p_entryNum].offset, wxFromStart );
-            m_file.Read( m_inputBuffer.GetPointer( ), inputSize );
-            m_lastReadEntry = p_entryNum;
-        } else {
-            inputSize = m_mftEntries[p_entryNum].size;
+            if ( !this->readAt( m_mftEntries[p_entryNum].offset, inputBuffer.GetPointer( ), readSize ) ) {
+                return 0;
+            }
+            input = inputBuffer.GetPointer( );
         }
 
+        auto outputSize = this->decodeEntryData( p_entryNum, input, inputSize, p_peekSize, po_Buffer );
+        this->releaseEntry( p_entryNum );
+        return outputSize;
+    }
+
+    uint DatFile::decodeEntryData( uint p_entryNum, const byte* p_input, uint p_inputSize, uint p_peekSize, byte* po_Buffer ) const {
         // If the file is compressed we need to uncompress it
         if ( m_mftEntries[p_entryNum].compressionFlag ) {
+            // Remember the uncompressed size while the header is at hand
+            if ( p_inputSize >= 8 && ( m_mftEntries[p_entryNum].compressionFlag & ANCF_Compressed ) ) {
+                m_entrySizes[p_entryNum].store( *reinterpret_cast<const uint32*>( p_input + 4 ), std::memory_order_relaxed );
+            }
+
             uint32 outputSize = p_peekSize;
             try {
-                gw2dt::compression::inflateDatFileBuffer( inputSize, m_inputBuffer.GetPointer( ), outputSize, po_Buffer );
-            } catch ( const gw2dt::exception::Exception& err ) {
+                DatInflater::inflate( p_inputSize, p_input, outputSize, po_Buffer, m_inflater );
+            } catch ( const exception::Exception& err ) {
                 wxLogMessage( wxT( "Failed to decompress file %u: %s" ), p_entryNum, std::string( err.what( ) ) );
                 outputSize = 0;
             }
             return outputSize;
         } else {
-            const uint dataSize = wxMin( p_peekSize, inputSize );
+            // Skip the trailer at the end of every block
+            DatEntryView view;
+            view.setRawEntry( p_input, p_inputSize );
+            return view.read( 0, po_Buffer, p_peekSize );
+        }
+    }
 
-            const uint blockSize = 65536;
-            const uint blockDataSize = 65532;
-            // skip 4 byte every 65532 byte, this is hash?
-            const uint bytetoskip = 4;
-            // how many block in data?
-            // (round down so if the data less than 65532, it will skip the copy block loop)
-            const uint numBlock = floor( dataSize / blockSize );
+    void DatFile::readEntries( const uint* p_entries, size_t p_count, const BatchCallback& p_callback ) const {
+        struct Request {
+            uint64  offset;
+            uint    size;
+            size_t  index;
+        };
+
+        std::vector<Request> requests;
+        requests.reserve( p_count );
+        for ( size_t i = 0; i < p_count; i++ ) {
+            Request request;
+            request.index = i;
+
+            // Cached entries need no reading at all, and entries that can not
+            // be read at all are done right away
+            bool isCached = m_cache.isEnabled( ) && m_cache.contains( p_entries[i] );
+            if ( isCached || !this->entryLocation( p_entries[i], request.offset, request.size ) ) {
+                if ( !p_callback( i, this->readEntry( p_entries[i] ) ) ) {
+                    return;
+                }
+                continue;
+            }
+            requests.push_back( request );
+        }
 
-#pragma omp parallel for
-            for ( int i = 0; i < static_cast<int>( numBlock ); i++ ) {
-                ::memcpy( &po_Buffer[i * blockDataSize], &m_inputBuffer[( i * blockDataSize ) + ( i * bytetoskip )], blockDataSize );
+        std::stable_sort( requests.begin( ), requests.end( ), [] ( const Request& p_a, const Request& p_b ) {
+            return p_a.offset < p_b.offset;
+        } );
+
+        Array<byte> buffer;
+        for ( size_t first = 0; first < requests.size( ); ) {
+            // Merge the following entries into this read while they are close
+            // enough, and the read does not get too big
+            uint64 start = requests[first].offset;
+            uint64 end = start + requests[first].size;
+            size_t last = first + 1;
+            for ( ; last < requests.size( ); last++ ) {
+                uint64 nextEnd = wxMax( end, requests[last].offset + requests[last].size );
+                if ( requests[last].offset > end + MaxCoalesceGap || nextEnd - start > MaxCoalescedReadSize ) {
+                    break;
+                }
+                end = nextEnd;
             }
 
-            const auto dataReaded = numBlock * blockSize;
-            const auto dataRemain = dataSize - dataReaded;
+            const byte* data = nullptr;
+            if ( m_mappedFile.isOpen( ) ) {
+                data = m_mappedFile.data( ) + start;
+            } else {
+                if ( buffer.GetSize( ) < end - start ) {
+                    buffer.SetSize( end - start );
+                }
+                if ( this->readAt( start, buffer.GetPointer( ), end - start ) ) {
+                    data = buffer.GetPointer( );
+                }
+            }
+
+            for ( size_t i = first; i < last; i++ ) {
+                const auto& request = requests[i];
+                auto entryNum = p_entries[request.index];
+
+                // If the merged read failed, try the entries one by one
+                auto output = data ? this->decodeEntry( entryNum, data + ( request.offset - start ), request.size ) : this->readEntry( entryNum );
+                if ( !p_callback( request.index, std::move( output ) ) ) {
+                    return;
+                }
+            }
+
+            // Includes the gaps between the entries that were read along
+            this->releaseRange( start, end - start );
+            first = last;
+        }
+    }
+
+    void DatFile::readFiles( const uint* p_files, size_t p_count, const BatchCallback& p_callback ) const {
+        Array<uint> entries( p_count );
+        for ( size_t i = 0; i < p_count; i++ ) {
+            entries[i] = p_files[i] + MFT_FILE_OFFSET;
+        }
+        this->readEntries( entries.GetPointer( ), p_count, p_callback );
+    }
+
+    bool DatFile::entryLocation( uint p_entryNum, uint64& po_offset, uint& po_size ) const {
+        if ( !this->isOpen( ) || p_entryNum >= m_mftEntries.GetSize( ) ) {
+            return false;
+        }
+
+        const auto& entry = m_mftEntries[p_entryNum];
+        if ( !( entry.entryFlags & ANMEF_InUse ) || m_fileLength < entry.offset + entry.size ) {
+            return false;
+        }
+
+        po_offset = entry.offset;
+        po_size = entry.size;
+        return true;
+    }
+
+    Array<byte> DatFile::decodeEntry( uint p_entryNum, const byte* p_input, uint p_inputSize ) const {
+        if ( !this->isOpen( ) || p_entryNum >= m_mftEntries.GetSize( ) || p_inputSize != m_mftEntries[p_entryNum].size ) {
+            return Array<byte>( );
+        }
 
-            // copy the last remaining data
-            if ( dataRemain ) {
-                auto outBufferIndex = blockDataSize * numBlock;
-                ::memcpy( &po_Buffer[outBufferIndex], &m_inputBuffer[dataReaded], dataRemain );
+        uint size = DatEntryView::rawEntryDataSize( p_inputSize );
+        if ( m_mftEntries[p_entryNum].compressionFlag & ANCF_Compressed ) {
+            if ( p_inputSize < 8 ) {
+                return Array<byte>( );
             }
+            size = *reinterpret_cast<const uint32*>( p_input + 4 );
+        }
 
-            return sizeof( po_Buffer );
+        Array<byte> output( size );
+        uint readBytes = this->decodeEntryData( p_entryNum, p_input, p_inputSize, size, output.GetPointer( ) );
+        if ( !readBytes ) {
+            return Array<byte>( );
         }
+
+        if ( readBytes == size && m_cache.isEnabled( ) ) {
+            m_cache.insert( p_entryNum, output.GetPointer( ), readBytes );
+        }
+        this->releaseEntry( p_entryNum );
+        return output;
     }
 
-    Array<byte> DatFile::peekFile( uint p_fileNum, uint p_peekSize ) {
+    uint DatFile::peekCompressedPrefix( uint p_entryNum, uint p_peekSize, byte* po_buffer ) const {
+        const auto& entry = m_mftEntries[p_entryNum];
+        if ( entry.size < 8 ) {
+            return 0;
+        }
+
+        Array<byte> callInput;
+        auto* input = &t_inputBuffer;
+        Array<byte> output;
+        uint32 targetSize = 0;
+        uint64 readSize = 0;
+        uint64 chunkSize = InitialPeekChunkSize;
+
+        while ( readSize < entry.size ) {
+            // The last attempt reads the whole entry
+            chunkSize = wxMin( chunkSize, static_cast<uint64>( entry.size ) );
+
+            // Keep the thread's buffer within its cap, bigger reads continue
+            // in a buffer of the call's own
+            if ( chunkSize > MaxThreadInputBufferSize && input == &t_inputBuffer ) {
+                callInput.SetSize( chunkSize );
+                ::memcpy( callInput.GetPointer( ), t_inputBuffer.GetPointer( ), readSize );
+                input = &callInput;
+            }
+
+            // Only read what was not already read by the last attempt
+            if ( input->GetSize( ) < chunkSize ) {
+                input->SetSize( chunkSize );
+            }
+            if ( !this->readAt( entry.offset + readSize, input->GetPointer( ) + readSize, chunkSize - readSize ) ) {
+                return 0;
+            }
+            readSize = chunkSize;
+            chunkSize *= PeekChunkGrowth;
+
+            // The second dword holds the uncompressed size. If the peek (plus
+            // margin) reaches the end of the stream, it needs the whole stream.
+            if ( !targetSize ) {
+                auto uncompressedSize = *reinterpret_cast<const uint32*>( input->GetPointer( ) + 4 );
+                m_entrySizes[p_entryNum].store( uncompressedSize, std::memory_order_relaxed );
+                if ( static_cast<uint64>( p_peekSize ) + PeekSafetyMargin >= uncompressedSize ) {
+                    return 0;
+                }
+                targetSize = p_peekSize + PeekSafetyMargin;
+                output.SetSize( targetSize );
+            }
+
+            // Running out of input makes the inflater throw, so retry with more
+            uint32 outputSize = targetSize;
+            try {
+                DatInflater::inflate( static_cast<uint32>( readSize ), input->GetPointer( ), outputSize, output.GetPointer( ), m_inflater );
+            } catch ( const exception::Exception& ) {
+                continue;
+            }
+
+            if ( outputSize == targetSize ) {
+                ::memcpy( po_buffer, output.GetPointer( ), p_peekSize );
+                return p_peekSize;
+            }
+        }
+
+        return 0;
+    }
+
+    Array<byte> DatFile::peekFile( uint p_fileNum, uint p_peekSize ) const {
         return this->peekEntry( p_fileNum + MFT_FILE_OFFSET, p_peekSize );
     }
 
-    Array<byte> DatFile::peekEntry( uint p_entryNum, uint p_peekSize ) {
+    Array<byte> DatFile::peekEntry( uint p_entryNum, uint p_peekSize ) const {
         Array<byte> output = Array<byte>( p_peekSize );
         uint readBytes = this->peekEntry( p_entryNum, p_peekSize, output.GetPointer( ) );
 
@@ -323,33 +801,54 @@ namespace gw2b {
         return output;
     }
 
-    uint DatFile::readFile( uint p_fileNum, byte* po_Buffer ) {
+    uint DatFile::readFile( uint p_fileNum, byte* po_Buffer ) const {
         return this->readEntry( p_fileNum + MFT_FILE_OFFSET, po_Buffer );
     }
 
-    uint DatFile::readEntry( uint p_entryNum, byte* po_Buffer ) {
+    uint DatFile::readEntry( uint p_entryNum, byte* po_Buffer ) const {
+        if ( m_cache.isEnabled( ) ) {
+            auto cachedSize = m_cache.read( p_entryNum, std::numeric_limits<uint>::max( ), po_Buffer );
+            if ( cachedSize ) {
+                return cachedSize;
+            }
+        }
+
         uint size = this->entrySize( p_entryNum );
 
         if ( size != std::numeric_limits<uint>::max( ) ) {
-            return this->peekEntry( p_entryNum, size, po_Buffer );
+            uint readBytes = this->readEntryData( p_entryNum, size, po_Buffer );
+            if ( readBytes == size && m_cache.isEnabled( ) ) {
+                m_cache.insert( p_entryNum, po_Buffer, readBytes );
+            }
+            return readBytes;
         }
 
         return 0;
     }
 
-    Array<byte> DatFile::readFile( uint p_fileNum ) {
+    Array<byte> DatFile::readFile( uint p_fileNum ) const {
         return this->readEntry( p_fileNum + MFT_FILE_OFFSET );
     }
 
-    Array<byte> DatFile::readEntry( uint p_entryNum ) {
+    Array<byte> DatFile::readEntry( uint p_entryNum ) const {
+        if ( m_cache.isEnabled( ) ) {
+            auto cached = m_cache.read( p_entryNum );
+            if ( cached.GetSize( ) ) {
+                return cached;
+            }
+        }
+
         uint size = this->entrySize( p_entryNum );
         Array<byte> output;
 
         if ( size != std::numeric_limits<uint>::max( ) ) {
             output.SetSize( size );
-            uint readBytes = this->peekEntry( p_entryNum, size, output.GetPointer( ) );
+            uint readBytes = this->readEntryData( p_entryNum, size, output.GetPointer( ) );
 
             if ( readBytes > 0 ) {
+                if ( readBytes == size && m_cache.isEnabled( ) ) {
+                    m_cache.insert( p_entryNum, output.GetPointer( ), readBytes );
+                }
                 return output;
             }
         }
@@ -357,7 +856,110 @@ namespace gw2b {
         return Array<byte>( );
     }
 
-    DatFile::IdentificationResult DatFile::identifyFileType( const byte* p_data, size_t p_size, ANetFileType& po_fileType ) {
+    bool DatFile::streamFile( uint p_fileNum, const StreamCallback& p_callback ) const {
+        return this->streamEntry( p_fileNum + MFT_FILE_OFFSET, p_callback );
+    }
+
+    bool DatFile::streamEntry( uint p_entryNum, const StreamCallback& p_callback ) const {
+        uint64 offset;
+        uint size;
+        if ( !this->entryLocation( p_entryNum, offset, size ) ) {
+            return false;
+        }
+
+        // Gets the raw data a chunk at a time. Chunks read through wxFile share
+        // one buffer, and are dropped from the page cache once done with, like
+        // the ones in the mapping are.
+        Array<byte> buffer;
+        uint64 chunkOffset = offset;
+        uint chunkSize = 0;
+        auto readChunk = [&] ( uint p_offset, uint p_size ) -> const byte* {
+            this->releaseRange( chunkOffset, chunkSize );
+            chunkOffset = offset + p_offset;
+            chunkSize = p_size;
+            if ( m_mappedFile.isOpen( ) ) {
+                return m_mappedFile.data( ) + chunkOffset;
+            }
+            if ( buffer.GetSize( ) < p_size ) {
+                buffer.SetSize( p_size );
+            }
+            return this->readAt( chunkOffset, buffer.GetPointer( ), p_size ) ? buffer.GetPointer( ) : nullptr;
+        };
+
+        bool completed = true;
+        if ( m_mftEntries[p_entryNum].compressionFlag ) {
+            try {
+                completed = DatInflater::inflate( size, readChunk, p_callback );
+            } catch ( const exception::Exception& err ) {
+                wxLogMessage( wxT( "Failed to decompress file %u: %s" ), p_entryNum, std::string( err.what( ) ) );
+                completed = false;
+            }
+        } else {
+            // Chunks of whole blocks keep the trailers where setRawEntry expects them
+            const uint rawChunkSize = StreamBlocksPerChunk * DatEntryView::RawBlockSize;
+            DatEntryView view;
+            for ( uint position = 0; completed && position < size; position += rawChunkSize ) {
+                uint rawSize = wxMin( rawChunkSize, size - position );
+                auto raw = readChunk( position, rawSize );
+                if ( !raw ) {
+                    completed = false;
+                    break;
+                }
+                view.setRawEntry( raw, rawSize );
+                for ( uint i = 0; completed && i < view.numSegments( ); i++ ) {
+                    completed = p_callback( view.segment( i ).data, view.segment( i ).size );
+                }
+            }
+        }
+
+        this->releaseEntry( p_entryNum );
+        return completed;
+    }
+
+    DatEntryView DatFile::viewFile( uint p_fileNum ) const {
+        return this->viewEntry( p_fileNum + MFT_FILE_OFFSET );
+    }
+
+    DatEntryView DatFile::viewEntry( uint p_entryNum ) const {
+        uint64 offset;
+        uint size;
+        bool isCached = m_cache.isEnabled( ) && m_cache.contains( p_entryNum );
+        if ( isCached || !this->entryLocation( p_entryNum, offset, size ) || m_mftEntries[p_entryNum].compressionFlag ) {
+            return DatEntryView( this->readEntry( p_entryNum ) );
+        }
+
+        DatEntryView view;
+        if ( m_mappedFile.isOpen( ) ) {
+            view.setRawEntry( m_mappedFile.data( ) + offset, size );
+        } else {
+            Array<byte> raw( size );
+            if ( this->readAt( offset, raw.GetPointer( ), size ) ) {
+                view.setRawEntry( raw.GetPointer( ), size, raw );
+            }
+        }
+        return view;
+    }
+
+    DatEntryView DatFile::viewRawEntry( uint p_entryNum ) const {
+        uint64 offset;
+        uint size;
+        DatEntryView view;
+        if ( !this->entryLocation( p_entryNum, offset, size ) ) {
+            return view;
+        }
+
+        if ( m_mappedFile.isOpen( ) ) {
+            view.setData( m_mappedFile.data( ) + offset, size );
+        } else {
+            Array<byte> raw( size );
+            if ( this->readAt( offset, raw.GetPointer( ), size ) ) {
+                view.setData( raw.GetPointer( ), size, raw );
+            }
+        }
+        return view;
+    }
+
+    DatFile::IdentificationResult DatFile::identifyFileType( const byte* p_data, size_t p_size, ANetFileType& po_fileType ) const {
         po_fileType = ANFT_Unknown;
 
         if ( p_size < 4 ) {
@@ -29,27 +29,64 @@
 #define DATFILE_H_INCLUDED
 
 #include <wx/file.h>
+#include <atomic>
+#include <functional>
+#include <mutex>
 
 #include "ANetStructs.h"
+#include "Compression/DatInflater.h"
+#include "DatCache.h"
+#include "DatEntryView.h"
+#include "Util/MappedFile.h"
 
 namespace gw2b {
     class FileReader;
 
-    /** Represents a GW2 .dat file. */
+    /** Represents a GW2 .dat file.
+    *   Once opened, all const members can be called from any number of threads
+    *   at once. Opening, closing and switching the read backend cannot. */
     class DatFile {
         struct IdEntry;
+    public:
+        /** Ways of getting entry data out of the .dat file. */
+        enum ReadBackend {
+            RB_File,        /**< Seek and read through wxFile into an input buffer. */
+            RB_MemoryMap,   /**< Map the .dat read-only and read straight from the mapping. */
+        };
+        /** How entries are going to be read, for tuning the OS page cache to.
+        *   Only hints, reads work the same under every policy. */
+        enum IoPolicy {
+            IP_Normal,      /**< No hints, the OS defaults. */
+            IP_Sequential,  /**< Entries are read roughly in .dat order, read ahead aggressively. */
+            IP_Random,      /**< Entries are read one at a time all over the .dat, do not read ahead. */
+            IP_Streaming,   /**< Like IP_Sequential, but every entry is read once. Its pages are
+                                 dropped from the page cache as soon as it was decoded, so bulk
+                                 reads do not push everything else out of it. */
+            IP_Count,
+        };
     private:
         typedef Array<ANetMftEntry> EntryArray;
         typedef Array<IdEntry>      EntryToIdArray;
-        typedef Array<byte>         InputBufferArray;
+        typedef Array<uint64>       IdLookupArray;
     private:
         wxFile              m_file;
+        wxString            m_filename;
+        MappedFile          m_mappedFile;
+        ReadBackend         m_readBackend;
+        mutable std::atomic<IoPolicy> m_ioPolicy;
+        IoPolicy            m_defaultIoPolicy;
+        mutable uint        m_ioPolicyUsers[IP_Count];
+        mutable std::mutex  m_ioPolicyMutex;
+        DatInflater::Implementation m_inflater;
+        uint64              m_fileLength;
         ANetDatHeader       m_datHead;
         ANetMftHeader       m_mftHead;
         EntryArray          m_mftEntries;
         EntryToIdArray      m_entryToId;
-        InputBufferArray    m_inputBuffer;
-        uint                m_lastReadEntry;
+        IdLookupArray       m_fileIdToEntry;
+        IdLookupArray       m_baseIdToEntry;
+        mutable DatCache    m_cache;
+        std::unique_ptr<std::atomic<uint32>[]> m_entrySizes;
     private:
         enum MFTFileOffset {
             MFT_FILE_OFFSET = 16
@@ -60,12 +97,24 @@ namespace gw2b {
             IR_NotEnoughData,
             IR_Failure,
         };
+        /** Called by readEntries for every entry read.
+        *  \param[in]  p_index  Position of the entry in the list given to readEntries.
+        *  \param[in]  p_data   Data of the entry, empty if reading it failed.
+        *  \return bool    true to carry on reading, false to stop. */
+        typedef std::function<bool( size_t p_index, Array<byte> p_data )> BatchCallback;
+        /** Called by streamEntry with each part of the entry, in order.
+        *  \param[in]  p_data   Part of the entry.
+        *  \param[in]  p_size   Size of the part.
+        *  \return bool    true to carry on reading, false to stop. */
+        typedef DatInflater::OutputSink StreamCallback;
     public:
-        /** Default constructor. Initializes internals. */
-        DatFile( );
+        /** Default constructor. Initializes internals.
+        *  \param[in]  p_backend    Backend to use for reading entries. */
+        DatFile( ReadBackend p_backend = RB_MemoryMap );
         /** Constructor. Initializes internals and opens the given .dat file.
-        *  \param[in]  p_filename   Name of the .dat file to open. */
-        DatFile( const wxString& p_filename );
+        *  \param[in]  p_filename   Name of the .dat file to open.
+        *  \param[in]  p_backend    Backend to use for reading entries. */
+        DatFile( const wxString& p_filename, ReadBackend p_backend = RB_MemoryMap );
         /** Destructor. Makes sure to clear out any unfreed data. */
         ~DatFile( );
 
@@ -79,6 +128,70 @@ namespace gw2b {
         /** Closes the open .dat file, if any. */
         void close( );
 
+        /** Sets the backend used for reading entries. If a .dat file is open,
+        *   it is switched over immediately, so no other thread may be reading.
+        *  \param[in]  p_backend    Backend to use. */
+        void setReadBackend( ReadBackend p_backend );
+        /** Gets the backend currently used for reading entries. This is
+        *   RB_File when no .dat is open, or when mapping it failed.
+        *  \return ReadBackend  Backend in use. */
+        ReadBackend readBackend( ) const {
+            return m_mappedFile.isOpen( ) ? RB_MemoryMap : RB_File;
+        }
+
+        /** Sets how entries are read when no reader announced a policy of its
+        *   own with beginIoPolicy. Kept when another .dat is opened, and can be
+        *   changed while other threads are reading. Only has an effect on
+        *   POSIX systems.
+        *  \param[in]  p_policy     Policy to use. */
+        void setIoPolicy( IoPolicy p_policy );
+        /** Tells the .dat file a reader is going to read entries under the given
+        *   policy, until it calls endIoPolicy with the same policy. Any number
+        *   of readers can do so at once. The page cache hints apply to the
+        *   whole .dat, so the bulkiest policy in use wins: IP_Streaming, then
+        *   IP_Sequential, then IP_Random, then the one set with setIoPolicy.
+        *  \param[in]  p_policy     Policy the reader reads under. */
+        void beginIoPolicy( IoPolicy p_policy ) const;
+        /** Tells the .dat file a reader that called beginIoPolicy is done.
+        *  \param[in]  p_policy     Policy given to beginIoPolicy. */
+        void endIoPolicy( IoPolicy p_policy ) const;
+        /** Gets how entries are expected to be read.
+        *  \return IoPolicy     Policy in use. */
+        IoPolicy ioPolicy( ) const {
+            return m_ioPolicy.load( std::memory_order_relaxed );
+        }
+        /** Sets the inflater compressed entries, and the ATEX textures of readers
+        *   made for them, are decompressed with. Cannot be changed while other
+        *   threads are reading.
+        *  \param[in]  p_inflater   Inflater implementation to use. */
+        void setInflater( DatInflater::Implementation p_inflater ) {
+            m_inflater = p_inflater;
+        }
+        /** Gets the inflater compressed entries are decompressed with.
+        *  \return DatInflater::Implementation  Inflater implementation in use. */
+        DatInflater::Implementation inflater( ) const {
+            return m_inflater;
+        }
+
+        /** Sets the memory budget of the cache of decompressed entries. Entries
+        *   read in full through readEntry/readFile are kept in it, and reads and
+        *   peeks are served from it when possible. 0, the default, disables it.
+        *  \param[in]  p_budget     Maximum amount of bytes to keep cached. */
+        void setCacheBudget( size_t p_budget ) {
+            m_cache.setBudget( p_budget );
+        }
+        /** Gets the cache of decompressed entries, mostly for its statistics.
+        *  \return DatCache&    Entry cache. */
+        const DatCache& cache( ) const {
+            return m_cache;
+        }
+        /** Gets the descriptor of the open .dat file, for reading entries with
+        *   entryLocation and decodeEntry outside of DatFile.
+        *  \return int     File descriptor, -1 if no .dat is open. */
+        int fileDescriptor( ) const {
+            return m_file.fd( );
+        }
+
         /** Gets the MFT entry number for the file with the given file id.
         *  \param[in]  p_fileId     ID of the file to get the entry number for.
         *  \return uint    The MFT entry num if it was found, UINT_MAX if not. */
@@ -101,14 +214,21 @@ namespace gw2b {
         *  \return uint    The base id if it was found, UINT_MAX if not. */
         uint baseIdFromFileNum( uint p_entryNum ) const;
 
-        /** Gets the total uncompressed size of the given entry.
+        /** Gets the total uncompressed size of the given entry. Sizes of
+        *   compressed entries are read from the .dat the first time they are
+        *   needed, or whenever the entry is read, and remembered after that.
         *  \param[in]  p_entryNum   Entry number to check the size for.
         *  \return uint    Uncompressed size of the entry. */
-        uint entrySize( uint p_entryNum );
+        uint entrySize( uint p_entryNum ) const;
         /** Gets the total uncompressed size of the given file.
         *  \param[in]  p_fileNum   File entry number to check the size for.
         *  \return uint    Uncompressed size of the file. */
-        uint fileSize( uint p_fileNum );
+        uint fileSize( uint p_fileNum ) const;
+        /** Remembers the uncompressed size of the given file, as found in the
+        *   index, so it does not need to be read from the .dat.
+        *  \param[in]  p_fileNum    File entry number the size belongs to.
+        *  \param[in]  p_size       Uncompressed size of the file. */
+        void cacheFileSize( uint p_fileNum, uint p_size ) const;
         /** Gets the amount of total MFT entries in the .dat file.
         *  \return uint    Amount of entries in the .dat file, UINT_MAX if file not open. */
         uint numEntries( ) const {
@@ -123,6 +243,26 @@ namespace gw2b {
                 return UINT_MAX;
             } return m_mftHead.numEntries - MFT_FILE_OFFSET;
         }
+        /** Gets the given MFT entry, as stored in the .dat.
+        *  \param[in]  p_entryNum   Entry number to get.
+        *  \return ANetMftEntry*    The MFT entry, nullptr if out of range or not open. */
+        const ANetMftEntry* mftEntry( uint p_entryNum ) const {
+            if ( !this->isOpen( ) || p_entryNum >= m_mftEntries.GetSize( ) ) {
+                return nullptr;
+            } return &m_mftEntries[p_entryNum];
+        }
+        /** Checks whether the given MFT entry holds any data.
+        *  \param[in]  p_entryNum   Entry number to check.
+        *  \return bool    true if the entry is in use, false if not or out of range. */
+        bool isEntryInUse( uint p_entryNum ) const {
+            return this->isOpen( ) && p_entryNum < m_mftEntries.GetSize( ) && ( m_mftEntries[p_entryNum].entryFlags & ANMEF_InUse );
+        }
+        /** Checks whether the given MFT entry is compressed.
+        *  \param[in]  p_entryNum   Entry number to check.
+        *  \return bool    true if the entry is compressed, false if not or out of range. */
+        bool isEntryCompressed( uint p_entryNum ) const {
+            return this->isOpen( ) && p_entryNum < m_mftEntries.GetSize( ) && m_mftEntries[p_entryNum].compressionFlag;
+        }
         /** Gets the amount of entries that appear before the file entries in the
         *   .dat file.
         *  \return uint    Index of the first file entry in the MFT. */
@@ -136,49 +276,170 @@ namespace gw2b {
         *  \param[in,out]  po_buffer    Buffer to store results in. Must be *at least*
         *                  pPeekSize in length.
         *  \return uint    Size of poBuffer. */
-        uint peekEntry( uint p_entryNum, uint p_peekSize, byte* po_buffer );
+        uint peekEntry( uint p_entryNum, uint p_peekSize, byte* po_buffer ) const;
         /** Peeks at the contents of the given MFT file entry and returns the results.
         *  \param[in]  p_fileNum    MFT entry number to get contents for.
         *  \param[in]  p_peekSize   Amount of bytes to peek at. Specifying 0 will read the whole file.
         *  \param[in,out]  po_buffer    Buffer to store results in. Must be *at least*
         *                  pPeekSize in length.
         *  \return uint    Size of poBuffer. */
-        uint peekFile( uint p_fileNum, uint p_peekSize, byte* po_buffer );
+        uint peekFile( uint p_fileNum, uint p_peekSize, byte* po_buffer ) const;
         /** Peeks at the contents of the given MFT entry and returns the results.
         *  \param[in]  p_entryNum   MFT entry number to get contents for.
         *  \param[in]  p_peekSize   Amount of bytes to peek at.
         *  \return Array<byte>  Object used to handle the peeked data. */
-        Array<byte> peekEntry( uint p_entryNum, uint p_peekSize );
+        Array<byte> peekEntry( uint p_entryNum, uint p_peekSize ) const;
         /** Peeks at the contents of the given MFT file entry and returns the results.
         *  \param[in]  p_fileNum    MFT file entry number to get contents for.
         *  \param[in]  p_peekSize   Amount of bytes to peek at.
         *  \return Array<byte>  Object used to handle the peeked data. */
-        Array<byte> peekFile( uint p_fileNum, uint p_peekSize );
+        Array<byte> peekFile( uint p_fileNum, uint p_peekSize ) const;
 
         /** Reads the contents of the given MFT entry and returns the results.
         *  \param[in]  p_entryNum   MFT entry number to get contents for.
         *  \param[in,out]  po_buffer    Buffer to store results in. It is up to the
         caller to make sure the buffer is big enough.
         *  \return uint    Size of poBuffer. */
-        uint readEntry( uint p_entryNum, byte* po_buffer );
+        uint readEntry( uint p_entryNum, byte* po_buffer ) const;
         /** Reads the contents of the given MFT file entry and returns the results.
         *  \param[in]  p_fileNum   MFT entry number to get contents for.
         *  \param[in,out]  po_buffer    Buffer to store results in. It is up to the
         caller to make sure the buffer is big enough.
         *  \return uint    Size of poBuffer. */
-        uint readFile( uint p_fileNum, byte* po_buffer );
+        uint readFile( uint p_fileNum, byte* po_buffer ) const;
         /** Reads the data contained at the given MFT entry.
         *  \param[in]  p_entryNum   MFT entry number to read.
         *  \return Array<byte>  Object used to handle the read data. */
-        Array<byte> readEntry( uint p_entryNum );
+        Array<byte> readEntry( uint p_entryNum ) const;
         /** Reads the file contained at the given MFT entry.
         *  \param[in]  p_fileNum    MFT file entry number to read.
         *  \return Array<byte>  Object used to handle the read file. */
-        Array<byte> readFile( uint p_fileNum );
+        Array<byte> readFile( uint p_fileNum ) const;
+
+        /** Reads the given MFT entry a part at a time, handing each part to the
+        *   callback as soon as it is read. Memory use stays the same whatever
+        *   the size of the entry: compressed entries are inflated through a
+        *   window of DatInflater::StreamWindowSize bytes, and uncompressed ones
+        *   are read a few blocks at a time. Meant for writing entries out as
+        *   they are, such as raw exports. Bypasses the entry cache, and always
+        *   inflates with the builtin inflater, as gw2dattools needs room for
+        *   all of the output at once.
+        *  \param[in]  p_entryNum   MFT entry number to read.
+        *  \param[in]  p_callback   Called with each part of the entry.
+        *  \return bool    true if all of the entry was read, false if reading
+        *                  failed or the callback asked to stop. */
+        bool streamEntry( uint p_entryNum, const StreamCallback& p_callback ) const;
+        /** Reads the given MFT file entry a part at a time, like streamEntry.
+        *  \param[in]  p_fileNum    MFT file entry number to read.
+        *  \param[in]  p_callback   Called with each part of the file.
+        *  \return bool    true if all of the file was read, false if not. */
+        bool streamFile( uint p_fileNum, const StreamCallback& p_callback ) const;
+
+        /** Gets a view of the contents of the given MFT entry. Uncompressed
+        *   entries of a memory mapped .dat are viewed right where they are
+        *   mapped, without copying them. Uncompressed entries read through
+        *   wxFile are read raw and viewed around their block trailers, and
+        *   compressed entries are read like readEntry does.
+        *   Views into the mapping are only valid until the .dat is closed or
+        *   its read backend is switched.
+        *  \param[in]  p_entryNum   MFT entry number to view.
+        *  \return DatEntryView     View of the entry, empty if reading it failed. */
+        DatEntryView viewEntry( uint p_entryNum ) const;
+        /** Gets a view of the contents of the given MFT file entry.
+        *  \param[in]  p_fileNum    MFT file entry number to view.
+        *  \return DatEntryView     View of the file, empty if reading it failed. */
+        DatEntryView viewFile( uint p_fileNum ) const;
+
+        /** Gets a view of the raw data of the given MFT entry, as stored in the
+        *   .dat: still compressed, and with the block trailers. The view is a
+        *   single segment, into the mapping if the .dat is memory mapped.
+        *  \param[in]  p_entryNum   MFT entry number to view.
+        *  \return DatEntryView     View of the raw data, empty if reading it failed. */
+        DatEntryView viewRawEntry( uint p_entryNum ) const;
+
+        /** Tells the .dat file the raw data of the given MFT entry is no longer
+        *   needed, so IP_Streaming can drop it from the page cache. Entries
+        *   read through readEntry and friends are released by DatFile itself,
+        *   this is for users of viewEntry/viewRawEntry that are done with the
+        *   view. Does nothing under the other policies.
+        *  \param[in]  p_entryNum   MFT entry number to release. */
+        void releaseEntry( uint p_entryNum ) const;
 
-        IdentificationResult identifyFileType( const byte* p_data, size_t p_size, ANetFileType& p_fileType );
+        /** Reads the given MFT entries in the order they are stored in the .dat
+        *   rather than the order given, merging entries close to each other into
+        *   one bigger read. Meant for reading many entries at once, such as a
+        *   whole category. The callback is called on the calling thread.
+        *  \param[in]  p_entries    MFT entry numbers to read.
+        *  \param[in]  p_count      Amount of entry numbers in p_entries.
+        *  \param[in]  p_callback   Called with each entry once read. */
+        void readEntries( const uint* p_entries, size_t p_count, const BatchCallback& p_callback ) const;
+        /** Reads the given MFT file entries in .dat order, like readEntries.
+        *  \param[in]  p_files      MFT file entry numbers to read.
+        *  \param[in]  p_count      Amount of file entry numbers in p_files.
+        *  \param[in]  p_callback   Called with each file once read. */
+        void readFiles( const uint* p_files, size_t p_count, const BatchCallback& p_callback ) const;
+
+        /** Gets where the raw data of the given MFT entry is stored in the .dat,
+        *   for reading it without going through DatFile.
+        *  \param[in]  p_entryNum   MFT entry number to locate.
+        *  \param[out] po_offset    Position of the raw data in the .dat file.
+        *  \param[out] po_size      Size of the raw data, in bytes.
+        *  \return bool    true if the entry is in use and fully in the .dat. */
+        bool entryLocation( uint p_entryNum, uint64& po_offset, uint& po_size ) const;
+        /** Decodes the raw data of the given MFT entry, as read from the location
+        *   given by entryLocation. Uses the entry cache like readEntry does.
+        *  \param[in]  p_entryNum   MFT entry number the data belongs to.
+        *  \param[in]  p_input      Raw data of the entry.
+        *  \param[in]  p_inputSize  Size of the raw data.
+        *  \return Array<byte>  Decoded entry, empty if it failed. */
+        Array<byte> decodeEntry( uint p_entryNum, const byte* p_input, uint p_inputSize ) const;
+
+        IdentificationResult identifyFileType( const byte* p_data, size_t p_size, ANetFileType& p_fileType ) const;
         static uint fileIdFromFileReference( const ANetFileReference& p_fileRef );
 
+    private:
+        /** Reads data at the given position of the .dat file, without touching
+        *   the file position.
+        *  \param[in]  p_offset     Position in the .dat file to read from.
+        *  \param[out] po_buffer    Buffer to store the data in.
+        *  \param[in]  p_size       Amount of bytes to read.
+        *  \return bool    true if all bytes were read, false if not. */
+        bool readAt( uint64 p_offset, void* po_buffer, size_t p_size ) const;
+        /** Works out the policy in use from the default and the readers'
+        *   policies, and applies it if it changed. Expects m_ioPolicyMutex to
+        *   be locked. */
+        void updateIoPolicy( ) const;
+        /** Applies the I/O policy to the open .dat file. */
+        void applyIoPolicy( ) const;
+        /** Drops the given range of the .dat from the page cache, if the I/O
+        *   policy asks for it. Called once data read from it was decoded.
+        *  \param[in]  p_offset     Start of the range.
+        *  \param[in]  p_size       Size of the range. */
+        void releaseRange( uint64 p_offset, uint64 p_size ) const;
+        /** Reads and decompresses the start of the given entry, bypassing
+        *   the entry cache.
+        *  \param[in]  p_entryNum   MFT entry number to get contents for.
+        *  \param[in]  p_peekSize   Amount of bytes to read.
+        *  \param[in,out]  po_buffer    Buffer to store results in.
+        *  \return uint    Amount of bytes read. */
+        uint readEntryData( uint p_entryNum, uint p_peekSize, byte* po_buffer ) const;
+        /** Decompresses, or strips the block trailers from, the raw data of the
+        *   given entry.
+        *  \param[in]  p_entryNum   MFT entry number the data belongs to.
+        *  \param[in]  p_input      Raw data of the entry.
+        *  \param[in]  p_inputSize  Size of the raw data.
+        *  \param[in]  p_peekSize   Amount of bytes to decode.
+        *  \param[in,out]  po_buffer    Buffer to store results in.
+        *  \return uint    Amount of bytes decoded. */
+        uint decodeEntryData( uint p_entryNum, const byte* p_input, uint p_inputSize, uint p_peekSize, byte* po_buffer ) const;
+        /** Peeks at a compressed entry by reading and inflating increasingly
+        *   large chunks from its start, instead of reading all of it.
+        *  \param[in]  p_entryNum   MFT entry number to get contents for.
+        *  \param[in]  p_peekSize   Amount of bytes to peek at.
+        *  \param[in,out]  po_buffer    Buffer to store results in.
+        *  \return uint    p_peekSize on success, 0 if the whole entry must be read. */
+        uint peekCompressedPrefix( uint p_entryNum, uint p_peekSize, byte* po_buffer ) const;
+
     }; // class DatFile
 
 }; // namespace gw2b
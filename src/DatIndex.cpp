@@ -27,11 +27,19 @@
 
 #include <wx/file.h>
 #include <new>
+#include <unordered_set>
 
 #include "DatIndex.h"
 
 namespace gw2b {
 
+    namespace {
+
+        /** Entries a block has room for, unless reserved all at once. */
+        const uint EntryBlockSize = 1024;
+
+    }; // anon namespace
+
     //----------------------------------------------------------------------------
     //      DatIndexEntry
     //----------------------------------------------------------------------------
@@ -42,6 +50,8 @@ namespace gw2b {
         , m_baseId( 0 )
         , m_mftEntry( 0 )
         , m_fileType( ANFT_Unknown )
+        , m_uncompressedSize( 0 )
+        , m_contentHash( 0 )
         , m_category( nullptr ) {
         Ensure::notNull( &p_owner );
     }
@@ -62,17 +72,24 @@ namespace gw2b {
         : m_owner( &p_owner )
         , m_index( p_index )
         , m_name( p_name )
+        , m_nameHash( hashName( p_name ) )
         , m_parent( nullptr ) {
         Ensure::notNull( &p_owner );
     }
 
+    uint64 DatIndexCategory::hashName( const wxString& p_name ) {
+        return xxHash64( p_name.wx_str( ), p_name.length( ) * sizeof( wxStringCharType ) );
+    }
+
+    void DatIndexCategory::setName( const wxString& p_name ) {
+        m_owner->onCategoryKeyChange( *this, false );
+        m_name = p_name;
+        m_nameHash = hashName( p_name );
+        m_owner->onCategoryKeyChange( *this, true );
+    }
+
     DatIndexCategory* DatIndexCategory::findSubCategory( const wxString& p_name ) {
-        for ( uint i = 0; i < m_subCategories.GetSize( ); i++ ) {
-            if ( m_subCategories[i]->name( ) == p_name ) {
-                return m_subCategories[i];
-            }
-        }
-        return nullptr;
+        return m_owner->findCategory( this, p_name, hashName( p_name ) );
     }
 
     DatIndexCategory* DatIndexCategory::findOrAddSubCategory( const wxString& p_name ) {
@@ -85,10 +102,10 @@ namespace gw2b {
     }
 
     uint DatIndexCategory::numEntries( bool p_recursive ) const {
-        auto count = m_entries.GetSize( );
+        auto count = static_cast<uint>( m_entries.size( ) );
 
         if ( p_recursive ) {
-            for ( uint i = 0; i < m_subCategories.GetSize( ); i++ ) {
+            for ( uint i = 0; i < m_subCategories.size( ); i++ ) {
                 count += m_subCategories[i]->numEntries( p_recursive );
             }
         }
@@ -97,16 +114,51 @@ namespace gw2b {
     }
 
     void DatIndexCategory::addEntry( DatIndexEntry* p_entry ) {
-        m_entries.Add( p_entry );
+        m_entries.push_back( p_entry );
         p_entry->onAddedToCategory( this );
     }
 
+    void DatIndexCategory::reserveEntries( uint p_additionalEntries ) {
+        m_entries.reserve( m_entries.size( ) + p_additionalEntries );
+    }
+
+    void DatIndexCategory::removeEntry( DatIndexEntry* p_entry ) {
+        for ( auto it = m_entries.begin( ); it != m_entries.end( ); ++it ) {
+            if ( *it == p_entry ) {
+                m_entries.erase( it );
+                return;
+            }
+        }
+    }
+
+    void DatIndexCategory::detachEntries( std::vector<DatIndexEntry*>& po_entries ) {
+        po_entries.clear( );
+        m_entries.swap( po_entries );
+    }
+
     void DatIndexCategory::addSubCategory( DatIndexCategory* p_subCategory ) {
         Ensure::notNull( p_subCategory );
         Assert( !p_subCategory->parent( ) );
 
-        m_subCategories.Add( p_subCategory );
+        m_subCategories.push_back( p_subCategory );
+        m_owner->onCategoryKeyChange( *p_subCategory, false );
         p_subCategory->onAddedToCategory( this );
+        m_owner->onCategoryKeyChange( *p_subCategory, true );
+    }
+
+    void DatIndexCategory::removeSubCategory( DatIndexCategory* p_subCategory ) {
+        Ensure::notNull( p_subCategory );
+        Assert( p_subCategory->parent( ) == this );
+
+        for ( auto it = m_subCategories.begin( ); it != m_subCategories.end( ); ++it ) {
+            if ( *it == p_subCategory ) {
+                m_subCategories.erase( it );
+                m_owner->onCategoryKeyChange( *p_subCategory, false );
+                p_subCategory->m_parent = nullptr;
+                m_owner->onCategoryKeyChange( *p_subCategory, true );
+                return;
+            }
+        }
     }
 
     void DatIndexCategory::onAddedToCategory( DatIndexCategory* p_parent ) {
@@ -121,7 +173,8 @@ namespace gw2b {
     DatIndex::DatIndex( )
         : m_datTimestamp( 0 )
         , m_highestMftEntry( -1 )
-        , m_isDirty( false )
+        , m_numChanges( 0 )
+        , m_numSavedChanges( 0 )
         , m_numEntries( 0 )
         , m_numCategories( 0 ) {
     }
@@ -136,27 +189,67 @@ namespace gw2b {
     }
 
     void DatIndex::clear( ) {
+        this->deleteContents( );
+
+        // Notify listeners
+        for ( auto const& it : m_listeners ) {
+            it->onIndexCleared( *this );
+        }
+    }
+
+    void DatIndex::takeContents( DatIndex& p_other ) {
+        Assert( &p_other != this );
+        this->deleteContents( );
+
+        m_categories = std::move( p_other.m_categories );
+        m_categoryLookup.swap( p_other.m_categoryLookup );
+        m_entries = std::move( p_other.m_entries );
+        m_entryBlocks.swap( p_other.m_entryBlocks );
+        m_datTimestamp = p_other.m_datTimestamp;
+        m_highestMftEntry = p_other.m_highestMftEntry;
+        m_numChanges = p_other.m_numChanges.load( );
+        m_numSavedChanges = p_other.m_numSavedChanges.load( );
+        m_numEntries = p_other.m_numEntries;
+        m_numCategories = p_other.m_numCategories;
+
+        // Only the owner changes, the entries and categories stay where they are
+        for ( uint i = 0; i < m_numEntries; i++ ) {
+            m_entries[i]->setOwner( *this );
+        }
+        for ( uint i = 0; i < m_numCategories; i++ ) {
+            m_categories[i]->setOwner( *this );
+        }
+
+        // Nothing is left to delete in the other index
+        p_other.m_numEntries = 0;
+        p_other.m_numCategories = 0;
+        p_other.deleteContents( );
+
+        // Notify listeners
+        for ( auto const& it : m_listeners ) {
+            it->onIndexLoaded( *this );
+        }
+    }
+
+    void DatIndex::deleteContents( ) {
         // destruct all entries before clearing their memory
         for ( uint i = 0; i < m_numEntries; i++ ) {
-            delete m_entries[i];
+            m_entries[i]->~DatIndexEntry( );
         }
         m_entries.Clear( );
+        m_entryBlocks.clear( );
         // also destruct all categories before clearing their memory
         for ( uint i = 0; i < m_numCategories; i++ ) {
             delete m_categories[i];
         }
         m_categories.Clear( );
+        m_categoryLookup.clear( );
 
         m_datTimestamp = 0;
         m_highestMftEntry = -1;
-        m_isDirty = false;
+        this->setDirty( false );
         m_numEntries = 0;
         m_numCategories = 0;
-
-        // Notify listeners
-        for ( auto const& it : m_listeners ) {
-            it->onIndexCleared( *this );
-        }
     }
 
     DatIndexEntry* DatIndex::addIndexEntry( bool p_setDirty ) {
@@ -166,14 +259,24 @@ namespace gw2b {
             }
         }
 
+        if ( m_entryBlocks.empty( ) || m_entryBlocks.back( ).numUsed == m_entryBlocks.back( ).size ) {
+            this->addEntryBlock( EntryBlockSize );
+        }
+
+        auto& block = m_entryBlocks.back( );
         uint index = m_numEntries++;
-        m_entries[index] = new DatIndexEntry( *this );
+        m_entries[index] = new ( &block.slots[block.numUsed++] ) DatIndexEntry( *this );
 
-        m_isDirty = ( m_isDirty || p_setDirty );
+        if ( p_setDirty ) {
+            this->setDirty( true );
+        }
         return m_entries[index];
     }
 
     DatIndexCategory* DatIndex::findCategory( const wxString& p_name, bool p_rootsOnly ) {
+        if ( p_rootsOnly ) {
+            return this->findCategory( nullptr, p_name, DatIndexCategory::hashName( p_name ) );
+        }
         for ( uint i = 0; i < m_numCategories; i++ ) {
             if ( !p_rootsOnly || !( m_categories[i]->parent( ) ) ) {
                 if ( m_categories[i]->name( ) == p_name ) {
@@ -184,6 +287,16 @@ namespace gw2b {
         return nullptr;
     }
 
+    DatIndexCategory* DatIndex::findCategory( const DatIndexCategory* p_parent, const wxString& p_name, uint64 p_nameHash ) {
+        auto range = m_categoryLookup.equal_range( CategoryKey { p_parent, p_nameHash } );
+        for ( auto it = range.first; it != range.second; ++it ) {
+            if ( it->second->name( ) == p_name ) {
+                return it->second;
+            }
+        }
+        return nullptr;
+    }
+
     DatIndexCategory* DatIndex::addIndexCategory( const wxString& p_name, bool p_setDirty ) {
         if ( m_numCategories == m_categories.GetSize( ) ) {
             if ( !reserveCategories( 1 ) ) {
@@ -194,13 +307,16 @@ namespace gw2b {
         uint index = m_numCategories++;
         m_categories[index] = new DatIndexCategory( *this, p_name, index );
         auto& category = *m_categories[index];
+        m_categoryLookup.emplace( CategoryKey { nullptr, category.nameHash( ) }, &category );
 
         // Notify listeners
         for ( auto const& it : m_listeners ) {
             it->onIndexCategoryAdded( *this, category );
         }
 
-        m_isDirty = ( m_isDirty || p_setDirty );
+        if ( p_setDirty ) {
+            this->setDirty( true );
+        }
         return &category;
     }
 
@@ -212,14 +328,111 @@ namespace gw2b {
         return category;
     }
 
+    void DatIndex::moveEntry( DatIndexEntry& p_entry, DatIndexCategory& p_category, bool p_setDirty ) {
+        auto oldCategory = p_entry.category( );
+        Ensure::notNull( oldCategory );
+        if ( oldCategory == &p_category ) {
+            return;
+        }
+
+        oldCategory->removeEntry( &p_entry );
+        p_category.addEntry( &p_entry );
+
+        // Notify listeners
+        for ( auto const& it : m_listeners ) {
+            it->onIndexFileMoved( *this, p_entry, *oldCategory );
+        }
+
+        if ( p_setDirty ) {
+            this->setDirty( true );
+        }
+    }
+
+    void DatIndex::removeEntries( const std::vector<DatIndexEntry*>& p_entries, bool p_setDirty ) {
+        if ( p_entries.empty( ) ) {
+            return;
+        }
+
+        std::unordered_set<DatIndexEntry*> removed( p_entries.begin( ), p_entries.end( ) );
+        uint numKept = 0;
+        m_highestMftEntry = -1;
+
+        // Compact the entries in one pass, rather than once for every removal
+        for ( uint i = 0; i < m_numEntries; i++ ) {
+            auto entry = m_entries[i];
+            if ( removed.find( entry ) == removed.end( ) ) {
+                m_entries[numKept++] = entry;
+                if ( static_cast<int>( entry->mftEntry( ) ) > m_highestMftEntry ) {
+                    m_highestMftEntry = static_cast<int>( entry->mftEntry( ) );
+                }
+                continue;
+            }
+
+            // Notify listeners
+            for ( auto const& it : m_listeners ) {
+                it->onIndexFileRemoved( *this, *entry );
+            }
+            if ( entry->category( ) ) {
+                entry->category( )->removeEntry( entry );
+            }
+            entry->~DatIndexEntry( );
+        }
+        m_numEntries = numKept;
+
+        if ( p_setDirty ) {
+            this->setDirty( true );
+        }
+    }
+
+    void DatIndex::removeCategory( DatIndexCategory& p_category, bool p_setDirty ) {
+        Assert( !p_category.numEntries( ) && !p_category.numSubCategories( ) );
+        Assert( m_categories[p_category.index( )] == &p_category );
+
+        // Notify listeners while the category is still intact
+        for ( auto const& it : m_listeners ) {
+            it->onIndexCategoryRemoved( *this, p_category );
+        }
+
+        if ( p_category.parent( ) ) {
+            p_category.parent( )->removeSubCategory( &p_category );
+        }
+        this->onCategoryKeyChange( p_category, false );
+
+        // Categories are referred to by index in the index file, keep them packed
+        for ( uint i = p_category.index( ); i + 1 < m_numCategories; i++ ) {
+            m_categories[i] = m_categories[i + 1];
+            m_categories[i]->setIndex( i );
+        }
+        m_numCategories--;
+        delete &p_category;
+
+        if ( p_setDirty ) {
+            this->setDirty( true );
+        }
+    }
+
     bool DatIndex::reserveEntries( uint p_additionalEntries ) {
         if ( ( UINT_MAX - m_entries.GetSize( ) ) < p_additionalEntries ) {
             return false;
         }
         m_entries.SetSize( m_entries.GetSize( ) + p_additionalEntries );
+
+        // A large reservation, such as a whole index being read, gets a block of its own
+        uint numFree = m_entryBlocks.empty( ) ? 0 : m_entryBlocks.back( ).size - m_entryBlocks.back( ).numUsed;
+        if ( p_additionalEntries > numFree && p_additionalEntries > EntryBlockSize ) {
+            this->addEntryBlock( p_additionalEntries );
+        }
         return true;
     }
 
+    void DatIndex::addEntryBlock( uint p_size ) {
+        EntryBlock block;
+        block.slots.reset( new EntrySlot[p_size] );
+        block.size = p_size;
+        block.numUsed = 0;
+        m_entryBlocks.push_back( std::move( block ) );
+    }
+
     bool DatIndex::reserveCategories( uint p_additionalCategories ) {
         if ( ( UINT_MAX - m_categories.GetSize( ) ) < p_additionalCategories ) {
             return false;
@@ -236,6 +449,22 @@ namespace gw2b {
         m_listeners.erase( p_listener );
     }
 
+    void DatIndex::onCategoryKeyChange( DatIndexCategory& p_category, bool p_isChanged ) {
+        CategoryKey key { p_category.parent( ), p_category.nameHash( ) };
+        if ( p_isChanged ) {
+            m_categoryLookup.emplace( key, &p_category );
+            return;
+        }
+
+        auto range = m_categoryLookup.equal_range( key );
+        for ( auto it = range.first; it != range.second; ++it ) {
+            if ( it->second == &p_category ) {
+                m_categoryLookup.erase( it );
+                return;
+            }
+        }
+    }
+
     void DatIndex::onEntryAddComplete( DatIndexEntry& p_entry ) {
         if ( static_cast<int>( p_entry.mftEntry( ) ) > m_highestMftEntry ) {
             m_highestMftEntry = static_cast<int>( p_entry.mftEntry( ) );
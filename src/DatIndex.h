@@ -28,7 +28,11 @@
 #define DATINDEX_H_INCLUDED
 
 #include <wx/filename.h>
+#include <atomic>
+#include <memory>
 #include <set>
+#include <unordered_map>
+#include <vector>
 
 #include "ANetStructs.h"
 
@@ -37,6 +41,66 @@ namespace gw2b {
     class DatIndexEntry;
     class DatIndexCategory;
 
+    /** The parts of an MFT entry that change when its file does. Kept for
+    *   each entry, so a patched .dat only needs its changed files rescanned. */
+    struct DatIndexFingerprint {
+        uint64  offset;             /**< Location of the file in the .dat. */
+        uint32  size;               /**< Size of the file in the .dat. */
+        uint16  compressionFlag;    /**< Compression flags of the file. */
+        uint32  crc;                /**< 'crc' field of the MFT entry. */
+
+        /** Constructor. Creates an unset fingerprint. */
+        DatIndexFingerprint( ) : offset( 0 ), size( 0 ), compressionFlag( 0 ), crc( 0 ) {
+        }
+        /** Constructor. Takes the fingerprint of the given MFT entry.
+        *  \param[in]  p_entry  MFT entry of the file. */
+        explicit DatIndexFingerprint( const ANetMftEntry& p_entry )
+            : offset( p_entry.offset ), size( p_entry.size ), compressionFlag( p_entry.compressionFlag ), crc( p_entry.crc ) {
+        }
+        /** Determines whether this fingerprint was taken, as indexes written
+        *   by older versions have none.
+        *  \return bool    true if set, false if not. */
+        bool isSet( ) const {
+            return offset || size;
+        }
+        bool operator==( const DatIndexFingerprint& p_other ) const {
+            return offset == p_other.offset && size == p_other.size
+                && compressionFlag == p_other.compressionFlag && crc == p_other.crc;
+        }
+        bool operator!=( const DatIndexFingerprint& p_other ) const {
+            return !( *this == p_other );
+        }
+    };
+
+    /** Audio codecs of sound files, as the format byte of their asnd or ASND
+    *   header gives them. */
+    enum DatIndexAudioFormat {
+        DAF_None = 0,               /**< Not a sound file, or no format known. */
+        DAF_MP3 = 1,                /**< MPEG-1 audio layer 3. */
+        DAF_Ogg = 2,                /**< Ogg Vorbis. */
+    };
+
+    /** What the scan learned about an entry from the header of its file, so
+    *   entries can be filtered without reading them. Fields that do not apply
+    *   to the entry's type, or that its header does not tell, are 0.
+    *   Only DDS headers store a mip count, ATEX-family headers do not, so it
+    *   is 0 for those. Mesh and vertex counts of models, and the length of
+    *   sounds, are deliberately not kept: they are not in the headers the
+    *   scan peeks at, and finding them would mean decompressing and parsing
+    *   the PF chunks of every such file. */
+    struct DatIndexMetadata {
+        uint32  format;             /**< FourCC of the texture format, such as DXT5. */
+        uint16  width;              /**< Width of the texture, in pixels. */
+        uint16  height;             /**< Height of the texture, in pixels. */
+        uint16  mipCount;           /**< Amount of mipmap levels of the texture. */
+        uint8   audioFormat;        /**< Codec of the sound, as the header's format byte. DAF_MP3 and
+                                    *   DAF_Ogg are the ones known, others are kept as they are. */
+
+        /** Constructor. Creates empty metadata. */
+        DatIndexMetadata( ) : format( 0 ), width( 0 ), height( 0 ), mipCount( 0 ), audioFormat( DAF_None ) {
+        }
+    };
+
     /** Represents an entry in the .dat index. */
     class DatIndexEntry {
         DatIndex*           m_owner;
@@ -44,6 +108,10 @@ namespace gw2b {
         uint32              m_baseId;
         uint32              m_mftEntry;
         ANetFileType        m_fileType;
+        uint32              m_uncompressedSize;
+        DatIndexFingerprint m_fingerprint;
+        DatIndexMetadata    m_metadata;
+        mutable std::atomic<uint64> m_contentHash;
         DatIndexCategory*   m_category;
         wxString            m_displayName;
     public:
@@ -80,6 +148,42 @@ namespace gw2b {
         ANetFileType fileType( ) const {
             return m_fileType;
         }
+        /** Gets this entry's uncompressed size.
+        *  \return uint32  uncompressed size of the file, 0 if not known. */
+        uint32 uncompressedSize( ) const {
+            return m_uncompressedSize;
+        }
+        /** Gets the size of this entry's file as stored in the .dat, as of
+        *   the last scan.
+        *  \return uint32  compressed size of the file, 0 if not known. */
+        uint32 compressedSize( ) const {
+            return m_fingerprint.size;
+        }
+        /** Gets what the last scan learned about this entry's contents.
+        *  \return DatIndexMetadata&   metadata of the entry. */
+        const DatIndexMetadata& metadata( ) const {
+            return m_metadata;
+        }
+        /** Gets the fingerprint of this entry's MFT entry, as of the last scan.
+        *  \return DatIndexFingerprint&    fingerprint, unset if not known. */
+        const DatIndexFingerprint& fingerprint( ) const {
+            return m_fingerprint;
+        }
+        /** Gets the XXH64 hash of this entry's uncompressed contents. Entries
+        *   with equal hashes hold the same data.
+        *  \return uint64  hash of the contents, 0 if not known. */
+        uint64 contentHash( ) const {
+            return m_contentHash.load( std::memory_order_relaxed );
+        }
+        /** Remembers the hash of this entry's contents, once something read
+        *   all of it. Like DatFile's size cache this does not change what the
+        *   entry is, so it works on const entries, and does not flag the index
+        *   dirty. It can be given from any thread, also while another one
+        *   reads it, e.g. to write the index.
+        *  \param[in]  p_hash   XXH64 hash of the uncompressed contents. */
+        void cacheContentHash( uint64 p_hash ) const {
+            m_contentHash.store( p_hash, std::memory_order_relaxed );
+        }
         /** Gets this entry's owner.
         *  \return DatIndex&   owner of this entry. */
         DatIndex& owner( ) {
@@ -120,6 +224,24 @@ namespace gw2b {
         DatIndexEntry& setFileType( ANetFileType p_fileType ) {
             m_fileType = p_fileType; return *this;
         }
+        /** Sets this entry's uncompressed size.
+        *  \param[in]  p_size   Uncompressed size of the file.
+        *  \return DatIndexEntry&  reference to this object. */
+        DatIndexEntry& setUncompressedSize( uint32 p_size ) {
+            m_uncompressedSize = p_size; return *this;
+        }
+        /** Sets the fingerprint of this entry's MFT entry.
+        *  \param[in]  p_fingerprint    Fingerprint of the MFT entry.
+        *  \return DatIndexEntry&  reference to this object. */
+        DatIndexEntry& setFingerprint( const DatIndexFingerprint& p_fingerprint ) {
+            m_fingerprint = p_fingerprint; return *this;
+        }
+        /** Sets what is known about this entry's contents.
+        *  \param[in]  p_metadata   New metadata of this entry.
+        *  \return DatIndexEntry&  reference to this object. */
+        DatIndexEntry& setMetadata( const DatIndexMetadata& p_metadata ) {
+            m_metadata = p_metadata; return *this;
+        }
         /** Sets this entry's name.
         *  \param[in]  p_name   name of this entry.
         *  \return DatIndexEntry&  reference to this object. */
@@ -127,6 +249,12 @@ namespace gw2b {
             m_displayName = p_name; return *this;
         }
 
+        /** Sets this entry's owner.
+        *  \param[in]  p_owner  Owner of this entry. */
+        void setOwner( DatIndex& p_owner ) {
+            m_owner = &p_owner;
+        }
+
         /** Completes the add operation by notifying the index, so it can notify
         *  its listeners. */
         void finalizeAdd( );
@@ -140,9 +268,10 @@ namespace gw2b {
         DatIndex*           m_owner;
         int                 m_index;
         wxString            m_name;
+        uint64              m_nameHash;
         DatIndexCategory*   m_parent;
-        Array<DatIndexCategory*, 0x3>  m_subCategories;
-        Array<DatIndexEntry*, 0x3>     m_entries;
+        std::vector<DatIndexCategory*>  m_subCategories;
+        std::vector<DatIndexEntry*>     m_entries;
     public:
         /** Constructor. Creates a category with the given name and index.
         *  \param[in]  p_owner  owner index.
@@ -153,13 +282,13 @@ namespace gw2b {
         /** Gets the number of subcategories this category has.
         *  \return uint    amount of subcategories. */
         uint numSubCategories( ) const {
-            return m_subCategories.GetSize( );
+            return m_subCategories.size( );
         }
         /** Gets the subcategory with the given index.
         *  \param[in]  p_index  index of the subcategory to get.
         *  \return DatIndexCategory*   the subcategory with the given index. */
         DatIndexCategory* subCategory( uint p_index ) {
-            if ( p_index >= m_subCategories.GetSize( ) ) {
+            if ( p_index >= m_subCategories.size( ) ) {
                 return nullptr;
             } return m_subCategories[p_index];
         }
@@ -167,7 +296,7 @@ namespace gw2b {
         *  \param[in]  p_index  index of the subcategory to get.
         *  \return DatIndexCategory*   the subcategory with the given index. */
         const DatIndexCategory* subCategory( uint p_index ) const {
-            if ( p_index >= m_subCategories.GetSize( ) ) {
+            if ( p_index >= m_subCategories.size( ) ) {
                 return nullptr;
             } return m_subCategories[p_index];
         }
@@ -189,7 +318,7 @@ namespace gw2b {
         *  \param[in]  p_index  index of the entry to get.
         *  \return DatIndexEntry*  the entry with the given index. */
         DatIndexEntry* entry( uint p_index ) {
-            if ( p_index >= m_entries.GetSize( ) ) {
+            if ( p_index >= m_entries.size( ) ) {
                 return nullptr;
             } return m_entries[p_index];
         }
@@ -197,22 +326,36 @@ namespace gw2b {
         *  \param[in]  p_index  index of the entry to get.
         *  \return DatIndexEntry*  the entry with the given index. */
         const DatIndexEntry* entry( uint p_index ) const {
-            if ( p_index >= m_entries.GetSize( ) ) {
+            if ( p_index >= m_entries.size( ) ) {
                 return nullptr;
             } return m_entries[p_index];
         }
         /** Adds an entry to this category.
         *  \param[in]  p_entry  Entry to add. */
         void addEntry( DatIndexEntry* p_entry );
+        /** Reserves room for more entries in this category, so adding many
+        *   at once does not grow its list over and over.
+        *  \param[in]  p_additionalEntries  Amount of entries to reserve room for. */
+        void reserveEntries( uint p_additionalEntries );
+        /** Removes an entry from this category.
+        *  \param[in]  p_entry  Entry to remove. */
+        void removeEntry( DatIndexEntry* p_entry );
+        /** Takes all entries out of this category at once, so they can be
+        *   moved elsewhere without removing them one by one. They still name
+        *   this category as theirs until DatIndex::moveEntry moves them, or
+        *   addEntry puts them back.
+        *  \param[out] po_entries   Receives the entries, in order. */
+        void detachEntries( std::vector<DatIndexEntry*>& po_entries );
         /** Adds a new sub category to this category.
         *  \param[in]  p_subCategory    Category to add. */
         void addSubCategory( DatIndexCategory* p_subCategory );
+        /** Removes a sub category from this category.
+        *  \param[in]  p_subCategory    Category to remove. */
+        void removeSubCategory( DatIndexCategory* p_subCategory );
 
         /** Sets the name of this category.
         *  \param[in]  p_name   name of the category. */
-        void setName( const wxString& p_name ) {
-            m_name = p_name;
-        }
+        void setName( const wxString& p_name );
         /** Sets this category's owner.
         *  \param[in]  p_owner  Owner of this category. */
         void setOwner( DatIndex& p_owner ) {
@@ -228,6 +371,15 @@ namespace gw2b {
         const wxString& name( ) const {
             return m_name;
         }
+        /** Gets the hash of this category's name, as computed by hashName().
+        *  \return uint64  hash of the name. */
+        uint64 nameHash( ) const {
+            return m_nameHash;
+        }
+        /** Hashes a category name, for looking categories up by it.
+        *  \param[in]  p_name   name to hash.
+        *  \return uint64  hash of the name. */
+        static uint64 hashName( const wxString& p_name );
         /** Gets the owner of this category.
         *  \return DatIndex&   owner of the category. */
         DatIndex& owner( ) {
@@ -269,15 +421,36 @@ namespace gw2b {
         *  \param[in]  p_entry  Reference to the newly added entry. */
         virtual void onIndexFileAdded( DatIndex& p_index, const DatIndexEntry& p_entry ) {
         }
+        /** Raised when an entry was moved to another category.
+        *  \param[in]  p_index          Reference to the index containing the entry.
+        *  \param[in]  p_entry          Reference to the moved entry.
+        *  \param[in]  p_oldCategory    Category the entry was moved out of. */
+        virtual void onIndexFileMoved( DatIndex& p_index, const DatIndexEntry& p_entry, const DatIndexCategory& p_oldCategory ) {
+        }
+        /** Raised right before an entry is removed from the index.
+        *  \param[in]  p_index  Reference to the index containing the entry.
+        *  \param[in]  p_entry  Reference to the entry being removed. */
+        virtual void onIndexFileRemoved( DatIndex& p_index, const DatIndexEntry& p_entry ) {
+        }
         /** Raised when a category was added to the index.
         *  \param[in]  p_index      Reference to the index that had a file added to it.
         *  \param[in]  p_category   Reference to the newly added category. */
         virtual void onIndexCategoryAdded( DatIndex& p_index, const DatIndexCategory& p_category ) {
         }
+        /** Raised right before an empty category is removed from the index.
+        *  \param[in]  p_index      Reference to the index containing the category.
+        *  \param[in]  p_category   Reference to the category being removed. */
+        virtual void onIndexCategoryRemoved( DatIndex& p_index, const DatIndexCategory& p_category ) {
+        }
         /** Raised when the index is cleared.
         *  \param[in]  p_index  Reference to the index being cleared. */
         virtual void onIndexCleared( DatIndex& p_index ) {
         }
+        /** Raised once when the index took over the contents of another one,
+        *   instead of an event for each of the categories and entries.
+        *  \param[in]  p_index  Reference to the loaded index. */
+        virtual void onIndexLoaded( DatIndex& p_index ) {
+        }
         /** Raised when the index is destroyed.
         *  \param[in]  p_index  Reference to the index being destroyed. */
         virtual void onIndexDestruction( DatIndex& p_index ) {
@@ -286,15 +459,47 @@ namespace gw2b {
 
     /** Represents a .dat index, for faster lookup. */
     class DatIndex {
+        /** Where a category is looked up: its parent, and its name's hash. */
+        struct CategoryKey {
+            const DatIndexCategory* parent;
+            uint64                  nameHash;
+            bool operator==( const CategoryKey& p_other ) const {
+                return parent == p_other.parent && nameHash == p_other.nameHash;
+            }
+        };
+        struct CategoryKeyHash {
+            size_t operator()( const CategoryKey& p_key ) const {
+                return static_cast<size_t>( p_key.nameHash ^ ( reinterpret_cast<uintptr_t>( p_key.parent ) * 0x9e3779b97f4a7c15ull ) );
+            }
+        };
         typedef Array<DatIndexCategory*>        CategoryArray;
         typedef Array<DatIndexEntry*>           EntryArray;
         typedef std::set<IDatIndexListener*>    ListenerSet;
+        typedef std::unordered_multimap<CategoryKey, DatIndexCategory*, CategoryKeyHash> CategoryLookup;
+        /** Room for one entry, constructed in place when it is added. */
+        struct alignas( DatIndexEntry ) EntrySlot {
+            byte    data[sizeof( DatIndexEntry )];
+        };
+        /** Entries are stored a block at a time, rather than allocated one
+        *   by one. The slots of removed entries are not used again until
+        *   the index is cleared. */
+        struct EntryBlock {
+            std::unique_ptr<EntrySlot[]>    slots;
+            uint                            size;
+            uint                            numUsed;
+        };
     private:
         CategoryArray       m_categories;
+        CategoryLookup      m_categoryLookup;
         uint64              m_datTimestamp;
         EntryArray          m_entries;
+        std::vector<EntryBlock> m_entryBlocks;
         int                 m_highestMftEntry;
-        bool                m_isDirty;
+        /** The index is dirty while it has more changes than were saved. Both
+        *   only grow, so a change made while the index is being written keeps
+        *   it dirty. */
+        std::atomic<uint64> m_numChanges;
+        std::atomic<uint64> m_numSavedChanges;
         ListenerSet         m_listeners;
         uint                m_numEntries;
         uint                m_numCategories;
@@ -306,6 +511,11 @@ namespace gw2b {
 
         /** Clears all data. */
         void clear( );
+        /** Replaces the data of this index with the data of another, without
+        *   copying the entries and categories. The other index is left empty.
+        *   Listeners are notified once, rather than for every entry.
+        *  \param[in]  p_other  Index to take the data of. */
+        void takeContents( DatIndex& p_other );
         /** Adds an entry to this index.
         *  \param[in]  p_setDirty   true to flag this index as dirty, false to not.
         *  \return DatIndexEntry&  the newly added entry. */
@@ -315,6 +525,14 @@ namespace gw2b {
         *  \param[in]  p_rootsOnly  Only find parent-less categories if this is true.
         *  \return DatIndexCategory*   pointer to found category, or nullptr if not found. */
         DatIndexCategory* findCategory( const wxString& p_name, bool p_rootsOnly = false );
+        /** Looks for the category with the given parent and name, without
+        *   going through all categories.
+        *  \param[in]  p_parent     Parent of the category, nullptr for top-level.
+        *  \param[in]  p_name       Name of the category to find.
+        *  \param[in]  p_nameHash   Hash of the name, as computed by
+        *                           DatIndexCategory::hashName().
+        *  \return DatIndexCategory*   pointer to found category, or nullptr if not found. */
+        DatIndexCategory* findCategory( const DatIndexCategory* p_parent, const wxString& p_name, uint64 p_nameHash );
         /** Creates a new category and returns it.
         *  \param[in]  p_name       Name of the category to create.
         *  \param[in]  p_setDirty   true to flag this index as dirty, false to not.
@@ -326,7 +544,24 @@ namespace gw2b {
         *  \param[in]  p_setDirty   true to flag this index as dirty, false to not.
         *  \return DatIndexCategory*   pointer to the found/new category. */
         DatIndexCategory* findOrAddCategory( const wxString& p_name, bool p_setDirty = true );
-        /** Reserves memory for a given amount of entries.
+        /** Moves an entry to another category.
+        *  \param[in]  p_entry      Entry to move.
+        *  \param[in]  p_category   Category to move the entry to.
+        *  \param[in]  p_setDirty   true to flag this index as dirty, false to not. */
+        void moveEntry( DatIndexEntry& p_entry, DatIndexCategory& p_category, bool p_setDirty = true );
+        /** Removes the given entries from the index, and deletes them. The
+        *   other entries keep their order.
+        *  \param[in]  p_entries    Entries to remove.
+        *  \param[in]  p_setDirty   true to flag this index as dirty, false to not. */
+        void removeEntries( const std::vector<DatIndexEntry*>& p_entries, bool p_setDirty = true );
+        /** Removes an empty category from the index, and deletes it. The
+        *   categories after it move down one index.
+        *  \param[in]  p_category   Category to remove. Must have no entries and
+        *                           no sub categories.
+        *  \param[in]  p_setDirty   true to flag this index as dirty, false to not. */
+        void removeCategory( DatIndexCategory& p_category, bool p_setDirty = true );
+        /** Reserves memory for a given amount of entries. The entries
+        *   reserved at once are stored next to each other.
         *  \param[in]  p_additionalEntries  How many additional entries to reserve
         *                                  memory for.
         *  \return bool    true if successful, false if not. */
@@ -349,6 +584,14 @@ namespace gw2b {
         }
         /** Gets the entry with the given index.
         *  \param[in]  p_index  Index of the entry to get.
+        *  \return DatIndexEntry*  pointer to the entry if valid, nullptr if not. */
+        DatIndexEntry* entry( uint p_index ) {
+            if ( p_index >= m_numEntries ) {
+                return nullptr;
+            } return m_entries[p_index];
+        }
+        /** Gets the entry with the given index.
+        *  \param[in]  p_index  Index of the entry to get.
         *  \return DatIndexEntry*  Const pointer to the entry if valid, nullptr if not. */
         const DatIndexEntry* entry( uint p_index ) const {
             if ( p_index >= m_numEntries ) {
@@ -380,12 +623,31 @@ namespace gw2b {
         /** Returns whether or not the data has been changed since writing to file.
         *  \return bool    true if data is dirty, false if not. */
         bool isDirty( ) const {
-            return m_isDirty;
+            return m_numSavedChanges.load( ) != m_numChanges.load( );
         }
-        /** Sets the dirty flag for this index.
+        /** Sets the dirty flag for this index. Can be called from any thread.
         *  \param[in]  p_isDirty    New dirty flag. */
         void setDirty( bool p_isDirty ) {
-            m_isDirty = p_isDirty;
+            if ( p_isDirty ) {
+                m_numChanges++;
+            } else {
+                this->setSaved( m_numChanges.load( ) );
+            }
+        }
+        /** Gets the amount of changes made to this index, to pass to setSaved
+        *   once the index as it is now was written.
+        *  \return uint64  Amount of changes so far. */
+        uint64 numChanges( ) const {
+            return m_numChanges.load( );
+        }
+        /** Clears the dirty flag, unless the index was changed again after the
+        *   given amount of changes.
+        *  \param[in]  p_numChanges Amount of changes that were written, as
+        *                           numChanges returned before writing. */
+        void setSaved( uint64 p_numChanges ) {
+            auto saved = m_numSavedChanges.load( );
+            while ( saved < p_numChanges && !m_numSavedChanges.compare_exchange_weak( saved, p_numChanges ) ) {
+            }
         }
 
         /** Gets the .dat timestamp stored for this index.
@@ -410,6 +672,17 @@ namespace gw2b {
         *  index's listeners.
         *  \param[in]  p_entry  Entry that was just added. */
         void onEntryAddComplete( DatIndexEntry& p_entry );
+        /** Called by DatIndexCategory when its parent or name is about to
+        *   change, and again once it changed. Keeps the category lookup current.
+        *  \param[in]  p_category   Category that changes.
+        *  \param[in]  p_isChanged  false before the change, true after it. */
+        void onCategoryKeyChange( DatIndexCategory& p_category, bool p_isChanged );
+    private:
+        /** Deletes all entries and categories, without notifying anyone. */
+        void deleteContents( );
+        /** Adds a block of room for entries.
+        *  \param[in]  p_size   Amount of entries the block has room for. */
+        void addEntryBlock( uint p_size );
     }; // class DatIndex
 
 }; // namespace gw2b
@@ -24,18 +24,65 @@
 
 #include "stdafx.h"
 
+#include <algorithm>
+
 #include "DatIndexIO.h"
 
+#include "Imported/crc.h"
+
 namespace gw2b {
 
+    namespace {
+
+        void toFields( const DatIndexMetadata& p_metadata, DatIndexMetadataFields& po_fields ) {
+            po_fields.format = p_metadata.format;
+            po_fields.width = p_metadata.width;
+            po_fields.height = p_metadata.height;
+            po_fields.mipCount = p_metadata.mipCount;
+        }
+
+        void fromFields( const DatIndexMetadataFields& p_fields, DatIndexMetadata& po_metadata ) {
+            po_metadata.format = p_fields.format;
+            po_metadata.width = p_fields.width;
+            po_metadata.height = p_fields.height;
+            po_metadata.mipCount = p_fields.mipCount;
+        }
+
+        void toFields( const DatIndexFingerprint& p_fingerprint, DatIndexFingerprintFields& po_fields ) {
+            po_fields.offset = p_fingerprint.offset;
+            po_fields.size = p_fingerprint.size;
+            po_fields.compressionFlag = p_fingerprint.compressionFlag;
+            po_fields.crc = p_fingerprint.crc;
+        }
+
+        void fromFields( const DatIndexFingerprintFields& p_fields, DatIndexFingerprint& po_fingerprint ) {
+            po_fingerprint.offset = p_fields.offset;
+            po_fingerprint.size = p_fields.size;
+            po_fingerprint.compressionFlag = p_fields.compressionFlag;
+            po_fingerprint.crc = p_fields.crc;
+        }
+
+        uint64 alignColumn( uint64 p_offset ) {
+            return ( p_offset + DatIndex_ColumnAlignment - 1 ) & ~uint64( DatIndex_ColumnAlignment - 1 );
+        }
+
+        void appendBytes( std::vector<char>& po_data, const void* p_bytes, size_t p_size ) {
+            auto bytes = static_cast<const char*>( p_bytes );
+            po_data.insert( po_data.end( ), bytes, bytes + p_size );
+        }
+
+    }; // anon namespace
+
     //----------------------------------------------------------------------------
     //      DatIndexReader
     //----------------------------------------------------------------------------
 
     DatIndexReader::DatIndexReader( DatIndex& p_index )
-        : m_index( p_index ) {
+        : m_index( p_index )
+        , m_chunksRead( false ) {
         Ensure::notNull( &p_index );
         ::memset( &m_header, 0, sizeof( m_header ) );
+        ::memset( &m_columns, 0, sizeof( m_columns ) );
     }
 
     DatIndexReader::~DatIndexReader( ) {
@@ -54,13 +101,20 @@ namespace gw2b {
             if ( m_header.magicInteger != DatIndex_Magic ) {
                 this->close( ); return false;
             }
-            if ( m_header.version != DatIndex_Version ) {
+            if ( m_header.version == DatIndex_Version ) {
+                // The columns are read from the mapping instead
+                m_file.Close( );
+                if ( !this->mapColumns( p_filename ) ) {
+                    this->close( ); return false;
+                }
+                m_chunksRead = true;
+            } else if ( m_header.version != DatIndex_StreamVersion ) {
                 this->close( ); return false;
             }
             m_index.clear( ); // always start with a fresh index
             m_index.setDatTimestamp( m_header.datTimestamp );
             m_index.reserveEntries( m_header.numEntries );
-            m_index.reserveCategories( m_header.numEntries );
+            m_index.reserveCategories( m_header.numCategories );
             return true;
         }
 
@@ -69,86 +123,363 @@ namespace gw2b {
 
     void DatIndexReader::close( ) {
         m_file.Close( );
+        m_mappedFile.close( );
+        m_chunksRead = false;
         ::memset( &m_header, 0, sizeof( m_header ) );
+        ::memset( &m_columns, 0, sizeof( m_columns ) );
     }
 
     bool DatIndexReader::isDone( ) const {
         return ( m_index.numCategories( ) == m_header.numCategories )
-            && ( m_index.numEntries( ) == m_header.numEntries );
+            && ( m_index.numEntries( ) == m_header.numEntries )
+            && m_chunksRead;
     }
 
     DatIndexReader::ReadResult DatIndexReader::read( uint p_amount ) {
-        ReadResult result = RR_Failure;
+        for ( uint i = 0; i < p_amount && !this->isDone( ); i++ ) {
+            auto result = m_mappedFile.isOpen( ) ? this->readColumns( ) : this->readRecord( );
+            if ( !( result & RR_Success ) ) {
+                return result;
+            }
+        }
 
-        for ( uint i = 0; i < p_amount; i++ ) {
-            ssize_t bytesRead;
-
-            // First read all categories, one at a time
-            if ( m_index.numCategories( ) < m_header.numCategories ) {
-                // Read fixed-width fields
-                DatIndexCategoryFields fields;
-                bytesRead = m_file.Read( &fields, sizeof( fields ) );
-                if ( bytesRead < static_cast<ssize_t>( sizeof( fields ) ) ) {
-                    result = RR_CorruptFile; goto READ_FAILED;
+        if ( this->isDone( ) ) {
+            this->release( );
+        }
+        return RR_Success;
+    }
+
+    bool DatIndexReader::mapColumns( const wxString& p_filename ) {
+        if ( !m_mappedFile.open( p_filename ) ) {
+            return false;
+        }
+        auto data = m_mappedFile.data( );
+        auto size = m_mappedFile.size( );
+
+        uint64 position = sizeof( DatIndexHead );
+        DatIndexColumnTableHead table;
+        if ( size < position + sizeof( table ) ) {
+            return false;
+        }
+        ::memcpy( &table, data + position, sizeof( table ) );
+        position += sizeof( table );
+        if ( ( size - position ) / sizeof( DatIndexColumnFields ) < table.numColumns ) {
+            return false;
+        }
+
+        ::memset( &m_columns, 0, sizeof( m_columns ) );
+        for ( uint i = 0; i < table.numColumns; i++ ) {
+            DatIndexColumnFields column;
+            ::memcpy( &column, data + position, sizeof( column ) );
+            position += sizeof( column );
+
+            // The columns are read straight from the mapping, so they must be aligned and in the file
+            if ( column.offset % DatIndex_ColumnAlignment || column.offset > size || column.size > size - column.offset ) {
+                return false;
+            }
+            auto columnData = data + column.offset;
+            auto hasElements = [&column] ( uint64 p_count, size_t p_elementSize ) {
+                return column.size == p_count * p_elementSize;
+            };
+
+            bool isValid = true;
+            switch ( column.id ) {
+            case DatIndexChunk_Categories:
+                isValid = hasElements( m_header.numCategories, sizeof( DatIndexCategoryRecordFields ) );
+                m_columns.categories = reinterpret_cast<const DatIndexCategoryRecordFields*>( columnData );
+                break;
+            case DatIndexChunk_Strings:
+                m_columns.strings = reinterpret_cast<const char*>( columnData );
+                m_columns.stringsSize = column.size;
+                break;
+            case DatIndexChunk_EntryCategories:
+                isValid = hasElements( m_header.numEntries, sizeof( int32 ) );
+                m_columns.entryCategories = reinterpret_cast<const int32*>( columnData );
+                break;
+            case DatIndexChunk_BaseIds:
+                isValid = hasElements( m_header.numEntries, sizeof( uint32 ) );
+                m_columns.baseIds = reinterpret_cast<const uint32*>( columnData );
+                break;
+            case DatIndexChunk_FileIds:
+                isValid = hasElements( m_header.numEntries, sizeof( uint32 ) );
+                m_columns.fileIds = reinterpret_cast<const uint32*>( columnData );
+                break;
+            case DatIndexChunk_MftEntries:
+                isValid = hasElements( m_header.numEntries, sizeof( uint32 ) );
+                m_columns.mftEntries = reinterpret_cast<const uint32*>( columnData );
+                break;
+            case DatIndexChunk_FileTypes:
+                isValid = hasElements( m_header.numEntries, sizeof( uint32 ) );
+                m_columns.fileTypes = reinterpret_cast<const uint32*>( columnData );
+                break;
+            case DatIndexChunk_EntryNames:
+                isValid = hasElements( m_header.numEntries, sizeof( DatIndexStringFields ) );
+                m_columns.entryNames = reinterpret_cast<const DatIndexStringFields*>( columnData );
+                break;
+            case DatIndexChunk_EntrySizes:
+                isValid = hasElements( m_header.numEntries, sizeof( uint32 ) );
+                m_columns.entrySizes = reinterpret_cast<const uint32*>( columnData );
+                break;
+            case DatIndexChunk_Fingerprints:
+                isValid = hasElements( m_header.numEntries, sizeof( DatIndexFingerprintFields ) );
+                m_columns.fingerprints = reinterpret_cast<const DatIndexFingerprintFields*>( columnData );
+                break;
+            case DatIndexChunk_ContentHashes:
+                isValid = hasElements( m_header.numEntries, sizeof( uint64 ) );
+                m_columns.contentHashes = reinterpret_cast<const uint64*>( columnData );
+                break;
+            case DatIndexChunk_Metadata:
+                isValid = hasElements( m_header.numEntries, sizeof( DatIndexMetadataFields ) );
+                m_columns.metadata = reinterpret_cast<const DatIndexMetadataFields*>( columnData );
+                break;
+            case DatIndexChunk_AudioFormats:
+                isValid = hasElements( m_header.numEntries, sizeof( uint8 ) );
+                m_columns.audioFormats = reinterpret_cast<const uint8*>( columnData );
+                break;
+            default:
+                // Written by a newer version, skip it
+                break;
+            }
+            if ( !isValid ) {
+                return false;
+            }
+        }
+
+        // The sizes, fingerprints, hashes, metadata and audio formats are optional
+        return m_columns.categories && m_columns.strings && m_columns.entryCategories && m_columns.baseIds
+            && m_columns.fileIds && m_columns.mftEntries && m_columns.fileTypes && m_columns.entryNames;
+    }
+
+    DatIndexReader::ReadResult DatIndexReader::readRecord( ) {
+        ssize_t bytesRead;
+
+        // First read all categories, one at a time
+        if ( m_index.numCategories( ) < m_header.numCategories ) {
+            // Read fixed-width fields
+            DatIndexCategoryFields fields;
+            bytesRead = m_file.Read( &fields, sizeof( fields ) );
+            if ( bytesRead < static_cast<ssize_t>( sizeof( fields ) ) ) {
+                return RR_CorruptFile;
+            }
+            // Read name
+            Array<char> nameData( fields.nameLength );
+            bytesRead = m_file.Read( nameData.GetPointer( ), nameData.GetSize( ) );
+            if ( bytesRead < ( ssize_t ) nameData.GetSize( ) ) {
+                return RR_CorruptFile;
+            }
+            // Add category
+            auto name = wxString::FromUTF8Unchecked( nameData.GetPointer( ), nameData.GetSize( ) );
+            auto category = m_index.addIndexCategory( name, false );
+            // Set parent
+            if ( fields.parent != DatIndex_RootCategory ) {
+                auto parent = m_index.category( fields.parent );
+                if ( parent ) {
+                    parent->addSubCategory( category );
                 }
-                // Read name
-                Array<char> nameData( fields.nameLength );
-                bytesRead = m_file.Read( nameData.GetPointer( ), nameData.GetSize( ) );
-                if ( bytesRead < ( ssize_t ) nameData.GetSize( ) ) {
-                    result = RR_CorruptFile; goto READ_FAILED;
+            }
+        }
+
+        // If all categories are read, start reading the files instead (note the 'else')
+        else if ( m_index.numEntries( ) < m_header.numEntries ) {
+            // Read fixed-width fields
+            DatIndexEntryFields fields;
+            bytesRead = m_file.Read( &fields, sizeof( fields ) );
+            if ( bytesRead < static_cast<ssize_t>( sizeof( fields ) ) ) {
+                return RR_CorruptFile;
+            }
+            // Read name
+            Array<char> nameData( fields.nameLength );
+            bytesRead = m_file.Read( nameData.GetPointer( ), nameData.GetSize( ) );
+            if ( bytesRead < ( ssize_t ) nameData.GetSize( ) ) {
+                return RR_CorruptFile;
+            }
+            // Add entry
+            auto name = wxString::FromUTF8Unchecked( nameData.GetPointer( ), nameData.GetSize( ) );
+            auto& newEntry = m_index.addIndexEntry( false )
+                ->setBaseId( fields.baseId )
+                .setFileId( fields.fileId )
+                .setMftEntry( fields.mftEntry )
+                .setFileType( ( ANetFileType ) fields.fileType )
+                .setName( name );
+            auto category = m_index.category( fields.category );
+            if ( !category ) {
+                return RR_CorruptFile;
+            }
+            category->addEntry( &newEntry );
+            newEntry.finalizeAdd( );
+        }
+
+        // Then read the optional chunks, all in one go
+        else if ( !m_chunksRead ) {
+            if ( !this->readChunks( ) ) {
+                return RR_CorruptFile;
+            }
+            m_chunksRead = true;
+        }
+
+        return RR_Success;
+    }
+
+    DatIndexReader::ReadResult DatIndexReader::readColumns( ) {
+        // First all categories
+        if ( m_index.numCategories( ) < m_header.numCategories ) {
+            const auto& fields = m_columns.categories[m_index.numCategories( )];
+            wxString name;
+            if ( !this->readString( fields.name, name ) ) {
+                return RR_CorruptFile;
+            }
+            auto category = m_index.addIndexCategory( name, false );
+            if ( fields.parent != DatIndex_RootCategory ) {
+                auto parent = m_index.category( fields.parent );
+                if ( parent ) {
+                    parent->addSubCategory( category );
                 }
-                // Add category
-                auto name = wxString::FromUTF8Unchecked( nameData.GetPointer( ), nameData.GetSize( ) );
-                auto category = m_index.addIndexCategory( name, false );
-                // Set parent
-                if ( fields.parent != DatIndex_RootCategory ) {
-                    auto parent = m_index.category( fields.parent );
-                    if ( parent ) {
-                        parent->addSubCategory( category );
-                    }
+            }
+            return RR_Success;
+        }
+
+        // Then the entries, with all of their columns at once. Their
+        // categories get room for all of them up front.
+        uint index = m_index.numEntries( );
+        if ( !index ) {
+            std::vector<uint> numEntries( m_index.numCategories( ), 0 );
+            for ( uint i = 0; i < m_header.numEntries; i++ ) {
+                auto category = m_columns.entryCategories[i];
+                if ( category >= 0 && static_cast<uint>( category ) < numEntries.size( ) ) {
+                    numEntries[category]++;
                 }
             }
+            for ( uint i = 0; i < numEntries.size( ); i++ ) {
+                m_index.category( i )->reserveEntries( numEntries[i] );
+            }
+        }
+        wxString name;
+        auto category = m_index.category( m_columns.entryCategories[index] );
+        if ( !category || !this->readString( m_columns.entryNames[index], name ) ) {
+            return RR_CorruptFile;
+        }
+        auto& newEntry = m_index.addIndexEntry( false )
+            ->setBaseId( m_columns.baseIds[index] )
+            .setFileId( m_columns.fileIds[index] )
+            .setMftEntry( m_columns.mftEntries[index] )
+            .setFileType( ( ANetFileType ) m_columns.fileTypes[index] )
+            .setName( name );
+        if ( m_columns.entrySizes ) {
+            newEntry.setUncompressedSize( m_columns.entrySizes[index] );
+        }
+        if ( m_columns.fingerprints ) {
+            DatIndexFingerprint fingerprint;
+            fromFields( m_columns.fingerprints[index], fingerprint );
+            newEntry.setFingerprint( fingerprint );
+        }
+        if ( m_columns.contentHashes ) {
+            newEntry.cacheContentHash( m_columns.contentHashes[index] );
+        }
+        if ( m_columns.metadata ) {
+            DatIndexMetadata metadata;
+            fromFields( m_columns.metadata[index], metadata );
+            if ( m_columns.audioFormats ) {
+                metadata.audioFormat = m_columns.audioFormats[index];
+            }
+            newEntry.setMetadata( metadata );
+        }
+        category->addEntry( &newEntry );
+        newEntry.finalizeAdd( );
+        return RR_Success;
+    }
+
+    bool DatIndexReader::readString( const DatIndexStringFields& p_name, wxString& po_name ) const {
+        if ( p_name.offset > m_columns.stringsSize || p_name.length > m_columns.stringsSize - p_name.offset ) {
+            return false;
+        }
+        po_name = wxString::FromUTF8Unchecked( m_columns.strings + p_name.offset, p_name.length );
+        return true;
+    }
+
+    bool DatIndexReader::readChunks( ) {
+        while ( m_file.Tell( ) < m_file.Length( ) ) {
+            DatIndexChunkHead head;
+            if ( m_file.Read( &head, sizeof( head ) ) < static_cast<ssize_t>( sizeof( head ) ) ) {
+                return false;
+            }
 
-            // If all categories are read, start reading the files instead (note the 'else')
-            else if ( m_index.numEntries( ) < m_header.numEntries ) {
-                // Read fixed-width fields
-                DatIndexEntryFields fields;
-                bytesRead = m_file.Read( &fields, sizeof( fields ) );
-                if ( bytesRead < static_cast<ssize_t>( sizeof( fields ) ) ) {
-                    result = RR_CorruptFile; goto READ_FAILED;
+            switch ( head.id ) {
+            case DatIndexChunk_EntrySizes:
+            {
+                if ( head.size != m_header.numEntries * sizeof( uint32 ) ) {
+                    return false;
                 }
-                // Read name
-                Array<char> nameData( fields.nameLength );
-                bytesRead = m_file.Read( nameData.GetPointer( ), nameData.GetSize( ) );
-                if ( bytesRead < ( ssize_t ) nameData.GetSize( ) ) {
-                    result = RR_CorruptFile; goto READ_FAILED;
+                Array<uint32> sizes( m_header.numEntries );
+                if ( m_file.Read( sizes.GetPointer( ), head.size ) < static_cast<ssize_t>( head.size ) ) {
+                    return false;
                 }
-                // Add entry
-                auto name = wxString::FromUTF8Unchecked( nameData.GetPointer( ), nameData.GetSize( ) );
-                auto& newEntry = m_index.addIndexEntry( false )
-                    ->setBaseId( fields.baseId )
-                    .setFileId( fields.fileId )
-                    .setMftEntry( fields.mftEntry )
-                    .setFileType( ( ANetFileType ) fields.fileType )
-                    .setName( name );
-                auto category = m_index.category( fields.category );
-                if ( !category ) {
-                    result = RR_CorruptFile; goto READ_FAILED;
+                for ( uint i = 0; i < sizes.GetSize( ); i++ ) {
+                    m_index.entry( i )->setUncompressedSize( sizes[i] );
                 }
-                category->addEntry( &newEntry );
-                newEntry.finalizeAdd( );
+                break;
             }
-
-            // If both are done we can skip this loop
-            else {
+            case DatIndexChunk_Fingerprints:
+            {
+                if ( head.size != m_header.numEntries * sizeof( DatIndexFingerprintFields ) ) {
+                    return false;
+                }
+                Array<DatIndexFingerprintFields> fields( m_header.numEntries );
+                if ( m_file.Read( fields.GetPointer( ), head.size ) < static_cast<ssize_t>( head.size ) ) {
+                    return false;
+                }
+                for ( uint i = 0; i < fields.GetSize( ); i++ ) {
+                    DatIndexFingerprint fingerprint;
+                    fromFields( fields[i], fingerprint );
+                    m_index.entry( i )->setFingerprint( fingerprint );
+                }
+                break;
+            }
+            case DatIndexChunk_ContentHashes:
+            {
+                if ( head.size != m_header.numEntries * sizeof( uint64 ) ) {
+                    return false;
+                }
+                Array<uint64> hashes( m_header.numEntries );
+                if ( m_file.Read( hashes.GetPointer( ), head.size ) < static_cast<ssize_t>( head.size ) ) {
+                    return false;
+                }
+                for ( uint i = 0; i < hashes.GetSize( ); i++ ) {
+                    m_index.entry( i )->cacheContentHash( hashes[i] );
+                }
+                break;
+            }
+            case DatIndexChunk_Metadata:
+            {
+                if ( head.size != m_header.numEntries * sizeof( DatIndexMetadataFields ) ) {
+                    return false;
+                }
+                Array<DatIndexMetadataFields> fields( m_header.numEntries );
+                if ( m_file.Read( fields.GetPointer( ), head.size ) < static_cast<ssize_t>( head.size ) ) {
+                    return false;
+                }
+                for ( uint i = 0; i < fields.GetSize( ); i++ ) {
+                    DatIndexMetadata metadata;
+                    fromFields( fields[i], metadata );
+                    m_index.entry( i )->setMetadata( metadata );
+                }
+                break;
+            }
+            default:
+                // Written by a newer version, skip it
+                m_file.Seek( head.size, wxFromCurrent );
                 break;
             }
         }
+        return true;
+    }
 
-        return RR_Success;
-
-    READ_FAILED:
-        return result;
+    void DatIndexReader::release( ) {
+        // Written in the current version when the index is saved next
+        if ( m_file.IsOpened( ) ) {
+            m_index.setDirty( true );
+        }
+        m_file.Close( );
+        m_mappedFile.close( );
     }
 
     //----------------------------------------------------------------------------
@@ -158,7 +489,8 @@ namespace gw2b {
     DatIndexWriter::DatIndexWriter( DatIndex& p_index )
         : m_index( p_index )
         , m_categoriesWritten( 0 )
-        , m_entriesWritten( 0 ) {
+        , m_entriesWritten( 0 )
+        , m_columnsWritten( false ) {
         Ensure::notNull( &p_index );
     }
 
@@ -183,6 +515,28 @@ namespace gw2b {
                 this->close( ); return false;
             }
 
+            // Parents sort before their children, as their path is a prefix
+            std::vector<std::vector<wxString>> paths( header.numCategories );
+            for ( uint i = 0; i < header.numCategories; i++ ) {
+                for ( auto category = m_index.category( i ); category; category = category->parent( ) ) {
+                    paths[i].push_back( category->name( ) );
+                }
+                std::reverse( paths[i].begin( ), paths[i].end( ) );
+            }
+            m_categoryOrder.resize( header.numCategories );
+            for ( uint i = 0; i < header.numCategories; i++ ) {
+                m_categoryOrder[i] = i;
+            }
+            std::stable_sort( m_categoryOrder.begin( ), m_categoryOrder.end( ), [&paths] ( uint p_a, uint p_b ) {
+                return paths[p_a] < paths[p_b];
+            } );
+            m_categoryPositions.resize( header.numCategories );
+            for ( uint i = 0; i < header.numCategories; i++ ) {
+                m_categoryPositions[m_categoryOrder[i]] = static_cast<int32>( i );
+            }
+
+            m_categoryRecords.reserve( header.numCategories );
+            m_entryNames.reserve( header.numEntries );
             return true;
         }
 
@@ -193,76 +547,328 @@ namespace gw2b {
         m_file.Close( );
         m_categoriesWritten = 0;
         m_entriesWritten = 0;
+        m_columnsWritten = false;
+        std::vector<uint>( ).swap( m_categoryOrder );
+        std::vector<int32>( ).swap( m_categoryPositions );
+        std::vector<DatIndexCategoryRecordFields>( ).swap( m_categoryRecords );
+        std::vector<DatIndexStringFields>( ).swap( m_entryNames );
+        std::vector<char>( ).swap( m_strings );
     }
 
     bool DatIndexWriter::isDone( ) const {
         return ( m_index.numEntries( ) == m_entriesWritten )
-            && ( m_index.numCategories( ) == m_categoriesWritten );
+            && ( m_index.numCategories( ) == m_categoriesWritten )
+            && m_columnsWritten;
     }
 
     bool DatIndexWriter::write( uint p_amount ) {
         for ( uint i = 0; i < p_amount; i++ ) {
-            ssize_t bytesWritten;
-
-            // First write categories, one at a time
+            // First collect the categories, one at a time
             if ( m_categoriesWritten < m_index.numCategories( ) ) {
-                auto category = m_index.category( m_categoriesWritten );
+                auto category = m_index.category( m_categoryOrder[m_categoriesWritten] );
                 auto parent = category->parent( );
-                wxScopedCharBuffer nameBuffer = category->name( ).ToUTF8( );
-                // Fixed-width fields
-                DatIndexCategoryFields fields;
-                fields.parent = ( parent ? parent->index( ) : -1 );
-                fields.nameLength = nameBuffer.length( );
-                bytesWritten = m_file.Write( &fields, sizeof( fields ) );
-                if ( bytesWritten < static_cast<ssize_t>( sizeof( fields ) ) ) {
-                    return false;
-                }
-                // Name
-                bytesWritten = m_file.Write( nameBuffer, fields.nameLength );
-                if ( bytesWritten < fields.nameLength ) {
-                    return false;
-                }
+                DatIndexCategoryRecordFields fields;
+                fields.parent = ( parent ? m_categoryPositions[parent->index( )] : DatIndex_RootCategory );
+                fields.name = this->addString( category->name( ) );
+                m_categoryRecords.push_back( fields );
                 // Increase the counter
                 m_categoriesWritten++;
             }
 
-            // Then, write entries one at a time (note the 'else')
+            // Then the names of the entries, one at a time (note the 'else')
             else if ( m_entriesWritten < m_index.numEntries( ) ) {
-                auto entry = m_index.entry( m_entriesWritten );
-                auto category = entry->category( );
-                auto nameBuffer = entry->name( ).ToUTF8( );
-                // Fixed-width fields
-                DatIndexEntryFields fields;
-                fields.category = category->index( );
-                fields.baseId = entry->baseId( );
-                fields.fileId = entry->fileId( );
-                fields.mftEntry = entry->mftEntry( );
-                fields.fileType = entry->fileType( );
-                fields.nameLength = nameBuffer.length( );
-                bytesWritten = m_file.Write( &fields, sizeof( fields ) );
-                if ( bytesWritten < static_cast<ssize_t>( sizeof( fields ) ) ) {
-                    return false;
-                }
-                // Name
-                bytesWritten = m_file.Write( nameBuffer, fields.nameLength );
-                if ( bytesWritten < fields.nameLength ) {
-                    return false;
-                }
+                m_entryNames.push_back( this->addString( m_index.entry( m_entriesWritten )->name( ) ) );
                 // Increase the counter
                 m_entriesWritten++;
             }
 
-            // Both done = ditch this loop
+            // Then write all columns in one go
+            else if ( !m_columnsWritten ) {
+                if ( !this->writeColumns( ) ) {
+                    return false;
+                }
+                m_columnsWritten = true;
+            }
+
+            // All done = ditch this loop
             else {
                 break;
             }
         }
 
-        // Remove dirty flag if everything is saved
-        if ( this->isDone( ) ) {
-            m_index.setDirty( false );
+        return true;
+    }
+
+    DatIndexStringFields DatIndexWriter::addString( const wxString& p_name ) {
+        auto nameBuffer = p_name.ToUTF8( );
+        DatIndexStringFields fields;
+        fields.offset = static_cast<uint32>( m_strings.size( ) );
+        fields.length = static_cast<uint32>( nameBuffer.length( ) );
+        appendBytes( m_strings, nameBuffer.data( ), fields.length );
+        return fields;
+    }
+
+    bool DatIndexWriter::writeColumns( ) {
+        // Split the entries into a column per field
+        uint numEntries = m_index.numEntries( );
+        Array<int32> categories( numEntries );
+        Array<uint32> baseIds( numEntries );
+        Array<uint32> fileIds( numEntries );
+        Array<uint32> mftEntries( numEntries );
+        Array<uint32> fileTypes( numEntries );
+        Array<uint32> sizes( numEntries );
+        Array<DatIndexFingerprintFields> fingerprints( numEntries );
+        Array<uint64> hashes( numEntries );
+        Array<DatIndexMetadataFields> metadata( numEntries );
+        Array<uint8> audioFormats( numEntries );
+        for ( uint i = 0; i < numEntries; i++ ) {
+            auto entry = m_index.entry( i );
+            categories[i] = m_categoryPositions[entry->category( )->index( )];
+            baseIds[i] = entry->baseId( );
+            fileIds[i] = entry->fileId( );
+            mftEntries[i] = entry->mftEntry( );
+            fileTypes[i] = entry->fileType( );
+            sizes[i] = entry->uncompressedSize( );
+            toFields( entry->fingerprint( ), fingerprints[i] );
+            hashes[i] = entry->contentHash( );
+            toFields( entry->metadata( ), metadata[i] );
+            audioFormats[i] = entry->metadata( ).audioFormat;
+        }
+
+        struct Column {
+            uint32      id;
+            const void* data;
+            uint64      size;
+        };
+        const Column columns[] = {
+            { DatIndexChunk_Categories, m_categoryRecords.data( ), m_categoryRecords.size( ) * sizeof( DatIndexCategoryRecordFields ) },
+            { DatIndexChunk_EntryCategories, categories.GetPointer( ), categories.GetByteSize( ) },
+            { DatIndexChunk_BaseIds, baseIds.GetPointer( ), baseIds.GetByteSize( ) },
+            { DatIndexChunk_FileIds, fileIds.GetPointer( ), fileIds.GetByteSize( ) },
+            { DatIndexChunk_MftEntries, mftEntries.GetPointer( ), mftEntries.GetByteSize( ) },
+            { DatIndexChunk_FileTypes, fileTypes.GetPointer( ), fileTypes.GetByteSize( ) },
+            { DatIndexChunk_EntryNames, m_entryNames.data( ), m_entryNames.size( ) * sizeof( DatIndexStringFields ) },
+            { DatIndexChunk_EntrySizes, sizes.GetPointer( ), sizes.GetByteSize( ) },
+            { DatIndexChunk_Fingerprints, fingerprints.GetPointer( ), fingerprints.GetByteSize( ) },
+            { DatIndexChunk_ContentHashes, hashes.GetPointer( ), hashes.GetByteSize( ) },
+            { DatIndexChunk_Metadata, metadata.GetPointer( ), metadata.GetByteSize( ) },
+            { DatIndexChunk_AudioFormats, audioFormats.GetPointer( ), audioFormats.GetByteSize( ) },
+            { DatIndexChunk_Strings, m_strings.data( ), m_strings.size( ) },
+        };
+
+        // The table follows the header, the columns follow the table
+        DatIndexColumnTableHead table;
+        table.numColumns = ArraySize( columns );
+        std::vector<DatIndexColumnFields> fields( table.numColumns );
+        uint64 position = sizeof( DatIndexHead ) + sizeof( table ) + fields.size( ) * sizeof( DatIndexColumnFields );
+        uint64 offset = position;
+        for ( uint i = 0; i < table.numColumns; i++ ) {
+            offset = alignColumn( offset );
+            fields[i].id = columns[i].id;
+            fields[i].reserved = 0;
+            fields[i].offset = offset;
+            fields[i].size = columns[i].size;
+            offset += columns[i].size;
+        }
+
+        if ( m_file.Write( &table, sizeof( table ) ) < sizeof( table ) ) {
+            return false;
+        }
+        if ( m_file.Write( fields.data( ), fields.size( ) * sizeof( DatIndexColumnFields ) ) < fields.size( ) * sizeof( DatIndexColumnFields ) ) {
+            return false;
+        }
+
+        static const char padding[DatIndex_ColumnAlignment] = { };
+        for ( uint i = 0; i < table.numColumns; i++ ) {
+            auto paddingSize = static_cast<size_t>( fields[i].offset - position );
+            if ( m_file.Write( padding, paddingSize ) < paddingSize ) {
+                return false;
+            }
+            if ( m_file.Write( columns[i].data, columns[i].size ) < columns[i].size ) {
+                return false;
+            }
+            position = fields[i].offset + fields[i].size;
+        }
+
+        return true;
+    }
+
+    //----------------------------------------------------------------------------
+    //      DatIndexJournal
+    //----------------------------------------------------------------------------
+
+    DatIndexJournal::DatIndexJournal( ) {
+    }
+
+    DatIndexJournal::~DatIndexJournal( ) {
+        this->close( );
+    }
+
+    bool DatIndexJournal::open( const wxString& p_filename, uint64 p_datTimestamp, const ReplayHandler& p_handler ) {
+        this->close( );
+
+        // Read what an earlier scan left behind
+        std::vector<char> data;
+        if ( wxFile::Exists( p_filename ) ) {
+            wxFile file( p_filename );
+            if ( file.IsOpened( ) ) {
+                data.resize( static_cast<size_t>( file.Length( ) ) );
+                if ( file.Read( data.data( ), data.size( ) ) < static_cast<ssize_t>( data.size( ) ) ) {
+                    data.clear( );
+                }
+            }
+        }
+
+        // Only a journal of the same .dat is of use
+        DatIndexJournalHead header;
+        size_t validSize = 0;
+        if ( data.size( ) >= sizeof( header ) ) {
+            ::memcpy( &header, data.data( ), sizeof( header ) );
+            if ( header.magic == DatIndexJournal_Magic && header.version == DatIndexJournal_Version
+                && header.datTimestamp == p_datTimestamp ) {
+                validSize = sizeof( header );
+            }
+        }
+
+        // Replay the batches up to the first one that was cut short
+        while ( validSize && data.size( ) - validSize >= sizeof( DatIndexJournalBatchHead ) ) {
+            DatIndexJournalBatchHead batch;
+            ::memcpy( &batch, data.data( ) + validSize, sizeof( batch ) );
+            auto records = data.data( ) + validSize + sizeof( batch );
+            if ( batch.magic != DatIndexJournal_BatchMagic
+                || batch.size > data.size( ) - validSize - sizeof( batch )
+                || compute_crc( INITIAL_CRC, records, batch.size ) != batch.crc ) {
+                break;
+            }
+            if ( !this->replayBatch( records, batch.size, p_handler ) ) {
+                break;
+            }
+            validSize += sizeof( batch ) + batch.size;
+        }
+
+        if ( validSize && validSize == data.size( ) ) {
+            m_file.Open( p_filename, wxFile::write_append );
+            return m_file.IsOpened( );
+        }
+
+        // Start over from the last complete batch, or from scratch
+        if ( !validSize ) {
+            header.magic = DatIndexJournal_Magic;
+            header.version = DatIndexJournal_Version;
+            header.datTimestamp = p_datTimestamp;
+            data.clear( );
+            appendBytes( data, &header, sizeof( header ) );
+            validSize = sizeof( header );
+        }
+
+        m_file.Open( p_filename, wxFile::write );
+        if ( !m_file.IsOpened( ) || m_file.Write( data.data( ), validSize ) < validSize || !m_file.Flush( ) ) {
+            this->close( ); return false;
+        }
+        return true;
+    }
+
+    void DatIndexJournal::close( ) {
+        m_file.Close( );
+        std::lock_guard<std::mutex> lock( m_pendingMutex );
+        m_pending.clear( );
+    }
+
+    void DatIndexJournal::append( const std::vector<DatIndexJournalRecord>& p_records ) {
+        // Serialize outside the lock, so callers only wait for the copy
+        std::vector<char> data;
+        for ( const auto& record : p_records ) {
+            DatIndexJournalRecordFields fields;
+            fields.fileNum = record.fileNum;
+            fields.crc = record.crc;
+            fields.fileType = record.fileType;
+            fields.size = record.size;
+            toFields( record.metadata, fields.metadata );
+            fields.audioFormat = record.metadata.audioFormat;
+            fields.numNames = record.category ? static_cast<uint8>( wxMin( record.category->size( ), size_t( 0xff ) ) ) : 0;
+            appendBytes( data, &fields, sizeof( fields ) );
+
+            for ( uint i = 0; i < fields.numNames; i++ ) {
+                auto nameBuffer = ( *record.category )[i].ToUTF8( );
+                uint16 nameLength = static_cast<uint16>( nameBuffer.length( ) );
+                appendBytes( data, &nameLength, sizeof( nameLength ) );
+                appendBytes( data, nameBuffer.data( ), nameLength );
+            }
+        }
+
+        std::lock_guard<std::mutex> lock( m_pendingMutex );
+        m_pending.insert( m_pending.end( ), data.begin( ), data.end( ) );
+    }
+
+    bool DatIndexJournal::checkpoint( ) {
+        // Taken even if there is no file, so the records do not pile up
+        std::vector<char> records;
+        {
+            std::lock_guard<std::mutex> lock( m_pendingMutex );
+            records.swap( m_pending );
+        }
+        if ( !m_file.IsOpened( ) ) {
+            return false;
+        }
+        if ( records.empty( ) ) {
+            return true;
+        }
+
+        // The marker goes first, a batch cut short by a crash fails its CRC
+        DatIndexJournalBatchHead head;
+        head.magic = DatIndexJournal_BatchMagic;
+        head.size = static_cast<uint32>( records.size( ) );
+        head.crc = compute_crc( INITIAL_CRC, records.data( ), records.size( ) );
+        if ( m_file.Write( &head, sizeof( head ) ) < sizeof( head )
+            || m_file.Write( records.data( ), records.size( ) ) < records.size( )
+            || !m_file.Flush( ) ) {
+            // Batches after a broken one would never be replayed
+            m_file.Close( );
+            return false;
         }
+        return true;
+    }
+
+    bool DatIndexJournal::replayBatch( const char* p_data, size_t p_size, const ReplayHandler& p_handler ) const {
+        DatIndexJournalRecord record;
+        std::vector<wxString> category;
+        record.category = &category;
+        size_t position = 0;
+
+        while ( position < p_size ) {
+            // Fixed-width fields
+            DatIndexJournalRecordFields fields;
+            if ( p_size - position < sizeof( fields ) ) {
+                return false;
+            }
+            ::memcpy( &fields, p_data + position, sizeof( fields ) );
+            position += sizeof( fields );
+
+            record.fileNum = fields.fileNum;
+            record.crc = fields.crc;
+            record.fileType = static_cast<ANetFileType>( fields.fileType );
+            record.size = fields.size;
+            fromFields( fields.metadata, record.metadata );
+            record.metadata.audioFormat = fields.audioFormat;
+
+            // Category names
+            category.clear( );
+            for ( uint i = 0; i < fields.numNames; i++ ) {
+                uint16 nameLength;
+                if ( p_size - position < sizeof( nameLength ) ) {
+                    return false;
+                }
+                ::memcpy( &nameLength, p_data + position, sizeof( nameLength ) );
+                position += sizeof( nameLength );
+                if ( p_size - position < nameLength ) {
+                    return false;
+                }
+                category.push_back( wxString::FromUTF8Unchecked( p_data + position, nameLength ) );
+                position += nameLength;
+            }
 
+            p_handler( record );
+        }
         return true;
     }
 
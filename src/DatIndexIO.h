@@ -28,16 +28,49 @@
 #ifndef DATINDEXREADER_H_INCLUDED
 #define DATINDEXREADER_H_INCLUDED
 
+#include <functional>
+#include <mutex>
+#include <vector>
+
 #include <wx/file.h>
 
 #include "DatIndex.h"
+#include "Util/MappedFile.h"
 
 namespace gw2b {
 
     enum DatIndexMagicNumber {
         DatIndex_Magic = 0x4944,
-        DatIndex_Version = 0x2,
+        DatIndex_Version = 0x3,
+        DatIndex_StreamVersion = 0x2,   /**< Last version storing the records one after the other. Still read. */
         DatIndex_RootCategory = -0x1,
+        DatIndex_ColumnAlignment = 0x8, /**< Columns start at multiples of this, to be read straight from the mapping. */
+    };
+
+    /** Identifies the columns of a version 3 .dat index file, and the optional
+    *  chunks stored after the entries in a version 2 one. Readers skip columns
+    *  and chunks they do not know, so new ones can be added without changing
+    *  the index version. */
+    enum DatIndexChunkId {
+        DatIndexChunk_Categories = 0x53544143,  /**< 'CATS', name and parent of each category. */
+        DatIndexChunk_Strings = 0x53525453,     /**< 'STRS', UTF-8 names the other columns refer to. */
+        DatIndexChunk_EntryCategories = 0x54414345, /**< 'ECAT', category index of each entry. */
+        DatIndexChunk_BaseIds = 0x44494245,     /**< 'EBID', base ID of each entry. */
+        DatIndexChunk_FileIds = 0x44494645,     /**< 'EFID', file ID of each entry. */
+        DatIndexChunk_MftEntries = 0x54464d45,  /**< 'EMFT', MFT entry number of each entry. */
+        DatIndexChunk_FileTypes = 0x50595445,   /**< 'ETYP', file type of each entry. */
+        DatIndexChunk_EntryNames = 0x4d414e45,  /**< 'ENAM', name of each entry. */
+        DatIndexChunk_EntrySizes = 0x5a495345,  /**< 'ESIZ', uncompressed size of each entry. */
+        DatIndexChunk_Fingerprints = 0x52504645,    /**< 'EFPR', MFT fingerprint of each entry. */
+        DatIndexChunk_ContentHashes = 0x48534845,   /**< 'EHSH', XXH64 of the contents of each entry. */
+        DatIndexChunk_Metadata = 0x41544d45,        /**< 'EMTA', header metadata of each entry. */
+        DatIndexChunk_AudioFormats = 0x44554145,    /**< 'EAUD', audio format byte of each entry. */
+    };
+
+    enum DatIndexJournalMagicNumber {
+        DatIndexJournal_Magic = 0x4a4c4944,     /**< 'DILJ' */
+        DatIndexJournal_Version = 0x3,
+        DatIndexJournal_BatchMagic = 0x48435442,    /**< 'BTCH' */
     };
 
 #pragma pack(push, 1)
@@ -54,13 +87,40 @@ namespace gw2b {
         uint32 numCategories;       /**< Amount of categories in the index. */
     };
 
-    /** Structure of the fixed-width category fields in the .dat index file. */
+    /** Structure of the column table following the header of a version 3
+    *  .dat index file. Each column is an array with an element per category
+    *  or per entry, except for the string pool. */
+    struct DatIndexColumnTableHead {
+        uint32 numColumns;          /**< Amount of columns following. */
+    };
+
+    /** Structure of a column in the column table of the .dat index file. */
+    struct DatIndexColumnFields {
+        uint32 id;                  /**< What the column holds, one of DatIndexChunkId. */
+        uint32 reserved;            /**< Keeps the offset aligned, always 0. */
+        uint64 offset;              /**< Location of the column in the file, a multiple of DatIndex_ColumnAlignment. */
+        uint64 size;                /**< Size of the column, in bytes. */
+    };
+
+    /** Structure of a reference to a name in the string pool of the .dat index file. */
+    struct DatIndexStringFields {
+        uint32 offset;              /**< Location of the name in the string pool. */
+        uint32 length;              /**< Length of the name, in bytes. */
+    };
+
+    /** Structure of a category in the category column of the .dat index file. */
+    struct DatIndexCategoryRecordFields {
+        int32 parent;               /**< Index of the category's parent. -1 for none. */
+        DatIndexStringFields name;  /**< Name of the category. */
+    };
+
+    /** Structure of the fixed-width category fields in a version 2 .dat index file. */
     struct DatIndexCategoryFields {
         int32 parent;               /**< Index of the category's parent. -1 for none. */
         uint16 nameLength;          /**< Length of the category's name, in bytes. */
     };
 
-    /** Structure of the fixed-width entry fields in the .dat index file. */
+    /** Structure of the fixed-width entry fields in a version 2 .dat index file. */
     struct DatIndexEntryFields {
         int32 category;             /**< Index of the category it belongs to. */
         uint32 baseId;              /**< Base ID of the indexed file. */
@@ -70,13 +130,91 @@ namespace gw2b {
         uint16 nameLength;          /**< Length of the entry's name, in bytes. */
     };
 
+    /** Structure of the MFT fingerprint of an entry in the .dat index file. */
+    struct DatIndexFingerprintFields {
+        uint64 offset;              /**< Location of the file in the .dat. */
+        uint32 size;                /**< Size of the file in the .dat. */
+        uint16 compressionFlag;     /**< Compression flags of the file. */
+        uint32 crc;                 /**< 'crc' field of the MFT entry. */
+    };
+
+    /** Structure of the metadata of an entry in the .dat index file. */
+    struct DatIndexMetadataFields {
+        uint32 format;              /**< FourCC of the texture format. */
+        uint16 width;               /**< Width of the texture, in pixels. */
+        uint16 height;              /**< Height of the texture, in pixels. */
+        uint16 mipCount;            /**< Amount of mipmap levels of the texture. */
+    };
+
+    /** Structure of the header of each optional chunk in a version 2 .dat index file. */
+    struct DatIndexChunkHead {
+        uint32 id;                  /**< Type of the chunk, one of DatIndexChunkId. */
+        uint32 size;                /**< Size of the chunk data following the header, in bytes. */
+    };
+
+    /** Structure of the index journal header in the file. */
+    struct DatIndexJournalHead {
+        uint32 magic;               /**< Contains 'DILJ'. */
+        uint16 version;             /**< Journal format version. */
+        uint64 datTimestamp;        /**< Timestamp of the scanned .dat file. */
+    };
+
+    /** Structure of the checkpoint marker heading each batch of records in the
+    *  index journal file. */
+    struct DatIndexJournalBatchHead {
+        uint32 magic;               /**< Contains 'BTCH'. */
+        uint32 size;                /**< Size of the records following the marker, in bytes. */
+        uint32 crc;                 /**< CRC of the records following the marker. */
+    };
+
+    /** Structure of the fixed-width record fields in the index journal file. */
+    struct DatIndexJournalRecordFields {
+        uint32 fileNum;             /**< MFT entry number of the file. */
+        uint32 crc;                 /**< 'crc' field of the file's MFT entry. */
+        uint32 fileType;            /**< Identified type of the file. */
+        uint32 size;                /**< Uncompressed size of the file. */
+        DatIndexMetadataFields metadata;    /**< Metadata of the file. */
+        uint8 audioFormat;          /**< Audio format byte of the file. */
+        uint8 numNames;             /**< Amount of category names following the fields. */
+    };
+
 #pragma pack(pop)
 
-    /** Responsible for reading a .dat index from file. */
+    /** Responsible for reading a .dat index from file. Version 3 files are
+    *   mapped and their columns copied into the index, version 2 files are
+    *   read record by record and leave the index dirty, so it is written in
+    *   the current format next time.
+    *   Reading a version 3 file needs no file reads or parsing, but it is not
+    *   free: every entry still becomes a DatIndexEntry with a wxString name
+    *   decoded from the string pool, and is added to its category one at a
+    *   time. Loading time grows with the amount of entries, and is mostly
+    *   spent on those names. */
     class DatIndexReader {
+        /** The columns of a mapped version 3 file. Optional columns that
+        *   are missing are nullptr. */
+        struct ColumnView {
+            const DatIndexCategoryRecordFields* categories;
+            const char*                         strings;
+            uint64                              stringsSize;
+            const int32*                        entryCategories;
+            const uint32*                       baseIds;
+            const uint32*                       fileIds;
+            const uint32*                       mftEntries;
+            const uint32*                       fileTypes;
+            const DatIndexStringFields*         entryNames;
+            const uint32*                       entrySizes;
+            const DatIndexFingerprintFields*    fingerprints;
+            const uint64*                       contentHashes;
+            const DatIndexMetadataFields*       metadata;
+            const uint8*                        audioFormats;
+        };
+
         DatIndex&       m_index;
         DatIndexHead    m_header;
         wxFile          m_file;
+        MappedFile      m_mappedFile;
+        ColumnView      m_columns;
+        bool            m_chunksRead;
     public:
         /** Result of the Read() operation. */
         enum ReadResult {
@@ -106,7 +244,7 @@ namespace gw2b {
         /** Determines whether there is an open index file.
         *  \return bool    true if there is an open index file, false if not. */
         bool isOpen( ) const {
-            return m_file.IsOpened( );
+            return m_file.IsOpened( ) || m_mappedFile.isOpen( );
         }
 
         /** Gets the current amount of read categories.
@@ -136,14 +274,45 @@ namespace gw2b {
         *  \param[in]  p_amount     Amount of read cycles to perform.
         *  \return ReadResult  The result of the read operation(s). */
         ReadResult read( uint p_amount = 1 );
+    private:
+        /** Maps the version 3 file and finds its columns.
+        *  \param[in]  p_filename   File to map.
+        *  \return bool    true if successful, false if the file is corrupt. */
+        bool mapColumns( const wxString& p_filename );
+        /** Reads a category or an entry of a version 2 file.
+        *  \return ReadResult  The result of the read operation. */
+        ReadResult readRecord( );
+        /** Adds a category or an entry from the columns of a version 3 file.
+        *  \return ReadResult  The result of the read operation. */
+        ReadResult readColumns( );
+        /** Gets a name from the string pool of a version 3 file.
+        *  \param[in]  p_name   Reference to the name.
+        *  \param[out] po_name  The name.
+        *  \return bool    true if successful, false if the reference is out of range. */
+        bool readString( const DatIndexStringFields& p_name, wxString& po_name ) const;
+        /** Reads the optional chunks following the entries of a version 2 file.
+        *  \return bool    true if successful, false if the chunks are corrupt. */
+        bool readChunks( );
+        /** Releases the file once everything is read, so it can be rewritten. */
+        void release( );
     }; // class DatIndexReader
 
-    /** Responsible for writing a .dat index to file. */
+    /** Responsible for writing a .dat index to file, in the current version.
+    *   The names are collected into the string pool a category or an entry
+    *   at a time, then all columns are written in one go. Categories are
+    *   written sorted by their path rather than in the order they were made,
+    *   so the file does not depend on the order a scan merged its results in. */
     class DatIndexWriter {
         DatIndex&       m_index;
         wxFile          m_file;
         uint            m_categoriesWritten;
         uint            m_entriesWritten;
+        bool            m_columnsWritten;
+        std::vector<uint>                           m_categoryOrder;        // category written at each position
+        std::vector<int32>                          m_categoryPositions;    // position each category is written at
+        std::vector<DatIndexCategoryRecordFields>   m_categoryRecords;
+        std::vector<DatIndexStringFields>           m_entryNames;
+        std::vector<char>                           m_strings;
     public:
         /** Constructor.
         *  \param[in]  p_index  Index to write onto disk. */
@@ -192,9 +361,79 @@ namespace gw2b {
         *  \param[in]  p_amount     Amount of write cycles to perform.
         *  \return bool    true if successful, false if not. */
         bool write( uint p_amount = 1 );
+    private:
+        /** Adds a name to the string pool.
+        *  \param[in]  p_name   Name to add.
+        *  \return DatIndexStringFields    Reference to the added name. */
+        DatIndexStringFields addString( const wxString& p_name );
+        /** Writes the column table and the columns.
+        *  \return bool    true if successful, false if not. */
+        bool writeColumns( );
 
     }; // class DatIndexWriter
 
+    /** A file identified by a scan, as kept in the index journal. */
+    struct DatIndexJournalRecord {
+        uint                    fileNum;    /**< MFT entry number of the file. */
+        uint32                  crc;        /**< 'crc' field of the file's MFT entry when it was scanned. */
+        ANetFileType            fileType;   /**< Identified type of the file. */
+        uint                    size;       /**< Uncompressed size of the file. */
+        DatIndexMetadata        metadata;   /**< What the file's header tells about it. */
+        const std::vector<wxString>*    category;   /**< Names of the file's category and its parents, root
+                                                    *   first. Not owned by the record, so records that
+                                                    *   share a category share the names. */
+    };
+
+    /** Append-only log of the files a scan has identified, so an interrupted
+    *  scan can pick up where it left off. Records are collected in memory and
+    *  written in batches, each behind a checkpoint marker holding its size and
+    *  CRC. Batches that were not completely written are ignored. */
+    class DatIndexJournal {
+    public:
+        /** Called for each record replayed from the journal. */
+        typedef std::function<void( const DatIndexJournalRecord& )> ReplayHandler;
+    private:
+        wxFile              m_file;
+        std::vector<char>   m_pending;
+        std::mutex          m_pendingMutex;
+    public:
+        /** Constructor. */
+        DatIndexJournal( );
+        /** Destructor. */
+        ~DatIndexJournal( );
+
+        /** Opens the given journal for appending. The records of its complete
+        *  batches are replayed first, if it was written for the same .dat file.
+        *  Anything else in it is discarded.
+        *  \param[in]  p_filename       File to open.
+        *  \param[in]  p_datTimestamp   Timestamp of the .dat file being scanned.
+        *  \param[in]  p_handler        Handler to replay the records to.
+        *  \return bool    true if open was successful, false if not. */
+        bool open( const wxString& p_filename, uint64 p_datTimestamp, const ReplayHandler& p_handler );
+        /** Closes the opened file. Records that were not checkpointed are lost. */
+        void close( );
+        /** Determines whether there is an open journal file.
+        *  \return bool    true if there is an open journal file, false if not. */
+        bool isOpen( ) const {
+            return m_file.IsOpened( );
+        }
+
+        /** Adds records to the next batch. Can be called from any thread.
+        *  \param[in]  p_records    Records to add. */
+        void append( const std::vector<DatIndexJournalRecord>& p_records );
+        /** Writes the records added since the last checkpoint, and flushes them
+        *  to disk. Must not be called from more than one thread at a time.
+        *  \return bool    true if successful, false if not. */
+        bool checkpoint( );
+    private:
+        /** Replays the records of one batch.
+        *  \param[in]  p_data       Records of the batch.
+        *  \param[in]  p_size       Size of the records, in bytes.
+        *  \param[in]  p_handler    Handler to replay the records to.
+        *  \return bool    true if successful, false if the batch is corrupt. */
+        bool replayBatch( const char* p_data, size_t p_size, const ReplayHandler& p_handler ) const;
+    }; // class DatIndexJournal
+
 }; // namespace gw2b
 
 #endif // DATINDEXREADER_H_INCLUDED
@@ -0,0 +1,229 @@
+/** \file       DatVerifier.cpp
+ *  \brief      Contains the definition of the .dat entry verifier.
+ *  \author     agent
+ */
+
+/**
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of Gw2Browser.
+ *
+ * Gw2Browser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "stdafx.h"
+
+#include "DatFile.h"
+#include "Exception.h"
+
+#include "DatVerifier.h"
+
+namespace gw2b {
+
+    namespace {
+
+        const uint BlockSize = DatEntryView::RawBlockSize;
+        const uint BlockDataSize = DatEntryView::RawBlockDataSize;
+
+        uint32 blockChecksum( DatVerifier::ChecksumType p_type, const byte* p_data, uint p_size ) {
+            return ( p_type == DatVerifier::CT_Crc32c ) ? crc32c( p_data, p_size ) : crc32( p_data, p_size );
+        }
+
+        uint32 blockCheckValue( const byte* p_block, uint p_dataSize ) {
+            uint32 value;
+            ::memcpy( &value, p_block + p_dataSize, sizeof( value ) );
+            return value;
+        }
+
+        /** Entries inflated all at once up to this size use a buffer owned by
+        *   the verifying thread, bigger ones get a buffer of their own. */
+        const uint MaxThreadOutputBufferSize = 16 * 1024 * 1024;
+
+        /** Decompression output buffer of the verifying thread. */
+        thread_local Array<byte> t_outputBuffer;
+
+    }; // anon namespace
+
+    DatVerifier::DatVerifier( const DatFile& p_datFile )
+        : m_datFile( p_datFile )
+        , m_checksumType( CT_None )
+        , m_checksLastBlock( false ) {
+    }
+
+    DatVerifier::~DatVerifier( ) {
+    }
+
+    DatVerifier::ChecksumType DatVerifier::detectChecksumType( uint p_maxSamples ) {
+        m_checksumType = CT_None;
+        m_checksLastBlock = false;
+        if ( !m_datFile.isOpen( ) || !p_maxSamples ) {
+            return m_checksumType;
+        }
+
+        // Sample entries spread over the whole MFT, skipping the ones that
+        // describe the .dat itself
+        uint numCrc32 = 0;
+        uint numCrc32c = 0;
+        uint numBlocks = 0;
+        uint numLastBlocks = 0;
+        uint numLastCrc32 = 0;
+        uint numLastCrc32c = 0;
+        uint numFiles = m_datFile.numFiles( );
+        uint step = wxMax( 1u, numFiles / p_maxSamples );
+        for ( uint fileNum = 0; fileNum < numFiles; fileNum += step ) {
+            auto raw = m_datFile.viewRawEntry( fileNum + m_datFile.mftFileOffset( ) );
+            auto data = raw.contiguousRange( 0, raw.size( ) );
+            if ( !data ) {
+                continue;
+            }
+
+            uint fullBlocks = raw.size( ) / BlockSize;
+            for ( uint i = 0; i < fullBlocks; i++ ) {
+                auto block = data + i * BlockSize;
+                auto value = blockCheckValue( block, BlockDataSize );
+                numCrc32 += ( crc32( block, BlockDataSize ) == value );
+                numCrc32c += ( crc32c( block, BlockDataSize ) == value );
+                numBlocks++;
+            }
+
+            uint lastSize = raw.size( ) - fullBlocks * BlockSize;
+            if ( lastSize > sizeof( uint32 ) ) {
+                auto block = data + fullBlocks * BlockSize;
+                auto value = blockCheckValue( block, lastSize - sizeof( uint32 ) );
+                numLastCrc32 += ( crc32( block, lastSize - sizeof( uint32 ) ) == value );
+                numLastCrc32c += ( crc32c( block, lastSize - sizeof( uint32 ) ) == value );
+                numLastBlocks++;
+            }
+        }
+
+        // Only trust a checksum that matches every sampled block
+        if ( numBlocks && numCrc32 == numBlocks ) {
+            m_checksumType = CT_Crc32;
+        } else if ( numBlocks && numCrc32c == numBlocks ) {
+            m_checksumType = CT_Crc32c;
+        } else if ( !numBlocks && numLastBlocks && numLastCrc32 == numLastBlocks ) {
+            m_checksumType = CT_Crc32;
+        } else if ( !numBlocks && numLastBlocks && numLastCrc32c == numLastBlocks ) {
+            m_checksumType = CT_Crc32c;
+        }
+
+        if ( m_checksumType != CT_None && numLastBlocks ) {
+            uint numLastMatching = ( m_checksumType == CT_Crc32 ) ? numLastCrc32 : numLastCrc32c;
+            m_checksLastBlock = ( numLastMatching == numLastBlocks );
+        }
+
+        return m_checksumType;
+    }
+
+    DatVerifier::Result DatVerifier::verifyEntry( uint p_entryNum ) const {
+        auto result = this->verifyRawEntry( p_entryNum, m_datFile.viewRawEntry( p_entryNum ) );
+        m_datFile.releaseEntry( p_entryNum );
+        return result;
+    }
+
+    DatVerifier::Result DatVerifier::verifyRawEntry( uint p_entryNum, const DatEntryView& p_raw ) const {
+        auto data = p_raw.contiguousRange( 0, p_raw.size( ) );
+        if ( !data ) {
+            return VR_Unreadable;
+        }
+
+        // Check the block check values first, they are cheaper than inflating
+        if ( m_checksumType != CT_None ) {
+            uint fullBlocks = p_raw.size( ) / BlockSize;
+            for ( uint i = 0; i < fullBlocks; i++ ) {
+                auto block = data + i * BlockSize;
+                if ( blockChecksum( m_checksumType, block, BlockDataSize ) != blockCheckValue( block, BlockDataSize ) ) {
+                    return VR_BadChecksum;
+                }
+            }
+
+            uint lastSize = p_raw.size( ) - fullBlocks * BlockSize;
+            if ( m_checksLastBlock && lastSize > sizeof( uint32 ) ) {
+                auto block = data + fullBlocks * BlockSize;
+                if ( blockChecksum( m_checksumType, block, lastSize - sizeof( uint32 ) ) != blockCheckValue( block, lastSize - sizeof( uint32 ) ) ) {
+                    return VR_BadChecksum;
+                }
+            }
+        }
+
+        if ( !m_datFile.isEntryCompressed( p_entryNum ) ) {
+            return VR_Ok;
+        }
+
+        // The second dword of compressed entries holds the uncompressed size
+        if ( p_raw.size( ) < 8 ) {
+            return VR_BadCompression;
+        }
+        uint32 expectedSize;
+        ::memcpy( &expectedSize, data + 4, sizeof( expectedSize ) );
+
+        // The builtin inflater streams the output a window at a time, which is
+        // counted and dropped. gw2dattools needs room for all of it at once.
+        uint64 outputSize = 0;
+        try {
+            if ( m_datFile.inflater( ) == DatInflater::DI_Builtin ) {
+                auto input = [data] ( uint p_offset, uint ) -> const byte* {
+                    return data + p_offset;
+                };
+                auto sink = [&outputSize] ( const byte*, uint p_size ) {
+                    outputSize += p_size;
+                    return true;
+                };
+                DatInflater::inflate( p_raw.size( ), input, sink );
+            } else {
+                Array<byte> callOutput;
+                auto& output = ( expectedSize <= MaxThreadOutputBufferSize ) ? t_outputBuffer : callOutput;
+                if ( output.GetSize( ) < expectedSize ) {
+                    output.SetSize( expectedSize );
+                }
+
+                uint32 inflatedSize = expectedSize;
+                DatInflater::inflate( p_raw.size( ), data, inflatedSize, output.GetPointer( ), m_datFile.inflater( ) );
+                outputSize = inflatedSize;
+            }
+        } catch ( const exception::Exception& ) {
+            return VR_BadCompression;
+        }
+
+        return ( outputSize == expectedSize ) ? VR_Ok : VR_BadCompression;
+    }
+
+    const char* DatVerifier::resultName( Result p_result ) {
+        switch ( p_result ) {
+        case VR_Ok:
+            return "ok";
+        case VR_Unreadable:
+            return "unreadable";
+        case VR_BadChecksum:
+            return "bad block checksum";
+        case VR_BadCompression:
+            return "bad compressed data";
+        }
+        return "unknown";
+    }
+
+    const char* DatVerifier::checksumName( ChecksumType p_type ) {
+        switch ( p_type ) {
+        case CT_None:
+            return "none";
+        case CT_Crc32:
+            return "CRC-32";
+        case CT_Crc32c:
+            return "CRC-32C";
+        }
+        return "unknown";
+    }
+
+}; // namespace gw2b
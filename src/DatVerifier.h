@@ -0,0 +1,107 @@
+/** \file       DatVerifier.h
+ *  \brief      Contains the declaration of the .dat entry verifier.
+ *  \author     agent
+ */
+
+/**
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of Gw2Browser.
+ *
+ * Gw2Browser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#ifndef DATVERIFIER_H_INCLUDED
+#define DATVERIFIER_H_INCLUDED
+
+namespace gw2b {
+    class DatFile;
+
+    /** Checks entries of a DatFile for damage. Every 64KiB block of an entry,
+    *   compressed or not, ends in a 4-byte check value. The checksum used for
+    *   these is not documented, so it is detected from the .dat itself; when
+    *   neither CRC-32 nor CRC-32C matches, only decompression is checked.
+    *   verifyEntry can be called from any number of threads at once. */
+    class DatVerifier {
+    public:
+        /** Checksums the block check values may be made with. */
+        enum ChecksumType {
+            CT_None,    /**< Unknown checksum, block check values are not checked. */
+            CT_Crc32,   /**< CRC-32 of the block data. */
+            CT_Crc32c,  /**< CRC-32C of the block data. */
+        };
+        /** Outcome of verifying an entry. */
+        enum Result {
+            VR_Ok,              /**< Entry is intact. */
+            VR_Unreadable,      /**< Entry could not be read, e.g. it lies past the end of the .dat. */
+            VR_BadChecksum,     /**< A block check value does not match its data. */
+            VR_BadCompression,  /**< Entry failed to decompress, or to the wrong size. */
+        };
+    private:
+        const DatFile&  m_datFile;
+        ChecksumType    m_checksumType;
+        bool            m_checksLastBlock;
+    public:
+        /** Constructor.
+        *  \param[in]  p_datFile    .dat file to verify the entries of. */
+        DatVerifier( const DatFile& p_datFile );
+        /** Destructor. */
+        ~DatVerifier( );
+
+        /** Finds the checksum used for the block check values, by trying the
+        *   known ones on the blocks of a sample of entries.
+        *  \param[in]  p_maxSamples     Maximum amount of entries to sample.
+        *  \return ChecksumType     Detected checksum, also used from then on. */
+        ChecksumType detectChecksumType( uint p_maxSamples = 64 );
+        /** Gets the checksum the block check values are verified with.
+        *  \return ChecksumType     Checksum in use. */
+        ChecksumType checksumType( ) const {
+            return m_checksumType;
+        }
+        /** Gets whether the last, partial block of an entry also ends in a
+        *   check value. Detected along with the checksum.
+        *  \return bool    true if the last block is checked as well. */
+        bool checksLastBlock( ) const {
+            return m_checksLastBlock;
+        }
+
+        /** Verifies the given MFT entry. Compressed entries are decompressed in
+        *   full, and the check values of all blocks are checked.
+        *  \param[in]  p_entryNum   MFT entry number to verify.
+        *  \return Result  Outcome of the verification. */
+        Result verifyEntry( uint p_entryNum ) const;
+
+        /** Gets a short description of the given result.
+        *  \param[in]  p_result     Result to describe.
+        *  \return const char*  Description of the result. */
+        static const char* resultName( Result p_result );
+        /** Gets the name of the given checksum.
+        *  \param[in]  p_type   Checksum to name.
+        *  \return const char*  Name of the checksum. */
+        static const char* checksumName( ChecksumType p_type );
+
+    private:
+        DatVerifier( const DatVerifier& );
+        DatVerifier& operator=( const DatVerifier& );
+
+        Result verifyRawEntry( uint p_entryNum, const DatEntryView& p_raw ) const;
+
+    }; // class DatVerifier
+
+}; // namespace gw2b
+
+#endif // DATVERIFIER_H_INCLUDED
@@ -26,11 +26,23 @@
 
 #include "stdafx.h"
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <vector>
 #include <wx/sstream.h>
 #include <wx/wfstream.h>
 
+#ifdef _WIN32
+#include <wx/msw/wrapwin.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "AsyncDatReader.h"
 #include "DatFile.h"
 #include "DatIndex.h"
 #include "FileReader.h"
@@ -48,26 +60,106 @@
 
 namespace gw2b {
 
-    Exporter::Exporter( const Array<const DatIndexEntry*>& p_entries, DatFile& p_datFile, ExtractionMode p_mode )
+    namespace {
+
+        bool createHardLink( const wxString& p_original, const wxString& p_path ) {
+#ifdef _WIN32
+            return ::CreateHardLinkW( p_path.wc_str( ), p_original.wc_str( ), nullptr ) != FALSE;
+#else
+            return ::link( p_original.fn_str( ), p_path.fn_str( ) ) == 0;
+#endif
+        }
+
+        /** Amount of raw data read ahead of the files being converted. */
+        const uint64 MaxExportReadAhead = 64 * 1024 * 1024;
+
+        /** Files read for a converted export, waiting to be converted. */
+        struct ExportQueue {
+            std::mutex                                      mutex;
+            std::condition_variable                         fileRead;
+            std::deque<std::pair<size_t, Array<byte>>>      files;
+            bool                                            isStopped;
+            ExportQueue( )
+                : isStopped( false ) {
+            }
+        };
+
+    }; // anon namespace
+
+    //----------------------------------------------------------------------------
+    //      ExportDeduplicator
+    //----------------------------------------------------------------------------
+
+    bool ExportDeduplicator::claim( uint64 p_hash, uint64 p_size, const wxString& p_path ) {
+        if ( !p_hash ) {
+            return true;
+        }
+
+        std::lock_guard<std::mutex> lock( m_mutex );
+        auto written = m_written.emplace( ContentKey( p_hash, p_size ), p_path );
+        if ( written.second || written.first->second == p_path ) {
+            return true;
+        }
+        m_duplicates.emplace_back( p_path, written.first->second );
+        return false;
+    }
+
+    uint ExportDeduplicator::linkDuplicates( ) {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        uint numFailed = 0;
+
+        for ( const auto& duplicate : m_duplicates ) {
+            const auto& path = duplicate.first;
+            const auto& original = duplicate.second;
+            if ( wxFile::Exists( path ) ) {
+                wxRemoveFile( path );
+            }
+            if ( !createHardLink( original, path ) && !wxCopyFile( original, path ) ) {
+                numFailed++;
+            }
+        }
+
+        m_duplicates.clear( );
+        return numFailed;
+    }
+
+    uint ExportDeduplicator::numDuplicates( ) {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return static_cast<uint>( m_duplicates.size( ) );
+    }
+
+    //----------------------------------------------------------------------------
+    //      Exporter
+    //----------------------------------------------------------------------------
+
+    Exporter::Exporter( const Array<const DatIndexEntry*>& p_entries, DatFile& p_datFile, AsyncDatReader& p_reader, ExtractionMode p_mode )
         : m_datFile( p_datFile )
+        , m_reader( p_reader )
         , m_entries( p_entries )
         , m_progress( nullptr )
         , m_currentProgress( 0 )
         , m_mode( p_mode )
-        , m_fileType( ANFT_Unknown ) {
+        , m_fileType( ANFT_Unknown )
+        , m_numHashed( 0 ) {
 
         // If it's just one file, we could handle it here
         if ( m_entries.GetSize( ) == 1 ) {
             auto& entry = m_entries[0];
-            auto entryData = m_datFile.readFile( entry->mftEntry( ) );
-            // Valid data?
-            if ( !entryData.GetSize( ) ) {
-                wxMessageBox( wxT( "Failed to get file data, most likely due to a decompression error." ), wxT( "Error" ), wxOK | wxICON_ERROR );
-                return;
-            }
+            if ( m_mode == EM_Raw ) {
+                // Raw files are streamed once the location is known, the index
+                // knows the file type
+                m_fileType = entry->fileType( );
+            } else {
+                auto entryData = m_datFile.readFile( entry->mftEntry( ) );
+                // Valid data?
+                if ( !entryData.GetSize( ) ) {
+                    wxMessageBox( wxT( "Failed to get file data, most likely due to a decompression error." ), wxT( "Error" ), wxOK | wxICON_ERROR );
+                    return;
+                }
 
-            // Identify file type
-            m_datFile.identifyFileType( entryData.GetPointer( ), entryData.GetSize( ), m_fileType );
+                // Identify file type
+                m_datFile.identifyFileType( entryData.GetPointer( ), entryData.GetSize( ), m_fileType );
+            }
 
             // Ask for location
             wxFileDialog dialog( this,
@@ -102,38 +194,126 @@ namespace gw2b {
                 m_progress = new wxProgressDialog( title, wxT( "Preparing to extract..." ), p_entries.GetSize( ), this, wxPD_SMOOTH | wxPD_CAN_ABORT | wxPD_ELAPSED_TIME );
                 m_progress->Show( );
 
-                // Loop through each files and update progress bar
-                for ( uint i = 0; i < m_entries.GetSize( ); i++ ) {
-                    // DONE
-                    if ( m_currentProgress >= m_entries.GetSize( ) ) {
-                        break;
+                // Read the files in the order they are in the .dat, rather than
+                // in category order, so the disk is mostly read front to back
+                Array<uint> fileNums( numFile );
+                for ( uint i = 0; i < numFile; i++ ) {
+                    fileNums[i] = m_entries[i]->mftEntry( );
+                }
+
+                // Every file is read once, do not let them push the rest of the
+                // system out of the page cache
+                m_datFile.beginIoPolicy( DatFile::IP_Streaming );
+
+                if ( m_mode == EM_Raw ) {
+                    // Raw files are written as they are read, so even the biggest
+                    // ones take little memory
+                    std::vector<std::pair<uint64, uint>> order;
+                    order.reserve( numFile );
+                    for ( uint i = 0; i < numFile; i++ ) {
+                        uint64 offset = 0;
+                        uint size;
+                        m_datFile.entryLocation( fileNums[i] + m_datFile.mftFileOffset( ), offset, size );
+                        order.emplace_back( offset, i );
+                    }
+                    std::stable_sort( order.begin( ), order.end( ) );
+
+                    for ( const auto& item : order ) {
+                        auto entry = m_entries[item.second];
+                        if ( !this->isKnownDuplicate( *entry ) ) {
+                            m_fileType = entry->fileType( );
+                            this->setEntryFilename( *entry );
+                            this->streamFile( *entry );
+                        }
+
+                        m_currentProgress++;
+                        if ( !m_progress->Update( m_currentProgress, wxString::Format( wxT( "Extracting file %d/%d..." ), m_currentProgress, numFile ) ) ) {
+                            break;
+                        }
+                    }
+                } else {
+                    // Entries known to hold the data of an earlier one are not read
+                    std::vector<std::pair<uint64, const DatIndexEntry*>> toRead;
+                    toRead.reserve( numFile );
+                    for ( uint i = 0; i < numFile; i++ ) {
+                        if ( this->isKnownDuplicate( *m_entries[i] ) ) {
+                            m_currentProgress++;
+                        } else {
+                            uint64 offset = 0;
+                            uint size;
+                            m_datFile.entryLocation( fileNums[i] + m_datFile.mftFileOffset( ), offset, size );
+                            toRead.emplace_back( offset, m_entries[i] );
+                        }
+                    }
+                    std::stable_sort( toRead.begin( ), toRead.end( ), [] ( const std::pair<uint64, const DatIndexEntry*>& p_a,
+                        const std::pair<uint64, const DatIndexEntry*>& p_b ) {
+                        return p_a.first < p_b.first;
+                    } );
+                    std::vector<uint> readSizes( toRead.size( ), 0 );
+                    for ( size_t i = 0; i < toRead.size( ); i++ ) {
+                        uint64 offset;
+                        fileNums[i] = toRead[i].second->mftEntry( );
+                        m_datFile.entryLocation( fileNums[i] + m_datFile.mftFileOffset( ), offset, readSizes[i] );
                     }
 
-                    auto entry = m_entries[m_currentProgress];
+                    // The workers of the reader read and decompress the files ahead,
+                    // this thread converts and writes them as they come in
+                    auto queue = std::make_shared<ExportQueue>( );
+                    size_t numRequested = 0;
+                    uint64 readAhead = 0;
+                    for ( size_t numExtracted = 0; numExtracted < toRead.size( ); numExtracted++ ) {
+                        while ( numRequested < toRead.size( ) && readAhead < MaxExportReadAhead ) {
+                            size_t first = numRequested;
+                            while ( numRequested < toRead.size( ) && ( numRequested == first || readAhead + readSizes[numRequested] <= MaxExportReadAhead ) ) {
+                                readAhead += readSizes[numRequested];
+                                numRequested++;
+                            }
+                            m_reader.readFiles( fileNums.GetPointer( ) + first, numRequested - first, [queue, first] ( size_t p_index, Array<byte> p_data ) {
+                                {
+                                    std::lock_guard<std::mutex> lock( queue->mutex );
+                                    if ( queue->isStopped ) {
+                                        return false;
+                                    }
+                                    queue->files.emplace_back( first + p_index, std::move( p_data ) );
+                                }
+                                queue->fileRead.notify_one( );
+                                return true;
+                            }, AsyncDatReader::RP_Export );
+                        }
+
+                        std::pair<size_t, Array<byte>> file;
+                        {
+                            std::unique_lock<std::mutex> lock( queue->mutex );
+                            queue->fileRead.wait( lock, [&queue] ( ) { return !queue->files.empty( ); } );
+                            file = std::move( queue->files.front( ) );
+                            queue->files.pop_front( );
+                        }
+                        readAhead -= readSizes[file.first];
 
-                    // Set file path
-                    m_filename.SetPath( m_path );
-                    // Set file name
-                    m_filename.SetName( entry->name( ) );
-                    // Set file extension
-                    m_filename.SetExt( wxString( this->GetExtension( ) ) );
+                        auto entry = toRead[file.first].second;
+                        this->setEntryFilename( *entry );
 
-                    // Appen category name as path
-                    this->appendPaths( m_filename, *entry->category( ) );
+                        // Extract current file
+                        this->extractFile( *entry, file.second );
 
-                    // Create directory if not exist
-                    if ( !m_filename.DirExists( ) ) {
-                        m_filename.Mkdir( 511, wxPATH_MKDIR_FULL );
+                        m_currentProgress++;
+                        if ( !m_progress->Update( m_currentProgress, wxString::Format( wxT( "Extracting file %d/%d..." ), m_currentProgress, numFile ) ) ) {
+                            // Reads still pending skip what is left of their stretch
+                            std::lock_guard<std::mutex> lock( queue->mutex );
+                            queue->isStopped = true;
+                            break;
+                        }
                     }
+                }
 
-                    // Extract current file
-                    this->extractFile( *m_entries[m_currentProgress] );
+                m_datFile.endIoPolicy( DatFile::IP_Streaming );
 
-                    bool shouldContinue = m_progress->Update( m_currentProgress, wxString::Format( wxT( "Extracting file %d/%d..." ), m_currentProgress, numFile ) );
-                    if ( shouldContinue ) {
-                        m_currentProgress++;
-                    } else {
-                        m_currentProgress = m_entries.GetSize( );
+                // Duplicates become links to the file holding their data
+                if ( m_deduplicator.numDuplicates( ) ) {
+                    m_progress->Update( m_currentProgress, wxT( "Linking duplicate files..." ) );
+                    uint numFailed = m_deduplicator.linkDuplicates( );
+                    if ( numFailed ) {
+                        wxLogMessage( wxT( "Failed to link %u duplicate files." ), numFailed );
                     }
                 }
                 deletePointer( m_progress );
@@ -528,18 +708,85 @@ namespace gw2b {
         }
     }
 
+    void Exporter::setEntryFilename( const DatIndexEntry& p_entry ) {
+        // Set file path
+        m_filename.SetPath( m_path );
+        // Set file name
+        m_filename.SetName( p_entry.name( ) );
+        // Set file extension
+        m_filename.SetExt( wxString( this->GetExtension( ) ) );
+
+        // Appen category name as path
+        this->appendPaths( m_filename, *p_entry.category( ) );
+
+        // Create directory if not exist
+        if ( !m_filename.DirExists( ) ) {
+            m_filename.Mkdir( 511, wxPATH_MKDIR_FULL );
+        }
+    }
+
     void Exporter::extractFile( const DatIndexEntry& p_entry ) {
-        auto entryData = m_datFile.readFile( p_entry.mftEntry( ) );
+        if ( m_mode == EM_Raw ) {
+            this->streamFile( p_entry );
+            return;
+        }
+        this->extractFile( p_entry, m_datFile.readFile( p_entry.mftEntry( ) ) );
+    }
+
+    bool Exporter::isSingleFile( ANetFileType p_fileType ) const {
+        if ( m_mode == EM_Raw ) {
+            return true;
+        }
+        // These are converted to several files named after the entry: EULAs
+        // and banks to one per record, fonts to one per glyph, and models to
+        // their meshes plus the textures they use. The deduplicator only
+        // keeps the path of the first export, so a duplicate could not be
+        // linked to all of them. They are converted every time instead.
+        switch ( p_fileType ) {
+        case ANFT_EULA:
+        case ANFT_Bank:
+        case ANFT_Model:
+        case ANFT_BitmapFontFile:
+            return false;
+        default:
+            return true;
+        }
+    }
+
+    bool Exporter::isKnownDuplicate( const DatIndexEntry& p_entry ) {
+        // The size is part of what tells contents apart, without it the
+        // entry is read and hashed again
+        if ( !p_entry.contentHash( ) || !p_entry.uncompressedSize( ) || !this->isSingleFile( p_entry.fileType( ) ) ) {
+            return false;
+        }
+        m_fileType = p_entry.fileType( );
+        this->setEntryFilename( p_entry );
+        return !m_deduplicator.claim( p_entry.contentHash( ), p_entry.uncompressedSize( ), m_filename.GetFullPath( ) );
+    }
+
+    void Exporter::extractFile( const DatIndexEntry& p_entry, const Array<byte>& p_entryData ) {
         // Valid data?
-        if ( !entryData.GetSize( ) ) {
+        if ( !p_entryData.GetSize( ) ) {
             wxMessageBox( wxT( "Failed to extract the file, most likely due to a decompression error." ), wxT( "Error" ), wxOK | wxICON_ERROR );
             return;
         }
 
         // Identify file type
-        m_datFile.identifyFileType( entryData.GetPointer( ), entryData.GetSize( ), m_fileType );
+        m_datFile.identifyFileType( p_entryData.GetPointer( ), p_entryData.GetSize( ), m_fileType );
 
-        auto reader = FileReader::readerForData( entryData, m_datFile, m_fileType );
+        // Hash what was not hashed yet, skip it if an earlier entry had the same data
+        if ( !p_entry.contentHash( ) ) {
+            p_entry.cacheContentHash( xxHash64( p_entryData.GetPointer( ), p_entryData.GetSize( ) ) );
+            m_numHashed++;
+            if ( this->isSingleFile( m_fileType ) ) {
+                m_filename.SetExt( wxString( this->GetExtension( ) ) );
+                if ( !m_deduplicator.claim( p_entry.contentHash( ), p_entryData.GetSize( ), m_filename.GetFullPath( ) ) ) {
+                    return;
+                }
+            }
+        }
+
+        auto reader = FileReader::readerForData( p_entryData, m_datFile, m_fileType );
 
         if ( reader ) {
             // Should we convert the file?
@@ -584,18 +831,18 @@ namespace gw2b {
                     break;
                 default:
                     //entryData = reader->rawData( );
-                    this->writeFile( entryData );
+                    this->writeFile( p_entryData );
                     break;
                 }
             } else {
                 //entryData = reader->rawData( );
-                this->writeFile( entryData );
+                this->writeFile( p_entryData );
             }
 
             deletePointer( reader );
 
         } else {
-            this->writeFile( entryData );
+            this->writeFile( p_entryData );
         }
     }
 
@@ -1124,6 +1371,44 @@ namespace gw2b {
         return true;
     }
 
+    bool Exporter::streamFile( const DatIndexEntry& p_entry ) {
+        // Open file for writing
+        wxFile file( m_filename.GetFullPath( ), wxFile::write );
+        if ( !file.IsOpened( ) ) {
+            wxMessageBox( wxString::Format( wxT( "Failed to open the file %s for writing." ), m_filename.GetFullPath( ) ),
+                wxT( "Error" ),
+                wxOK | wxICON_ERROR );
+            wxLogMessage( wxString::Format( wxT( "Failed to open the file %s for writing." ), m_filename.GetFullPath( ) ) );
+            return false;
+        }
+
+        XxHash64 hash;
+        uint64 size = 0;
+        bool written = m_datFile.streamFile( p_entry.mftEntry( ), [&file, &hash, &size] ( const byte* p_data, uint p_size ) {
+            hash.update( p_data, p_size );
+            size += p_size;
+            return file.Write( p_data, p_size ) == p_size;
+        } );
+        file.Close( );
+
+        // Do not leave half-written files behind
+        if ( !written ) {
+            wxRemoveFile( m_filename.GetFullPath( ) );
+            wxMessageBox( wxT( "Failed to extract the file, most likely due to a decompression error." ), wxT( "Error" ), wxOK | wxICON_ERROR );
+            return false;
+        }
+
+        // Only known now, a duplicate is replaced by a link later
+        if ( !p_entry.contentHash( ) ) {
+            p_entry.cacheContentHash( hash.digest( ) );
+            m_numHashed++;
+            if ( !m_deduplicator.claim( p_entry.contentHash( ), size, m_filename.GetFullPath( ) ) ) {
+                wxRemoveFile( m_filename.GetFullPath( ) );
+            }
+        }
+        return true;
+    }
+
     void Exporter::appendPaths( wxFileName& p_path, const DatIndexCategory& p_category ) {
         auto parent = p_category.parent( );
         if ( parent ) {
@@ -29,6 +29,11 @@
 #ifndef EXPORTER_H_INCLUDED
 #define EXPORTER_H_INCLUDED
 
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 #include <wx/filename.h>
 #include <wx/mstream.h>
 #include <wx/progdlg.h>
@@ -38,10 +43,46 @@
 #include "FileReader.h"
 
 namespace gw2b {
+    class AsyncDatReader;
     class DatFile;
     class DatIndexCategory;
     class DatIndexEntry;
 
+    /** Keeps track of the contents an export has written, so entries holding
+    *   the same data are only written once. The files of the other entries are
+    *   linked to the written one once the export is done, or copied where
+    *   links are not supported. Can be used from several threads. */
+    class ExportDeduplicator {
+        /** Contents are told apart by their XXH64 hash and their size, a 64-bit
+        *   hash alone is too likely to collide over all the files of a .dat. */
+        typedef std::pair<uint64, uint64>   ContentKey;
+        struct ContentKeyHash {
+            size_t operator()( const ContentKey& p_key ) const {
+                return static_cast<size_t>( p_key.first ^ ( p_key.second * 0x9e3779b97f4a7c15ull ) );
+            }
+        };
+        std::unordered_map<ContentKey, wxString, ContentKeyHash>    m_written;
+        std::vector<std::pair<wxString, wxString>>  m_duplicates;
+        std::mutex                                  m_mutex;
+    public:
+        /** Claims the given contents for the given file.
+        *  \param[in]  p_hash   XXH64 hash of the contents, 0 if not known.
+        *  \param[in]  p_size   Uncompressed size of the contents.
+        *  \param[in]  p_path   File the contents would be written to.
+        *  \return bool    true if the file should be written, false if another
+        *                  file holds the contents, and this one is linked to
+        *                  it by linkDuplicates( ). */
+        bool claim( uint64 p_hash, uint64 p_size, const wxString& p_path );
+        /** Links each duplicate file to the file holding its contents. Call
+        *   this once all files were written.
+        *  \return uint    Amount of files that could be neither linked nor copied. */
+        uint linkDuplicates( );
+        /** Gets the amount of files that were not written because another file
+        *   holds the same contents.
+        *  \return uint    Amount of duplicate files. */
+        uint numDuplicates( );
+    }; // class ExportDeduplicator
+
     class Exporter : public wxFrame {
     public:
         enum ExtractionMode {
@@ -51,6 +92,7 @@ namespace gw2b {
 
     private:
         DatFile&                    m_datFile;
+        AsyncDatReader&             m_reader;
         Array<const DatIndexEntry*> m_entries;
         wxProgressDialog*           m_progress;
         uint                        m_currentProgress;
@@ -58,21 +100,44 @@ namespace gw2b {
         wxFileName                  m_filename;
         ExtractionMode              m_mode;
         ANetFileType                m_fileType;
+        ExportDeduplicator          m_deduplicator;
+        uint                        m_numHashed;
 
     public:
         /** Constructor.
         *  \param[in]  p_entries       Entry to extract.
         *  \param[in]  p_datFile       .dat file containing the file.
+        *  \param[in]  p_reader        Reader of p_datFile that converted files
+        *                              are read through, as export reads.
         *  \param[in]  p_mode          File extract mode.
         *  \param[in]  p_filename      File name to save to.*/
-        Exporter( const Array<const DatIndexEntry*>& p_entries, DatFile& p_datFile, ExtractionMode p_mode );
+        Exporter( const Array<const DatIndexEntry*>& p_entries, DatFile& p_datFile, AsyncDatReader& p_reader, ExtractionMode p_mode );
+
+        /** Determines whether the export found the content hash of any entry
+        *   that did not have one yet, making the index worth saving again.
+        *  \return bool    true if new hashes were found, false if not. */
+        bool hasNewHashes( ) const {
+            return m_numHashed > 0;
+        }
 
     private:
         /** Gets an appropriate file extension for the contents.
         *  \return wxString             File extension. */
         const wxChar* GetExtension( ) const;
         const wxString GetWildcard( ) const;
+        void setEntryFilename( const DatIndexEntry& p_entry );
+        /** Determines whether the given type is exported to a single file, so
+        *   duplicates of it can be linked.
+        *  \param[in]  p_fileType   Type of the file to export.
+        *  \return bool    true if a single file is written, false if not. */
+        bool isSingleFile( ANetFileType p_fileType ) const;
+        /** Determines whether the given entry is known to hold the same data as
+        *   an entry exported before, before reading it. Sets m_filename.
+        *  \param[in]  p_entry  Entry to check.
+        *  \return bool    true if the entry does not need to be exported. */
+        bool isKnownDuplicate( const DatIndexEntry& p_entry );
         void extractFile( const DatIndexEntry& p_entry );
+        void extractFile( const DatIndexEntry& p_entry, const Array<byte>& p_entryData );
         void exportImage( FileReader* p_reader, const wxString& p_entryname );
         void exportString( FileReader* p_reader, const wxString& p_entryname );
         void exportEula( FileReader* p_reader, const wxString& p_entryname );
@@ -85,6 +150,11 @@ namespace gw2b {
         void writeImage( wxImage p_image );
         void writeXML( std::unique_ptr<tinyxml2::XMLDocument> p_xml );
         bool writeFile( const Array<byte>& p_data );
+        /** Writes the given entry to m_filename as it is read from the .dat, a
+        *   part at a time, without holding all of it in memory.
+        *  \param[in]  p_entry  Entry to write.
+        *  \return bool    true if all of the entry was written. */
+        bool streamFile( const DatIndexEntry& p_entry );
         void appendPaths( wxFileName& p_path, const DatIndexCategory& p_category );
 
     };
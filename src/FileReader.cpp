@@ -44,6 +44,13 @@ namespace gw2b {
 
     FileReader::FileReader( const Array<byte>& p_data, DatFile& p_datFile, ANetFileType p_fileType )
         : m_data( p_data )
+        , m_view( p_data )
+        , m_datFile( p_datFile )
+        , m_fileType( p_fileType ) {
+    }
+
+    FileReader::FileReader( const DatEntryView& p_view, DatFile& p_datFile, ANetFileType p_fileType )
+        : m_view( p_view )
         , m_datFile( p_datFile )
         , m_fileType( p_fileType ) {
     }
@@ -53,11 +60,12 @@ namespace gw2b {
 
     void FileReader::clean() {
         m_data.Clear();
+        m_view = DatEntryView( );
         m_fileType = ANFT_Unknown;
     }
 
     Array<byte> FileReader::rawData( ) const {
-        return m_data;
+        return m_view.toArray( );
     }
 
     FileReader* FileReader::readerForData( const Array<byte>& p_data, DatFile& p_datFile, ANetFileType p_fileType ) {
@@ -117,4 +125,23 @@ namespace gw2b {
         return new FileReader( p_data, p_datFile, p_fileType );
     }
 
+    FileReader* FileReader::readerForView( const DatEntryView& p_view, DatFile& p_datFile, ANetFileType p_fileType ) {
+        switch ( p_fileType ) {
+        case ANFT_asndMP3:
+            return new asndMP3Reader( p_view, p_datFile, p_fileType );
+            break;
+        case ANFT_TEXT:
+        case ANFT_UTF8:
+            return new TextReader( p_view, p_datFile, p_fileType );
+            break;
+        case ANFT_BitmapFontFile:
+            return new AFNTReader( p_view, p_datFile, p_fileType );
+            break;
+        default:
+            break;
+        }
+
+        return readerForData( p_view.toArray( ), p_datFile, p_fileType );
+    }
+
 }; // namespace gw2b
@@ -41,6 +41,7 @@ namespace gw2b {
     class FileReader {
     protected:
         Array<byte>     m_data;
+        DatEntryView    m_view;
         DatFile&        m_datFile;
         ANetFileType    m_fileType;
     public:
@@ -63,6 +64,11 @@ namespace gw2b {
         *  \param[in]  p_data       Data to be handled by this reader.
         *  \param[in]  p_fileType   File type of the given data. */
         FileReader( const Array<byte>& p_data, DatFile& p_datFile, ANetFileType p_fileType );
+        /** Constructor. Only m_view holds the data, readers made this way must
+        *  read it through the view.
+        *  \param[in]  p_view       View of the data to be handled by this reader.
+        *  \param[in]  p_fileType   File type of the given data. */
+        FileReader( const DatEntryView& p_view, DatFile& p_datFile, ANetFileType p_fileType );
         /** Destructor. Clears all data. */
         virtual ~FileReader( );
 
@@ -85,6 +91,13 @@ namespace gw2b {
         *  \param[in]  p_fileType   File type of the given data.
         *  \return FileReader* Newly created FileReader for the data. */
         static FileReader* readerForData( const Array<byte>& p_data, DatFile& p_datfile, ANetFileType p_fileType );
+        /** Creates an appropriate subclass of FileReader for the viewed data.
+        *  Readers that go through their data front to back or by pack file
+        *  chunk read it from the view, the others get a copy of it as one array.
+        *  \param[in]  p_view      View of the data to read.
+        *  \param[in]  p_fileType   File type of the given data.
+        *  \return FileReader* Newly created FileReader for the data. */
+        static FileReader* readerForView( const DatEntryView& p_view, DatFile& p_datfile, ANetFileType p_fileType );
     };
 
 }; // namespace gw2b
@@ -33,6 +33,10 @@ namespace gw2b {
         : m_data( p_data ) {
     }
 
+    PackFile::PackFile( const DatEntryView& p_view )
+        : m_data( p_view ) {
+    }
+
     PackFile::~PackFile( ) {
     }
 
@@ -40,21 +44,21 @@ namespace gw2b {
         po_size = 0;
 
         // Bail if the data size is too small
-        if ( m_data.GetSize( ) < sizeof( ANetPfHeader ) ) {
+        ANetPfHeader header;
+        if ( m_data.read( 0, &header, sizeof( header ) ) < sizeof( header ) ) {
             return nullptr;
         }
 
         // Bail when Gw2 would
-        auto header = reinterpret_cast<const ANetPfHeader*>( m_data.GetPointer( ) );
-        if ( header->identifier[0] != 'P' ||
-            header->identifier[1] != 'F' ||
-            header->unknownField2 != 0 ||
-            header->pkFileVersion > 0xC ) {
+        if ( header.identifier[0] != 'P' ||
+            header.identifier[1] != 'F' ||
+            header.unknownField2 != 0 ||
+            header.pkFileVersion > 0xC ) {
             return nullptr;
         }
 
-        auto end = 1 + &m_data[m_data.GetSize( ) - 1];
-        auto pos = &m_data[sizeof( ANetPfHeader )];
+        auto end = m_data.size( );
+        auto pos = static_cast<uint>( sizeof( ANetPfHeader ) );
 
         while ( pos < end ) {
             uint bytesLeft = ( end - pos );
@@ -63,19 +67,26 @@ namespace gw2b {
             }
 
             // Get the chunk header
-            auto chunkHead = reinterpret_cast<const ANetPfChunkHeader*>( pos );
+            ANetPfChunkHeader chunkHead;
+            m_data.read( pos, &chunkHead, sizeof( chunkHead ) );
             // Calculate actual data size, as mChunkDataSize does not count the size of some header variables
-            auto chunkSize = chunkHead->chunkDataSize + offsetof( ANetPfChunkHeader, chunkVersion );
+            auto chunkSize = static_cast<uint>( chunkHead.chunkDataSize + offsetof( ANetPfChunkHeader, chunkVersion ) );
 
             // Correct chunk type?
-            if ( chunkHead->chunkTypeInteger == p_chunkType ) {
+            if ( chunkHead.chunkTypeInteger == p_chunkType ) {
                 // Bail if too little data left
                 if ( chunkSize > bytesLeft ) {
                     return nullptr;
                 }
-                // Return result
+                // Return result, gathering it if it spans a block boundary
                 po_size = chunkSize;
-                return pos;
+                auto chunk = m_data.contiguousRange( pos, chunkSize );
+                if ( !chunk ) {
+                    m_chunkData.SetSize( chunkSize );
+                    m_data.read( pos, m_chunkData.GetPointer( ), chunkSize );
+                    chunk = m_chunkData.GetPointer( );
+                }
+                return chunk;
             } else {
                 pos += chunkSize;
             }
@@ -27,17 +27,26 @@
 #ifndef PACKFILE_H_INCLUDED
 #define PACKFILE_H_INCLUDED
 
+#include "DatEntryView.h"
+
 namespace gw2b {
 
     class PackFile {
-        Array<byte> m_data;
+        DatEntryView        m_data;
+        mutable Array<byte> m_chunkData;
     public:
         PackFile( const Array<byte>& p_data );
+        /** Constructor. Reads the pack file through the given view, so entries
+        *  split over several blocks need not be copied in full.
+        *  \param[in]  p_view   View of the pack file data. */
+        PackFile( const DatEntryView& p_view );
         ~PackFile( );
 
         /** Finds a given chunk and returns a pointer to it. Note that this does
-        *  \e not allocate a new array, but rather returns a pointer to within
-        *  the array that already exists.
+        *  \e not allocate a new array when the chunk lies in one segment of the
+        *  data, but rather returns a pointer to within the data that already
+        *  exists. Chunks split over segments are gathered into a buffer that
+        *  is valid until the next call.
         *  \param[in]  p_chunkType  Type of chunk to look for.
         *  \param[out] po_size      Size of the returned chunk.
         *  \return byte*   Pointer to the start of the chunk (post-header). */
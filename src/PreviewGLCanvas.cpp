@@ -122,15 +122,18 @@ namespace gw2b {
     }
 
     bool PreviewGLCanvas::previewFile( DatFile& p_datFile, const DatIndexEntry& p_entry ) {
+        return this->previewFile( p_datFile, p_entry, p_datFile.readFile( p_entry.mftEntry( ) ) );
+    }
+
+    bool PreviewGLCanvas::previewFile( DatFile& p_datFile, const DatIndexEntry& p_entry, const Array<byte>& p_entryData ) {
         this->clear( );
 
-        auto entryData = p_datFile.readFile( p_entry.mftEntry( ) );
-        if ( !entryData.GetSize( ) ) {
+        if ( !p_entryData.GetSize( ) ) {
             return false;
         }
 
         // Create file reader
-        m_reader = FileReader::readerForData( entryData, p_datFile, p_entry.fileType( ) );
+        m_reader = FileReader::readerForData( p_entryData, p_datFile, p_entry.fileType( ) );
         if ( m_reader ) {
             switch ( m_reader->dataType( ) ) {
             //case FileReader::DT_Map:
@@ -77,6 +77,12 @@ namespace gw2b {
         *  \param[in]  p_entry      Entry to preview.
         *  \return bool    true if successful, false if not. */
         bool previewFile( DatFile& p_datFile, const DatIndexEntry& p_entry );
+        /** Tells this GLCanvas to preview a file that was already read.
+        *  \param[in]  p_datFile    .dat file containing the file to preview.
+        *  \param[in]  p_entry      Entry to preview.
+        *  \param[in]  p_entryData  Contents of the entry.
+        *  \return bool    true if successful, false if not. */
+        bool previewFile( DatFile& p_datFile, const DatIndexEntry& p_entry, const Array<byte>& p_entryData );
         /** Clear the viewer. */
         void clear( );
         /** Initialize the GLCanvas. */
@@ -51,13 +51,20 @@ namespace gw2b {
     }
 
     bool PreviewPanel::previewFile( DatFile& p_datFile, const DatIndexEntry& p_entry ) {
-        auto entryData = p_datFile.readFile( p_entry.mftEntry( ) );
-        if ( !entryData.GetSize( ) ) {
+        return this->previewFile( p_datFile, p_entry, p_datFile.viewFile( p_entry.mftEntry( ) ) );
+    }
+
+    bool PreviewPanel::previewFile( DatFile& p_datFile, const DatIndexEntry& p_entry, const Array<byte>& p_entryData ) {
+        return this->previewFile( p_datFile, p_entry, DatEntryView( p_entryData ) );
+    }
+
+    bool PreviewPanel::previewFile( DatFile& p_datFile, const DatIndexEntry& p_entry, const DatEntryView& p_entryView ) {
+        if ( !p_entryView.size( ) ) {
             return false;
         }
 
         // Create file reader
-        auto reader = FileReader::readerForData( entryData, p_datFile, p_entry.fileType( ) );
+        auto reader = FileReader::readerForView( p_entryView, p_datFile, p_entry.fileType( ) );
 
         if ( reader ) {
             if ( m_currentView ) {
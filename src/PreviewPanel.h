@@ -51,6 +51,18 @@ namespace gw2b {
         *  \param[in]  p_entry      Entry to preview.
         *  \return bool    true if successful, false if not. */
         bool previewFile( DatFile& p_datFile, const DatIndexEntry& p_entry );
+        /** Tells this panel to preview a file that was already read.
+        *  \param[in]  p_datFile    .dat file containing the file to preview.
+        *  \param[in]  p_entry      Entry to preview.
+        *  \param[in]  p_entryData  Contents of the entry.
+        *  \return bool    true if successful, false if not. */
+        bool previewFile( DatFile& p_datFile, const DatIndexEntry& p_entry, const Array<byte>& p_entryData );
+        /** Tells this panel to preview a file through a view of its contents.
+        *  \param[in]  p_datFile    .dat file containing the file to preview.
+        *  \param[in]  p_entry      Entry to preview.
+        *  \param[in]  p_entryView  View of the contents of the entry.
+        *  \return bool    true if successful, false if not. */
+        bool previewFile( DatFile& p_datFile, const DatIndexEntry& p_entry, const DatEntryView& p_entryView );
         /** Destroy the viewer in this preview panel. */
         void destroyViewer( );
     private:
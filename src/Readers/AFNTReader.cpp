@@ -98,6 +98,10 @@ namespace gw2b {
         : FileReader( p_data, p_datFile, p_fileType ) {
     }
 
+    AFNTReader::AFNTReader( const DatEntryView& p_view, DatFile& p_datFile, ANetFileType p_fileType )
+        : FileReader( p_view, p_datFile, p_fileType ) {
+    }
+
     AFNTReader::~AFNTReader( ) {
     }
 
@@ -124,7 +128,7 @@ namespace gw2b {
 
         std::vector<Font> fonts;
 
-        auto pf = PackFile( m_data );
+        auto pf = PackFile( m_view );
         auto afnt = pf.findChunk( FCC_AFNT, size );
 
         ANetPfChunkHeader* chunkHeader = (ANetPfChunkHeader*)( afnt );
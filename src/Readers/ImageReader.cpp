@@ -28,8 +28,9 @@
 #include <wx/mstream.h>
 
 #include <webp/decode.h> // libwebp
-#include <gw2dattools/compression/inflateTextureFileBuffer.h>
-#include <gw2dattools/exception/Exception.h>
+
+#include "Compression/TextureInflater.h"
+#include "Exception.h"
 
 #include "ImageReader.h"
 
@@ -209,8 +210,8 @@ namespace gw2b {
 
             // Decompress
             try {
-                gw2dt::compression::inflateTextureFileBuffer( m_data.GetSize( ), data, uncompressedSize, reinterpret_cast<uint8_t*>( buffer.GetPointer( ) ) );
-            } catch ( const gw2dt::exception::Exception& err ) {
+                TextureInflater::inflate( m_data.GetSize( ), data, uncompressedSize, buffer.GetPointer( ), m_datFile.inflater( ) );
+            } catch ( const exception::Exception& err ) {
                 wxLogMessage( wxT( "Failed decompress ATEX texture: %s" ), wxString( err.what( ) ) );
                 return Array<byte>( );
             }
@@ -409,13 +410,13 @@ namespace gw2b {
 
         uint32_t uncompressedSize = this->getUncompressedATEXSize( width, height, atex->formatInteger );
 
-        // Allocate output
-        auto buffer = allocate<BGRA>( width * height );
+        // Allocate output, textures smaller than a block still take up a whole one
+        auto buffer = allocate<BGRA>( wxMax( static_cast<uint32_t>( width * height ), ( uncompressedSize + 3 ) / 4 ) );
 
         // Decompress
         try {
-            gw2dt::compression::inflateTextureFileBuffer( m_data.GetSize( ), data, uncompressedSize, reinterpret_cast<uint8_t*>( buffer ) );
-        } catch ( const gw2dt::exception::Exception& err ) {
+            TextureInflater::inflate( m_data.GetSize( ), data, uncompressedSize, reinterpret_cast<byte*>( buffer ), m_datFile.inflater( ) );
+        } catch ( const exception::Exception& err ) {
             wxLogMessage( wxT( "Failed decompress ATEX texture: %s" ), wxString( err.what( ) ) );
             freePointer( buffer );
             return false;
@@ -35,17 +35,23 @@ namespace gw2b {
         : FileReader( p_data, p_datFile, p_fileType ) {
     }
 
+    TextReader::TextReader( const DatEntryView& p_view, DatFile& p_datFile, ANetFileType p_fileType )
+        : FileReader( p_view, p_datFile, p_fileType ) {
+    }
+
     TextReader::~TextReader( ) {
     }
 
     wxString TextReader::getString( ) const {
-        auto data = m_data.GetPointer( );
-        auto size = m_data.GetSize( );
-
         wxString str;
-        for ( uint i = 0; i < size; i++ ) {
-            if ( isprint( data[i] ) || iscntrl( data[i] ) ) {
-                str << data[i];
+        for ( uint s = 0; s < m_view.numSegments( ); s++ ) {
+            auto data = m_view.segment( s ).data;
+            auto size = m_view.segment( s ).size;
+
+            for ( uint i = 0; i < size; i++ ) {
+                if ( isprint( data[i] ) || iscntrl( data[i] ) ) {
+                    str << data[i];
+                }
             }
         }
 
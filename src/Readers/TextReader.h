@@ -38,6 +38,11 @@ namespace gw2b {
         *  \param[in]  p_datFile    Reference to an instance of DatFile.
         *  \param[in]  p_fileType   File type of the given data. */
         TextReader( const Array<byte>& p_data, DatFile& p_datFile, ANetFileType p_fileType );
+        /** Constructor.
+        *  \param[in]  p_view       View of the data to be handled by this reader.
+        *  \param[in]  p_datFile    Reference to an instance of DatFile.
+        *  \param[in]  p_fileType   File type of the given data. */
+        TextReader( const DatEntryView& p_view, DatFile& p_datFile, ANetFileType p_fileType );
         /** Destructor. Clears all data. */
         virtual ~TextReader( );
 
@@ -32,20 +32,22 @@ namespace gw2b {
         : FileReader( p_data, p_datFile, p_fileType ) {
     }
 
+    asndMP3Reader::asndMP3Reader( const DatEntryView& p_view, DatFile& p_datFile, ANetFileType p_fileType )
+        : FileReader( p_view, p_datFile, p_fileType ) {
+    }
+
     asndMP3Reader::~asndMP3Reader( ) {
     }
 
     Array<byte> asndMP3Reader::getMP3Data( ) const {
-        auto asnd = m_data;
-        int size = m_data.GetSize( );
-
-        Array<byte> outputArray( size - 36 );
+        const uint headerSize = 36;
+        if ( m_view.size( ) <= headerSize ) {
+            return Array<byte>( );
+        }
 
-#pragma omp parallel for
         // skip first 36 byte
-        for ( int i = 36; i < size; i++ ) {
-            ::memcpy( &outputArray[i - 36], &asnd[i], sizeof( asnd[i] ) );
-        }
+        Array<byte> outputArray( m_view.size( ) - headerSize );
+        m_view.read( headerSize, outputArray.GetPointer( ), outputArray.GetSize( ) );
 
         return outputArray;
     }
@@ -27,12 +27,18 @@
 #ifndef TASK_H_INCLUDED
 #define TASK_H_INCLUDED
 
+#include <atomic>
 #include <functional>
 #include <list>
+#include <mutex>
 
 namespace gw2b {
 
-    /** Represents a task that gets executed repeatedly until it's done. */
+    /** Represents a task that gets executed repeatedly until it's done.
+    *   perform() is called on a background thread, while commit() is called
+    *   on the main thread every now and then to hand the results over to
+    *   anything the UI can see, such as the index. Progress and text can be
+    *   read from either thread. */
     class Task {
     public:
         /** Event handler for task completion. */
@@ -40,9 +46,10 @@ namespace gw2b {
     private:
         std::list<OnCompleteHandler>    m_onComplete;
 
-        uint                            m_currentProgress;
-        uint                            m_maxProgress;
+        std::atomic<uint>               m_currentProgress;
+        std::atomic<uint>               m_maxProgress;
         wxString                        m_label;
+        mutable std::mutex              m_labelMutex;
     public:
         /** Constructor. */
         Task( ) : m_currentProgress( 0 ), m_maxProgress( 0 ) {
@@ -52,8 +59,9 @@ namespace gw2b {
         }
 
         /** Gets the text that should be used to display what's going on.
-        *  \return wxString&   Message describing the task. */
-        virtual const wxString& text( ) const {
+        *  \return wxString    Message describing the task. */
+        virtual wxString text( ) const {
+            std::lock_guard<std::mutex> lock( m_labelMutex );
             return m_label;
         }
         /** Gets the current progress.
@@ -83,8 +91,12 @@ namespace gw2b {
         virtual bool init( ) {
             return true;
         }
-        /** Performs one iteration of this task. */
+        /** Performs one iteration of this task, on the task's background thread. */
         virtual void perform( ) = 0;
+        /** Applies the work done so far to state shared with the UI. Called on
+        *   the main thread while the task runs, and once more after it is done. */
+        virtual void commit( ) {
+        }
         /** Aborts this task. */
         virtual void abort( ) {
         }
@@ -111,6 +123,7 @@ namespace gw2b {
         /** Used by subclasses to set the task message.
         *  \param[in]  p_text   Current task message. */
         virtual void setText( const wxString& p_text ) {
+            std::lock_guard<std::mutex> lock( m_labelMutex );
             m_label = p_text;
         }
     }; // class Task
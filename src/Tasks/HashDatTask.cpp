@@ -0,0 +1,159 @@
+/** \file       HashDatTask.cpp
+ *  \brief      Contains definition of the HashDatTask class.
+ *  \author     agent
+ */
+
+/**
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of Gw2Browser.
+ *
+ * Gw2Browser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stdafx.h"
+
+#include <algorithm>
+
+#include "HashDatTask.h"
+
+namespace gw2b {
+
+    namespace {
+
+        /** Longest perform() waits for a file to be hashed. */
+        const auto MaxPerformWait = std::chrono::milliseconds( 20 );
+        /** Files streamed at once. Each holds a window of the inflater, and
+        *   more would only take workers away from previews. */
+        const uint MaxInFlight = 8;
+
+    }; // anon namespace
+
+    HashDatTask::HashDatTask( const std::shared_ptr<DatIndex>& p_index, DatFile& p_datFile, AsyncDatReader& p_reader )
+        : m_index( p_index )
+        , m_datFile( p_datFile )
+        , m_reader( p_reader )
+        , m_nextItem( 0 )
+        , m_numInFlight( 0 )
+        , m_numFinished( 0 )
+        , m_stopping( false ) {
+        Ensure::notNull( p_index.get( ) );
+        Ensure::notNull( &p_datFile );
+        m_datFile.beginIoPolicy( DatFile::IP_Sequential );
+    }
+
+    HashDatTask::~HashDatTask( ) {
+        // The reads still pending point into this task
+        this->stopReads( );
+        m_datFile.endIoPolicy( DatFile::IP_Sequential );
+    }
+
+    bool HashDatTask::init( ) {
+        for ( uint i = 0; i < m_index->numEntries( ); i++ ) {
+            auto entry = m_index->entry( i );
+            uint size;
+            Item item;
+            item.entry = entry;
+            if ( !entry->contentHash( ) && m_datFile.entryLocation( entry->mftEntry( ) + m_datFile.mftFileOffset( ), item.offset, size ) && size ) {
+                m_items.push_back( item );
+            }
+        }
+        // Reading in .dat order keeps the disk reading ahead
+        std::sort( m_items.begin( ), m_items.end( ), [] ( const Item& p_a, const Item& p_b ) {
+            return p_a.offset < p_b.offset;
+        } );
+
+        this->setMaxProgress( static_cast<uint>( m_items.size( ) ) );
+        this->setCurrentProgress( 0 );
+        this->setText( wxT( "Hashing .dat entries..." ) );
+        return !m_items.empty( );
+    }
+
+    void HashDatTask::perform( ) {
+        const Item* item = nullptr;
+        {
+            std::unique_lock<std::mutex> lock( m_mutex );
+            auto canStart = [this] ( ) {
+                return m_numInFlight < MaxInFlight && m_nextItem < m_items.size( );
+            };
+            m_itemDone.wait_for( lock, MaxPerformWait, [this, &canStart] ( ) {
+                return m_stopping || canStart( ) || !m_numInFlight;
+            } );
+            if ( m_stopping || !canStart( ) ) {
+                return;
+            }
+            item = &m_items[m_nextItem++];
+            m_numInFlight++;
+        }
+        this->hashItem( *item );
+    }
+
+    void HashDatTask::hashItem( const Item& p_item ) {
+        auto hash = std::make_shared<XxHash64>( );
+        auto entry = p_item.entry;
+        m_reader.streamFile( entry->mftEntry( ), [this, hash] ( const byte* p_data, uint p_size ) {
+            hash->update( p_data, p_size );
+            return !m_stopping;
+        }, [this, hash, entry] ( bool p_isComplete ) {
+            // Notified under the lock, so the destructor can not run in between
+            std::lock_guard<std::mutex> lock( m_mutex );
+            if ( p_isComplete ) {
+                Result result;
+                result.entry = entry;
+                result.hash = hash->digest( );
+                m_results.push_back( result );
+            }
+            m_numInFlight--;
+            this->setCurrentProgress( ++m_numFinished );
+            m_itemDone.notify_all( );
+        }, AsyncDatReader::RP_Scan );
+    }
+
+    void HashDatTask::commit( ) {
+        std::vector<Result> results;
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            results.swap( m_results );
+        }
+        // A hash of 0 means none, an entry hashing to it is read to hash again
+        bool isChanged = false;
+        for ( auto& result : results ) {
+            if ( result.hash ) {
+                result.entry->cacheContentHash( result.hash );
+                isChanged = true;
+            }
+        }
+        if ( isChanged ) {
+            m_index->setDirty( true );
+        }
+    }
+
+    void HashDatTask::abort( ) {
+        this->stopReads( );
+    }
+
+    bool HashDatTask::isDone( ) const {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_stopping || ( m_nextItem >= m_items.size( ) && !m_numInFlight );
+    }
+
+    void HashDatTask::stopReads( ) {
+        // Streams still reading stop at their next part
+        std::unique_lock<std::mutex> lock( m_mutex );
+        m_stopping = true;
+        m_itemDone.notify_all( );
+        m_itemDone.wait( lock, [this] ( ) { return !m_numInFlight; } );
+    }
+
+}; // namespace gw2b
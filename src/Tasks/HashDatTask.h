@@ -0,0 +1,93 @@
+/** \file       HashDatTask.h
+ *  \brief      Contains declaration of the HashDatTask class.
+ *  \author     agent
+ */
+
+/**
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of Gw2Browser.
+ *
+ * Gw2Browser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifndef TASKS_HASHDATTASK_H_INCLUDED
+#define TASKS_HASHDATTASK_H_INCLUDED
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "AsyncDatReader.h"
+#include "DatFile.h"
+#include "DatIndex.h"
+#include "Task.h"
+
+namespace gw2b {
+
+    /** Hashes the contents of the indexed files that have no content hash
+    *   yet, so exports can tell duplicates apart before reading them. The
+    *   files are streamed through the reader as scan reads, in .dat order,
+    *   so previews go first and memory use stays flat. commit() hands the
+    *   hashes to the index, which makes it dirty. */
+    class HashDatTask : public Task {
+        /** A file to hash. */
+        struct Item {
+            DatIndexEntry*  entry;
+            uint64          offset;
+        };
+        /** A file that was hashed. */
+        struct Result {
+            DatIndexEntry*  entry;
+            uint64          hash;
+        };
+
+        std::shared_ptr<DatIndex>   m_index;
+        DatFile&                    m_datFile;
+        AsyncDatReader&             m_reader;
+        std::vector<Item>           m_items;
+        std::vector<Result>         m_results;
+        uint                        m_nextItem;
+        uint                        m_numInFlight;
+        uint                        m_numFinished;
+        mutable std::mutex          m_mutex;
+        std::condition_variable     m_itemDone;
+        std::atomic<bool>           m_stopping;
+    public:
+        /** Constructor.
+        *  \param[in]  p_index      Index holding the files to hash.
+        *  \param[in]  p_datFile    .dat file the index belongs to.
+        *  \param[in]  p_reader     Reader of p_datFile the files are read
+        *                           through, as scan reads. */
+        HashDatTask( const std::shared_ptr<DatIndex>& p_index, DatFile& p_datFile, AsyncDatReader& p_reader );
+        /** Destructor. Waits for the reads still pending. */
+        virtual ~HashDatTask( );
+
+        virtual bool init( ) override;
+        virtual void perform( ) override;
+        virtual void commit( ) override;
+        virtual void abort( ) override;
+
+        virtual bool isDone( ) const override;
+    private:
+        void hashItem( const Item& p_item );
+        void stopReads( );
+    }; // class HashDatTask
+
+}; // namespace gw2b
+
+#endif // TASKS_HASHDATTASK_H_INCLUDED
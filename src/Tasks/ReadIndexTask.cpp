@@ -28,12 +28,23 @@
 
 namespace gw2b {
 
-    ReadIndexTask::ReadIndexTask( const std::shared_ptr<DatIndex>& p_index, const wxString& p_filename, uint64 p_datTimestamp )
+    namespace {
+
+        /** Longest perform() waits for commit() to hand the index over. */
+        const auto MaxPerformWait = std::chrono::milliseconds( 20 );
+        /** Categories and entries read between progress updates and checks
+        *   for an abort. */
+        const uint ReadBatchSize = 0x4000;
+
+    }; // anon namespace
+
+    ReadIndexTask::ReadIndexTask( const std::shared_ptr<DatIndex>& p_index, const wxString& p_filename )
         : m_index( p_index )
-        , m_reader( *p_index )
+        , m_reader( m_loaded )
         , m_filename( p_filename )
         , m_errorOccured( false )
-        , m_datTimestamp( p_datTimestamp ) {
+        , m_isLoaded( false )
+        , m_isDone( false ) {
         Ensure::notNull( p_index.get( ) );
     }
 
@@ -42,9 +53,6 @@ namespace gw2b {
         m_index->setDirty( false );
 
         bool result = m_reader.open( m_filename );
-        if ( result ) {
-            result = ( m_index->datTimestamp( ) == m_datTimestamp );
-        }
         if ( result ) {
             this->setMaxProgress( m_reader.numEntries( ) + m_reader.numCategories( ) );
         }
@@ -53,19 +61,33 @@ namespace gw2b {
     }
 
     void ReadIndexTask::perform( ) {
-        if ( !this->isDone( ) ) {
-            m_errorOccured = !( m_reader.read( 7 ) & DatIndexReader::RR_Success );
-            if ( m_errorOccured ) {
-                m_index->clear( );
-            }
-            uint progress = m_reader.currentEntry( ) + m_reader.currentCategory( );
-            this->setCurrentProgress( progress );
-            this->setText( wxT( "Reading .dat index..." ) );
+        // The whole file at once, the index is pre-sized from its header
+        this->setText( wxT( "Reading .dat index..." ) );
+        while ( !m_isLoaded && !m_isDone ) {
+            m_errorOccured = !( m_reader.read( ReadBatchSize ) & DatIndexReader::RR_Success );
+            this->setCurrentProgress( m_reader.currentEntry( ) + m_reader.currentCategory( ) );
+            m_isLoaded = ( m_errorOccured || !m_reader.isOpen( ) || m_reader.isDone( ) );
+        }
+
+        std::unique_lock<std::mutex> lock( m_mutex );
+        m_doneChanged.wait_for( lock, MaxPerformWait, [this] ( ) { return m_isDone.load( ); } );
+    }
+
+    void ReadIndexTask::commit( ) {
+        if ( !m_isLoaded || m_isDone ) {
+            return;
+        }
+
+        // A failed read leaves the index empty, as init() left it
+        if ( !m_errorOccured ) {
+            m_index->takeContents( m_loaded );
         }
+        this->setDone( );
     }
 
     void ReadIndexTask::abort( ) {
-        this->clean( );
+        // perform() stops after its current batch, the reader is closed with the task
+        this->setDone( );
     }
 
     void ReadIndexTask::clean( ) {
@@ -73,7 +95,15 @@ namespace gw2b {
     }
 
     bool ReadIndexTask::isDone( ) const {
-        return ( m_errorOccured || !m_reader.isOpen( ) || m_reader.isDone( ) );
+        return m_isDone;
+    }
+
+    void ReadIndexTask::setDone( ) {
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_isDone = true;
+        }
+        m_doneChanged.notify_all( );
     }
 
 }; // namespace gw2b
@@ -27,27 +27,47 @@
 #ifndef TASKS_READINDEXTASK_H_INCLUDED
 #define TASKS_READINDEXTASK_H_INCLUDED
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#include "DatIndex.h"
 #include "DatIndexIO.h"
 #include "Task.h"
 
 namespace gw2b {
-    class DatIndex;
 
+    /** Reads the index file into the index. perform() reads the whole file
+    *   into an index of its own on the background thread, nothing listens to
+    *   that one. commit() then hands its contents over to the shared index
+    *   in one go, so the listeners are notified once instead of for every
+    *   entry. */
     class ReadIndexTask : public Task {
         std::shared_ptr<DatIndex>   m_index;
+        DatIndex                    m_loaded;
         DatIndexReader              m_reader;
         wxString                    m_filename;
-        bool                        m_errorOccured;
-        uint64                      m_datTimestamp;
+        std::atomic<bool>           m_errorOccured;
+        std::atomic<bool>           m_isLoaded;
+        std::atomic<bool>           m_isDone;
+        std::mutex                  m_mutex;
+        std::condition_variable     m_doneChanged;
     public:
-        ReadIndexTask( const std::shared_ptr<DatIndex>& p_index, const wxString& p_filename, uint64 p_datTimestamp );
+        /** Constructor. Indexes of an older .dat are read too, ScanDatTask
+        *   brings them up to date.
+        *  \param[in]  p_index      Index to read into.
+        *  \param[in]  p_filename   Index file to read. */
+        ReadIndexTask( const std::shared_ptr<DatIndex>& p_index, const wxString& p_filename );
 
         virtual bool init( ) override;
         virtual void perform( ) override;
+        virtual void commit( ) override;
         virtual void abort( ) override;
         virtual void clean( ) override;
 
         virtual bool isDone( ) const override;
+    private:
+        void setDone( );
     }; // class ReadIndexTask
 
 }; // namespace gw2b
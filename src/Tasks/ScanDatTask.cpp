@@ -33,93 +33,669 @@
 
 namespace gw2b {
 
-    ScanDatTask::ScanDatTask( const std::shared_ptr<DatIndex>& p_index, DatFile& p_datFile )
+    namespace {
+
+        /** Amount of MFT entries in each bucket of unclassified files, and
+        *   so in each chunk a worker scans at a time. */
+        const uint ScanChunkSize = 4096;
+        /** How many chunks the workers may have scanned but not merged yet.
+        *   Bounds the memory held by results waiting to be merged. */
+        const uint MaxChunksAhead = 64;
+        /** Longest perform() waits for the next chunk, so aborts are noticed soon. */
+        const auto MaxPerformWait = std::chrono::milliseconds( 20 );
+        /** Time commit() may spend merging chunks, so the UI stays responsive. */
+        const auto MaxCommitTime = std::chrono::milliseconds( 20 );
+        /** How often the journal is flushed to disk, the most work a crash can cost. */
+        const auto CheckpointInterval = std::chrono::seconds( 2 );
+        /** Bytes of a DDS file up to and including the FourCC of its pixel format. */
+        const uint DdsHeaderSize = 88;
+        /** Bytes of a PNG file up to and including the size in its IHDR chunk. */
+        const uint PngHeaderSize = 24;
+        /** Offset of the format byte of a PF packed ASND sound. */
+        const uint AsndPackedFormatOffset = 68;
+
+        uint32 readBigEndian32( const byte* p_data ) {
+            return ( uint32( p_data[0] ) << 24 ) | ( uint32( p_data[1] ) << 16 ) | ( uint32( p_data[2] ) << 8 ) | p_data[3];
+        }
+
+        uint16 clampToUint16( uint32 p_value ) {
+            return static_cast<uint16>( wxMin( p_value, 0xffffu ) );
+        }
+
+        /** Name of the category holding the files that were not identified yet. */
+        const wxChar* const UnclassifiedCategoryName = wxT( "Unclassified" );
+
+    }; // anon namespace
+
+    ScanDatTask::ScanDatTask( const std::shared_ptr<DatIndex>& p_index, DatFile& p_datFile, AsyncDatReader& p_reader, uint64 p_datTimestamp,
+        const wxString& p_journalPath, uint p_numThreads )
         : m_index( p_index )
-        , m_datFile( p_datFile ) {
+        , m_datFile( p_datFile )
+        , m_reader( p_reader )
+        , m_datTimestamp( p_datTimestamp )
+        , m_journalPath( p_journalPath )
+        , m_lastCheckpoint( std::chrono::steady_clock::now( ) )
+        , m_numThreads( p_numThreads ? p_numThreads : wxMax( std::thread::hardware_concurrency( ), 1u ) )
+        , m_nextChunk( 0 )
+        , m_nextMerge( 0 )
+        , m_numInFlight( 0 )
+        , m_numFilesMerged( 0 )
+        , m_isStarted( false )
+        , m_stopping( false ) {
         Ensure::notNull( p_index.get( ) );
         Ensure::notNull( &p_datFile );
+        // The files are mostly scanned in MFT order, which mostly follows the .dat
+        m_datFile.beginIoPolicy( DatFile::IP_Sequential );
     }
 
     ScanDatTask::~ScanDatTask( ) {
+        this->stopWorkers( );
+        // Keep what was scanned since the last checkpoint
+        m_journal.checkpoint( );
+        m_datFile.endIoPolicy( DatFile::IP_Sequential );
     }
 
     bool ScanDatTask::init( ) {
-        this->setMaxProgress( m_datFile.numFiles( ) );
-        this->setCurrentProgress( m_index->highestMftEntry( ) + 1 );
-
-        uint filesLeft = m_datFile.numFiles( ) - ( m_index->highestMftEntry( ) + 1 );
-        m_index->reserveEntries( filesLeft );
+        // Files that are new or were changed by a patch become unclassified.
+        // Files of an interrupted scan still are.
+        auto root = m_index->findOrAddCategory( UnclassifiedCategoryName );
+        this->reconcile( *root );
+
+        uint numFiles = 0;
+        for ( uint i = 0; i < root->numSubCategories( ); i++ ) {
+            Chunk chunk;
+            chunk.bucket = root->subCategory( i );
+            chunk.files.reserve( chunk.bucket->numEntries( ) );
+            for ( uint j = 0; j < chunk.bucket->numEntries( ); j++ ) {
+                chunk.files.push_back( chunk.bucket->entry( j )->mftEntry( ) );
+            }
+            chunk.results.resize( chunk.files.size( ) );
+            chunk.isTaken = false;
+            chunk.isUrgent = false;
+            chunk.isReplayed = false;
+            chunk.isDone = false;
+            chunk.isMerged = false;
+            numFiles += static_cast<uint>( chunk.files.size( ) );
+            m_chunks.push_back( std::move( chunk ) );
+        }
+        if ( !root->numSubCategories( ) && !root->numEntries( ) ) {
+            m_index->removeCategory( *root, false );
+        }
 
+        this->setMaxProgress( numFiles );
+        this->setCurrentProgress( 0 );
         return true;
     }
 
+    void ScanDatTask::reconcile( DatIndexCategory& p_root ) {
+        uint numFiles = m_datFile.numFiles( );
+        // Indexes older than fingerprints can only be trusted if the .dat is unchanged
+        bool isStale = ( m_datTimestamp && m_index->datTimestamp( ) != m_datTimestamp );
+
+        auto isFileInUse = [this] ( uint p_fileNum ) {
+            uint64 offset;
+            uint size;
+            return m_datFile.entryLocation( p_fileNum + m_datFile.mftFileOffset( ), offset, size ) && size;
+        };
+        std::vector<DatIndexCategory*> buckets( ( numFiles + ScanChunkSize - 1 ) / ScanChunkSize, nullptr );
+        auto bucketFor = [this, &p_root, &buckets, numFiles] ( uint p_fileNum ) -> DatIndexCategory& {
+            auto& bucket = buckets[p_fileNum / ScanChunkSize];
+            if ( !bucket ) {
+                uint bucketStart = p_fileNum - p_fileNum % ScanChunkSize;
+                uint bucketEnd = wxMin( bucketStart + ScanChunkSize, numFiles );
+                bucket = p_root.findOrAddSubCategory( wxString::Format( wxT( "%u-%u" ), bucketStart, bucketEnd - 1 ) );
+            }
+            return *bucket;
+        };
+        // Everything needed for browsing is in the MFT already, only the file
+        // type and category need the contents
+        auto setIds = [this] ( DatIndexEntry& p_entry, uint p_fileNum ) {
+            uint baseId = m_datFile.baseIdFromFileNum( p_fileNum );
+            p_entry.setBaseId( baseId )
+                .setFileId( m_datFile.fileIdFromFileNum( p_fileNum ) )
+                .setName( wxString::Format( wxT( "%d" ), baseId ) );
+            // Found a file with no baseId...
+            if ( baseId == 0 ) {
+                p_entry.setName( wxString::Format( wxT( "ID-less_%d" ), p_fileNum ) );
+            }
+        };
+
+        // Compare the indexed files with the MFT
+        std::vector<bool> isIndexed( numFiles, false );
+        std::vector<DatIndexEntry*> removed;
+        for ( uint i = 0; i < m_index->numEntries( ); i++ ) {
+            auto entry = m_index->entry( i );
+            uint file = entry->mftEntry( );
+            // Gone from the .dat, or indexed twice
+            if ( file >= numFiles || !isFileInUse( file ) || isIndexed[file] ) {
+                removed.push_back( entry );
+                continue;
+            }
+            isIndexed[file] = true;
+
+            DatIndexFingerprint fingerprint( *m_datFile.mftEntry( file + m_datFile.mftFileOffset( ) ) );
+            bool isChanged = ( entry->fingerprint( ).isSet( ) ? entry->fingerprint( ) != fingerprint : isStale )
+                || entry->baseId( ) != m_datFile.baseIdFromFileNum( file )
+                || entry->fileId( ) != m_datFile.fileIdFromFileNum( file );
+            if ( entry->fingerprint( ) != fingerprint ) {
+                entry->setFingerprint( fingerprint );
+                m_index->setDirty( true );
+            }
+
+            bool isUnclassified = ( entry->category( )->parent( ) == &p_root );
+            if ( !isChanged ) {
+                // Saves looking up the sizes of compressed entries in the .dat
+                if ( !isUnclassified && entry->uncompressedSize( ) ) {
+                    m_datFile.cacheFileSize( file, entry->uncompressedSize( ) );
+                }
+                continue;
+            }
+
+            setIds( *entry, file );
+            entry->setFileType( ANFT_Unknown )
+                .setUncompressedSize( 0 )
+                .setMetadata( DatIndexMetadata( ) );
+            entry->cacheContentHash( 0 );
+            if ( !isUnclassified ) {
+                m_index->moveEntry( *entry, bucketFor( file ) );
+            }
+        }
+        m_index->removeEntries( removed );
+
+        // Files in use but not indexed are new
+        if ( numFiles > m_index->numEntries( ) ) {
+            m_index->reserveEntries( numFiles - m_index->numEntries( ) );
+        }
+        for ( uint file = 0; file < numFiles; file++ ) {
+            if ( isIndexed[file] || !isFileInUse( file ) ) {
+                continue;
+            }
+
+            auto& newEntry = *m_index->addIndexEntry( );
+            setIds( newEntry, file );
+            newEntry.setMftEntry( file )
+                .setFingerprint( DatIndexFingerprint( *m_datFile.mftEntry( file + m_datFile.mftFileOffset( ) ) ) );
+            bucketFor( file ).addEntry( &newEntry );
+            newEntry.finalizeAdd( );
+        }
+
+        if ( m_datTimestamp ) {
+            m_index->setDatTimestamp( m_datTimestamp );
+        }
+    }
+
+    void ScanDatTask::start( ) {
+        // Results of files an interrupted scan got to already
+        if ( !m_journalPath.IsEmpty( ) ) {
+            this->setText( wxT( "Replaying scan journal..." ) );
+            this->replayJournal( );
+        }
+
+        std::lock_guard<std::mutex> lock( m_mutex );
+        if ( m_stopping ) {
+            return;
+        }
+        uint numThreads = wxMin( m_numThreads, static_cast<uint>( m_chunks.size( ) ) );
+        for ( uint i = 0; i < numThreads; i++ ) {
+            m_workers.emplace_back( &ScanDatTask::workerLoop, this );
+        }
+    }
+
+    void ScanDatTask::replayJournal( ) {
+        // Only files still unclassified after reconciling can be replayed, find
+        // their results by file number
+        const uint64 NoResult = std::numeric_limits<uint64>::max( );
+        std::vector<uint64> resultOf( m_datFile.numFiles( ), NoResult );
+        for ( uint i = 0; i < m_chunks.size( ); i++ ) {
+            for ( uint j = 0; j < m_chunks[i].files.size( ); j++ ) {
+                resultOf[m_chunks[i].files[j]] = ( static_cast<uint64>( i ) << 32 ) | j;
+            }
+        }
+
+        std::vector<uint> numReplayed( m_chunks.size( ), 0 );
+        m_journal.open( m_journalPath, m_index->datTimestamp( ), [&] ( const DatIndexJournalRecord& p_record ) {
+            if ( m_stopping || p_record.fileNum >= resultOf.size( ) || p_record.category->empty( ) ) {
+                return;
+            }
+            auto slot = resultOf[p_record.fileNum];
+            if ( slot == NoResult ) {
+                return;
+            }
+            // Skip files a patch changed since, and files replayed already
+            auto chunkIndex = static_cast<uint>( slot >> 32 );
+            auto& result = m_chunks[chunkIndex].results[static_cast<uint>( slot )];
+            if ( result.category || m_datFile.mftEntry( p_record.fileNum + m_datFile.mftFileOffset( ) )->crc != p_record.crc ) {
+                return;
+            }
+            result = p_record;
+            result.category = this->intern( *p_record.category );
+            numReplayed[chunkIndex]++;
+        } );
+
+        // Chunks replayed in full need no scanning, commit() merges them like
+        // scanned ones. They do not count against the chunks scanned ahead.
+        std::lock_guard<std::mutex> lock( m_mutex );
+        for ( uint i = 0; i < m_chunks.size( ); i++ ) {
+            if ( numReplayed[i] && numReplayed[i] == m_chunks[i].files.size( ) ) {
+                m_chunks[i].isTaken = true;
+                m_chunks[i].isReplayed = true;
+                m_chunks[i].isDone = true;
+            }
+        }
+    }
+
     void ScanDatTask::perform( ) {
+        if ( !m_isStarted ) {
+            this->start( );
+            m_isStarted = true;
+            return;
+        }
+
+        // The workers do the scanning and commit() the merging, this only
+        // waits so the task thread does not spin
+        {
+            std::unique_lock<std::mutex> lock( m_mutex );
+            m_chunkDone.wait_for( lock, MaxPerformWait, [this] ( ) { return m_stopping.load( ); } );
+        }
+
+        // Flushing to disk is slow, it is kept away from the workers and the UI
+        auto now = std::chrono::steady_clock::now( );
+        if ( now - m_lastCheckpoint >= CheckpointInterval ) {
+            m_journal.checkpoint( );
+            m_lastCheckpoint = now;
+        }
+    }
+
+    void ScanDatTask::commit( ) {
+        auto start = std::chrono::steady_clock::now( );
+
+        for ( ;; ) {
+            uint index;
+            {
+                std::lock_guard<std::mutex> lock( m_mutex );
+                if ( !this->takeDoneChunk( index ) ) {
+                    break;
+                }
+            }
+
+            // The worker is done with the chunk, so it can be read without the lock
+            auto& chunk = m_chunks[index];
+            this->mergeChunk( chunk );
+            m_numFilesMerged += static_cast<uint>( chunk.files.size( ) );
+            {
+                std::lock_guard<std::mutex> lock( m_mutex );
+                chunk.isMerged = true;
+                if ( !chunk.isReplayed ) {
+                    m_numInFlight--;
+                }
+            }
+            m_chunkMerged.notify_all( );
+
+            this->setText( wxString::Format( wxT( "Scanning .dat: %d/%d" ), m_numFilesMerged, this->maxProgress( ) ) );
+            this->setCurrentProgress( m_numFilesMerged );
+
+            if ( std::chrono::steady_clock::now( ) - start >= MaxCommitTime ) {
+                break;
+            }
+        }
+    }
+
+    void ScanDatTask::abort( ) {
+        this->stopWorkers( );
+    }
+
+    void ScanDatTask::prioritize( const DatIndexCategory& p_category ) {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        for ( uint i = 0; i < m_chunks.size( ); i++ ) {
+            // Buckets of merged chunks are gone, and may have been reused
+            if ( !m_chunks[i].isTaken && m_chunks[i].bucket == &p_category ) {
+                m_urgentChunks.push_front( i );
+                break;
+            }
+        }
+        m_chunkMerged.notify_all( );
+    }
+
+    void ScanDatTask::stopWorkers( ) {
+        // start() may still be adding workers on the task thread
+        std::vector<std::thread> workers;
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_stopping = true;
+            workers.swap( m_workers );
+        }
+        m_chunkMerged.notify_all( );
+        m_chunkDone.notify_all( );
+        for ( auto& worker : workers ) {
+            worker.join( );
+        }
+    }
+
+    bool ScanDatTask::takeChunk( uint& po_index ) {
+        // Chunks asked for go first, and may exceed MaxChunksAhead
+        while ( !m_urgentChunks.empty( ) ) {
+            uint index = m_urgentChunks.front( );
+            m_urgentChunks.pop_front( );
+            if ( !m_chunks[index].isTaken ) {
+                m_chunks[index].isUrgent = true;
+                po_index = index;
+                return true;
+            }
+        }
+
+        while ( m_nextChunk < m_chunks.size( ) && m_chunks[m_nextChunk].isTaken ) {
+            m_nextChunk++;
+        }
+        if ( m_nextChunk < m_chunks.size( ) && m_numInFlight < MaxChunksAhead ) {
+            po_index = m_nextChunk++;
+            return true;
+        }
+        return false;
+    }
+
+    bool ScanDatTask::takeDoneChunk( uint& po_index ) {
+        // Chunks asked for are merged as soon as they are done
+        while ( !m_doneUrgentChunks.empty( ) ) {
+            uint index = m_doneUrgentChunks.front( );
+            m_doneUrgentChunks.pop_front( );
+            if ( !m_chunks[index].isMerged ) {
+                po_index = index;
+                return true;
+            }
+        }
+
+        // The others wait for the chunks before them
+        while ( m_nextMerge < m_chunks.size( ) && m_chunks[m_nextMerge].isMerged ) {
+            m_nextMerge++;
+        }
+        if ( m_nextMerge < m_chunks.size( ) && m_chunks[m_nextMerge].isDone ) {
+            po_index = m_nextMerge;
+            return true;
+        }
+        return false;
+    }
+
+    void ScanDatTask::workerLoop( ) {
+        Array<byte> buffer;
+        CategoryNames names;
+
+        for ( ;; ) {
+            uint index = 0;
+            {
+                std::unique_lock<std::mutex> lock( m_mutex );
+                bool isFound = false;
+                m_chunkMerged.wait( lock, [this, &index, &isFound] ( ) {
+                    isFound = !m_stopping && this->takeChunk( index );
+                    return m_stopping || isFound || m_nextChunk >= m_chunks.size( );
+                } );
+                if ( !isFound ) {
+                    return;
+                }
+                m_chunks[index].isTaken = true;
+                m_numInFlight++;
+            }
+
+            this->scanChunk( m_chunks[index], buffer, names );
+            // The results of a chunk cut short by stopping are incomplete
+            if ( !m_stopping && !m_journalPath.IsEmpty( ) ) {
+                m_journal.append( m_chunks[index].results );
+            }
+            {
+                std::lock_guard<std::mutex> lock( m_mutex );
+                m_chunks[index].isDone = true;
+                if ( m_chunks[index].isUrgent ) {
+                    m_doneUrgentChunks.push_back( index );
+                }
+            }
+            m_chunkDone.notify_all( );
+        }
+    }
+
+    void ScanDatTask::scanChunk( Chunk& p_chunk, Array<byte>& p_buffer, CategoryNames& p_names ) {
+        for ( size_t i = 0; i < p_chunk.files.size( ); i++ ) {
+            if ( m_stopping ) {
+                return;
+            }
+            // Replayed from the journal already
+            if ( p_chunk.results[i].category ) {
+                continue;
+            }
+            this->identify( p_chunk.files[i], p_buffer, p_names, p_chunk.results[i] );
+        }
+    }
+
+    void ScanDatTask::identify( uint p_fileNum, Array<byte>& p_buffer, CategoryNames& p_names, ScanResult& po_result ) {
         uint bytetoread = 32;
-        // Make sure the output buffer is big enough
-        this->ensureBufferSize( bytetoread );
+        if ( p_buffer.GetSize( ) < bytetoread ) {
+            p_buffer.SetSize( bytetoread );
+        }
+
+        po_result.fileNum = p_fileNum;
+        po_result.crc = m_datFile.mftEntry( p_fileNum + m_datFile.mftFileOffset( ) )->crc;
+        po_result.fileType = ANFT_Unknown;
+        po_result.size = 0;
+        po_result.metadata = DatIndexMetadata( );
 
         // Read file
-        uint32 entryNumber = this->currentProgress( );
-        uint size = m_datFile.peekFile( entryNumber, bytetoread, m_outputBuffer.GetPointer( ) );
+        uint size = this->peekFile( p_fileNum, bytetoread, p_buffer );
+
+        // Get the file type
+        if ( size ) {
+            auto results = m_datFile.identifyFileType( p_buffer.GetPointer( ), size, po_result.fileType );
+
+            // Enough data to identify the file type?
+            uint lastRequestedSize = bytetoread;
+            while ( results == DatFile::IR_NotEnoughData ) {
+                uint sizeRequired = this->requiredIdentificationSize( p_buffer.GetPointer( ), size, po_result.fileType );
+
+                // Prevent infinite loops
+                if ( sizeRequired == lastRequestedSize ) {
+                    break;
+                }
+                lastRequestedSize = sizeRequired;
+
+                // Re-read with the newly asked-for size
+                if ( p_buffer.GetSize( ) < sizeRequired ) {
+                    p_buffer.SetSize( sizeRequired );
+                }
+                size = this->peekFile( p_fileNum, sizeRequired, p_buffer );
+                results = m_datFile.identifyFileType( p_buffer.GetPointer( ), size, po_result.fileType );
+            }
+        }
 
-        // Skip if empty
+        // Files that could not be read are already in the index, file them as unknown
         if ( !size ) {
-            this->setCurrentProgress( entryNumber + 1 );
+            po_result.fileType = ANFT_Unknown;
+            this->categorize( ANFT_Unknown, p_buffer.GetPointer( ), 0, p_fileNum, p_names );
+            po_result.category = this->intern( p_names );
             return;
         }
 
-        // Get the file type
-        ANetFileType fileType;
-        auto results = m_datFile.identifyFileType( m_outputBuffer.GetPointer( ), size, fileType );
+        po_result.size = m_datFile.fileSize( p_fileNum );
+        this->describe( p_fileNum, po_result.fileType, p_buffer, size, po_result.metadata );
+        this->categorize( po_result.fileType, p_buffer.GetPointer( ), size, p_fileNum, p_names );
+        po_result.category = this->intern( p_names );
+    }
+
+    uint ScanDatTask::peekFile( uint p_fileNum, uint p_peekSize, Array<byte>& po_buffer ) const {
+        // Going through the shared reader lets previews of the user go first,
+        // and keeps a worker free for them
+        auto data = m_reader.peekFile( p_fileNum, p_peekSize, AsyncDatReader::RP_Scan ).get( );
+        if ( po_buffer.GetSize( ) < data.GetSize( ) ) {
+            po_buffer.SetSize( data.GetSize( ) );
+        }
+        ::memcpy( po_buffer.GetPointer( ), data.GetPointer( ), data.GetSize( ) );
+        return static_cast<uint>( data.GetSize( ) );
+    }
+
+    const ScanDatTask::CategoryPath* ScanDatTask::intern( const CategoryNames& p_names ) {
+        // The literals are hashed by address, equal paths made in different
+        // places are interned twice but resolve to the same category
+        XxHash64 hash;
+        for ( const auto& name : p_names ) {
+            hash.update( &name.format, sizeof( name.format ) );
+            hash.update( name.args, name.numArgs * sizeof( name.args[0] ) );
+        }
+        auto key = hash.digest( );
 
-        // Enough data to identify the file type?
-        uint lastRequestedSize = bytetoread;
-        while ( results == DatFile::IR_NotEnoughData ) {
-            uint sizeRequired = this->requiredIdentificationSize( m_outputBuffer.GetPointer( ), size, fileType );
+        std::lock_guard<std::mutex> lock( m_pathMutex );
+        auto it = m_pathsByHash.find( key );
+        if ( it != m_pathsByHash.end( ) ) {
+            return it->second;
+        }
+
+        // First time this path is seen, make its names
+        CategoryPath path;
+        for ( const auto& name : p_names ) {
+            if ( !name.format ) {
+                path.push_back( wxString( reinterpret_cast<const char*>( name.args ), 4 ) );
+            } else if ( name.numArgs == 2 ) {
+                path.push_back( wxString::Format( name.format, name.args[0], name.args[1] ) );
+            } else if ( name.numArgs == 1 ) {
+                path.push_back( wxString::Format( name.format, name.args[0] ) );
+            } else {
+                path.push_back( name.format );
+            }
+        }
+        m_paths.push_back( std::move( path ) );
+        m_pathsByHash.emplace( key, &m_paths.back( ) );
+        return &m_paths.back( );
+    }
+
+    const ScanDatTask::CategoryPath* ScanDatTask::intern( const CategoryPath& p_path ) {
+        // Paths replayed from the journal are hashed by their names, and
+        // compared in full, as different paths must not be merged
+        XxHash64 hash;
+        for ( const auto& name : p_path ) {
+            hash.update( name.wx_str( ), ( name.length( ) + 1 ) * sizeof( wxStringCharType ) );
+        }
+        auto key = hash.digest( );
+
+        std::lock_guard<std::mutex> lock( m_pathMutex );
+        auto it = m_replayedPaths.find( key );
+        if ( it != m_replayedPaths.end( ) && *it->second == p_path ) {
+            return it->second;
+        }
+        m_paths.push_back( p_path );
+        m_replayedPaths[key] = &m_paths.back( );
+        return &m_paths.back( );
+    }
 
-            // Prevent infinite loops
-            if ( sizeRequired == lastRequestedSize ) {
+    void ScanDatTask::describe( uint p_fileNum, ANetFileType p_fileType, Array<byte>& p_buffer, uint p_size, DatIndexMetadata& po_metadata ) const {
+        switch ( p_fileType ) {
+        case ANFT_ATEX:
+        case ANFT_ATTX:
+        case ANFT_ATEC:
+        case ANFT_ATEP:
+        case ANFT_ATEU:
+        case ANFT_ATET:
+            // The header has no mip count, it stays 0
+            if ( p_size >= sizeof( ANetAtexHeader ) ) {
+                auto header = reinterpret_cast<const ANetAtexHeader*>( p_buffer.GetPointer( ) );
+                po_metadata.format = header->formatInteger;
+                po_metadata.width = header->width;
+                po_metadata.height = header->height;
+            }
+            break;
+        case ANFT_Sound:
+        case ANFT_asndMP3:
+        case ANFT_asndOgg:
+        case ANFT_PackedMP3:
+        case ANFT_PackedOgg:
+            // The same format byte identifyFileType looks at, identification
+            // read far enough for it
+            if ( p_size >= 12 && *reinterpret_cast<const uint32*>( p_buffer.GetPointer( ) ) == FCC_asnd ) {
+                po_metadata.audioFormat = p_buffer[8];
+            } else if ( p_size > AsndPackedFormatOffset && *reinterpret_cast<const uint32*>( p_buffer.GetPointer( ) + 8 ) == FCC_ASND ) {
+                po_metadata.audioFormat = p_buffer[AsndPackedFormatOffset];
+            }
+            break;
+        case ANFT_DDS:
+            // The pixel format is further in than identification reads
+            if ( p_size < DdsHeaderSize ) {
+                if ( p_buffer.GetSize( ) < DdsHeaderSize ) {
+                    p_buffer.SetSize( DdsHeaderSize );
+                }
+                p_size = this->peekFile( p_fileNum, DdsHeaderSize, p_buffer );
+            }
+            if ( p_size >= DdsHeaderSize ) {
+                auto data = p_buffer.GetPointer( );
+                po_metadata.height = clampToUint16( *reinterpret_cast<const uint32*>( data + 12 ) );
+                po_metadata.width = clampToUint16( *reinterpret_cast<const uint32*>( data + 16 ) );
+                po_metadata.mipCount = clampToUint16( wxMax( *reinterpret_cast<const uint32*>( data + 28 ), 1u ) );
+                po_metadata.format = *reinterpret_cast<const uint32*>( data + 84 );
+            }
+            break;
+        case ANFT_PNG:
+            if ( p_size >= PngHeaderSize ) {
+                po_metadata.width = clampToUint16( readBigEndian32( p_buffer.GetPointer( ) + 16 ) );
+                po_metadata.height = clampToUint16( readBigEndian32( p_buffer.GetPointer( ) + 20 ) );
+                po_metadata.format = FCC_PNG;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    void ScanDatTask::mergeChunk( Chunk& p_chunk ) {
+        // Take all entries out of the bucket at once, removing them one at a
+        // time would shift the remaining ones every time
+        auto& bucket = *p_chunk.bucket;
+        std::vector<DatIndexEntry*> entries;
+        bucket.detachEntries( entries );
+
+        // The bucket held the entries of the chunk in the same order
+        size_t i = 0;
+        for ( ; i < entries.size( ) && i < p_chunk.results.size( ); i++ ) {
+            const auto& result = p_chunk.results[i];
+            if ( !result.category || entries[i]->mftEntry( ) != result.fileNum ) {
                 break;
             }
-            lastRequestedSize = sizeRequired;
 
-            // Re-read with the newly asked-for size
-            this->ensureBufferSize( sizeRequired );
-            size = m_datFile.peekFile( entryNumber, sizeRequired, m_outputBuffer.GetPointer( ) );
-            results = m_datFile.identifyFileType( m_outputBuffer.GetPointer( ), size, fileType );
+            auto& category = m_pathCategories[result.category];
+            if ( !category ) {
+                category = this->resolve( *result.category );
+            }
+            this->classify( *entries[i], result, *category );
         }
+        // Entries without results stay unclassified
+        for ( ; i < entries.size( ); i++ ) {
+            bucket.addEntry( entries[i] );
+        }
+        this->removeIfEmpty( bucket );
 
-        // Need another check, since the file might have been reloaded a couple of times
-        if ( !size ) {
-            this->setCurrentProgress( entryNumber + 1 );
-            return;
+        // Merged results are not needed anymore
+        std::vector<ScanResult>( ).swap( p_chunk.results );
+    }
+
+    DatIndexCategory* ScanDatTask::resolve( const CategoryPath& p_path ) {
+        auto category = m_index->findOrAddCategory( p_path[0] );
+        for ( size_t i = 1; i < p_path.size( ); i++ ) {
+            category = category->findOrAddSubCategory( p_path[i] );
         }
+        return category;
+    }
+
+    void ScanDatTask::classify( DatIndexEntry& p_entry, const ScanResult& p_result, DatIndexCategory& p_category ) {
+        p_entry.setFileType( p_result.fileType )
+            .setUncompressedSize( p_result.size )
+            .setMetadata( p_result.metadata );
+        m_index->moveEntry( p_entry, p_category );
+    }
 
-        // Categorize the entry
-        auto category = this->categorize( fileType, m_outputBuffer.GetPointer( ), size );
-
-        // Add to index
-        uint baseId = m_datFile.baseIdFromFileNum( entryNumber );
-        auto& newEntry = m_index->addIndexEntry( )
-            ->setBaseId( baseId )
-            .setFileId( m_datFile.fileIdFromFileNum( entryNumber ) )
-            .setFileType( fileType )
-            .setMftEntry( entryNumber )
-            .setName( wxString::Format( wxT( "%d" ), baseId ) );
-        // Found a file with no baseId...
-        if ( baseId == 0 ) {
-            newEntry.setName( wxString::Format( wxT( "ID-less_%d" ), entryNumber ) );
-        }
-        // Finalize the add
-        category->addEntry( &newEntry );
-        newEntry.finalizeAdd( );
-
-        // Delete the reader and proceed to the next file
-        this->setText( wxString::Format( wxT( "Scanning .dat: %d/%d" ), entryNumber, this->maxProgress( ) ) );
-        this->setCurrentProgress( entryNumber + 1 );
+    void ScanDatTask::removeIfEmpty( DatIndexCategory& p_bucket ) {
+        // Drop the emptied bucket, and the unclassified category with the last one
+        if ( !p_bucket.numEntries( ) ) {
+            auto root = p_bucket.parent( );
+            m_index->removeCategory( p_bucket );
+            if ( root && !root->numSubCategories( ) && !root->numEntries( ) ) {
+                m_index->removeCategory( *root );
+            }
+        }
     }
 
-    uint ScanDatTask::requiredIdentificationSize( const byte* p_data, size_t p_size, ANetFileType p_fileType ) {
+    uint ScanDatTask::requiredIdentificationSize( const byte* p_data, size_t p_size, ANetFileType p_fileType ) const {
         switch ( p_fileType ) {
         case ANFT_Binary:
             if ( p_size >= 0x40 ) {
@@ -134,7 +710,7 @@ namespace gw2b {
         }
     }
 
-    bool ScanDatTask::isBitmapFontChunk(uint p_baseId)
+    bool ScanDatTask::isBitmapFontChunk(uint p_baseId) const
     {
         // Hard coded file list from Bitmap Font (AFNT), file number 154945
         uint chunklist[] =
@@ -186,10 +762,10 @@ namespace gw2b {
         return false;
     }
 
-#define MakeCategory(x)     { category = m_index->findOrAddCategory(x); }
-#define MakeSubCategory(x)  { category = category->findOrAddSubCategory(x); }
-    DatIndexCategory* ScanDatTask::categorize( ANetFileType p_fileType, const byte* p_data, size_t p_size ) {
-        DatIndexCategory* category = nullptr;
+#define MakeCategory(x)     { po_category.clear( ); po_category.push_back( CategoryName( x ) ); }
+#define MakeSubCategory(x)  { po_category.push_back( CategoryName( x ) ); }
+    void ScanDatTask::categorize( ANetFileType p_fileType, const byte* p_data, size_t p_size, uint p_fileNum, CategoryNames& po_category ) const {
+        po_category.clear( );
 
         switch ( p_fileType ) {
         case ANFT_ATEX:
@@ -245,11 +821,11 @@ namespace gw2b {
                 p_fileType == ANFT_ATEP || p_fileType == ANFT_ATEU || p_fileType == ANFT_ATET ) ) {
                 uint16 width = *reinterpret_cast<const uint16*>( p_data + 8 );
                 uint16 height = *reinterpret_cast<const uint16*>( p_data + 10 );
-                MakeSubCategory( wxString::Format( wxT( "%ux%u" ), width, height ) );
+                MakeSubCategory( CategoryName( wxT( "%ux%u" ), 2, width, height ) );
             } else if ( p_fileType == ANFT_DDS && p_size >= 20 ) {
                 uint32 width = *reinterpret_cast<const uint32*>( p_data + 16 );
                 uint32 height = *reinterpret_cast<const uint32*>( p_data + 12 );
-                MakeSubCategory( wxString::Format( wxT( "%ux%u" ), width, height ) );
+                MakeSubCategory( CategoryName( wxT( "%ux%u" ), 2, width, height ) );
             }
 
             break;
@@ -294,14 +870,10 @@ namespace gw2b {
         {
             MakeCategory( wxT( "Strings" ) );
 
-            uint32 entryNumber = this->currentProgress( );
-
-            auto buffer = allocate<byte>( m_datFile.fileSize( entryNumber ) );
-            auto size = m_datFile.readFile( entryNumber, buffer );
+            auto data = m_reader.readFile( p_fileNum, AsyncDatReader::RP_Scan ).get( );
 
             // strs file format that have to read near end of file to know what language is
-            auto end = buffer + size - 2;
-            auto language = static_cast<uint32>( *end );
+            auto language = data.GetSize( ) >= 2 ? static_cast<uint32>( data[data.GetSize( ) - 2] ) : std::numeric_limits<uint32>::max( );
 
             switch ( language ) {
             case language::English:
@@ -324,9 +896,8 @@ namespace gw2b {
                 break;
             default:
                 MakeSubCategory( wxT( "Unknown" ) );
-                MakeSubCategory( wxString::Format( wxT( "%u" ), language ) );
+                MakeSubCategory( CategoryName( wxT( "%u" ), 1, language ) );
             }
-            freePointer( buffer );
             break;
         }
         case ANFT_Manifest:
@@ -357,8 +928,8 @@ namespace gw2b {
         case ANFT_Model:
         {
             MakeCategory(wxT("Models"));
-            uint baseId = m_datFile.baseIdFromFileNum(this->currentProgress());
-            MakeSubCategory(wxString::Format(wxT("%i"), ((uint32)baseId / 10000)) + wxT("xxxx"));
+            uint baseId = m_datFile.baseIdFromFileNum(p_fileNum);
+            MakeSubCategory(CategoryName(wxT("%uxxxx"), 1, ((uint32)baseId / 10000)));
             break;
         }
         case ANFT_ModelCollisionManifest:
@@ -426,12 +997,12 @@ namespace gw2b {
             MakeCategory( wxT( "Misc" ) );
 
             if ( p_fileType == ANFT_PF && p_size >= 12 ) {
-                MakeSubCategory( wxString( reinterpret_cast<const char*>( p_data + 8 ), 4 ) );
+                MakeSubCategory( CategoryName( nullptr, 1, *reinterpret_cast<const uint32*>( p_data + 8 ) ) );
             }
             break;
         default:
         {
-            uint32 entryNumber = this->currentProgress();
+            uint32 entryNumber = p_fileNum;
             uint baseId = m_datFile.baseIdFromFileNum(entryNumber);
             //auto fileId = m_datFile.fileIdFromFileNum(entryNumber); // uint
             if (isBitmapFontChunk(baseId))
@@ -445,14 +1016,6 @@ namespace gw2b {
             }
         }
         } // switch (p_fileType)
-
-        return category;
-    }
-
-    void ScanDatTask::ensureBufferSize( size_t p_size ) {
-        if ( m_outputBuffer.GetSize( ) < p_size ) {
-            m_outputBuffer.SetSize( p_size );
-        }
     }
 
 }; // namespace gw2b
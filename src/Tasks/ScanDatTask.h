@@ -28,7 +28,19 @@
 #ifndef TASKS_SCANDATTASK_H_INCLUDED
 #define TASKS_SCANDATTASK_H_INCLUDED
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
 #include "ANetStructs.h"
+#include "AsyncDatReader.h"
+#include "DatFile.h"
+#include "DatIndexIO.h"
 #include "Task.h"
 
 namespace gw2b {
@@ -36,21 +48,136 @@ namespace gw2b {
     class DatIndex;
     class DatIndexCategory;
 
+    /** Scans the .dat for files, identifying and categorizing each of them.
+    *   init() compares the index with the MFT, dropping the entries of files
+    *   that are gone. Files that are new, or were changed by a patch, go to
+    *   buckets of the "Unclassified" category right away, so they can be
+    *   browsed before they are identified. Only those are scanned. Each
+    *   bucket is a chunk that worker threads read and identify into buffers
+    *   of their own. commit() then moves the entries of finished chunks to
+    *   their categories on the main thread, and removes the emptied buckets.
+    *   Chunks are merged in MFT order. Chunks the user shows interest in are
+    *   scanned and merged first, which changes the order categories are made
+    *   in, but DatIndexWriter writes them sorted by path, so the index file
+    *   is the same either way. The results are also written to a journal every few
+    *   seconds, so a scan that gets killed resumes from there on the next
+    *   run. The journal is replayed on the task thread into the results of
+    *   the chunks, which commit() merges like scanned ones. */
     class ScanDatTask : public Task {
+        /** Names of a category and its parents, root first. */
+        typedef std::vector<wxString> CategoryPath;
+        /** A category name as categorize() makes it, without allocating: a
+        *   literal, or a format and its arguments. A null format stands for
+        *   the four characters packed in the first argument. */
+        struct CategoryName {
+            const wxChar*   format;
+            uint32          args[2];
+            uint            numArgs;
+            CategoryName( const wxChar* p_format, uint p_numArgs = 0, uint32 p_arg0 = 0, uint32 p_arg1 = 0 )
+                : format( p_format )
+                , numArgs( p_numArgs ) {
+                args[0] = p_arg0;
+                args[1] = p_arg1;
+            }
+        };
+        typedef std::vector<CategoryName> CategoryNames;
+        /** An identified file, waiting to be moved to its category. */
+        typedef DatIndexJournalRecord ScanResult;
+        /** A bucket of unclassified files, scanned by one worker. */
+        struct Chunk {
+            DatIndexCategory*       bucket;
+            std::vector<uint>       files;
+            std::vector<ScanResult> results;
+            bool                    isTaken;
+            bool                    isUrgent;
+            bool                    isReplayed;
+            bool                    isDone;
+            bool                    isMerged;
+        };
+
         std::shared_ptr<DatIndex>   m_index;
-        Array<byte>                 m_outputBuffer;
         DatFile&                    m_datFile;
+        AsyncDatReader&             m_reader;
+        uint64                      m_datTimestamp;
+        wxString                    m_journalPath;
+        DatIndexJournal             m_journal;
+        std::chrono::steady_clock::time_point   m_lastCheckpoint;
+        uint                        m_numThreads;
+        std::vector<std::thread>    m_workers;
+        std::vector<Chunk>          m_chunks;
+        std::mutex                  m_mutex;
+        std::condition_variable     m_chunkDone;
+        std::condition_variable     m_chunkMerged;
+        std::deque<uint>            m_urgentChunks;
+        std::deque<uint>            m_doneUrgentChunks;
+        uint                        m_nextChunk;
+        uint                        m_nextMerge;
+        uint                        m_numInFlight;
+        uint                        m_numFilesMerged;
+        bool                        m_isStarted;
+        std::atomic<bool>           m_stopping;
+        /** Every category path seen by the workers, stored once. Results
+        *   point into it, so its elements must not move. */
+        std::deque<CategoryPath>    m_paths;
+        std::unordered_map<uint64, const CategoryPath*> m_pathsByHash;
+        std::unordered_map<uint64, const CategoryPath*> m_replayedPaths;
+        std::mutex                  m_pathMutex;
+        /** The category each path was resolved to, only used by the main thread. */
+        std::unordered_map<const CategoryPath*, DatIndexCategory*>  m_pathCategories;
     public:
-        ScanDatTask( const std::shared_ptr<DatIndex>& p_index, DatFile& p_datFile );
+        /** Constructor.
+        *  \param[in]  p_index      Index to add the files to.
+        *  \param[in]  p_datFile    .dat file to scan.
+        *  \param[in]  p_reader     Reader of p_datFile the files are read
+        *                           through, as scan reads.
+        *  \param[in]  p_datTimestamp   Timestamp of the .dat file, given to the
+        *                               index. 0 to leave the index's alone.
+        *  \param[in]  p_journalPath    Journal to resume from and to record the
+        *                               progress in. Empty for none.
+        *  \param[in]  p_numThreads Amount of worker threads, 0 for one per
+        *                           hardware thread. */
+        ScanDatTask( const std::shared_ptr<DatIndex>& p_index, DatFile& p_datFile, AsyncDatReader& p_reader, uint64 p_datTimestamp = 0,
+            const wxString& p_journalPath = wxEmptyString, uint p_numThreads = 0 );
         virtual ~ScanDatTask( );
 
+        /** Brings the index up to date with the MFT, and splits the entries
+        *   that are still unclassified into chunks. */
         virtual bool init( ) override;
+        /** Replays the journal and starts the workers the first time. After
+        *   that, waits a little, the workers do the scanning. Checkpoints the
+        *   journal every few seconds. */
         virtual void perform( ) override;
+        /** Moves the entries of finished chunks to their categories, for as
+        *   long as the UI can spare. */
+        virtual void commit( ) override;
+        virtual void abort( ) override;
+
+        /** Has the entries of the given category scanned before the others,
+        *   if it is a bucket of unclassified entries. Can be called from any
+        *   thread.
+        *  \param[in]  p_category   Category the user is interested in. */
+        void prioritize( const DatIndexCategory& p_category );
     private:
-        uint requiredIdentificationSize( const byte* p_data, size_t p_size, ANetFileType p_fileType );
-        bool isBitmapFontChunk(uint p_baseId);
-        DatIndexCategory* categorize( ANetFileType p_fileType, const byte* p_data, size_t p_size );
-        void ensureBufferSize( size_t p_size );
+        void reconcile( DatIndexCategory& p_root );
+        void start( );
+        void replayJournal( );
+        void workerLoop( );
+        bool takeChunk( uint& po_index );
+        bool takeDoneChunk( uint& po_index );
+        void scanChunk( Chunk& p_chunk, Array<byte>& p_buffer, CategoryNames& p_names );
+        void identify( uint p_fileNum, Array<byte>& p_buffer, CategoryNames& p_names, ScanResult& po_result );
+        uint peekFile( uint p_fileNum, uint p_peekSize, Array<byte>& po_buffer ) const;
+        const CategoryPath* intern( const CategoryNames& p_names );
+        const CategoryPath* intern( const CategoryPath& p_path );
+        void describe( uint p_fileNum, ANetFileType p_fileType, Array<byte>& p_buffer, uint p_size, DatIndexMetadata& po_metadata ) const;
+        void mergeChunk( Chunk& p_chunk );
+        DatIndexCategory* resolve( const CategoryPath& p_path );
+        void classify( DatIndexEntry& p_entry, const ScanResult& p_result, DatIndexCategory& p_category );
+        void removeIfEmpty( DatIndexCategory& p_bucket );
+        void stopWorkers( );
+        uint requiredIdentificationSize( const byte* p_data, size_t p_size, ANetFileType p_fileType ) const;
+        bool isBitmapFontChunk( uint p_baseId ) const;
+        void categorize( ANetFileType p_fileType, const byte* p_data, size_t p_size, uint p_fileNum, CategoryNames& po_category ) const;
     }; // class ScanDatTask
 
 }; // namespace gw2b
@@ -31,7 +31,9 @@ namespace gw2b {
         : m_index( p_index )
         , m_writer( *p_index )
         , m_filename( p_filename )
-        , m_errorOccured( false ) {
+        , m_errorOccured( false )
+        , m_numChanges( 0 )
+        , m_isWritten( false ) {
         Ensure::notNull( p_index.get( ) );
     }
 
@@ -41,6 +43,8 @@ namespace gw2b {
         }
 
         if ( m_index->isDirty( ) ) {
+            // Changes made while writing are not in the file, they keep the index dirty
+            m_numChanges = m_index->numChanges( );
             bool result = m_writer.open( m_filename.GetFullPath( ) );
             if ( result ) {
                 this->setMaxProgress( m_writer.numEntries( ) + m_writer.numCategories( ) );
@@ -61,10 +65,14 @@ namespace gw2b {
             if ( m_errorOccured && wxFile::Exists( path ) ) {
                 wxRemoveFile( path );
             }
-            // If done, remove the dirty flag from the index
-            if ( this->isDone( ) ) {
-                m_index->setDirty( false );
-            }
+            m_isWritten = this->isDone( );
+        }
+    }
+
+    void WriteIndexTask::commit( ) {
+        // If done, remove the dirty flag from the index, unless it changed since init()
+        if ( m_isWritten ) {
+            m_index->setSaved( m_numChanges );
         }
     }
 
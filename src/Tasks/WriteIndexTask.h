@@ -27,6 +27,8 @@
 #ifndef TASKS_WRITEINDEXTASK_H_INCLUDED
 #define TASKS_WRITEINDEXTASK_H_INCLUDED
 
+#include <atomic>
+
 #include <wx/filename.h>
 
 #include "DatIndexIO.h"
@@ -40,11 +42,14 @@ namespace gw2b {
         DatIndexWriter              m_writer;
         wxFileName                  m_filename;
         bool                        m_errorOccured;
+        uint64                      m_numChanges;
+        std::atomic<bool>           m_isWritten;
     public:
         WriteIndexTask( const std::shared_ptr<DatIndex>& p_index, const wxFileName& p_filename );
 
         virtual bool init( );
         virtual void perform( );
+        virtual void commit( );
         virtual void abort( );
         virtual void clean( );
 
@@ -81,6 +81,14 @@ namespace gw2b {
             : mData( pOther.mData ) {
         }
 
+        /** Move constructor. Leaves the other array empty, so the data can be
+        *  handed to another thread without touching its reference count there.
+        *  \param[in]  pOther  Object to move from. */
+        Array( Array&& pOther )
+            : mData( pOther.mData ) {
+            pOther.mData = new ArrayData<T>( );
+        }
+
         /** Destructor. */
         ~Array( ) {
         }
@@ -93,6 +101,17 @@ namespace gw2b {
             return *this;
         }
 
+        /** Move assignment operator. Leaves the other array empty.
+        *  \param[in]  pOther   Object to move from.
+        *  \return Array   This array. */
+        Array& operator=( Array&& pOther ) {
+            if ( this != &pOther ) {
+                mData = pOther.mData;
+                pOther.mData = new ArrayData<T>( );
+            }
+            return *this;
+        }
+
         /** Addition assignment operator. Adds the elements of the other array
         *  to the end of this one.
         *  \param[in]  pOther  Array to append to this.
@@ -0,0 +1,176 @@
+/** \file       Util/MappedFile.cpp
+ *  \brief      Contains the definition of the read-only memory mapped file class.
+ *  \author     agent
+ */
+
+/**
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of Gw2Browser.
+ *
+ * Gw2Browser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stdafx.h"
+
+#ifdef _WIN32
+#include <wx/msw/wrapwin.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "MappedFile.h"
+
+namespace gw2b {
+
+    MappedFile::MappedFile( )
+        : m_data( nullptr )
+        , m_size( 0 )
+#ifdef _WIN32
+        , m_fileHandle( INVALID_HANDLE_VALUE )
+        , m_mappingHandle( nullptr )
+#endif
+    {
+    }
+
+    MappedFile::~MappedFile( ) {
+        this->close( );
+    }
+
+#ifdef _WIN32
+
+    bool MappedFile::open( const wxString& p_filename ) {
+        this->close( );
+
+        m_fileHandle = ::CreateFileW( p_filename.wc_str( ), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+        if ( m_fileHandle == INVALID_HANDLE_VALUE ) {
+            return false;
+        }
+
+        LARGE_INTEGER fileSize;
+        if ( !::GetFileSizeEx( m_fileHandle, &fileSize ) || fileSize.QuadPart == 0 ) {
+            this->close( );
+            return false;
+        }
+
+        m_mappingHandle = ::CreateFileMappingW( m_fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr );
+        if ( !m_mappingHandle ) {
+            this->close( );
+            return false;
+        }
+
+        // Fails on 32-bit builds if the file does not fit the address space
+        m_data = static_cast<const byte*>( ::MapViewOfFile( m_mappingHandle, FILE_MAP_READ, 0, 0, 0 ) );
+        if ( !m_data ) {
+            this->close( );
+            return false;
+        }
+
+        m_size = fileSize.QuadPart;
+        return true;
+    }
+
+    void MappedFile::close( ) {
+        if ( m_data ) {
+            ::UnmapViewOfFile( m_data );
+            m_data = nullptr;
+        }
+        if ( m_mappingHandle ) {
+            ::CloseHandle( m_mappingHandle );
+            m_mappingHandle = nullptr;
+        }
+        if ( m_fileHandle != INVALID_HANDLE_VALUE ) {
+            ::CloseHandle( m_fileHandle );
+            m_fileHandle = INVALID_HANDLE_VALUE;
+        }
+        m_size = 0;
+    }
+
+    void MappedFile::advise( Advice p_advice ) const {
+    }
+
+    void MappedFile::discard( uint64 p_offset, uint64 p_size ) const {
+    }
+
+#else
+
+    bool MappedFile::open( const wxString& p_filename ) {
+        this->close( );
+
+        int fd = ::open( p_filename.fn_str( ), O_RDONLY );
+        if ( fd == -1 ) {
+            return false;
+        }
+
+        struct stat fileStat;
+        if ( ::fstat( fd, &fileStat ) != 0 || fileStat.st_size == 0 ||
+            static_cast<uint64>( fileStat.st_size ) > std::numeric_limits<size_t>::max( ) ) {
+            ::close( fd );
+            return false;
+        }
+
+        // The mapping keeps its own reference to the file, so the descriptor
+        // is not needed once it exists
+        void* data = ::mmap( nullptr, fileStat.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+        ::close( fd );
+        if ( data == MAP_FAILED ) {
+            return false;
+        }
+
+        m_data = static_cast<const byte*>( data );
+        m_size = fileStat.st_size;
+        return true;
+    }
+
+    void MappedFile::close( ) {
+        if ( m_data ) {
+            ::munmap( const_cast<byte*>( m_data ), m_size );
+            m_data = nullptr;
+        }
+        m_size = 0;
+    }
+
+    void MappedFile::advise( Advice p_advice ) const {
+        if ( !m_data ) {
+            return;
+        }
+
+        int advice = MADV_NORMAL;
+        if ( p_advice == MA_Sequential ) {
+            advice = MADV_SEQUENTIAL;
+        } else if ( p_advice == MA_Random ) {
+            advice = MADV_RANDOM;
+        }
+        ::madvise( const_cast<byte*>( m_data ), m_size, advice );
+    }
+
+    void MappedFile::discard( uint64 p_offset, uint64 p_size ) const {
+        if ( !m_data || p_offset >= m_size ) {
+            return;
+        }
+
+        // madvise wants whole pages, widen the range to the pages it touches
+        static const uint64 pageSize = ::sysconf( _SC_PAGESIZE );
+        uint64 start = p_offset - ( p_offset % pageSize );
+        uint64 end = wxMin( p_offset + p_size, m_size );
+        ::madvise( const_cast<byte*>( m_data ) + start, end - start, MADV_DONTNEED );
+    }
+
+#endif
+
+}; // namespace gw2b
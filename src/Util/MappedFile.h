@@ -0,0 +1,97 @@
+/** \file       Util/MappedFile.h
+ *  \brief      Contains the declaration of the read-only memory mapped file class.
+ *  \author     agent
+ */
+
+/**
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This file is part of Gw2Browser.
+ *
+ * Gw2Browser is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#ifndef UTIL_MAPPEDFILE_H_INCLUDED
+#define UTIL_MAPPEDFILE_H_INCLUDED
+
+namespace gw2b {
+
+    /** Maps a whole file read-only into the address space of the process. */
+    class MappedFile {
+    public:
+        /** How the mapping is expected to be read, for the kernel to tune
+        *   readahead to. */
+        enum Advice {
+            MA_Normal,      /**< No particular order. */
+            MA_Sequential,  /**< Front to back, read ahead aggressively. */
+            MA_Random,      /**< All over the place, do not read ahead. */
+        };
+    private:
+        const byte*     m_data;
+        uint64          m_size;
+#ifdef _WIN32
+        void*           m_fileHandle;
+        void*           m_mappingHandle;
+#endif
+    public:
+        /** Constructor. Initializes internals. */
+        MappedFile( );
+        /** Destructor. Unmaps the file if it is still mapped. */
+        ~MappedFile( );
+
+        /** Maps the given file into memory.
+        *  \param[in]  p_filename   Name of the file to map.
+        *  \return bool    true if the file was mapped, false if not. */
+        bool open( const wxString& p_filename );
+        /** Unmaps the file, if any. */
+        void close( );
+        /** Checks whether or not a file is currently mapped.
+        *  \return bool    true if a file is mapped, false if not. */
+        bool isOpen( ) const {
+            return m_data != nullptr;
+        }
+
+        /** Gets a pointer to the first byte of the mapping.
+        *  \return byte*   Pointer to the mapped data, nullptr if not mapped. */
+        const byte* data( ) const {
+            return m_data;
+        }
+        /** Gets the size of the mapping.
+        *  \return uint64  Size of the mapped file, in bytes. */
+        uint64 size( ) const {
+            return m_size;
+        }
+
+        /** Tells the kernel how the mapping is going to be read. Does nothing
+        *   on Windows, which only takes such hints when opening the file.
+        *  \param[in]  p_advice     Expected access pattern. */
+        void advise( Advice p_advice ) const;
+        /** Tells the kernel the given range is not going to be read again
+        *   soon, so its pages can be dropped. The range stays readable, it is
+        *   read from the file again if needed. Does nothing on Windows.
+        *  \param[in]  p_offset     Start of the range.
+        *  \param[in]  p_size       Size of the range. */
+        void discard( uint64 p_offset, uint64 p_size ) const;
+
+    private:
+        MappedFile( const MappedFile& );
+        MappedFile& operator=( const MappedFile& );
+
+    }; // class MappedFile
+
+}; // namespace gw2b
+
+#endif // UTIL_MAPPEDFILE_H_INCLUDED
@@ -55,4 +55,187 @@ namespace gw2b {
 #pragma warning( pop )
 #endif
 
+    namespace {
+
+        /** Lookup tables for computing a reflected CRC-32 eight bytes at a time. */
+        struct CrcTables {
+            uint32 table[8][256];
+
+            explicit CrcTables( uint32 p_polynomial ) {
+                for ( uint i = 0; i < 256; i++ ) {
+                    uint32 crc = i;
+                    for ( uint bit = 0; bit < 8; bit++ ) {
+                        crc = ( crc >> 1 ) ^ ( ( crc & 1 ) ? p_polynomial : 0 );
+                    }
+                    table[0][i] = crc;
+                }
+                for ( uint i = 0; i < 256; i++ ) {
+                    for ( uint slice = 1; slice < 8; slice++ ) {
+                        table[slice][i] = ( table[slice - 1][i] >> 8 ) ^ table[0][table[slice - 1][i] & 0xff];
+                    }
+                }
+            }
+
+            uint32 compute( const void* p_data, size_t p_size ) const {
+                auto data = static_cast<const byte*>( p_data );
+                uint32 crc = 0xffffffff;
+
+                // Slicing-by-8, assumes a little endian host like the rest of the code
+                while ( p_size >= 8 ) {
+                    uint32 low;
+                    uint32 high;
+                    ::memcpy( &low, data, sizeof( low ) );
+                    ::memcpy( &high, data + 4, sizeof( high ) );
+                    low ^= crc;
+                    crc = table[7][low & 0xff] ^ table[6][( low >> 8 ) & 0xff] ^
+                        table[5][( low >> 16 ) & 0xff] ^ table[4][low >> 24] ^
+                        table[3][high & 0xff] ^ table[2][( high >> 8 ) & 0xff] ^
+                        table[1][( high >> 16 ) & 0xff] ^ table[0][high >> 24];
+                    data += 8;
+                    p_size -= 8;
+                }
+                while ( p_size-- ) {
+                    crc = ( crc >> 8 ) ^ table[0][( crc ^ *data++ ) & 0xff];
+                }
+
+                return ~crc;
+            }
+        };
+
+    }; // anon namespace
+
+    uint32 crc32( const void* p_data, size_t p_size ) {
+        static const CrcTables tables( 0xedb88320 );
+        return tables.compute( p_data, p_size );
+    }
+
+    uint32 crc32c( const void* p_data, size_t p_size ) {
+        static const CrcTables tables( 0x82f63b78 );
+        return tables.compute( p_data, p_size );
+    }
+
+    namespace {
+
+        // https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+        const uint64 XxPrime1 = 0x9e3779b185ebca87ull;
+        const uint64 XxPrime2 = 0xc2b2ae3d27d4eb4full;
+        const uint64 XxPrime3 = 0x165667b19e3779f9ull;
+        const uint64 XxPrime4 = 0x85ebca77c2b2ae63ull;
+        const uint64 XxPrime5 = 0x27d4eb2f165667c5ull;
+
+        uint64 rotateLeft( uint64 p_value, uint p_bits ) {
+            return ( p_value << p_bits ) | ( p_value >> ( 64 - p_bits ) );
+        }
+
+        uint64 xxRound( uint64 p_lane, uint64 p_input ) {
+            p_lane += p_input * XxPrime2;
+            return rotateLeft( p_lane, 31 ) * XxPrime1;
+        }
+
+        uint64 xxMergeLane( uint64 p_hash, uint64 p_lane ) {
+            p_hash ^= xxRound( 0, p_lane );
+            return p_hash * XxPrime1 + XxPrime4;
+        }
+
+        uint64 readUint64( const byte* p_data ) {
+            uint64 value;
+            ::memcpy( &value, p_data, sizeof( value ) );
+            return value;
+        }
+
+        uint32 readUint32( const byte* p_data ) {
+            uint32 value;
+            ::memcpy( &value, p_data, sizeof( value ) );
+            return value;
+        }
+
+    }; // anon namespace
+
+    XxHash64::XxHash64( uint64 p_seed )
+        : m_bufferSize( 0 )
+        , m_totalSize( 0 )
+        , m_seed( p_seed ) {
+        m_lanes[0] = p_seed + XxPrime1 + XxPrime2;
+        m_lanes[1] = p_seed + XxPrime2;
+        m_lanes[2] = p_seed;
+        m_lanes[3] = p_seed - XxPrime1;
+    }
+
+    void XxHash64::update( const void* p_data, size_t p_size ) {
+        auto data = static_cast<const byte*>( p_data );
+        m_totalSize += p_size;
+
+        // Finish the stripe left over from the last update first
+        if ( m_bufferSize ) {
+            size_t count = wxMin( p_size, sizeof( m_buffer ) - m_bufferSize );
+            ::memcpy( m_buffer + m_bufferSize, data, count );
+            m_bufferSize += static_cast<uint>( count );
+            data += count;
+            p_size -= count;
+            if ( m_bufferSize < sizeof( m_buffer ) ) {
+                return;
+            }
+            for ( uint i = 0; i < 4; i++ ) {
+                m_lanes[i] = xxRound( m_lanes[i], readUint64( m_buffer + i * 8 ) );
+            }
+            m_bufferSize = 0;
+        }
+
+        // Then whole stripes of 32 bytes, straight from the data
+        while ( p_size >= sizeof( m_buffer ) ) {
+            for ( uint i = 0; i < 4; i++ ) {
+                m_lanes[i] = xxRound( m_lanes[i], readUint64( data + i * 8 ) );
+            }
+            data += sizeof( m_buffer );
+            p_size -= sizeof( m_buffer );
+        }
+
+        ::memcpy( m_buffer, data, p_size );
+        m_bufferSize = static_cast<uint>( p_size );
+    }
+
+    uint64 XxHash64::digest( ) const {
+        uint64 hash;
+        if ( m_totalSize >= sizeof( m_buffer ) ) {
+            hash = rotateLeft( m_lanes[0], 1 ) + rotateLeft( m_lanes[1], 7 )
+                + rotateLeft( m_lanes[2], 12 ) + rotateLeft( m_lanes[3], 18 );
+            for ( uint i = 0; i < 4; i++ ) {
+                hash = xxMergeLane( hash, m_lanes[i] );
+            }
+        } else {
+            hash = m_seed + XxPrime5;
+        }
+        hash += m_totalSize;
+
+        // Whatever did not fill a stripe
+        uint position = 0;
+        for ( ; position + 8 <= m_bufferSize; position += 8 ) {
+            hash ^= xxRound( 0, readUint64( m_buffer + position ) );
+            hash = rotateLeft( hash, 27 ) * XxPrime1 + XxPrime4;
+        }
+        if ( position + 4 <= m_bufferSize ) {
+            hash ^= readUint32( m_buffer + position ) * XxPrime1;
+            hash = rotateLeft( hash, 23 ) * XxPrime2 + XxPrime3;
+            position += 4;
+        }
+        for ( ; position < m_bufferSize; position++ ) {
+            hash ^= m_buffer[position] * XxPrime5;
+            hash = rotateLeft( hash, 11 ) * XxPrime1;
+        }
+
+        // Avalanche
+        hash ^= hash >> 33;
+        hash *= XxPrime2;
+        hash ^= hash >> 29;
+        hash *= XxPrime3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+    uint64 xxHash64( const void* p_data, size_t p_size, uint64 p_seed ) {
+        XxHash64 hash( p_seed );
+        hash.update( p_data, p_size );
+        return hash.digest( );
+    }
+
 }; // namespace gw2b
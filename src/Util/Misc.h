@@ -129,6 +129,55 @@ namespace gw2b {
 
     //============================================================================/
 
+    /** Computes the CRC-32 (as used by zlib) of the given data.
+    *  \param[in]  p_data  Data to compute the checksum of.
+    *  \param[in]  p_size  Size of the data, in bytes.
+    *  \return uint32  Checksum of the data. */
+    uint32 crc32( const void* p_data, size_t p_size );
+
+    //============================================================================/
+
+    /** Computes the CRC-32C (Castagnoli) of the given data.
+    *  \param[in]  p_data  Data to compute the checksum of.
+    *  \param[in]  p_size  Size of the data, in bytes.
+    *  \return uint32  Checksum of the data. */
+    uint32 crc32c( const void* p_data, size_t p_size );
+
+    //============================================================================/
+
+    /** Computes the 64-bit xxHash (XXH64) of data that is given a part at a
+    *  time. Meant for telling contents apart, not for security. */
+    class XxHash64 {
+        uint64  m_lanes[4];
+        byte    m_buffer[32];
+        uint    m_bufferSize;
+        uint64  m_totalSize;
+        uint64  m_seed;
+    public:
+        /** Constructor.
+        *  \param[in]  p_seed  Seed of the hash. */
+        explicit XxHash64( uint64 p_seed = 0 );
+
+        /** Adds the given data to the hash.
+        *  \param[in]  p_data  Data to add.
+        *  \param[in]  p_size  Size of the data, in bytes. */
+        void update( const void* p_data, size_t p_size );
+        /** Gets the hash of all data added so far.
+        *  \return uint64  Hash of the data. */
+        uint64 digest( ) const;
+    }; // class XxHash64
+
+    //============================================================================/
+
+    /** Computes the 64-bit xxHash (XXH64) of the given data.
+    *  \param[in]  p_data  Data to compute the hash of.
+    *  \param[in]  p_size  Size of the data, in bytes.
+    *  \param[in]  p_seed  Seed of the hash.
+    *  \return uint64  Hash of the data. */
+    uint64 xxHash64( const void* p_data, size_t p_size, uint64 p_seed = 0 );
+
+    //============================================================================/
+
     /** Check if the given object is the same type of the given type.
     *  \param[in]  p_object    Object to check type.
     *  \tparam     T           Type the object that to check. */
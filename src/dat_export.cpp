@@ -1,10 +1,16 @@
+#include <cerrno>
+#include <cstdlib>
 #include <iostream>
 #include <wx/string.h>
 #include <wx/filefn.h>
 #include <wx/filename.h>
 #include "Tasks/ReadIndexTask.h"
 #include "DatIndex.h"
+#include "AsyncDatReader.h"
 #include "DatFile.h"
+#include "DatVerifier.h"
+#include "Exception.h"
+#include "Compression/TextureInflater.h"
 #include "Exporter.h"
 #include "Readers/ImageReader.h"
 #include "Tasks/ScanDatTask.h"
@@ -13,7 +19,11 @@
 #include <thread>
 #include <chrono>
 #include <mutex>
+#include <atomic>
 #include <future>
+#include <functional>
+#include <algorithm>
+#include <vector>
 
 using namespace std::chrono_literals;
 using namespace gw2b;
@@ -174,37 +184,454 @@ void addCategoryEntriesToArray(Array<const DatIndexEntry *> &p_array, uint &p_in
     }
 }
 
+// Parses the number following the given prefix of an option, such as --cache=<MB>
+bool parseOptionValue(const std::string &arg, size_t prefix_length, unsigned long &value) {
+    auto text = arg.c_str() + prefix_length;
+    char *end = nullptr;
+    errno = 0;
+    value = std::strtoul(text, &end, 10);
+    return *text && *text != '-' && !*end && errno != ERANGE;
+}
+
+// Counts the entries whose content hash is known, to tell whether an export found new ones
+uint countHashed(const Array<const DatIndexEntry *> &entries, uint count) {
+    uint hashed = 0;
+    for (uint i = 0; i < count; i++) {
+        if (entries[i]->contentHash()) {
+            hashed++;
+        }
+    }
+    return hashed;
+}
+
+bool writeIndex(DatIndex &index) {
+    DatIndexWriter indexWriter(index);
+    auto num_changes = index.numChanges();
+    if (!indexWriter.open(wxString("gw2dat.idx")) || !indexWriter.write(100000000)) {
+        return false;
+    }
+    index.setSaved(num_changes);
+    return true;
+}
+
+int verifyDat(const DatFile &dat_file) {
+    DatVerifier verifier(dat_file);
+    auto checksum = verifier.detectChecksumType();
+    std::printf("Block checksum: %s%s\n", DatVerifier::checksumName(checksum),
+                checksum == DatVerifier::CT_None ? " (not checked, only decompression is)"
+                                                 : (verifier.checksLastBlock() ? ", last blocks included" : ""));
+
+    // Verify the entries in the order they are stored in, so the threads
+    // walk through the .dat front to back together
+    struct VerifyEntry {
+        uint64 offset;
+        uint entry_num;
+        uint size;
+    };
+    std::vector<VerifyEntry> entries;
+    entries.reserve(dat_file.numFiles());
+    std::vector<std::pair<uint, DatVerifier::Result>> failures;
+    for (uint file_num = 0; file_num < dat_file.numFiles(); file_num++) {
+        auto entry_num = file_num + dat_file.mftFileOffset();
+        if (!dat_file.isEntryInUse(entry_num)) {
+            continue;
+        }
+        uint64 offset;
+        uint size;
+        if (!dat_file.entryLocation(entry_num, offset, size)) {
+            failures.emplace_back(entry_num, DatVerifier::VR_Unreadable);
+            continue;
+        }
+        entries.push_back(VerifyEntry{offset, entry_num, size});
+    }
+    std::sort(entries.begin(), entries.end(), [](const VerifyEntry &a, const VerifyEntry &b) {
+        return a.offset < b.offset;
+    });
+
+    std::atomic<uint> num_done(0);
+    std::atomic<uint64> bytes_done(0);
+    std::mutex failures_mutex;
+    auto verify_start = std::chrono::steady_clock::now();
+
+    auto verify = std::thread([&] {
+#pragma omp parallel for schedule(dynamic, 16)
+        for (int e = 0; e < static_cast<int>(entries.size()); e++) {
+            auto result = verifier.verifyEntry(entries[e].entry_num);
+            if (result != DatVerifier::VR_Ok) {
+                std::lock_guard<std::mutex> lock(failures_mutex);
+                failures.emplace_back(entries[e].entry_num, result);
+            }
+            bytes_done += entries[e].size;
+            num_done++;
+        }
+    });
+
+    {
+        std::future<void> future = std::async(std::launch::async, [&]() {
+            if (verify.joinable()) verify.join();
+        });
+        for (;;) {
+            if (future.wait_for(1s) == std::future_status::ready) {
+                break;
+            }
+
+            std::printf("Verify   %7u / %7u\n", num_done.load(), static_cast<uint>(entries.size()));
+        }
+    }
+    std::chrono::duration<double> verify_time = std::chrono::steady_clock::now() - verify_start;
+    auto seconds = std::max(verify_time.count(), 0.001);
+
+    std::sort(failures.begin(), failures.end());
+    for (const auto &failure : failures) {
+        std::printf("FAILED  entry %7u  file id %7u  %s\n", failure.first, dat_file.fileIdFromEntryNum(failure.first),
+                    DatVerifier::resultName(failure.second));
+    }
+    std::printf("Verify      Done in %.2fs: %u entries, %.1f MB/s, %.0f entries/s, %u failed (%s)\n",
+                verify_time.count(), num_done.load(), bytes_done.load() / (1024.0 * 1024.0) / seconds,
+                num_done.load() / seconds, static_cast<uint>(failures.size()),
+                dat_file.readBackend() == DatFile::RB_MemoryMap ? "mmap" : "file");
+
+    return failures.empty() ? 0 : 2;
+}
+
+int compareInflaters(const DatFile &dat_file) {
+    const uint peek_size = 4096;
+
+    // Compressed entries in the order they are stored in
+    std::vector<std::pair<uint64, uint>> entries;
+    for (uint file_num = 0; file_num < dat_file.numFiles(); file_num++) {
+        auto entry_num = file_num + dat_file.mftFileOffset();
+        uint64 offset;
+        uint size;
+        if (dat_file.isEntryCompressed(entry_num) && dat_file.entryLocation(entry_num, offset, size)) {
+            entries.emplace_back(offset, entry_num);
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+
+    // What one implementation made of the entry at hand
+    struct InflateRun {
+        Array<byte> output;
+        uint32 size;
+        bool succeeded;
+    };
+    const DatInflater::Implementation implementations[] = {DatInflater::DI_Gw2DatTools, DatInflater::DI_Builtin};
+    InflateRun runs[2];
+    InflateRun texture_runs[2];
+    double seconds[2] = {0, 0};
+    double texture_seconds[2] = {0, 0};
+    uint64 bytes_done = 0;
+    uint64 texture_bytes_done = 0;
+    uint num_done = 0;
+    uint num_textures = 0;
+    std::vector<std::pair<uint, const char *>> mismatches;
+
+    auto timed_inflate = [](InflateRun &p_run, uint32 p_output_size, double &p_seconds,
+                            const std::function<void(uint32 &, byte *)> &p_inflate) {
+        if (p_run.output.GetSize() < p_output_size) {
+            p_run.output.SetSize(p_output_size);
+        }
+        p_run.size = p_output_size;
+        auto start = std::chrono::steady_clock::now();
+        try {
+            p_inflate(p_run.size, p_run.output.GetPointer());
+            p_run.succeeded = true;
+        } catch (const exception::Exception &) {
+            p_run.succeeded = false;
+        }
+        p_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    };
+    // Why the runs of both implementations differ, nullptr if they do not
+    auto difference = [](const InflateRun *p_runs, const char *p_what) -> const char * {
+        if (p_runs[0].succeeded != p_runs[1].succeeded) {
+            return !p_runs[0].succeeded ? "only gw2dattools failed" : "only builtin failed";
+        }
+        if (p_runs[0].succeeded && (p_runs[0].size != p_runs[1].size ||
+                                    ::memcmp(p_runs[0].output.GetPointer(), p_runs[1].output.GetPointer(), p_runs[0].size))) {
+            return p_what;
+        }
+        return nullptr;
+    };
+
+    auto last_progress = std::chrono::steady_clock::now();
+    for (size_t e = 0; e < entries.size(); e++) {
+        auto entry_num = entries[e].second;
+        auto raw = dat_file.viewRawEntry(entry_num);
+        auto input = raw.contiguousRange(0, raw.size());
+        if (!input || raw.size() < 8) {
+            mismatches.emplace_back(entry_num, "unreadable");
+            continue;
+        }
+        uint32 size;
+        ::memcpy(&size, input + 4, sizeof(size));
+
+        // Alternate which one goes first, so neither always gets the input
+        // from the CPU cache
+        for (int i = 0; size && i < 2; i++) {
+            auto index = (e + i) % 2;
+            timed_inflate(runs[index], size, seconds[index], [&](uint32 &io_size, byte *po_output) {
+                DatInflater::inflate(raw.size(), input, io_size, po_output, implementations[index]);
+            });
+        }
+        auto reason = size ? difference(runs, "output differs") : nullptr;
+
+        // Compare the textures in the entries both inflated the same
+        TextureInflater::Info info;
+        auto data = runs[0].output.GetPointer();
+        if (size && !reason && runs[0].succeeded && runs[0].size >= 4 &&
+            *reinterpret_cast<const uint32 *>(data) == FCC_ATEX && TextureInflater::readInfo(data, runs[0].size, info)) {
+            for (int i = 0; i < 2; i++) {
+                auto index = (e + i) % 2;
+                timed_inflate(texture_runs[index], info.outputSize, texture_seconds[index], [&](uint32 &io_size, byte *po_output) {
+                    TextureInflater::inflate(runs[0].size, data, io_size, po_output, implementations[index]);
+                });
+            }
+            reason = difference(texture_runs, "texture differs");
+            texture_bytes_done += info.outputSize;
+            num_textures++;
+        }
+
+        // Peeking stops early, which has its own paths through the inflaters
+        if (!reason && size > peek_size) {
+            for (int i = 0; i < 2; i++) {
+                timed_inflate(runs[i], peek_size, seconds[i], [&](uint32 &io_size, byte *po_output) {
+                    DatInflater::inflate(raw.size(), input, io_size, po_output, implementations[i]);
+                });
+            }
+            reason = difference(runs, "peek differs");
+        }
+        if (reason) {
+            mismatches.emplace_back(entry_num, reason);
+        }
+        dat_file.releaseEntry(entry_num);
+
+        bytes_done += size;
+        num_done++;
+        if (std::chrono::steady_clock::now() - last_progress >= 1s) {
+            last_progress = std::chrono::steady_clock::now();
+            std::printf("Compare  %7u / %7u\n", num_done, static_cast<uint>(entries.size()));
+        }
+    }
+
+    for (const auto &mismatch : mismatches) {
+        std::printf("MISMATCH  entry %7u  file id %7u  %s\n", mismatch.first,
+                    dat_file.fileIdFromEntryNum(mismatch.first), mismatch.second);
+    }
+    // Peeks are timed too, but are small next to the full entries
+    for (int i = 0; i < 2; i++) {
+        std::printf("Inflate  %-12s %.2fs, %.1f MB/s\n", DatInflater::implementationName(implementations[i]),
+                    seconds[i], bytes_done / (1024.0 * 1024.0) / std::max(seconds[i], 0.001));
+    }
+    for (int i = 0; num_textures && i < 2; i++) {
+        std::printf("Texture  %-12s %.2fs, %.1f MB/s\n", DatInflater::implementationName(implementations[i]),
+                    texture_seconds[i], texture_bytes_done / (1024.0 * 1024.0) / std::max(texture_seconds[i], 0.001));
+    }
+    std::printf("Compare     Done: %u entries, %u textures, builtin is %.2fx / %.2fx as fast, %u mismatches\n",
+                num_done, num_textures, seconds[0] / std::max(seconds[1], 0.001),
+                texture_seconds[0] / std::max(texture_seconds[1], 0.001), static_cast<uint>(mismatches.size()));
+
+    return mismatches.empty() ? 0 : 2;
+}
+
+// Writes the entries as they are stored, a window at a time, so memory use
+// does not grow with the size of the entries
+int exportRaw(const DatFile &dat_file, const Array<const DatIndexEntry *> &entries, uint count, const wxString &out_dir) {
+    // Export in .dat order, so the disk is mostly read front to back
+    std::vector<std::pair<uint64, uint>> order;
+    order.reserve(count);
+    for (uint idx = 0; idx < count; idx++) {
+        uint64 offset = 0;
+        uint size;
+        dat_file.entryLocation(entries[idx]->mftEntry() + dat_file.mftFileOffset(), offset, size);
+        order.emplace_back(offset, idx);
+    }
+    std::sort(order.begin(), order.end());
+
+    std::mutex mutex_dir;
+    std::atomic<size_t> next(0);
+    std::atomic<uint> done(0);
+    std::atomic<uint> failed(0);
+    ExportDeduplicator deduplicator;
+    auto export_start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (uint t = 0; t < std::max(1u, std::thread::hardware_concurrency()); t++) {
+        workers.emplace_back([&] {
+            for (size_t idx; (idx = next++) < order.size();) {
+                auto entry = entries[order[idx].second];
+                auto entry_file_name = wxFileName();
+                entry_file_name.SetPath(out_dir);
+                entry_file_name.SetName(entry->name());
+                entry_file_name.SetExt(wxT("raw"));
+                appendPaths(entry_file_name, *entry->category());
+                {
+                    std::lock_guard<std::mutex> lock(mutex_dir);
+                    if (!entry_file_name.DirExists()) {
+                        entry_file_name.Mkdir(511, wxPATH_MKDIR_FULL);
+                    }
+                }
+
+                // Entries known to hold the data of an earlier one are linked to it later
+                auto path = entry_file_name.GetFullPath();
+                if (entry->uncompressedSize() && !deduplicator.claim(entry->contentHash(), entry->uncompressedSize(), path)) {
+                    done++;
+                    continue;
+                }
+
+                wxFile file(path, wxFile::write);
+                XxHash64 hash;
+                uint64 size = 0;
+                bool written = file.IsOpened() &&
+                               dat_file.streamFile(entry->mftEntry(), [&file, &hash, &size](const byte *p_data, uint p_size) {
+                                   hash.update(p_data, p_size);
+                                   size += p_size;
+                                   return file.Write(p_data, p_size) == p_size;
+                               });
+                file.Close();
+                if (!written) {
+                    std::fprintf(stderr, "Failed to export file: %s\n", entry_file_name.GetFullName().c_str().AsChar());
+                    failed++;
+                } else if (!entry->contentHash()) {
+                    entry->cacheContentHash(hash.digest());
+                    if (!deduplicator.claim(entry->contentHash(), size, path)) {
+                        wxRemoveFile(path);
+                    }
+                }
+                done++;
+            }
+        });
+    }
+
+    {
+        std::future<void> future = std::async(std::launch::async, [&]() {
+            for (auto &worker : workers) {
+                worker.join();
+            }
+        });
+        for (;;) {
+            if (future.wait_for(1s) == std::future_status::ready) {
+                break;
+            }
+
+            std::printf("Export   %7u / %7u\n", done.load(), count);
+        }
+    }
+    auto duplicates = deduplicator.numDuplicates();
+    failed += deduplicator.linkDuplicates();
+    std::chrono::duration<double> export_time = std::chrono::steady_clock::now() - export_start;
+    std::printf("Export      Done in %.2fs, %u raw files, %u duplicates linked, %u failed\n", export_time.count(),
+                done.load(), duplicates, failed.load());
+
+    return failed.load() ? 1 : 0;
+}
+
 int main(int argc, char **argv) {
-    if (argc < 3) {
+    std::vector<std::string> paths;
+    std::vector<std::string> options;
+    for (auto a = 1; a < argc; a++) {
+        auto arg = std::string(argv[a]);
+        (arg.compare(0, 2, "--") == 0 ? options : paths).push_back(arg);
+    }
+
+    bool verify_only = std::find(options.begin(), options.end(), "--verify") != options.end();
+    bool compare_only = std::find(options.begin(), options.end(), "--compare-inflaters") != options.end();
+    bool raw = std::find(options.begin(), options.end(), "--raw") != options.end();
+    if (paths.size() != (verify_only || compare_only ? 1u : 2u)) {
         std::cerr << "2 arguments are expected: dat file path followed by output directory" << std::endl;
+        std::cerr << "optional: --backend=mmap|file to choose how the dat file is read" << std::endl;
+        std::cerr << "          --cache=<MB> to cache decompressed entries" << std::endl;
+        std::cerr << "          --verify to check every entry of the dat file instead, without an output directory"
+                  << std::endl;
+        std::cerr << "          --inflater=gw2dattools|builtin to choose how compressed entries and textures are inflated"
+                  << std::endl;
+        std::cerr << "          --raw to write the entries as they are stored instead of converting them"
+                  << std::endl;
+        std::cerr << "          --min-texture-size=<pixels> to only export textures at least that wide and high,"
+                  << " going by the index, textures of unknown size are kept" << std::endl;
+        std::cerr << "          --compare-inflaters to check both inflaters give the same output and time them,"
+                  << " without an output directory" << std::endl;
         return 1;
     }
 
-    auto dat_path = wxString::FromUTF8Unchecked(argv[1]);
-    auto out_dir = wxString::FromUTF8Unchecked(argv[2]);
+    auto dat_path = wxString::FromUTF8Unchecked(paths[0].c_str());
+    auto out_dir = verify_only || compare_only ? wxString() : wxString::FromUTF8Unchecked(paths[1].c_str());
+
+    auto backend = DatFile::RB_MemoryMap;
+    size_t cache_budget = 0;
+    unsigned long min_texture_size = 0;
+    auto inflater = DatInflater::DI_Gw2DatTools;
+    for (const auto &arg : options) {
+        if (arg == "--verify" || arg == "--compare-inflaters" || arg == "--raw") {
+            continue;
+        } else if (arg == "--backend=file") {
+            backend = DatFile::RB_File;
+        } else if (arg == "--backend=mmap") {
+            backend = DatFile::RB_MemoryMap;
+        } else if (arg.compare(0, 8, "--cache=") == 0) {
+            unsigned long megabytes;
+            if (!parseOptionValue(arg, 8, megabytes)) {
+                std::cerr << "Invalid cache size: " << arg << std::endl;
+                return 1;
+            }
+            cache_budget = static_cast<size_t>(megabytes) * 1024 * 1024;
+        } else if (arg.compare(0, 19, "--min-texture-size=") == 0) {
+            if (!parseOptionValue(arg, 19, min_texture_size)) {
+                std::cerr << "Invalid texture size: " << arg << std::endl;
+                return 1;
+            }
+        } else if (arg == "--inflater=gw2dattools") {
+            inflater = DatInflater::DI_Gw2DatTools;
+        } else if (arg == "--inflater=builtin") {
+            inflater = DatInflater::DI_Builtin;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
 
-    auto dat_file = DatFile();
+    auto dat_file = DatFile(backend);
     if (!dat_file.open(dat_path)) {
         std::fprintf(stderr, "Failed to open file: %s\n", dat_path.c_str().AsChar());
         return 1;
     }
+    dat_file.setCacheBudget(cache_budget);
+    dat_file.setInflater(inflater);
+    // Exports and verification read every entry once, keep them out of the page cache
+    dat_file.setIoPolicy(DatFile::IP_Streaming);
+
+    if (verify_only) {
+        return verifyDat(dat_file);
+    }
+    if (compare_only) {
+        return compareInflaters(dat_file);
+    }
 
     auto index = std::make_shared<DatIndex>();
     auto dat_ts = wxFileModificationTime(dat_path);
 
+    // An index of an older .dat is still read, the scan only redoes what changed
     DatIndexReader indexReader(*index);
-    if (!indexReader.open(wxString("gw2dat.idx")) || index->datTimestamp() != dat_ts) {
-        auto scan_dat = ScanDatTask(index, dat_file);
+    auto index_read = indexReader.open(wxString("gw2dat.idx")) && (indexReader.read(100000000) & DatIndexReader::RR_Success);
+    if (!index_read) {
+        index->clear();
+    }
+    // A scan that was killed resumes from its journal
+    auto is_written = false;
+    if (!index_read || index->datTimestamp() != dat_ts) {
+        // The scan reads through a pool of its own, no previews compete with it here
+        AsyncDatReader scan_reader(dat_file);
+        auto scan_dat = ScanDatTask(index, dat_file, scan_reader, dat_ts, wxString("gw2dat.jnl"));
 
         if (!scan_dat.init()) {
             std::cerr << "failed to initialize read dat task" << std::endl;
             return 1;
         }
-        index->setDatTimestamp(dat_ts);
 
         auto thr = std::thread([&] {
+            // Nothing listens to the index here, so results can be committed right away
             while (!scan_dat.isDone()) {
                 scan_dat.perform();
+                scan_dat.commit();
             }
         });
 
@@ -221,11 +648,20 @@ int main(int argc, char **argv) {
         }
         std::cout << "Scan Dat    Done" << std::endl;
 
-        DatIndexWriter indexWriter(*index);
-        indexWriter.open(wxString("gw2dat.idx"));
-        indexWriter.write(100000000);
+        is_written = writeIndex(*index);
+    } else if (index->isDirty()) {
+        // An index in the old format is converted once
+        is_written = writeIndex(*index);
+    }
+    if (is_written) {
+        wxRemoveFile(wxString("gw2dat.jnl"));
+    }
+    for (uint i = 0; i < index->numEntries(); i++) {
+        auto entry = index->entry(i);
+        if (entry->uncompressedSize()) {
+            dat_file.cacheFileSize(entry->mftEntry(), entry->uncompressedSize());
+        }
     }
-    indexReader.read(100000000);
 
     auto textures = index->findCategory(wxString("Textures"));
     auto ui = textures->findSubCategory(wxString("UI Textures"));
@@ -233,148 +669,194 @@ int main(int argc, char **argv) {
     auto entries = Array<const DatIndexEntry *>(ui->numEntries(true));
     uint max = 0;
     addCategoryEntriesToArray(entries, max, *ui);
-    wxInitAllImageHandlers();
 
-    std::mutex mutex_index;
-    std::mutex mutex_dir;
-    uint i = 0;
-
-    auto num_threads = std::thread::hardware_concurrency();
-    std::vector<std::thread> threads;
-    for (auto t = 0; t < num_threads; t++) {
-        threads.emplace_back([&] {
-            auto dat_file = DatFile();
-            if (!dat_file.open(dat_path)) {
-                std::fprintf(stderr, "Failed to open file: %s\n", dat_path.c_str().AsChar());
-                std::exit(1);
+    // The scan kept the dimensions in the index, so filtering reads nothing
+    if (min_texture_size) {
+        uint kept = 0;
+        for (uint idx = 0; idx < max; idx++) {
+            const auto &metadata = entries[idx]->metadata();
+            bool is_known = metadata.width && metadata.height;
+            if (!is_known || (metadata.width >= min_texture_size && metadata.height >= min_texture_size)) {
+                entries[kept++] = entries[idx];
             }
+        }
+        std::printf("Filter      %u of %u textures kept\n", kept, max);
+        max = kept;
+    }
 
-            for (i = 0; i < max; i++) {
-                uint idx;
-                {
-                    std::lock_guard<std::mutex> lock(mutex_index);
-                    if (i >= max) {
-                        break;
-                    }
-                    idx = i++;
-                }
-
-                auto entry = entries[idx];
-
-                auto entry_file_name = wxFileName();
-                auto file_type = entry->fileType();
-                auto ext = extension(file_type);
-
-                // Set file path
-                entry_file_name.SetPath(out_dir);
-                // Set file name
-                entry_file_name.SetName(entry->name());
-                // Set file extension
-                entry_file_name.SetExt(wxString(ext));
-
-
+    // Hashes found while exporting let the next export skip the duplicates unread
+    auto hashed_before = countHashed(entries, max);
+    auto save_hashes = [&] {
+        if (countHashed(entries, max) != hashed_before) {
+            writeIndex(*index);
+        }
+    };
+    if (raw) {
+        auto result = exportRaw(dat_file, entries, max, out_dir);
+        save_hashes();
+        return result;
+    }
+    wxInitAllImageHandlers();
 
-                // Appen category name as path
-                appendPaths(entry_file_name, *entry->category());
+    std::mutex mutex_dir;
+    std::atomic<uint> i(0);
+    ExportDeduplicator deduplicator;
+
+    // Sets the path an entry is exported to, and creates its directory
+    auto set_entry_path = [&](const DatIndexEntry *entry, wxFileName &entry_file_name) {
+        entry_file_name.SetPath(out_dir);
+        entry_file_name.SetName(entry->name());
+        entry_file_name.SetExt(wxString(extension(entry->fileType())));
+        appendPaths(entry_file_name, *entry->category());
+
+        std::lock_guard<std::mutex> lock(mutex_dir);
+        if (!entry_file_name.DirExists()) {
+            entry_file_name.Mkdir(511, wxPATH_MKDIR_FULL);
+        }
+    };
+
+    auto export_entry = [&](const DatIndexEntry *entry, Array<byte> entryData) {
+        auto entry_file_name = wxFileName();
+        auto file_type = entry->fileType();
+        auto ext = extension(file_type);
+        set_entry_path(entry, entry_file_name);
+
+        // Valid data?
+        if (!entryData.GetSize()) {
+            std::fprintf(stderr, "Failed to read file: %s\n", entry_file_name.GetFullName().c_str().AsChar());
+            std::exit(1);
+        }
 
-                // Create directory if not exist
-                {
-                    std::lock_guard<std::mutex> lock(mutex_dir);
-                    if (!entry_file_name.DirExists()) {
-                        entry_file_name.Mkdir(511, wxPATH_MKDIR_FULL);
-                    }
-                }
+        // Skip it if an earlier entry had the same data, it is linked to that one later
+        if (!entry->contentHash()) {
+            entry->cacheContentHash(xxHash64(entryData.GetPointer(), entryData.GetSize()));
+            if (!deduplicator.claim(entry->contentHash(), entryData.GetSize(), entry_file_name.GetFullPath())) {
+                i++;
+                return;
+            }
+        }
 
-                auto entryData = dat_file.readFile(entry->mftEntry());
-                // Valid data?
-                if (!entryData.GetSize()) {
-                    std::fprintf(stderr, "Failed to read file: %s\n", entry_file_name.GetFullName().c_str().AsChar());
+        entry_file_name.SetExt(wxString(ext));
+
+        // Identify file type
+        dat_file.identifyFileType(entryData.GetPointer(), entryData.GetSize(), file_type);
+
+        auto reader = FileReader::readerForData(entryData, dat_file, file_type);
+
+        if (reader) {
+
+            switch (file_type) {
+                case ANFT_ATEX:
+                case ANFT_ATTX:
+                case ANFT_ATEC:
+                case ANFT_ATEP:
+                case ANFT_ATEU:
+                case ANFT_ATET:
+                case ANFT_DDS:
+                case ANFT_JPEG:
+                case ANFT_WEBP:
+                    exportImage(reader, entry->name(), entry_file_name);
+                    break;
+                case ANFT_StringFile:
+                    std::cerr << "string" << std::endl;
+                    //exportString( reader, entry->name( ), entry_file_name );
                     std::exit(1);
-                }
+                    break;
+                case ANFT_EULA:
+                    std::cerr << "eula" << std::endl;
+                    //exportEula( reader, entry->name( ), entry_file_name );
+                    std::exit(1);
+                    break;
+                case ANFT_PackedMP3:
+                case ANFT_PackedOgg:
+                case ANFT_asndMP3:
+                    exportSound(reader, entry->name(), file_type, entry_file_name);
+                    break;
+                case ANFT_Bank:
+                    std::cerr << "bank" << std::endl;
+                    //exportSoundBank( reader, entry->name( ), entry_file_name );
+                    std::exit(1);
+                    break;
+                case ANFT_Model:
+                    std::cerr << "model" << std::endl;
+                    //exportModel( reader, entry->name( ), entry_file_name );
+                    std::exit(1);
+                    break;
+                case ANFT_GameContent:
+                    std::cerr << "content" << std::endl;
+                    //exportGameContent( reader, entry->name( ), entry_file_name );
+                    std::exit(1);
+                    break;
+                case ANFT_BitmapFontFile:
+                    std::cerr << "font" << std::endl;
+                    //exportBitmapFont( reader, entry->name( ), entry_file_name );
+                    std::exit(1);
+                    break;
+                default:
+                    //entryData = reader->rawData( );
+                    writeFile(entryData, entry_file_name);
+                    break;
+            }
 
-                entry_file_name.SetExt(wxString(ext));
-
-                // Identify file type
-                dat_file.identifyFileType(entryData.GetPointer(), entryData.GetSize(), file_type);
-
-                auto reader = FileReader::readerForData(entryData, dat_file, file_type);
-
-                if (reader) {
-
-                    switch (file_type) {
-                        case ANFT_ATEX:
-                        case ANFT_ATTX:
-                        case ANFT_ATEC:
-                        case ANFT_ATEP:
-                        case ANFT_ATEU:
-                        case ANFT_ATET:
-                        case ANFT_DDS:
-                        case ANFT_JPEG:
-                        case ANFT_WEBP:
-                            exportImage(reader, entry->name(), entry_file_name);
-                            break;
-                        case ANFT_StringFile:
-                            std::cerr << "string" << std::endl;
-                            //exportString( reader, entry->name( ), entry_file_name );
-                            std::exit(1);
-                            break;
-                        case ANFT_EULA:
-                            std::cerr << "eula" << std::endl;
-                            //exportEula( reader, entry->name( ), entry_file_name );
-                            std::exit(1);
-                            break;
-                        case ANFT_PackedMP3:
-                        case ANFT_PackedOgg:
-                        case ANFT_asndMP3:
-                            exportSound(reader, entry->name(), file_type, entry_file_name);
-                            break;
-                        case ANFT_Bank:
-                            std::cerr << "bank" << std::endl;
-                            //exportSoundBank( reader, entry->name( ), entry_file_name );
-                            std::exit(1);
-                            break;
-                        case ANFT_Model:
-                            std::cerr << "model" << std::endl;
-                            //exportModel( reader, entry->name( ), entry_file_name );
-                            std::exit(1);
-                            break;
-                        case ANFT_GameContent:
-                            std::cerr << "content" << std::endl;
-                            //exportGameContent( reader, entry->name( ), entry_file_name );
-                            std::exit(1);
-                            break;
-                        case ANFT_BitmapFontFile:
-                            std::cerr << "font" << std::endl;
-                            //exportBitmapFont( reader, entry->name( ), entry_file_name );
-                            std::exit(1);
-                            break;
-                        default:
-                            //entryData = reader->rawData( );
-                            writeFile(entryData, entry_file_name);
-                            break;
-                    }
+            deletePointer(reader);
+        } else {
+            writeFile(entryData, entry_file_name);
+        }
+        i++;
+    };
 
-                    deletePointer(reader);
-                } else {
-                    writeFile(entryData, entry_file_name);
-                }
+    auto export_start = std::chrono::steady_clock::now();
+    auto num_threads = std::thread::hardware_concurrency();
+    // Keeps many reads in flight, the exports run on its worker threads. The
+    // entries are read in .dat order, not in category order.
+    AsyncDatReader async_reader(dat_file, num_threads, num_threads * 4);
+    auto feeder = std::thread([&] {
+        // Entries known to hold the data of an earlier one are not read at all
+        auto file_nums = Array<uint>(max);
+        auto to_read = std::vector<const DatIndexEntry *>();
+        for (uint idx = 0; idx < max; idx++) {
+            auto entry_file_name = wxFileName();
+            set_entry_path(entries[idx], entry_file_name);
+            if (entries[idx]->uncompressedSize() &&
+                !deduplicator.claim(entries[idx]->contentHash(), entries[idx]->uncompressedSize(), entry_file_name.GetFullPath())) {
+                i++;
+                continue;
             }
+            file_nums[to_read.size()] = entries[idx]->mftEntry();
+            to_read.push_back(entries[idx]);
+        }
+        async_reader.readFiles(file_nums.GetPointer(), to_read.size(), [&](size_t idx, Array<byte> data) {
+            export_entry(to_read[idx], std::move(data));
+            return true;
         });
-    }
+        async_reader.wait();
+    });
 
-    for (auto &thr: threads) {
+    {
         std::future<void> future = std::async(std::launch::async, [&]() {
-            if (thr.joinable()) thr.join();
+            if (feeder.joinable()) feeder.join();
         });
         for (;;) {
             if (future.wait_for(1s) == std::future_status::ready) {
                 break;
             }
 
-            std::printf("Export   %7u / %7u\n", i, max);
+            std::printf("Export   %7u / %7u\n", i.load(), max);
         }
     }
-    std::cout << "Export      Done" << std::endl;
+    auto duplicates = deduplicator.numDuplicates();
+    auto link_failed = deduplicator.linkDuplicates();
+    save_hashes();
+    std::chrono::duration<double> export_time = std::chrono::steady_clock::now() - export_start;
+    std::printf("Duplicates  %u linked, %u failed\n", duplicates - link_failed, link_failed);
+    std::printf("Export      Done in %.2fs (%s%s)\n", export_time.count(),
+                dat_file.readBackend() == DatFile::RB_MemoryMap ? "mmap" : "file",
+                async_reader.backend() == AsyncDatReader::AB_IoUring ? ", io_uring" : "");
+    if (dat_file.cache().isEnabled()) {
+        std::printf("Entry cache %llu hits, %llu misses\n",
+                    static_cast<unsigned long long>(dat_file.cache().hits()),
+                    static_cast<unsigned long long>(dat_file.cache().misses()));
+    }
 
     return 0;
 }